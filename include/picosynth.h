@@ -29,6 +29,7 @@
 #define PICOSYNTH_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef SAMPLE_RATE
@@ -60,6 +61,18 @@
 #error "PICOSYNTH_MAX_NODES must be <= 255 (uint8_t n_nodes)"
 #endif
 
+/* Constant-time render mode for hard realtime targets.
+ * When set to 1, picosynth_process() runs every voice and every wired node
+ * each sample, and uses branch-free envelope and silence-detection kernels,
+ * so per-block cost no longer depends on note activity. Inactive voices are
+ * computed and then masked out, so output matches the default mode except
+ * that idle noise oscillators still advance the noise generator.
+ * Trades average speed for a flat worst case (see tools/rtbench.c).
+ */
+#ifndef PICOSYNTH_CONSTANT_TIME
+#define PICOSYNTH_CONSTANT_TIME 0
+#endif
+
 /**
  * Q15 fixed-point: signed 16-bit, 15 fractional bits.
  * Range: [-1.0, +1.0) as [-32768, +32767].
@@ -74,11 +87,8 @@ typedef int8_t q7_t;
 /* Saturating cast from int32_t to q15_t */
 static inline q15_t q15_sat(int32_t x)
 {
-    if (x > Q15_MAX)
-        return Q15_MAX;
-    if (x < -32768)
-        return Q15_MIN;
-    return (q15_t) x;
+    x = x > Q15_MAX ? Q15_MAX : x;
+    return (q15_t) (x < -32768 ? -32768 : x);
 }
 
 /* Waveform generator function pointer */
@@ -148,6 +158,230 @@ typedef struct {
     const q15_t *in[3]; /* Input signal pointers (NULL = unused) */
 } picosynth_mixer_t;
 
+/* Summing bus state. The input and gain arrays belong to the caller and
+ * are read in place, so gains can be changed while playing.
+ */
+typedef struct {
+    const q15_t *const *in; /* Input signal pointers (NULL = unused) */
+    const q15_t *gains;     /* Per-input gains (NULL = unity) */
+    uint8_t count;          /* Entries in both arrays */
+} picosynth_sum_t;
+
+/* Additive partial bank, shared read-only by every node that plays it.
+ * Partial k runs at ratio[k] times the node's fundamental (Q16.16, so
+ * stretched inharmonic series are possible), starts at level amp[k] and
+ * halves every 1/rate[k] samples (rate in Q16.16 halvings per sample, 0
+ * for no decay). Use picosynth_partials_set() to fill it.
+ * Spectral nodes, whose cost does not grow with the partial count, can
+ * use banks of hundreds of partials: raise PICOSYNTH_ADDITIVE_MAX.
+ */
+#ifndef PICOSYNTH_ADDITIVE_MAX
+#define PICOSYNTH_ADDITIVE_MAX 32
+#endif
+
+#if PICOSYNTH_ADDITIVE_MAX > 65535
+#error "PICOSYNTH_ADDITIVE_MAX must be <= 65535 (uint16_t count)"
+#endif
+
+typedef struct {
+    uint16_t count; /* Partials in use */
+    uint32_t ratio[PICOSYNTH_ADDITIVE_MAX];
+    q15_t amp[PICOSYNTH_ADDITIVE_MAX];
+    uint32_t rate[PICOSYNTH_ADDITIVE_MAX];
+} picosynth_partials_t;
+
+/* Additive node state. Partials derive their phase from the node's single
+ * master phase (node state) and their decay from the time since note-on,
+ * so a node holds no per-partial state and one bank serves all voices.
+ */
+typedef struct {
+    const q15_t *freq;                /* Fundamental phase increment */
+    const picosynth_partials_t *bank; /* Partials to play */
+    uint32_t time;                    /* Samples since note-on */
+} picosynth_additive_t;
+
+/* Overlap-add inverse-FFT engine of one spectral node (opaque) */
+typedef struct picosynth_spectral picosynth_spectral_t;
+
+/* Spectral node state. Like the additive node, partial phases come from
+ * the master phase in the node state.
+ */
+typedef struct {
+    const q15_t *freq;                /* Fundamental phase increment */
+    const picosynth_partials_t *bank; /* Partials to play */
+    picosynth_spectral_t *engine;     /* Frame and overlap-add buffers */
+    uint32_t time;                    /* Samples since note-on */
+} picosynth_spectral_node_t;
+
+/* Plucked/struck string state (Karplus-Strong). A noise burst fills the
+ * delay line at note-on and circulates through a fractional delay and a
+ * two-tap loss filter, tuned so the loop period follows @freq.
+ */
+typedef struct {
+    const q15_t *freq;   /* Pitch (phase increment) */
+    const q15_t *excite; /* Optional signal fed into the loop */
+    q15_t *line;         /* Delay line, len samples */
+    uint16_t len;        /* Power of two */
+    uint16_t pos;        /* Next write index */
+    q15_t feedback;      /* Loop gain per period */
+    q15_t damping;       /* Loss filter: 0 = bright, Q15_MAX = darkest */
+    q15_t level;         /* Excitation burst level */
+} picosynth_string_t;
+
+/* Modulated delay line for chorus, flanger and echo. The write position
+ * is in node state; the output is the delayed (wet) signal only, so mix
+ * it with the dry signal in a mixer.
+ */
+typedef struct {
+    const q15_t *in;  /* Input signal */
+    const q15_t *mod; /* Delay modulation, e.g. an LFO (NULL = none) */
+    q15_t *line;      /* Delay line, len samples */
+    uint32_t time;    /* Delay, Q16.16 samples */
+    uint32_t depth;   /* Delay change at full-scale modulation, Q16.16 */
+    uint16_t len;     /* Power of two */
+    q15_t feedback;   /* Share of the output fed back into the line */
+    q15_t wet;        /* This sample's tap, for the feedback */
+} picosynth_delay_t;
+
+/* Loop behaviour of a sample */
+typedef enum {
+    PICOSYNTH_LOOP_NONE = 0, /* Play once, then fall silent */
+    PICOSYNTH_LOOP_ON,       /* Loop for as long as the voice sounds */
+    PICOSYNTH_LOOP_SUSTAIN,  /* Loop while the key is held, then play out */
+} picosynth_loop_t;
+
+/* A PCM sample, read in place: @data may point into flash or into a
+ * memory-mapped bank (see samplebank.h) and is shared by every node and
+ * instance that plays it. The loop is [loop_start, loop_end) and is
+ * ignored unless loop_start < loop_end <= len. A sample with @resident
+ * set holds only its first frames at @data; samplers play the rest from
+ * a stream (see picosynth_stream_t).
+ */
+typedef struct {
+    const q15_t *data;   /* len samples, mono */
+    uint32_t len;        /* Below 2^31 */
+    uint32_t loop_start; /* First sample of the loop */
+    uint32_t loop_end;   /* One past its last sample */
+    uint32_t rate;       /* Recording rate in Hz, tuning included */
+    uint8_t root;        /* MIDI note that plays at the recorded pitch */
+    uint8_t loop;        /* picosynth_loop_t */
+    uint32_t resident;   /* Samples at data when streamed (0 = all len) */
+} picosynth_sample_t;
+
+/* Ring that feeds one sampler node the streamed part of its samples */
+typedef struct picosynth_stream picosynth_stream_t;
+
+/* Sampler node state. The read position is in node state (whole samples)
+ * and frac; every note starts at the beginning of the sample. While a
+ * streamed sample plays, the position counts samples played since the
+ * start, with loops unrolled.
+ */
+typedef struct {
+    const q15_t *freq;                /* Note phase increment */
+    const picosynth_sample_t *sample; /* PCM to play (NULL = silent) */
+    uint32_t scale; /* Q16.16 step per unit of freq, from rate and root */
+    uint32_t frac;  /* Position fraction, Q16 */
+    picosynth_stream_t *stream; /* Source of streamed samples, or NULL */
+} picosynth_sampler_t;
+
+/* Modal resonator table, shared read-only by every modal node that uses
+ * it. Mode k is a two-pole resonator y = b1 y[-1] + b2 y[-2] + a0 x with
+ * coefficients in Q29; fill it with picosynth_modes_set().
+ */
+#ifndef PICOSYNTH_MODAL_MAX
+#define PICOSYNTH_MODAL_MAX 32
+#endif
+
+#if PICOSYNTH_MODAL_MAX > 65535
+#error "PICOSYNTH_MODAL_MAX must be <= 65535 (uint16_t count)"
+#endif
+
+typedef struct {
+    uint16_t count; /* Modes in use */
+    int32_t b1[PICOSYNTH_MODAL_MAX]; /* 2 r cos(w) */
+    int32_t b2[PICOSYNTH_MODAL_MAX]; /* -r^2 */
+    int32_t a0[PICOSYNTH_MODAL_MAX]; /* Input gain, gain * sin(w) */
+} picosynth_modes_t;
+
+/* Modal node state: the last two outputs of each mode, in Q23, stored as
+ * a row of y[-1] followed by a row of y[-2]
+ */
+typedef struct {
+    const q15_t *in;                /* Excitation input */
+    const picosynth_modes_t *modes; /* Resonators to run */
+    int32_t *y;                     /* 2 * count values */
+    uint16_t count;                 /* Modes with state in y */
+} picosynth_modal_t;
+
+/* Voices per unison node */
+#define PICOSYNTH_UNISON_MAX 16
+
+/* Unison (supersaw) oscillator state. Phases are in 1/2^32 cycles: voice
+ * k runs at the master phase (node state) plus (2k - count + 1) times the
+ * spread phase, which advances at the detune between neighbours, plus a
+ * fixed start offset. All voices thus come from two accumulators.
+ */
+typedef struct {
+    const q15_t *freq;          /* Centre phase increment */
+    picosynth_wave_func_t wave; /* Waveform of every voice */
+    uint8_t count;              /* Voices, 1..PICOSYNTH_UNISON_MAX */
+    q15_t phase;                /* Start phase spread */
+    uint32_t step;              /* Half the neighbour detune, Q31 of freq */
+    uint32_t spread;            /* Spread phase */
+} picosynth_unison_t;
+
+/* FM operator node state. The operator runs at ratio times the note
+ * (master phase in node state, as for additive nodes) or at a fixed rate
+ * from the time since note-on, plus a phase offset from the modulation
+ * input and from the average of its last two outputs.
+ */
+typedef struct {
+    const q15_t *freq; /* Note phase increment */
+    const q15_t *pm;   /* Phase modulation: full scale = +/- 2 cycles */
+    uint32_t ratio;    /* Q16.16 multiple of the note; 0 = fixed */
+    uint32_t fixed;    /* Fixed rate, 1/2^32 cycles per sample */
+    q15_t feedback;    /* Self-modulation depth */
+    uint32_t history;  /* Last two outputs, latest in the low half */
+    uint32_t time;     /* Samples since note-on */
+} picosynth_fm_op_t;
+
+/* Operators per FM algorithm node */
+#define PICOSYNTH_FM_OPS 6
+
+/* One operator of an FM patch. Levels decay like additive partials:
+ * halving every 1/rate samples (Q16.16, 0 = none).
+ */
+typedef struct {
+    uint32_t ratio; /* Q16.16 multiple of the note; 0 = fixed */
+    uint32_t fixed; /* Fixed rate, 1/2^32 cycles per sample */
+    q15_t level;    /* Output level, or modulation depth */
+    uint32_t rate;  /* Level halvings per sample */
+} picosynth_fm_operator_t;
+
+/* FM patch, shared read-only by every algorithm node that plays it.
+ * Operators run from the highest index down; op j modulates op k when bit
+ * j of mod[k] is set (only j > k counts), and carriers are summed into
+ * the output. Fill it with picosynth_fm_set_algorithm() and
+ * picosynth_fm_set_op().
+ */
+typedef struct {
+    uint8_t ops;                   /* Operators in use */
+    uint8_t mod[PICOSYNTH_FM_OPS]; /* Modulator masks */
+    uint8_t carriers;              /* Mask of operators heard */
+    uint8_t feedback_op;           /* Operator with self-modulation */
+    q15_t feedback;                /* Its depth */
+    picosynth_fm_operator_t op[PICOSYNTH_FM_OPS];
+} picosynth_fm_patch_t;
+
+/* FM algorithm node state; the master phase is in node state */
+typedef struct {
+    const q15_t *freq;                 /* Note phase increment */
+    const picosynth_fm_patch_t *patch; /* Operators and routing */
+    uint32_t history;                  /* Feedback operator's last two */
+    uint32_t time;                     /* Samples since note-on */
+    q15_t fb_next;                     /* Its output this sample */
+} picosynth_fm_t;
+
 /* Node types */
 typedef enum {
     PICOSYNTH_NODE_NONE = 0,
@@ -159,6 +393,16 @@ typedef enum {
     PICOSYNTH_NODE_SVF_LP, /* 2-pole SVF low-pass (-12dB/oct) */
     PICOSYNTH_NODE_SVF_HP, /* 2-pole SVF high-pass */
     PICOSYNTH_NODE_SVF_BP, /* 2-pole SVF band-pass */
+    PICOSYNTH_NODE_ADDITIVE, /* Bank of sine partials */
+    PICOSYNTH_NODE_SPECTRAL, /* Partials via inverse FFT */
+    PICOSYNTH_NODE_STRING,   /* Karplus-Strong string */
+    PICOSYNTH_NODE_MODAL,    /* Bank of two-pole resonators */
+    PICOSYNTH_NODE_UNISON,   /* Detuned oscillator stack */
+    PICOSYNTH_NODE_FM_OP,    /* Phase-modulated sine operator */
+    PICOSYNTH_NODE_FM,       /* Multi-operator FM algorithm */
+    PICOSYNTH_NODE_SUM,      /* N-input summing bus */
+    PICOSYNTH_NODE_DELAY,    /* Modulated delay line */
+    PICOSYNTH_NODE_SAMPLER,  /* PCM sample playback */
 } picosynth_node_type_t;
 
 /* Audio processing node */
@@ -173,6 +417,16 @@ typedef struct {
         picosynth_filter_t flt;
         picosynth_svf_t svf;
         picosynth_mixer_t mix;
+        picosynth_additive_t add;
+        picosynth_spectral_node_t spec;
+        picosynth_string_t str;
+        picosynth_modal_t modal;
+        picosynth_unison_t uni;
+        picosynth_fm_op_t fop;
+        picosynth_fm_t fm;
+        picosynth_sum_t sum;
+        picosynth_delay_t dly;
+        picosynth_sampler_t smp;
     };
 } picosynth_node_t;
 
@@ -204,6 +458,27 @@ void picosynth_note_on(picosynth_t *s, uint8_t voice, uint8_t note);
 /* Release note (starts envelope release phase) */
 void picosynth_note_off(picosynth_t *s, uint8_t voice);
 
+/* Seed the noise generator (0 selects the default seed). With @per_note set,
+ * each note-on reseeds that voice's own generator from @seed and the note
+ * number, so a note's noise no longer depends on what played before it.
+ * Segmented and cached renders need this to reproduce a sequential render
+ * exactly.
+ */
+void picosynth_set_noise_seed(picosynth_t *s, uint32_t seed, bool per_note);
+
+/* Give @s an arena of @size bytes for node buffers such as delay lines.
+ * With @buf NULL the arena is allocated and freed by picosynth_destroy();
+ * otherwise @buf is used and must outlive @s. Fails (returns false) once
+ * an arena is attached.
+ */
+bool picosynth_arena_init(picosynth_t *s, void *buf, size_t size);
+
+/* Carve @size bytes, 8-byte aligned, out of the arena of @s. Returns NULL
+ * when the arena is missing or exhausted. Blocks are released together
+ * with the instance.
+ */
+void *picosynth_arena_alloc(picosynth_t *s, size_t size);
+
 /* Convert MIDI note (0-127) to phase increment */
 q15_t picosynth_midi_to_freq(uint8_t note);
 
@@ -294,9 +569,551 @@ void picosynth_init_mix(picosynth_node_t *n,
                         const q15_t *in2,
                         const q15_t *in3);
 
+/* Initialize summing bus node: the sum of @count inputs, each scaled by
+ * its entry in @gains, accumulated at full precision and saturated once.
+ * Neither array is copied and both must outlive the node.
+ */
+void picosynth_init_sum(picosynth_node_t *n,
+                        const q15_t *gain,
+                        const q15_t *const *in,
+                        const q15_t *gains,
+                        uint8_t count);
+
+/* Initialize additive node playing @bank at fundamental @freq. Partials
+ * whose frequency reaches Nyquist are muted. The bank is not copied and
+ * must outlive the node.
+ */
+void picosynth_init_additive(picosynth_node_t *n,
+                             const q15_t *gain,
+                             const q15_t *freq,
+                             const picosynth_partials_t *bank);
+
+/* Set partial @k (< PICOSYNTH_ADDITIVE_MAX) of @bank to @ratio times the
+ * fundamental (Q16.16), level @amp, halving every @half_life_ms (0 = no
+ * decay). Grows bank->count to cover @k.
+ */
+void picosynth_partials_set(picosynth_partials_t *bank,
+                            uint16_t k,
+                            uint32_t ratio,
+                            q15_t amp,
+                            uint32_t half_life_ms);
+
+/* Q16.16 ratio of partial @k (1 = fundamental) of a stiff string with
+ * inharmonicity coefficient B = @b_ppm / 1e6: k * sqrt(1 + B * k^2)
+ */
+uint32_t picosynth_partial_ratio(uint16_t k, uint32_t b_ppm);
+
+/* Spectral engine sizes: 2^6 to 2^10 samples per frame */
+#define PICOSYNTH_SPECTRAL_MIN_LOG2 6
+#define PICOSYNTH_SPECTRAL_MAX_LOG2 10
+
+/* Create the engine for one spectral node, with frames of 2^@log2_size
+ * samples and a hop of a quarter frame. Returns NULL on failure or for a
+ * size outside PICOSYNTH_SPECTRAL_MIN_LOG2..PICOSYNTH_SPECTRAL_MAX_LOG2.
+ */
+picosynth_spectral_t *picosynth_spectral_create(uint8_t log2_size);
+
+/* Free a spectral engine */
+void picosynth_spectral_destroy(picosynth_spectral_t *sp);
+
+/* Initialize spectral node playing @bank at fundamental @freq through
+ * @engine, which must be used by this node only. Each hop the node adds
+ * every partial's window spectrum to a frame and overlap-adds its inverse
+ * FFT, so per-sample cost barely depends on the partial count. Pitch and
+ * partial levels are sampled once per hop, output lags the frequency
+ * input by half a frame and fades in over that time at note-on.
+ */
+void picosynth_init_spectral(picosynth_node_t *n,
+                             const q15_t *gain,
+                             const q15_t *freq,
+                             const picosynth_partials_t *bank,
+                             picosynth_spectral_t *engine);
+
+/* String parameters for picosynth_init_string() */
+typedef struct {
+    q15_t feedback; /* Loop gain per period (Q15_MAX = sustain longest) */
+    q15_t damping;  /* High-frequency loss: 0 = bright, Q15_MAX = dark */
+    q15_t level;    /* Excitation burst level */
+} picosynth_string_params_t;
+
+/* Delay line length, in samples, a string needs to play down to MIDI
+ * @note. Use with picosynth_arena_alloc(s, len * sizeof(q15_t)).
+ */
+uint16_t picosynth_string_len(uint8_t note);
+
+/* Initialize string node at pitch @freq on delay line @line of @len
+ * samples (rounded down to a power of two; see picosynth_string_len()).
+ * Lower pitches than the line can hold are played an octave up or more.
+ * The burst is seeded by the note number, so every note is reproducible.
+ */
+void picosynth_init_string(picosynth_node_t *n,
+                           const q15_t *gain,
+                           const q15_t *freq,
+                           q15_t *line,
+                           uint16_t len,
+                           const picosynth_string_params_t *params);
+
+/* Delay parameters for picosynth_init_delay() */
+typedef struct {
+    uint32_t time_us;  /* Delay time */
+    uint32_t depth_us; /* Swing either side at full-scale modulation */
+    q15_t feedback;    /* Output fed back: echoes and flanger resonance */
+} picosynth_delay_params_t;
+
+/* Delay line length, in samples, that holds @max_us of delay and
+ * modulation swing. Use with picosynth_arena_alloc(s, len * sizeof(q15_t)).
+ */
+uint16_t picosynth_delay_len(uint32_t max_us);
+
+/* Initialize delay node reading @in back through delay line @line of @len
+ * samples (rounded down to a power of two; see picosynth_delay_len()),
+ * with the delay time swung by @mod. Reads are linearly interpolated and
+ * the time is clamped to what the line holds. The line is cleared at
+ * note-on.
+ */
+void picosynth_init_delay(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *in,
+                          const q15_t *mod,
+                          q15_t *line,
+                          uint16_t len,
+                          const picosynth_delay_params_t *params);
+
+/* Initialize sampler node playing @sample at pitch @freq: the root note's
+ * pitch plays the sample at its recorded rate, others resample it with
+ * linear interpolation. The sample is not copied and must outlive the
+ * node.
+ */
+void picosynth_init_sampler(picosynth_node_t *n,
+                            const q15_t *gain,
+                            const q15_t *freq,
+                            const picosynth_sample_t *sample);
+
+/* Switch a sampler node to @sample, e.g. per key range before note-on.
+ * A note already playing continues from the same position.
+ */
+void picosynth_sampler_set(picosynth_node_t *n,
+                           const picosynth_sample_t *sample);
+
+/* Disk streaming for sampler nodes.
+ * A streamed sample keeps only its first frames in memory. Past them, or
+ * past its loop end if that comes first, a sampler node plays from its
+ * stream: a ring of frames in playback order, loops unrolled, that one
+ * other thread fills while the note plays (see samplestream.h). The node
+ * only reads the ring and publishes its position with atomics, so the
+ * audio thread never waits on I/O. When the next frame has not arrived it
+ * outputs silence, holds its position and counts an underrun.
+ *
+ * Each note-on restarts the stream for the node's sample. Set a streamed
+ * sample before note-on, not during a note. Releasing a sustain loop
+ * leaves the loop where the producer next reaches its end, at most a
+ * ring ahead of playback. Snapshots do not cover stream contents, and
+ * instance groups cannot use streams.
+ */
+
+/* Arena bytes taken by a stream of @frames (rounded up to a power of two) */
+size_t picosynth_stream_size(uint32_t frames);
+
+/* Allocate a stream of @frames, at least 2 and rounded up to a power of
+ * two, from the arena of @s. Returns NULL when the arena is missing or
+ * too small. Size it for the longest stall of the producer at the
+ * highest note played: the node can move several samples per output
+ * sample when transposing up. Frames already written keep playing after
+ * note-off, so a sustain loop can go on for up to a full ring before
+ * playing out: 8192 frames at SAMPLE_RATE is about 0.74 s.
+ */
+picosynth_stream_t *picosynth_stream_create(picosynth_t *s, uint32_t frames);
+
+/* Play the streamed part of samples on sampler @n from @st (NULL = none).
+ * Each stream feeds one node.
+ */
+void picosynth_sampler_set_stream(picosynth_node_t *n, picosynth_stream_t *st);
+
+/* Output samples lost waiting for frames since @st was created */
+uint32_t picosynth_stream_underruns(const picosynth_stream_t *st);
+
+/* Producer side, from one thread at a time. */
+
+/* Whether a note started since the last poll. If so, any frames written
+ * for the previous note are dropped and *@sample is set to the sample
+ * now playing, or NULL if it is not streamed. Write its samples from
+ * *@from in playback order.
+ */
+bool picosynth_stream_poll(picosynth_stream_t *st,
+                           const picosynth_sample_t **sample,
+                           uint32_t *from);
+
+/* Free space: *@n contiguous frames at the returned pointer (0 if full) */
+q15_t *picosynth_stream_reserve(picosynth_stream_t *st, uint32_t *n);
+
+/* Publish @n frames written at the pointer from picosynth_stream_reserve */
+void picosynth_stream_commit(picosynth_stream_t *st, uint32_t n);
+
+/* Mark the frames written so far as the whole note */
+void picosynth_stream_end(picosynth_stream_t *st);
+
+/* Whether the key of the current note was released: past that point a
+ * sustain loop plays out instead of wrapping
+ */
+bool picosynth_stream_released(const picosynth_stream_t *st);
+
+/* Set mode @k (< PICOSYNTH_MODAL_MAX) of @modes to resonate at @freq_hz
+ * (up to Nyquist), halving every @half_life_ms (at least one sample). A
+ * full-scale impulse rings the mode at level @gain. Grows modes->count to
+ * cover @k.
+ */
+void picosynth_modes_set(picosynth_modes_t *modes,
+                         uint16_t k,
+                         uint32_t freq_hz,
+                         uint32_t half_life_ms,
+                         q15_t gain);
+
+/* Initialize modal node filtering @in through every mode of @modes and
+ * summing them. @state holds the node's 2 * modes->count resonator
+ * values (e.g. from picosynth_arena_alloc()); modes added to the table
+ * later are ignored. The table is not copied and must outlive the node.
+ * Resonators are cleared at note-on.
+ */
+void picosynth_init_modal(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *in,
+                          const picosynth_modes_t *modes,
+                          int32_t *state);
+
+/* Unison parameters for picosynth_init_unison() */
+typedef struct {
+    uint8_t voices; /* 1..PICOSYNTH_UNISON_MAX (clamped) */
+    q15_t detune;   /* Outermost voices' offset, Q15 fraction of freq */
+    q15_t phase;    /* Start phase spread: 0 = aligned, Q15_MAX = full */
+} picosynth_unison_params_t;
+
+/* Initialize unison node: @params->voices copies of @wave spread evenly
+ * over +/- detune around @freq, summed and scaled by 1/sqrt(voices). Start
+ * phases are a fixed pattern scaled by @params->phase, so notes are
+ * reproducible; with aligned phases the voices add up coherently and
+ * saturate until they drift apart. One voice with no detune plays
+ * exactly like an oscillator.
+ */
+void picosynth_init_unison(picosynth_node_t *n,
+                           const q15_t *gain,
+                           const q15_t *freq,
+                           picosynth_wave_func_t wave,
+                           const picosynth_unison_params_t *params);
+
+/* FM operator parameters for picosynth_init_fm_op() */
+typedef struct {
+    uint32_t ratio;    /* Q16.16 multiple of the note (0 = use fixed_hz) */
+    uint32_t fixed_hz; /* Fixed frequency when ratio is 0 */
+    q15_t feedback;    /* Self-modulation depth */
+} picosynth_fm_op_params_t;
+
+/* Initialize FM operator node: a sine at @params->ratio times @freq (or
+ * at a fixed frequency), phase-modulated by @pm. Chain operators by
+ * wiring one's output to the next one's @pm; scale modulation depth with
+ * the modulator's @gain.
+ */
+void picosynth_init_fm_op(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *freq,
+                          const q15_t *pm,
+                          const picosynth_fm_op_params_t *params);
+
+/* Operator routings for picosynth_fm_set_algorithm(). Operator 0 is
+ * always a carrier and the highest operator has the feedback.
+ */
+typedef enum {
+    PICOSYNTH_FM_STACK4,  /* 3 > 2 > 1 > 0 */
+    PICOSYNTH_FM_PAIRS4,  /* 1 > 0, 3 > 2 */
+    PICOSYNTH_FM_BRANCH4, /* 1, 2 and 3 each > 0 */
+    PICOSYNTH_FM_ORGAN4,  /* 0, 1, 2, 3 all carriers */
+    PICOSYNTH_FM_DX1,     /* 1 > 0, 5 > 4 > 3 > 2 (DX7 algorithm 1) */
+    PICOSYNTH_FM_DX5,     /* 1 > 0, 3 > 2, 5 > 4 (DX7 algorithm 5) */
+} picosynth_fm_algorithm_t;
+
+/* Set the routing and operator count of @patch from @algo and its
+ * feedback depth to @feedback. Operator settings are kept. Returns false
+ * for an unknown algorithm.
+ */
+bool picosynth_fm_set_algorithm(picosynth_fm_patch_t *patch,
+                                picosynth_fm_algorithm_t algo,
+                                q15_t feedback);
+
+/* Set operator @k (< PICOSYNTH_FM_OPS) of @patch to @ratio times the note
+ * (Q16.16) or, with @ratio 0, to @fixed_hz, at level @level halving every
+ * @half_life_ms (0 = no decay)
+ */
+void picosynth_fm_set_op(picosynth_fm_patch_t *patch,
+                         uint8_t k,
+                         uint32_t ratio,
+                         uint32_t fixed_hz,
+                         q15_t level,
+                         uint32_t half_life_ms);
+
+/* Initialize FM algorithm node playing @patch at @freq. All operators run
+ * in one fused kernel; carriers are summed and divided by their number.
+ * The patch is not copied and must outlive the node.
+ */
+void picosynth_init_fm(picosynth_node_t *n,
+                       const q15_t *gain,
+                       const q15_t *freq,
+                       const picosynth_fm_patch_t *patch);
+
 /* Process one sample (mix all voices, apply soft clipping) */
 q15_t picosynth_process(picosynth_t *s);
 
+/* Render @n consecutive samples into @out (block form of picosynth_process) */
+void picosynth_render(picosynth_t *s, q15_t *out, uint32_t n);
+
+/* Render only the voices: @sum receives the raw sum of voice outputs per
+ * sample, plus the effect bus returns, before master gain, DC blocking and
+ * clipping. The master stage state is left untouched. Used to capture
+ * audio for later mixing.
+ */
+void picosynth_render_voices(picosynth_t *s, int32_t *sum, uint32_t n);
+
+/* Render @n samples, adding @premix[i] to the voice sum before the master
+ * stage. Audio captured with picosynth_render_voices() on a like-configured
+ * instance mixes in exactly as if its voices had played here.
+ */
+void picosynth_render_premix(picosynth_t *s,
+                             q15_t *out,
+                             const int32_t *premix,
+                             uint32_t n);
+
+/* Effect send buses.
+ * Each instance has PICOSYNTH_BUSES auxiliary buses. Every voice sends its
+ * output to each bus at its own level; the sends are summed into a bus
+ * buffer a block at a time, the bus's effect chain runs once over the
+ * block, and the result is added to the voice sum before the master stage.
+ * An effect is thus paid for once per instance rather than once per voice.
+ * Rendering works in blocks of up to PICOSYNTH_BUS_BLOCK samples;
+ * picosynth_process() runs the chain on a block of one.
+ */
+#ifndef PICOSYNTH_BUSES
+#define PICOSYNTH_BUSES 2
+#endif
+
+#if PICOSYNTH_BUSES < 1 || PICOSYNTH_BUSES > 8
+#error "PICOSYNTH_BUSES must be 1-8 (uint8_t bus mask)"
+#endif
+
+/* Effects per bus */
+#ifndef PICOSYNTH_BUS_EFFECTS
+#define PICOSYNTH_BUS_EFFECTS 4
+#endif
+
+/* Largest block an effect is handed */
+#ifndef PICOSYNTH_BUS_BLOCK
+#define PICOSYNTH_BUS_BLOCK 64
+#endif
+
+/* Bus effect: process @n samples of @buf in place. Samples are on the
+ * scale of the voice sum (a full-scale voice peaks at Q15_MAX) and may
+ * exceed Q15 range; the effect's own wet level is its output level.
+ */
+typedef void (*picosynth_effect_func_t)(void *ctx, int32_t *buf, uint32_t n);
+
+/* Set the level at which @voice sends to @bus (0 = none, the default).
+ * Returns false for an invalid voice or bus.
+ */
+bool picosynth_set_send(picosynth_t *s,
+                        uint8_t voice,
+                        uint8_t bus,
+                        q15_t level);
+
+/* Append @fx to the effect chain of @bus; @ctx is passed to every call and
+ * is owned by the caller. Returns false for an invalid bus or a full chain.
+ */
+bool picosynth_bus_add_effect(picosynth_t *s,
+                              uint8_t bus,
+                              picosynth_effect_func_t fx,
+                              void *ctx);
+
+/* Remove every effect from @bus. Sends are kept, so the bus then returns
+ * its input unprocessed.
+ */
+void picosynth_bus_clear(picosynth_t *s, uint8_t bus);
+
+/* Feedback-delay-network reverb for a send bus: eight delay lines of
+ * distinct prime lengths, mixed through a Hadamard matrix, with a
+ * low-pass in each loop. Lines and state live in the instance arena.
+ */
+typedef struct picosynth_reverb picosynth_reverb_t;
+
+typedef struct {
+    uint32_t memory;   /* Delay line bytes; longer lines = larger room */
+    uint32_t decay_ms; /* Time for the tail to fall by 60 dB */
+    q15_t damping;     /* High-frequency loss: 0 = bright, Q15_MAX = dark */
+    q15_t wet;         /* Output level */
+} picosynth_reverb_params_t;
+
+/* Arena bytes taken by a reverb with @memory bytes of delay lines */
+size_t picosynth_reverb_size(uint32_t memory);
+
+/* Allocate a reverb from the arena of @s. Returns NULL if the arena is
+ * missing or too small, or if @params->memory would make a line shorter
+ * than PICOSYNTH_BUS_BLOCK samples (under 1.4 KB at the default block).
+ */
+picosynth_reverb_t *picosynth_reverb_create(
+    picosynth_t *s,
+    const picosynth_reverb_params_t *params);
+
+/* Change decay, damping and level; memory is fixed at creation */
+void picosynth_reverb_set(picosynth_reverb_t *r,
+                          const picosynth_reverb_params_t *params);
+
+/* Bus effect (see picosynth_effect_func_t) with a reverb as @ctx. The
+ * buffer is replaced by the wet signal.
+ */
+void picosynth_reverb_process(void *ctx, int32_t *buf, uint32_t n);
+
+/* Convolution reverb for a send bus: the bus is convolved with a recorded
+ * impulse response by uniformly partitioned FFT convolution. The response
+ * is split into partitions of PICOSYNTH_BUS_BLOCK samples (which must then
+ * be a power of two of at most 512); each block of input costs one forward
+ * and one inverse FFT of two blocks plus one complex multiply-add per
+ * partition and bin, instead of one multiply-add per response sample and
+ * output sample. Output lags input by PICOSYNTH_BUS_BLOCK samples.
+ * Spectra live in the instance arena.
+ */
+typedef struct picosynth_conv picosynth_conv_t;
+
+/* Arena bytes taken by a convolver for a response of @ir_len samples */
+size_t picosynth_conv_size(uint32_t ir_len);
+
+/* Allocate a convolver from the arena of @s for the @ir_len samples of
+ * @ir, which is copied. Returns NULL if @ir is empty or the arena is
+ * missing or too small.
+ */
+picosynth_conv_t *picosynth_conv_create(picosynth_t *s,
+                                        const q15_t *ir,
+                                        uint32_t ir_len,
+                                        q15_t wet);
+
+/* Change the output level */
+void picosynth_conv_set_wet(picosynth_conv_t *c, q15_t wet);
+
+/* Bus effect (see picosynth_effect_func_t) with a convolver as @ctx. The
+ * buffer is replaced by the wet signal.
+ */
+void picosynth_conv_process(void *ctx, int32_t *buf, uint32_t n);
+
+/* Double-buffered output for DMA-driven audio peripherals.
+ * The DMA controller loops over one buffer of two halves and interrupts
+ * when it finishes each half; the handler (or a task it wakes) calls
+ * picosynth_dbuf_render() to refill the half just played while the
+ * hardware reads the other. Note events may be queued from one other
+ * context at any time and are applied at the start of the next half
+ * rendered, so an event sounds between one and two halves after it was
+ * queued, independent of where the DMA was when it arrived.
+ */
+typedef struct picosynth_dbuf picosynth_dbuf_t;
+
+/* Queued events per double buffer; must be a power of two */
+#ifndef PICOSYNTH_DBUF_EVENTS
+#define PICOSYNTH_DBUF_EVENTS 32
+#endif
+
+/* Attach a double buffer of two @half-sample halves to @s. @buf supplies
+ * 2 * @half samples (e.g. in DMA-capable memory), or NULL to allocate.
+ * The buffer starts silent. Returns NULL on failure.
+ */
+picosynth_dbuf_t *picosynth_dbuf_create(picosynth_t *s,
+                                        q15_t *buf,
+                                        uint32_t half);
+
+/* Free the double buffer (and the sample buffer if it was allocated) */
+void picosynth_dbuf_destroy(picosynth_dbuf_t *d);
+
+/* The 2 * half samples to hand to the DMA controller in circular mode */
+q15_t *picosynth_dbuf_buffer(picosynth_dbuf_t *d);
+
+/* Queue picosynth_note_on()/picosynth_note_off(). Returns false if the
+ * queue is full. Safe against a concurrent picosynth_dbuf_render().
+ */
+bool picosynth_dbuf_note_on(picosynth_dbuf_t *d, uint8_t voice, uint8_t note);
+bool picosynth_dbuf_note_off(picosynth_dbuf_t *d, uint8_t voice);
+
+/* Apply queued events, then render half @half (0: half-transfer interrupt,
+ * 1: transfer-complete). Halves are expected to alternate; a repeat means
+ * an interrupt was missed and is counted as an overrun.
+ */
+void picosynth_dbuf_render(picosynth_dbuf_t *d, uint8_t half);
+
+/* Number of missed halves since creation */
+uint32_t picosynth_dbuf_overruns(const picosynth_dbuf_t *d);
+
+/* Instance groups.
+ * A group renders many copies of one patch in a single call, for uses such
+ * as one small synth per sound emitter. Each member has its own voices,
+ * state, noise sequence and output, but members are stored side by side so
+ * every node kernel processes a run of members at once. The patch (node
+ * types, wiring and parameters) and the initial state are cloned from
+ * @proto when the group is created; later changes to @proto do not affect
+ * the group. Wiring to values outside @proto stays shared by all members.
+ */
+typedef struct picosynth_group picosynth_group_t;
+
+/* Clone @proto @count times. Returns NULL on failure, when @proto uses
+ * spectral, string, modal, summing bus or delay nodes or streamed
+ * samplers, whose buffers cannot be shared, or when any of its voices
+ * sends to an effect bus.
+ */
+picosynth_group_t *picosynth_group_create(const picosynth_t *proto,
+                                          uint16_t count);
+
+/* Free a group */
+void picosynth_group_destroy(picosynth_group_t *g);
+
+/* Number of members (0 if @g is NULL) */
+uint16_t picosynth_group_size(const picosynth_group_t *g);
+
+/* picosynth_note_on()/picosynth_note_off() for one member */
+void picosynth_group_note_on(picosynth_group_t *g,
+                             uint16_t member,
+                             uint8_t voice,
+                             uint8_t note);
+void picosynth_group_note_off(picosynth_group_t *g,
+                              uint16_t member,
+                              uint8_t voice);
+
+/* Reseed one member's noise; per-note seeding follows the prototype */
+void picosynth_group_set_noise_seed(picosynth_group_t *g,
+                                    uint16_t member,
+                                    uint32_t seed);
+
+/* Render @n samples of every member; member j writes @out[j] (a NULL entry
+ * renders without storing). Each member's output is identical to what a
+ * standalone instance receiving the same calls would produce.
+ */
+void picosynth_group_render(picosynth_group_t *g,
+                            q15_t *const *out,
+                            uint32_t n);
+
+/* State snapshots.
+ * A snapshot is a flat copy of all mutable state: note/gate/frequency per
+ * voice, oscillator phases, envelope levels, block and hold counters, filter
+ * accumulators and smoothed coefficients, DC blocker history and the noise
+ * seed. Node wiring and parameters are not included, so a snapshot can only
+ * be restored into an instance with the same voice/node layout (the instance
+ * it came from, or a fork built by the same setup code). Values read through
+ * external pointers (e.g. a detune offset owned by the caller) are not part of
+ * the snapshot.
+ */
+
+/* Size in bytes of a snapshot of @s (0 if @s is NULL) */
+size_t picosynth_snapshot_size(const picosynth_t *s);
+
+/* Copy the state of @s into @buf. Returns bytes written, 0 if @len is too
+ * small.
+ */
+size_t picosynth_snapshot_save(const picosynth_t *s, void *buf, size_t len);
+
+/* Load state saved by picosynth_snapshot_save(). Returns false, leaving @s
+ * untouched, if the buffer is truncated or was taken from a different layout.
+ */
+bool picosynth_snapshot_restore(picosynth_t *s, const void *buf, size_t len);
+
 /* Waveform generators. Input: phase [0, Q15_MAX]. Output: sample [-Q15_MAX,
  * Q15_MAX].
  */
@@ -0,0 +1,140 @@
+/**
+ * samplebank.h - Read-only PCM sample banks for the PicoSynth sampler node
+ *
+ * A bank is a file of 16-bit PCM that is memory-mapped rather than read:
+ * opening one parses the headers and builds a small table of
+ * picosynth_sample_t entries whose data pointers point straight into the
+ * mapping. No sample data is copied, pages are read from disk the first
+ * time a note touches them, and every voice, instance and process playing
+ * the bank shares the same page-cache memory. Banks in flash or other
+ * memory the caller keeps can be parsed in place the same way.
+ *
+ * Supported formats:
+ *   - WAV files of 16-bit mono PCM, with the root note, tuning and first
+ *     loop taken from a 'smpl' chunk when present (root 60 otherwise).
+ *     The bank holds one preset with one zone covering every key.
+ *   - SoundFont 2 banks. Presets, instruments and their zones are resolved
+ *     once at open: each zone becomes a key/velocity range with its own
+ *     sample entry (offsets, loop mode and tuning applied), volume
+ *     envelope, attenuation and low-pass filter. Modulators, LFOs, the
+ *     modulation envelope, delayVolEnv and scaleTuning are not used.
+ *     Compressed (SF3) and ROM samples are skipped.
+ *
+ * Usage:
+ *   bank_t bank;
+ *   if (bank_open(&bank, "piano.sf2") == BANK_OK) {
+ *       const bank_preset_t *p = bank_find_preset(&bank, 0, 0);
+ *       const bank_zone_t *z = bank_find_zone(&bank, p, note, 127);
+ *       if (z) {
+ *           bank_zone_init(&bank, z, env, smp, flt,
+ *                          picosynth_voice_freq_ptr(v));
+ *           picosynth_voice_set_out(v, flt_index);
+ *           picosynth_note_on(s, voice, note);
+ *       }
+ *       ...
+ *       bank_close(&bank); // After every instance using it is destroyed
+ *   }
+ */
+
+#ifndef SAMPLEBANK_H_
+#define SAMPLEBANK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "picosynth.h"
+
+/* Error codes */
+typedef enum {
+    BANK_OK = 0,
+    BANK_ERR_IO,     /* File could not be opened or mapped */
+    BANK_ERR_FORMAT, /* Not a supported bank, or malformed */
+    BANK_ERR_NOMEM,  /* Allocation failed */
+} bank_error_t;
+
+/* One key/velocity range of a preset and how to play it */
+typedef struct {
+    uint8_t key_lo, key_hi;        /* Inclusive MIDI key range */
+    uint8_t vel_lo, vel_hi;        /* Inclusive velocity range */
+    uint32_t sample;               /* Index into bank_t.samples */
+    picosynth_env_ms_params_t env; /* Volume envelope */
+    q15_t gain;                    /* Initial attenuation as a gain */
+    uint16_t cutoff_hz;            /* Low-pass cutoff, 0 = no filter */
+    q15_t q;                       /* SVF damping for the cutoff */
+} bank_zone_t;
+
+typedef struct {
+    char name[21];    /* NUL-terminated preset name */
+    uint16_t bank;    /* MIDI bank number */
+    uint16_t program; /* MIDI program number */
+    uint32_t zone;    /* First entry in bank_t.zones */
+    uint32_t zones;   /* Number of zones */
+} bank_preset_t;
+
+typedef struct {
+    const uint8_t *data;         /* Whole bank, read-only */
+    size_t size;                 /* Bytes at data */
+    picosynth_sample_t *samples; /* Sample table, pointing into data */
+    uint32_t count;              /* Entries in samples */
+    bank_zone_t *zones;          /* Zones of all presets */
+    uint32_t zone_count;         /* Entries in zones */
+    bank_preset_t *presets;      /* Presets in file order */
+    uint32_t preset_count;       /* Entries in presets */
+    bool mapped;                 /* data is a mapping owned by the bank */
+    int fd;                      /* The mapped file, or -1 */
+} bank_t;
+
+/* Parse the WAV file in @data (@size bytes) into @bank. @data is used in
+ * place and must outlive the bank; the sample data in it must be 2-byte
+ * aligned.
+ */
+bank_error_t bank_parse_wav(bank_t *bank, const void *data, size_t size);
+
+/* Parse the SoundFont 2 bank in @data (@size bytes) into @bank, with the
+ * same lifetime and alignment rules as bank_parse_wav()
+ */
+bank_error_t bank_parse_sf2(bank_t *bank, const void *data, size_t size);
+
+/* Memory-map the WAV or SoundFont 2 file at @path read-only and parse it
+ * into @bank
+ */
+bank_error_t bank_open(bank_t *bank, const char *path);
+
+/* Preset @program of MIDI bank @bank_num, or NULL */
+const bank_preset_t *bank_find_preset(const bank_t *bank,
+                                      uint16_t bank_num,
+                                      uint16_t program);
+
+/* First zone of @preset covering @note at @velocity, or NULL */
+const bank_zone_t *bank_find_zone(const bank_t *bank,
+                                  const bank_preset_t *preset,
+                                  uint8_t note,
+                                  uint8_t velocity);
+
+/* Set up a voice to play @zone before its note-on: @env becomes the
+ * zone's volume envelope, @smp a sampler of its sample at @freq scaled by
+ * @env, and @flt, when not NULL, its low-pass filter over @smp (a
+ * pass-through mixer for zones without one) so it can stay the voice
+ * output. Every zone wires the nodes the same way: set the voice output
+ * once, after the first call.
+ */
+void bank_zone_init(const bank_t *bank,
+                    const bank_zone_t *zone,
+                    picosynth_node_t *env,
+                    picosynth_node_t *smp,
+                    picosynth_node_t *flt,
+                    const q15_t *freq);
+
+/* Ask the kernel to start reading @zone's sample in the background, so a
+ * note about to play it does not fault pages in from disk. No-op for
+ * banks that are not mapped.
+ */
+void bank_prefetch(const bank_t *bank, const bank_zone_t *zone);
+
+/* Free the sample table and unmap and close the file. Nodes must no
+ * longer play the bank's samples, nor streams read from it.
+ */
+void bank_close(bank_t *bank);
+
+#endif /* SAMPLEBANK_H_ */
@@ -0,0 +1,107 @@
+/**
+ * samplestream.h - Disk streaming for the PicoSynth sampler node
+ *
+ * Long samples need not be resident. A streamed sample keeps only its
+ * first milliseconds in memory, copied out of the bank when it is set up.
+ * A background prefetch thread reads the rest from the bank file with
+ * pread() into per-voice rings (picosynth_stream_t) while notes play. The
+ * thread takes its own lock but the audio thread takes none: it only
+ * reads the rings, so a slow disk costs underruns (see
+ * picosynth_stream_underruns()), never a blocked audio callback.
+ *
+ * Usage:
+ *   bank_open(&bank, "strings.sf2");
+ *   stream_t *st = stream_create(2000); // Refill every 2 ms
+ *   stream_sample_t *ss = calloc(bank.count, sizeof(stream_sample_t));
+ *   for (uint32_t i = 0; i < bank.count; i++) {
+ *       stream_sample_init(&ss[i], &bank, i, 100); // 100 ms resident
+ *       stream_add_sample(st, &ss[i]);
+ *   }
+ *
+ *   picosynth_arena_init(s, NULL, voices * picosynth_stream_size(8192));
+ *   for (each voice's sampler node smp) {
+ *       picosynth_stream_t *ring = picosynth_stream_create(s, 8192);
+ *       picosynth_sampler_set_stream(smp, ring);
+ *       stream_add(st, ring);
+ *   }
+ *
+ *   // Per note, before picosynth_note_on()
+ *   picosynth_sampler_set(smp, &ss[zone->sample].sample);
+ *   ...
+ *   stream_destroy(st); // Before the synth and the bank go away
+ *
+ * A sustain loop is unrolled into the ring ahead of playback, so after
+ * note-off it keeps looping until the frames already written run out: up
+ * to a whole ring (see picosynth_stream_create()).
+ *
+ * Only WAV and SoundFont 2 banks from bank_open() can be streamed, as the
+ * frames are read from the bank file. Little-endian hosts only, like
+ * playing banks in place.
+ */
+
+#ifndef SAMPLESTREAM_H_
+#define SAMPLESTREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "picosynth.h"
+#include "samplebank.h"
+
+/* A bank sample with only its head resident */
+typedef struct {
+    picosynth_sample_t sample; /* What samplers play */
+    q15_t *head;               /* Resident frames, sample.data */
+    int fd;                    /* Bank file, -1 if not initialized */
+    off_t offset;              /* File offset of the first frame */
+} stream_sample_t;
+
+/* Prefetch thread and the rings it fills */
+typedef struct stream stream_t;
+
+/* Set up sample @index of @bank to stream, with the first @preload_ms
+ * (at the recording rate, at least one frame) resident. A sample shorter
+ * than that is copied whole and does not stream. The bank must stay open
+ * while the sample plays. Returns false if @bank was not opened from a
+ * file or memory runs out.
+ */
+bool stream_sample_init(stream_sample_t *ss,
+                        const bank_t *bank,
+                        uint32_t index,
+                        uint32_t preload_ms);
+
+/* Free the resident frames */
+void stream_sample_free(stream_sample_t *ss);
+
+/* Start a prefetch thread that tops up every ring each @period_us. With
+ * @period_us 0 no thread is started and the caller runs stream_service()
+ * itself. Returns NULL on failure.
+ */
+stream_t *stream_create(uint32_t period_us);
+
+/* Stop the thread and free @s; the rings stay with their synth */
+void stream_destroy(stream_t *s);
+
+/* Fill @ring for notes of registered samples from now on */
+bool stream_add(stream_t *s, picosynth_stream_t *ring);
+
+/* Register @ss, which must stay valid until @s is destroyed. Only frames
+ * of registered samples are read; a note of any other sample with
+ * frames left to stream counts as an error and stops after its resident
+ * frames. Returns false if @ss was not initialized or memory runs out.
+ */
+bool stream_add_sample(stream_t *s, const stream_sample_t *ss);
+
+/* Top up every ring once from the calling thread */
+void stream_service(stream_t *s);
+
+/* Underruns of every ring, summed */
+uint32_t stream_underruns(stream_t *s);
+
+/* Reads that failed or came up short, and notes of unregistered samples;
+ * each ends its note early
+ */
+uint32_t stream_errors(stream_t *s);
+
+#endif /* SAMPLESTREAM_H_ */
@@ -0,0 +1,182 @@
+/**
+ * song.h - Note sequences and offline player for PicoSynth
+ *
+ * Loads melodies (the "NOTE BEATS" text format read by tools/midi2c) and
+ * Standard MIDI Files into a flat list of note events timestamped in samples,
+ * and plays them through a picosynth_t with sample-accurate event timing.
+ * Voices are allocated by the player, one voice per sounding note.
+ *
+ * Usage:
+ *   song_t song;
+ *   if (song_load_file(&song, "melody.txt") == SONG_OK) {
+ *       picosynth_t *s = song_patch_create(&song_patch_piano, 8);
+ *       song_player_t p;
+ *       song_player_init(&p, s, &song_patch_piano, &song);
+ *       q15_t buf[256];
+ *       uint32_t n;
+ *       while ((n = song_player_render(&p, buf, 256)) > 0)
+ *           consume(buf, n);
+ *       picosynth_destroy(s);
+ *       song_free(&song);
+ *   }
+ */
+
+#ifndef SONG_H_
+#define SONG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "picosynth.h"
+
+/* Upper bound on voices driven by one player */
+#define SONG_MAX_VOICES 32
+
+/* Error codes */
+typedef enum {
+    SONG_OK = 0,
+    SONG_ERR_NOMEM, /* Allocation failed */
+    SONG_ERR_IO,    /* File could not be read */
+    SONG_ERR_PARSE, /* Malformed melody text */
+    SONG_ERR_MIDI,  /* Malformed or unsupported MIDI file */
+} song_error_t;
+
+/* Event types */
+typedef enum {
+    SONG_EVENT_NOTE_OFF = 0,
+    SONG_EVENT_NOTE_ON = 1,
+} song_event_type_t;
+
+/* Timestamped note event */
+typedef struct {
+    uint32_t time; /* Sample offset from song start */
+    uint8_t type;  /* song_event_type_t */
+    uint8_t note;  /* MIDI note number */
+} song_event_t;
+
+/* Note sequence. Events are sorted by time, note-offs first on ties. */
+typedef struct {
+    song_event_t *events;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t length; /* Time of the last event in samples */
+} song_t;
+
+/* Instrument patch: how to wire a voice and start a note on it */
+typedef struct {
+    const char *name;
+    uint8_t nodes;                         /* Nodes per voice */
+    void (*setup)(picosynth_voice_t *v);   /* Wire one voice */
+    void (*note_on)(picosynth_t *s,        /* Start a note (NULL selects */
+                    uint8_t voice,         /* picosynth_note_on) */
+                    uint8_t note);
+    uint32_t tail; /* Samples after note-off until the voice is silent */
+} song_patch_t;
+
+/* Built-in single-voice piano: fundamental and 2nd partial with separate
+ * decays, a hammer noise burst and a key-tracked low-pass filter.
+ */
+extern const song_patch_t song_patch_piano;
+
+/* Rendered-note cache. Each entry holds the output of one voice for a note
+ * played from note-on through release, keyed by (patch, note, samples to
+ * release, release tail), so repeated notes are mixed in instead of being
+ * synthesized again. Entries are evicted least recently used first once the
+ * memory cap is reached. Not thread-safe: use one cache per thread.
+ */
+typedef struct song_cache song_cache_t;
+typedef struct song_clip song_clip_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t uncached; /* Notes too large to keep under the cap */
+    uint32_t failures; /* Notes dropped for lack of memory */
+    uint32_t entries;
+    size_t bytes;
+} song_cache_stats_t;
+
+/* Playback state. The voice allocator is a pure function of the events
+ * applied so far, so song_player_skip() reproduces it without rendering.
+ */
+typedef struct {
+    picosynth_t *synth;
+    const song_patch_t *patch;
+    const song_t *song;
+    uint32_t pos;  /* Current sample position */
+    uint32_t next; /* Index of the next event to apply */
+    uint32_t end;  /* Rendering stops here: song length plus patch tail */
+    uint8_t voices;
+    uint8_t held[SONG_MAX_VOICES];      /* Gated note per voice, 0xFF = free */
+    uint32_t started[SONG_MAX_VOICES];  /* Time of the last note-on */
+    uint32_t released[SONG_MAX_VOICES]; /* Time of the last note-off */
+    song_cache_t *cache;                /* See song_player_set_cache() */
+    song_clip_t *clip[SONG_MAX_VOICES]; /* Cached note playing per voice */
+    uint32_t clip_pos[SONG_MAX_VOICES]; /* Read position within clip */
+} song_player_t;
+
+/* Parse melody text ("C4 4", "- 2", '#' comments) into @song */
+song_error_t song_parse_text(song_t *song, const char *text, size_t len);
+
+/* Parse a Standard MIDI File (all tracks and channels merged) into @song */
+song_error_t song_parse_midi(song_t *song, const uint8_t *data, size_t len);
+
+/* Load a melody text or MIDI file, detected by the "MThd" magic */
+song_error_t song_load_file(song_t *song, const char *path);
+
+/* Release memory owned by @song */
+void song_free(song_t *song);
+
+/* Create an instance with @voices voices wired with @patch */
+picosynth_t *song_patch_create(const song_patch_t *patch, uint8_t voices);
+
+/* Start playback of @song from sample 0 on a fresh instance made by
+ * song_patch_create(). Uses at most SONG_MAX_VOICES voices.
+ */
+void song_player_init(song_player_t *p,
+                      picosynth_t *s,
+                      const song_patch_t *patch,
+                      const song_t *song);
+
+/* Render up to @n samples. Returns the number written, 0 once finished. */
+uint32_t song_player_render(song_player_t *p, q15_t *out, uint32_t n);
+
+/* Apply @e immediately: allocate a voice and start the note, or release
+ * it. For events scheduled outside a song_t (live input, pipelines), init
+ * the player with an empty song and render with picosynth_render(). Notes
+ * applied this way are always synthesized, never taken from a cache.
+ */
+void song_player_event(song_player_t *p, const song_event_t *e);
+
+/* Advance to @pos applying events to the voice allocator only; the synth is
+ * left untouched. Used to position a player without rendering.
+ */
+void song_player_skip(song_player_t *p, uint32_t pos);
+
+/* Earliest note-on among voices still audible at the current position (gated
+ * or released less than the patch tail ago), or the position itself if all
+ * voices are silent. Rendering from there reproduces the state at the
+ * current position, since a note-on fully resets its voice. Noise is only
+ * reproduced with per-note seeding (picosynth_set_noise_seed).
+ */
+uint32_t song_player_warm_start(const song_player_t *p);
+
+/* Create a cache holding at most @max_bytes of rendered audio */
+song_cache_t *song_cache_create(size_t max_bytes);
+
+/* Free @c and all entries. No player may still reference it. */
+void song_cache_destroy(song_cache_t *c);
+
+/* Copy hit/miss/eviction counters and current usage into @st */
+void song_cache_get_stats(const song_cache_t *c, song_cache_stats_t *st);
+
+/* Play every note of @p through @c (NULL detaches and releases the notes
+ * still referenced). Notes are rendered on a private one-voice instance
+ * with per-note noise seeding, so the output equals an uncached render on
+ * an instance set up with picosynth_set_noise_seed(s, 0, true). Call after
+ * song_player_init() and before rendering.
+ */
+void song_player_set_cache(song_player_t *p, song_cache_t *c);
+
+#endif /* SONG_H_ */
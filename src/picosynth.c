@@ -1,5 +1,6 @@
 /* Lightweight software synthesizer */
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,6 +32,8 @@ struct picosynth_voice {
     q15_t freq;              /* Base frequency (phase increment) */
     picosynth_node_t *nodes;
     uint8_t n_nodes;
+    uint32_t noise_seed; /* Per-note LFSR state (see noise_per_note) */
+    q15_t send[PICOSYNTH_BUSES]; /* Effect bus send levels */
 };
 
 struct picosynth {
@@ -39,14 +42,156 @@ struct picosynth {
     uint16_t voice_enable_mask; /* Bit N = voice N active */
     /* DC blocker state (placed after main mixer, before soft clipper) */
     int32_t dc_x_prev, dc_y_prev; /* Previous input, output */
+    uint32_t noise_seed;          /* LFSR state for noise oscillators */
+    bool noise_per_note;          /* Reseed each voice's LFSR at note-on */
+    /* Arena for node buffers (see picosynth_arena_init()) */
+    uint8_t *arena;
+    size_t arena_size, arena_used;
+    bool arena_owned;
+    /* Effect send buses (see picosynth_set_send()) */
+    uint8_t bus_mask; /* Bit B = some voice sends to bus B */
+    uint8_t bus_effects[PICOSYNTH_BUSES];
+    picosynth_effect_func_t bus_fx[PICOSYNTH_BUSES][PICOSYNTH_BUS_EFFECTS];
+    void *bus_ctx[PICOSYNTH_BUSES][PICOSYNTH_BUS_EFFECTS];
+    int32_t bus_buf[PICOSYNTH_BUSES][PICOSYNTH_BUS_BLOCK];
 };
 
+struct picosynth_spectral {
+    uint8_t log2_size;
+    uint16_t size; /* Frame length */
+    uint16_t hop;  /* Quarter frame */
+    uint16_t pos;  /* Samples of the current hop played; hop = build next */
+    int32_t *re, *im; /* Frame being synthesized */
+    int32_t *ola;     /* Overlap-add sum, ola[0] is the next output */
+};
+
+/* Single-producer ring between a sampler node (audio) and the thread that
+ * streams its samples. Counters run freely and index the ring by mask.
+ * A note-on bumps gen; the producer drops what it wrote and answers with
+ * ack, and frames count only while the two agree.
+ */
+struct picosynth_stream {
+    q15_t *buf;
+    uint32_t mask; /* Ring frames - 1 */
+    _Atomic(const picosynth_sample_t *) sample; /* Note being streamed */
+    atomic_uint gen;       /* Notes started (audio) */
+    atomic_uint ack;       /* Note the frames belong to (producer) */
+    atomic_uint fill;      /* Frames written for the note (producer) */
+    atomic_uint total;     /* Frames in the note, UINT32_MAX until known */
+    atomic_uint read;      /* Frames the node has moved past (audio) */
+    atomic_uint released;  /* Key released during the note (audio) */
+    atomic_uint underruns; /* Output samples lost to missing frames */
+};
+
+/* Thread-local storage qualifier. Define as empty on single-threaded
+ * targets whose toolchain lacks C11 _Thread_local.
+ */
+#ifndef PICOSYNTH_THREAD_LOCAL
+#define PICOSYNTH_THREAD_LOCAL _Thread_local
+#endif
+
+/* Kernels shared by the scalar and group paths must inline into the group's
+ * row loops to vectorize, even when the compiler would rather call them.
+ */
+#if defined(__GNUC__)
+#define PICOSYNTH_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define PICOSYNTH_ALWAYS_INLINE inline
+#endif
+
+#define LFSR_DEFAULT_SEED 0x12345678u
+
 /* LFSR seed for noise generator.
- * Global state shared across all instances - not thread-safe.
- * For multi-threaded use, move seed into picosynth_t and change
- * picosynth_wave_noise() to accept instance pointer.
+ * picosynth_process() points lfsr_seed at the seed of the instance being
+ * rendered, so every instance owns its noise sequence (and snapshots capture
+ * it). Calls to picosynth_wave_noise() outside processing (lfsr_seed NULL)
+ * use a per-thread default seed.
+ */
+static PICOSYNTH_THREAD_LOCAL uint32_t lfsr_default_seed = LFSR_DEFAULT_SEED;
+static PICOSYNTH_THREAD_LOCAL uint32_t *lfsr_seed;
+
+/* Restart overlap-add for a new note: build a frame on the next sample */
+static void spectral_reset(picosynth_spectral_t *sp)
+{
+    if (!sp)
+        return;
+    memset(sp->ola, 0, sp->size * sizeof(int32_t));
+    sp->pos = sp->hop;
+}
+
+/* String loop delay in Q16.16 samples for phase increment @freq: one
+ * period less the loss filter's delay, folded up by octaves until it fits
+ * the line
  */
-static uint32_t lfsr_seed = 0x12345678;
+static inline uint32_t string_delay(const picosynth_string_t *st,
+                                    int32_t freq)
+{
+    uint32_t period = freq > 0 ? (32768u << 16) / (uint32_t) freq : 0;
+    uint32_t max = (uint32_t) (st->len - 2) << 16;
+    while (period > max)
+        period >>= 1;
+    uint32_t loss = (uint32_t) st->damping; /* Half the blend, in Q16 */
+    return period > loss + 65536u ? period - loss : 65536u;
+}
+
+/* Fill a string's delay line with a noise burst seeded by @note, smoothed
+ * by the string's damping so dark strings also start dark. The mean of
+ * the period that circulates is removed, as the loop passes DC almost
+ * unattenuated.
+ */
+static void string_excite(picosynth_string_t *st, uint8_t note)
+{
+    if (!st->line)
+        return;
+    st->pos = 0;
+    uint32_t x = (note + 1u) * 0x9E3779B9u;
+    int32_t prev = 0;
+    for (uint32_t i = 0; i < st->len; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int32_t y = ((int32_t) (x >> 16) - 32768) * st->level >> 15;
+        y -= ((y - prev) * st->damping) >> 16;
+        st->line[i] = (q15_t) y;
+        prev = y;
+    }
+
+    /* The loop holds one period of samples, just behind position 0 */
+    uint32_t d = string_delay(st, st->freq ? *st->freq : 0);
+    uint32_t loss = (uint32_t) st->damping;
+    uint32_t span = (d + loss + 32768u) >> 16;
+    int32_t sum = 0;
+    for (uint32_t i = st->len - span; i < st->len; i++)
+        sum += st->line[i];
+    int32_t mean = sum / (int32_t) span;
+    for (uint32_t i = 0; i < st->len; i++)
+        st->line[i] = q15_sat(st->line[i] - mean);
+}
+
+/* First frame of @sp that comes from a stream, or 0 if it is resident.
+ * Streaming starts at the end of the resident frames or of a loop that
+ * lies within them, where playback first leaves the plain sample order.
+ */
+static inline uint32_t stream_start(const picosynth_sample_t *sp)
+{
+    if (!sp || !sp->resident || sp->resident >= sp->len)
+        return 0;
+    if (sp->loop != PICOSYNTH_LOOP_NONE && sp->loop_start < sp->loop_end &&
+        sp->loop_end < sp->resident)
+        return sp->loop_end;
+    return sp->resident;
+}
+
+/* Hand the producer a new note; the node reads nothing until it answers */
+static void stream_restart(picosynth_stream_t *st,
+                           const picosynth_sample_t *sp)
+{
+    atomic_store_explicit(&st->read, 0, memory_order_relaxed);
+    atomic_store_explicit(&st->released, 0, memory_order_relaxed);
+    atomic_store_explicit(&st->sample, stream_start(sp) ? sp : NULL,
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->gen, 1, memory_order_release);
+}
 
 static void voice_note_on(picosynth_voice_t *v, uint8_t note)
 {
@@ -70,6 +215,39 @@ static void voice_note_on(picosynth_voice_t *v, uint8_t note)
             n->svf.bp = 0;
             n->svf.f = n->svf.f_target;
         }
+        /* Restart partial decays */
+        if (n->type == PICOSYNTH_NODE_ADDITIVE)
+            n->add.time = 0;
+        if (n->type == PICOSYNTH_NODE_SPECTRAL) {
+            n->spec.time = 0;
+            spectral_reset(n->spec.engine);
+        }
+        /* Pluck the string */
+        if (n->type == PICOSYNTH_NODE_STRING)
+            string_excite(&n->str, note);
+        /* Silence the resonators */
+        if (n->type == PICOSYNTH_NODE_MODAL && n->modal.y)
+            memset(n->modal.y, 0, 2u * n->modal.count * sizeof(int32_t));
+        if (n->type == PICOSYNTH_NODE_UNISON)
+            n->uni.spread = 0;
+        if (n->type == PICOSYNTH_NODE_FM_OP) {
+            n->fop.time = 0;
+            n->fop.history = 0;
+        }
+        if (n->type == PICOSYNTH_NODE_FM) {
+            n->fm.time = 0;
+            n->fm.history = 0;
+        }
+        /* Forget the previous note's echoes */
+        if (n->type == PICOSYNTH_NODE_DELAY && n->dly.line) {
+            memset(n->dly.line, 0, n->dly.len * sizeof(q15_t));
+            n->dly.wet = 0;
+        }
+        if (n->type == PICOSYNTH_NODE_SAMPLER) {
+            n->smp.frac = 0;
+            if (n->smp.stream)
+                stream_restart(n->smp.stream, n->smp.sample);
+        }
         /* Reset envelope block state to force immediate rate calculation */
         if (n->type == PICOSYNTH_NODE_ENV) {
             n->env.block_counter = 0;
@@ -95,7 +273,7 @@ static void voice_note_off(picosynth_voice_t *v)
 /* Map a pointer to a node's output field back to the node index.
  * Returns -1 if the pointer doesn't point to any node's output.
  */
-static int ptr_to_node_idx(picosynth_voice_t *v, const q15_t *ptr)
+static int ptr_to_node_idx(const picosynth_voice_t *v, const q15_t *ptr)
 {
     if (!ptr)
         return -1;
@@ -159,6 +337,47 @@ static void mark_node_used(picosynth_voice_t *v, int idx)
         if (dep >= 0)
             mark_node_used(v, dep);
         break;
+    case PICOSYNTH_NODE_ADDITIVE:
+        dep = ptr_to_node_idx(v, n->add.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_SPECTRAL:
+        dep = ptr_to_node_idx(v, n->spec.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_STRING:
+        dep = ptr_to_node_idx(v, n->str.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        dep = ptr_to_node_idx(v, n->str.excite);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_MODAL:
+        dep = ptr_to_node_idx(v, n->modal.in);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_UNISON:
+        dep = ptr_to_node_idx(v, n->uni.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_FM_OP:
+        dep = ptr_to_node_idx(v, n->fop.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        dep = ptr_to_node_idx(v, n->fop.pm);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_FM:
+        dep = ptr_to_node_idx(v, n->fm.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
     case PICOSYNTH_NODE_MIX:
         for (int j = 0; j < 3; j++) {
             dep = ptr_to_node_idx(v, n->mix.in[j]);
@@ -166,6 +385,26 @@ static void mark_node_used(picosynth_voice_t *v, int idx)
                 mark_node_used(v, dep);
         }
         break;
+    case PICOSYNTH_NODE_DELAY:
+        dep = ptr_to_node_idx(v, n->dly.in);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        dep = ptr_to_node_idx(v, n->dly.mod);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_SAMPLER:
+        dep = ptr_to_node_idx(v, n->smp.freq);
+        if (dep >= 0)
+            mark_node_used(v, dep);
+        break;
+    case PICOSYNTH_NODE_SUM:
+        for (int j = 0; j < n->sum.count && n->sum.in; j++) {
+            dep = ptr_to_node_idx(v, n->sum.in[j]);
+            if (dep >= 0)
+                mark_node_used(v, dep);
+        }
+        break;
     default:
         break;
     }
@@ -191,6 +430,7 @@ picosynth_t *picosynth_create(uint8_t voices, uint8_t nodes)
         return NULL;
 
     s->num_voices = voices;
+    s->noise_seed = LFSR_DEFAULT_SEED;
     s->voices = calloc(voices, sizeof(picosynth_voice_t));
     if (!s->voices) {
         free(s);
@@ -219,6 +459,8 @@ void picosynth_destroy(picosynth_t *s)
     for (int i = 0; i < s->num_voices; i++)
         free(s->voices[i].nodes);
     free(s->voices);
+    if (s->arena_owned)
+        free(s->arena);
     free(s);
 }
 
@@ -251,10 +493,56 @@ const q15_t *picosynth_voice_freq_ptr(picosynth_voice_t *v)
     return &v->freq;
 }
 
+/* Derive a voice's LFSR seed from the instance seed and the note, so that a
+ * note's noise is the same wherever and whenever it is played.
+ */
+static uint32_t noise_note_seed(uint32_t seed, uint8_t note)
+{
+    uint32_t x = seed ^ ((uint32_t) note + 1) * 0x9E3779B9u;
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x ? x : LFSR_DEFAULT_SEED; /* xorshift must not start at zero */
+}
+
+void picosynth_set_noise_seed(picosynth_t *s, uint32_t seed, bool per_note)
+{
+    if (!s)
+        return;
+    s->noise_seed = seed ? seed : LFSR_DEFAULT_SEED;
+    s->noise_per_note = per_note;
+}
+
+bool picosynth_arena_init(picosynth_t *s, void *buf, size_t size)
+{
+    if (!s || s->arena || !size)
+        return false;
+    s->arena = buf ? buf : malloc(size);
+    if (!s->arena)
+        return false;
+    s->arena_owned = !buf;
+    s->arena_size = size;
+    s->arena_used = 0;
+    return true;
+}
+
+void *picosynth_arena_alloc(picosynth_t *s, size_t size)
+{
+    if (!s || !s->arena)
+        return NULL;
+    size_t at = (s->arena_used + 7) & ~(size_t) 7;
+    if (at > s->arena_size || size > s->arena_size - at)
+        return NULL;
+    s->arena_used = at + size;
+    return s->arena + at;
+}
+
 void picosynth_note_on(picosynth_t *s, uint8_t voice, uint8_t note)
 {
     if (s && voice < s->num_voices) {
         voice_note_on(&s->voices[voice], note);
+        if (s->noise_per_note)
+            s->voices[voice].noise_seed = noise_note_seed(s->noise_seed, note);
         /* Only track in bitmask for voices 0-15 (16-bit mask) */
         if (voice < 16)
             s->voice_enable_mask |= (uint16_t) (1u << voice);
@@ -267,6 +555,42 @@ void picosynth_note_off(picosynth_t *s, uint8_t voice)
         voice_note_off(&s->voices[voice]);
 }
 
+bool picosynth_set_send(picosynth_t *s,
+                        uint8_t voice,
+                        uint8_t bus,
+                        q15_t level)
+{
+    if (!s || voice >= s->num_voices || bus >= PICOSYNTH_BUSES)
+        return false;
+    s->voices[voice].send[bus] = level;
+    /* The bus runs while any voice sends to it */
+    s->bus_mask &= (uint8_t) ~(1u << bus);
+    for (int i = 0; i < s->num_voices; i++)
+        if (s->voices[i].send[bus])
+            s->bus_mask |= (uint8_t) (1u << bus);
+    return true;
+}
+
+bool picosynth_bus_add_effect(picosynth_t *s,
+                              uint8_t bus,
+                              picosynth_effect_func_t fx,
+                              void *ctx)
+{
+    if (!s || !fx || bus >= PICOSYNTH_BUSES ||
+        s->bus_effects[bus] >= PICOSYNTH_BUS_EFFECTS)
+        return false;
+    s->bus_fx[bus][s->bus_effects[bus]] = fx;
+    s->bus_ctx[bus][s->bus_effects[bus]] = ctx;
+    s->bus_effects[bus]++;
+    return true;
+}
+
+void picosynth_bus_clear(picosynth_t *s, uint8_t bus)
+{
+    if (s && bus < PICOSYNTH_BUSES)
+        s->bus_effects[bus] = 0;
+}
+
 /* Internal macros for frequency and envelope rate calculations */
 #define PICOSYNTH_HZ_TO_FREQ(hz) \
     ((q15_t) (((long) (hz) * Q15_MAX) / SAMPLE_RATE))
@@ -586,340 +910,3322 @@ void picosynth_init_mix(picosynth_node_t *n,
     n->mix.in[2] = in3;
 }
 
-static q15_t soft_clip(int32_t x)
+void picosynth_init_sum(picosynth_node_t *n,
+                        const q15_t *gain,
+                        const q15_t *const *in,
+                        const q15_t *gains,
+                        uint8_t count)
 {
-    int32_t sign = x < 0 ? -1 : 1;
-    uint32_t abs_x = x < 0 ? (uint32_t) (-(int64_t) x) : (uint32_t) x;
-    uint32_t a = abs_x >> 3;
-    if (a > Q15_MAX / 4)
-        a = Q15_MAX / 4;
-    return q15_sat(picosynth_sine_impl((q15_t) a) * sign);
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_SUM;
+    n->sum.in = in;
+    n->sum.gains = gains;
+    n->sum.count = in ? count : 0;
 }
 
-q15_t picosynth_process(picosynth_t *s)
+void picosynth_init_additive(picosynth_node_t *n,
+                             const q15_t *gain,
+                             const q15_t *freq,
+                             const picosynth_partials_t *bank)
 {
-    if (!s)
-        return 0;
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_ADDITIVE;
+    n->add.freq = freq;
+    n->add.bank = bank;
+}
 
-    int32_t out = 0;
+void picosynth_partials_set(picosynth_partials_t *bank,
+                            uint16_t k,
+                            uint32_t ratio,
+                            q15_t amp,
+                            uint32_t half_life_ms)
+{
+    if (!bank || k >= PICOSYNTH_ADDITIVE_MAX)
+        return;
+    uint32_t rate = 0;
+    if (half_life_ms) {
+        /* Q16.16 halvings per sample */
+        uint32_t hl = PICOSYNTH_MS(half_life_ms);
+        rate = hl ? (65536u + hl / 2) / hl : 65536u;
+    }
+    bank->ratio[k] = ratio;
+    bank->amp[k] = amp;
+    bank->rate[k] = rate;
+    if (bank->count <= k)
+        bank->count = (uint16_t) (k + 1);
+}
 
-    for (int vi = 0; vi < s->num_voices; vi++) {
-        /* Skip inactive voices via bitfield check (voices 0-15 only) */
-        if (vi < 16 && !(s->voice_enable_mask & (1u << vi)))
-            continue;
+/* Integer square root, rounded down */
+static uint32_t isqrt64(uint64_t x)
+{
+    uint64_t r = 0;
+    for (uint64_t bit = 1ull << 62; bit; bit >>= 2) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return (uint32_t) r;
+}
 
-        picosynth_voice_t *v = &s->voices[vi];
-        picosynth_node_t *nodes = v->nodes;
-        int32_t tmp[PICOSYNTH_MAX_NODES];
+uint32_t picosynth_partial_ratio(uint16_t k, uint32_t b_ppm)
+{
+    /* 1 + B * k^2 in Q32, so its square root comes out in Q16. Extra
+     * fraction bits are shifted in first so that k times the root stays
+     * accurate to the last bit.
+     */
+    uint64_t bk = (uint64_t) b_ppm * k * k;
+    if (bk / 1000000u >= (1u << 30))
+        return UINT32_MAX;
+    uint64_t x = (1ull << 32) + (bk / 1000000u << 32) +
+                 ((bk % 1000000u << 32) / 1000000u);
+    int sh = 0;
+    while (x < (1ull << 61)) {
+        x <<= 2;
+        sh++;
+    }
+    uint64_t r = ((uint64_t) k * isqrt64(x) + (1ull << sh >> 1)) >> sh;
+    return r > UINT32_MAX ? UINT32_MAX : (uint32_t) r;
+}
 
-        /* Two-pass processing per voice:
-         * 1. Compute outputs from current state of all nodes.
-         *    This ensures inputs for a node (e.g. filter) are based on the
-         *    outputs of other nodes (e.g. oscillator) from the same sample.
-         * 2. Update the internal state of all nodes for the next sample.
-         *    This prevents race conditions where a node's state is updated
-         *    before its output has been consumed by other nodes.
-         */
+picosynth_spectral_t *picosynth_spectral_create(uint8_t log2_size)
+{
+    if (log2_size < PICOSYNTH_SPECTRAL_MIN_LOG2 ||
+        log2_size > PICOSYNTH_SPECTRAL_MAX_LOG2)
+        return NULL;
 
-        /* Pass 1: compute outputs from current state */
-        uint8_t mask = v->node_usage_mask;
-        for (int i = 0; i < v->n_nodes && nodes[i].type != PICOSYNTH_NODE_NONE;
-             i++) {
-            /* Skip nodes that don't affect output (if mask is set) */
-            if (mask && !(mask & (1u << i))) {
-                tmp[i] = 0;
-                continue;
-            }
-            picosynth_node_t *n = &nodes[i];
-            switch (n->type) {
-            case PICOSYNTH_NODE_OSC:
-                tmp[i] = n->osc.wave(n->state & Q15_MAX);
-                break;
-            case PICOSYNTH_NODE_ENV:
-                /* Envelope output is scaled down and squared for a non-linear
-                 * curve.
-                 */
-                tmp[i] = (n->state & ENVELOPE_STATE_VALUE_MASK) >> 4;
-                tmp[i] = (tmp[i] * tmp[i]) >> 15; /* Squared curve */
-                if (n->env.sustain < 0)
-                    tmp[i] = -tmp[i];
-                break;
-            case PICOSYNTH_NODE_LP:
-                tmp[i] =
-                    (int32_t) (((int64_t) n->flt.accum * n->flt.coeff) >> 15);
-                break;
-            case PICOSYNTH_NODE_HP:
-                /* High-pass is the input signal minus the low-pass signal */
-                if (n->flt.in) {
-                    tmp[i] =
-                        (int32_t) (((int64_t) n->flt.accum * n->flt.coeff) >>
-                                   15);
-                    tmp[i] = *n->flt.in - tmp[i];
-                } else {
-                    tmp[i] = 0;
-                }
-                break;
-            case PICOSYNTH_NODE_SVF_LP:
-                /* SVF low-pass output: scaled down from internal precision */
-                tmp[i] = n->svf.lp >> 8;
-                break;
-            case PICOSYNTH_NODE_SVF_HP: {
-                /* SVF high-pass: hp = in - lp - q*bp
-                 * Computed at internal <<8 scale for consistency with state,
-                 * then scaled down. Uses int64_t to prevent overflow.
-                 */
-                int64_t in_val = n->svf.in ? ((int32_t) *n->svf.in) << 8 : 0;
-                int64_t q_bp = ((int64_t) n->svf.bp * n->svf.q) >> 15;
-                int64_t hp = in_val - n->svf.lp - q_bp;
-                /* Clamp to int32_t range before scaling */
-                if (hp > 0x7FFFFFFF)
-                    hp = 0x7FFFFFFF;
-                else if (hp < (-0x7FFFFFFF - 1))
-                    hp = (-0x7FFFFFFF - 1);
-                tmp[i] = (int32_t) (hp >> 8);
-                break;
-            }
-            case PICOSYNTH_NODE_SVF_BP:
-                /* SVF band-pass output */
-                tmp[i] = n->svf.bp >> 8;
-                break;
-            case PICOSYNTH_NODE_MIX: {
-                int32_t sum = 0;
-                for (int j = 0; j < 3; j++)
-                    if (n->mix.in[j])
-                        sum += *n->mix.in[j];
-                tmp[i] = sum;
-                break;
-            }
-            default:
-                tmp[i] = 0;
-                break;
-            }
+    picosynth_spectral_t *sp = calloc(1, sizeof(picosynth_spectral_t));
+    if (!sp)
+        return NULL;
+    sp->log2_size = log2_size;
+    sp->size = (uint16_t) (1u << log2_size);
+    sp->hop = sp->size / 4;
+    sp->pos = sp->hop;
+    sp->re = calloc(sp->size, sizeof(int32_t));
+    sp->im = calloc(sp->size, sizeof(int32_t));
+    sp->ola = calloc(sp->size, sizeof(int32_t));
+    if (!sp->re || !sp->im || !sp->ola) {
+        picosynth_spectral_destroy(sp);
+        return NULL;
+    }
+    return sp;
+}
 
-            if (n->gain)
-                tmp[i] = (int32_t) (((int64_t) tmp[i] * *n->gain) >> 15);
-        }
+void picosynth_spectral_destroy(picosynth_spectral_t *sp)
+{
+    if (!sp)
+        return;
+    free(sp->re);
+    free(sp->im);
+    free(sp->ola);
+    free(sp);
+}
 
-        /* Pass 2: update state for next sample */
-        for (int i = 0; i < v->n_nodes && nodes[i].type != PICOSYNTH_NODE_NONE;
-             i++) {
-            /* Skip nodes that don't affect output (if mask is set) */
-            if (mask && !(mask & (1u << i)))
-                continue;
-            picosynth_node_t *n = &nodes[i];
-            n->out = q15_sat(tmp[i]);
+void picosynth_init_spectral(picosynth_node_t *n,
+                             const q15_t *gain,
+                             const q15_t *freq,
+                             const picosynth_partials_t *bank,
+                             picosynth_spectral_t *engine)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_SPECTRAL;
+    n->spec.freq = freq;
+    n->spec.bank = bank;
+    n->spec.engine = engine;
+    spectral_reset(engine);
+}
 
-            switch (n->type) {
-            case PICOSYNTH_NODE_OSC:
-                if (n->osc.freq)
-                    n->state += *n->osc.freq;
-                if (n->osc.detune)
-                    n->state += *n->osc.detune;
-                n->state =
-                    (int32_t) (((uint32_t) n->state) & (uint32_t) Q15_MAX);
-                break;
-            case PICOSYNTH_NODE_ENV: {
-                /* Block-based AHDSR envelope: compute rate at block
-                 * boundaries, check for phase transitions per-sample. */
-                uint32_t mode = ((uint32_t) n->state) & ENVELOPE_MODE_MASK;
-
-                /* Recompute rate at block boundary */
-                if (n->env.block_counter == 0) {
-                    n->env.block_counter = PICOSYNTH_BLOCK_SIZE;
-                    if (!v->gate) {
-                        n->env.block_rate = -n->env.release; /* Informational */
-                    } else if (mode == ENVELOPE_MODE_DECAY) {
-                        n->env.block_rate = -n->env.decay; /* Informational */
-                    } else if (mode == ENVELOPE_MODE_HOLD) {
-                        n->env.block_rate = 0; /* Hold at peak */
-                    } else {
-                        n->env.block_rate = n->env.attack;
-                    }
-                }
-                n->env.block_counter--;
-
-                /* Apply rate based on mode */
-                int32_t val = n->state & ENVELOPE_STATE_VALUE_MASK;
-                if (v->gate) {
-                    if (mode == ENVELOPE_MODE_DECAY) {
-                        /* Decay/Sustain phase */
-                        q15_t sus_abs = n->env.sustain < 0 ? -n->env.sustain
-                                                           : n->env.sustain;
-                        int32_t sus_level = sus_abs << 4;
-                        int32_t delta = val - sus_level;
-                        /* Exponential decay of delta toward sustain */
-                        val =
-                            sus_level +
-                            (int32_t) (((int64_t) delta * n->env.decay_coeff) >>
-                                       15);
-                        if (val < sus_level)
-                            val = sus_level;
-                    } else if (mode == ENVELOPE_MODE_HOLD) {
-                        /* Hold phase: maintain peak, count down */
-                        val = (int32_t) Q15_MAX << 4; /* Stay at peak */
-                        if (n->env.hold_counter > 0)
-                            n->env.hold_counter--;
-                        if (n->env.hold_counter == 0) {
-                            /* Transition to decay mode */
-                            mode = ENVELOPE_MODE_DECAY;
-                            n->env.block_counter = 0;
-                        }
-                    } else {
-                        /* Attack phase: ramp up to peak */
-                        val += n->env.block_rate;
-                        if (val >= (int32_t) Q15_MAX << 4) {
-                            val = (int32_t) Q15_MAX << 4;
-                            /* Check if hold phase is configured */
-                            if (n->env.hold > 0) {
-                                mode = ENVELOPE_MODE_HOLD;
-                                n->env.hold_counter = n->env.hold;
-                            } else {
-                                mode = ENVELOPE_MODE_DECAY;
-                            }
-                            /* Force rate recalculation next sample */
-                            n->env.block_counter = 0;
-                        }
-                    }
-                    n->state = (int32_t) (((uint32_t) val) | mode);
-                } else {
-                    /* Exponential release (mode cleared) */
-                    val = (int32_t) (((int64_t) val * n->env.release_coeff) >>
-                                     15);
-                    if (val < 16)
-                        val = 0;
-                    n->state = val; /* mode bits clear during release */
-                }
-                break;
-            }
-            case PICOSYNTH_NODE_LP:
-            case PICOSYNTH_NODE_HP: {
-                /* Smooth cutoff changes to avoid zipper noise.
-                 * Time constant: ~256 samples (~23ms @ 11kHz, ~6ms @ 44kHz).
-                 */
-                int32_t coeff_delta =
-                    (int32_t) n->flt.coeff_target - n->flt.coeff;
-                if (coeff_delta) {
-                    int32_t step = coeff_delta >> 8;
-                    if (step == 0)
-                        step = coeff_delta > 0 ? 1 : -1;
-                    n->flt.coeff = q15_sat((int32_t) n->flt.coeff + step);
-                }
+uint16_t picosynth_string_len(uint8_t note)
+{
+    q15_t f = picosynth_midi_to_freq(note);
+    uint32_t period = (f > 0 ? 32768u / (uint32_t) f : 32768u) + 2;
+    uint32_t len = 4;
+    while (len < period && len < 32768u)
+        len <<= 1;
+    return (uint16_t) len;
+}
 
-                /* Single-pole filter accumulator update:
-                 * accum += (input - output)
-                 * where output is the filtered signal from the previous sample.
-                 * This implements a simple recursive filter.
-                 */
-                int32_t input_val = n->flt.in ? *n->flt.in : 0;
-                int32_t delta = input_val - n->out;
-                int64_t acc = (int64_t) n->flt.accum + delta;
-                if (acc > 0x7FFFFFFF)
-                    acc = 0x7FFFFFFF;
-                else if (acc < (-0x7FFFFFFF - 1))
-                    acc = (-0x7FFFFFFF - 1);
-                n->flt.accum = (int32_t) acc;
-                break;
-            }
-            case PICOSYNTH_NODE_SVF_LP:
-            case PICOSYNTH_NODE_SVF_HP:
-            case PICOSYNTH_NODE_SVF_BP: {
-                /* Smooth frequency changes to avoid zipper noise */
-                int32_t f_delta = (int32_t) n->svf.f_target - n->svf.f;
-                if (f_delta) {
-                    int32_t step = f_delta >> 8;
-                    if (step == 0)
-                        step = f_delta > 0 ? 1 : -1;
-                    n->svf.f = q15_sat((int32_t) n->svf.f + step);
-                }
+void picosynth_init_string(picosynth_node_t *n,
+                           const q15_t *gain,
+                           const q15_t *freq,
+                           q15_t *line,
+                           uint16_t len,
+                           const picosynth_string_params_t *params)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_STRING;
+    n->str.freq = freq;
+    while (len & (len - 1))
+        len &= (uint16_t) (len - 1);
+    if (line && len >= 4) {
+        n->str.line = line;
+        n->str.len = len;
+        memset(line, 0, len * sizeof(q15_t));
+    }
+    if (params) {
+        n->str.feedback = params->feedback;
+        n->str.damping = params->damping < 0 ? 0 : params->damping;
+        n->str.level = params->level;
+    }
+}
 
-                /* State Variable Filter update:
-                 * hp = in - lp - q*bp
-                 * lp_new = lp + f*bp
-                 * bp_new = bp + f*hp
-                 *
-                 * States stored with <<8 scaling for precision.
-                 */
-                int32_t in_val = n->svf.in ? ((int32_t) *n->svf.in) << 8 : 0;
-                int32_t lp = n->svf.lp;
-                int32_t bp = n->svf.bp;
-
-                /* Compute high-pass: hp = in - lp - q*bp
-                 * Uses int64_t to prevent overflow with large <<8 scaled
-                 * values.
-                 */
-                int64_t q_bp = ((int64_t) bp * n->svf.q) >> 15;
-                int64_t hp64 = (int64_t) in_val - lp - q_bp;
-                if (hp64 > 0x7FFFFFFF)
-                    hp64 = 0x7FFFFFFF;
-                else if (hp64 < (-0x7FFFFFFF - 1))
-                    hp64 = (-0x7FFFFFFF - 1);
-                int32_t hp = (int32_t) hp64;
-
-                /* Update low-pass: lp += f*bp */
-                int32_t f_bp = (int32_t) (((int64_t) bp * n->svf.f) >> 15);
-                int64_t lp_new = (int64_t) lp + f_bp;
-                if (lp_new > 0x7FFFFFFF)
-                    lp_new = 0x7FFFFFFF;
-                else if (lp_new < (-0x7FFFFFFF - 1))
-                    lp_new = (-0x7FFFFFFF - 1);
-                n->svf.lp = (int32_t) lp_new;
-
-                /* Update band-pass: bp += f*hp */
-                int32_t f_hp = (int32_t) (((int64_t) hp * n->svf.f) >> 15);
-                int64_t bp_new = (int64_t) bp + f_hp;
-                if (bp_new > 0x7FFFFFFF)
-                    bp_new = 0x7FFFFFFF;
-                else if (bp_new < (-0x7FFFFFFF - 1))
-                    bp_new = (-0x7FFFFFFF - 1);
-                n->svf.bp = (int32_t) bp_new;
-                break;
-            }
-            default:
-                break;
-            }
-        }
+uint16_t picosynth_delay_len(uint32_t max_us)
+{
+    uint64_t need = ((uint64_t) max_us * SAMPLE_RATE + 999999u) / 1000000u;
+    uint32_t len = 4;
+    while (len < need + 2 && len < 32768u)
+        len <<= 1;
+    return (uint16_t) len;
+}
 
-        out += v->nodes[v->out_idx].out;
+/* Microseconds to Q16.16 samples */
+static uint32_t us_to_q16(uint32_t us)
+{
+    uint64_t q = (((uint64_t) us * SAMPLE_RATE) << 16) / 1000000u;
+    return q > UINT32_MAX ? UINT32_MAX : (uint32_t) q;
+}
 
-        /* Disable voice when fully silent (gate off, all envelopes at zero).
-         * Only applies to voices 0-15 tracked by 16-bit mask. */
-        if (vi < 16 && !v->gate) {
-            bool silent = true;
-            for (int i = 0; i < v->n_nodes && silent; i++) {
-                if (nodes[i].type == PICOSYNTH_NODE_ENV &&
-                    (nodes[i].state & ENVELOPE_STATE_VALUE_MASK) != 0)
-                    silent = false;
-            }
-            if (silent)
-                s->voice_enable_mask &= (uint16_t) ~(1u << vi);
+void picosynth_init_delay(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *in,
+                          const q15_t *mod,
+                          q15_t *line,
+                          uint16_t len,
+                          const picosynth_delay_params_t *params)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_DELAY;
+    n->dly.in = in;
+    n->dly.mod = mod;
+    while (len & (len - 1))
+        len &= (uint16_t) (len - 1);
+    if (line && len >= 4) {
+        n->dly.line = line;
+        n->dly.len = len;
+        memset(line, 0, len * sizeof(q15_t));
+    }
+    if (params) {
+        n->dly.time = us_to_q16(params->time_us);
+        n->dly.depth = us_to_q16(params->depth_us);
+        n->dly.feedback = params->feedback;
+    }
+}
+
+/* Q16.16 source samples per output sample per unit of phase increment */
+static uint32_t sampler_scale(const picosynth_sample_t *sp)
+{
+    uint32_t root = (uint32_t) picosynth_midi_to_freq(sp->root);
+    if (!root)
+        return 0;
+    uint64_t scale =
+        ((uint64_t) sp->rate << 32) / ((uint64_t) SAMPLE_RATE * root);
+    return scale > UINT32_MAX ? UINT32_MAX : (uint32_t) scale;
+}
+
+void picosynth_init_sampler(picosynth_node_t *n,
+                            const q15_t *gain,
+                            const q15_t *freq,
+                            const picosynth_sample_t *sample)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_SAMPLER;
+    n->smp.freq = freq;
+    picosynth_sampler_set(n, sample);
+}
+
+void picosynth_sampler_set(picosynth_node_t *n,
+                           const picosynth_sample_t *sample)
+{
+    if (!n)
+        return;
+    n->smp.sample = sample;
+    n->smp.scale = sample ? sampler_scale(sample) : 0;
+}
+
+void picosynth_sampler_set_stream(picosynth_node_t *n, picosynth_stream_t *st)
+{
+    if (n && n->type == PICOSYNTH_NODE_SAMPLER)
+        n->smp.stream = st;
+}
+
+/* Ring frames for a request of @frames: a power of two, at least 2 */
+static uint32_t stream_frames(uint32_t frames)
+{
+    uint32_t size = 2;
+    while (size < frames && size < (1u << 30))
+        size <<= 1;
+    return size;
+}
+
+size_t picosynth_stream_size(uint32_t frames)
+{
+    return ((sizeof(picosynth_stream_t) + 7) & ~(size_t) 7) +
+           stream_frames(frames) * sizeof(q15_t);
+}
+
+picosynth_stream_t *picosynth_stream_create(picosynth_t *s, uint32_t frames)
+{
+    if (!s)
+        return NULL;
+    size_t used = s->arena_used;
+    uint32_t size = stream_frames(frames);
+    picosynth_stream_t *st =
+        picosynth_arena_alloc(s, sizeof(picosynth_stream_t));
+    q15_t *buf = st ? picosynth_arena_alloc(s, size * sizeof(q15_t)) : NULL;
+    if (!buf) {
+        s->arena_used = used;
+        return NULL;
+    }
+    st->buf = buf;
+    st->mask = size - 1;
+    atomic_init(&st->sample, NULL);
+    atomic_init(&st->gen, 0);
+    atomic_init(&st->ack, 0);
+    atomic_init(&st->fill, 0);
+    atomic_init(&st->total, 0);
+    atomic_init(&st->read, 0);
+    atomic_init(&st->released, 0);
+    atomic_init(&st->underruns, 0);
+    return st;
+}
+
+uint32_t picosynth_stream_underruns(const picosynth_stream_t *st)
+{
+    return st ? atomic_load_explicit(&st->underruns, memory_order_relaxed)
+              : 0;
+}
+
+bool picosynth_stream_poll(picosynth_stream_t *st,
+                           const picosynth_sample_t **sample,
+                           uint32_t *from)
+{
+    unsigned gen = atomic_load_explicit(&st->gen, memory_order_acquire);
+    if (gen == atomic_load_explicit(&st->ack, memory_order_relaxed))
+        return false;
+    *sample = atomic_load_explicit(&st->sample, memory_order_relaxed);
+    *from = stream_start(*sample);
+    atomic_store_explicit(&st->fill, 0, memory_order_relaxed);
+    atomic_store_explicit(&st->total, UINT32_MAX, memory_order_relaxed);
+    atomic_store_explicit(&st->ack, gen, memory_order_release);
+    return true;
+}
+
+q15_t *picosynth_stream_reserve(picosynth_stream_t *st, uint32_t *n)
+{
+    uint32_t fill = atomic_load_explicit(&st->fill, memory_order_relaxed);
+    uint32_t used =
+        fill - atomic_load_explicit(&st->read, memory_order_acquire);
+    uint32_t at = fill & st->mask;
+    /* A note-on rewinds read before the producer has caught up */
+    *n = used > st->mask ? 0 : st->mask + 1 - used;
+    if (*n > st->mask + 1 - at)
+        *n = st->mask + 1 - at;
+    return st->buf + at;
+}
+
+void picosynth_stream_commit(picosynth_stream_t *st, uint32_t n)
+{
+    uint32_t fill = atomic_load_explicit(&st->fill, memory_order_relaxed);
+    atomic_store_explicit(&st->fill, fill + n, memory_order_release);
+}
+
+void picosynth_stream_end(picosynth_stream_t *st)
+{
+    uint32_t fill = atomic_load_explicit(&st->fill, memory_order_relaxed);
+    atomic_store_explicit(&st->total, fill, memory_order_release);
+}
+
+bool picosynth_stream_released(const picosynth_stream_t *st)
+{
+    return atomic_load_explicit(&st->released, memory_order_relaxed);
+}
+
+#define MODAL_ONE (1 << 30)
+
+/* cos(2 pi @phase / 2^32) in Q30 for @phase up to half a cycle, by its
+ * Taylor series over the first quadrant. Accurate to a few parts in 1e9,
+ * which keeps low, slowly decaying modes in tune.
+ */
+static int32_t modal_cos(uint32_t phase)
+{
+    bool neg = phase > (1u << 30);
+    if (neg)
+        phase = (1u << 31) - phase;
+    /* pi / 2 in Q30 turns a Q32 cycle into Q30 radians */
+    int64_t w = (int64_t) (((uint64_t) phase * 1686629713u) >> 30);
+    int64_t w2 = (w * w) >> 30;
+    /* Horner form: 1 - w^2/2 (1 - w^2/12 (1 - w^2/30 (...))) */
+    static const int32_t div[6] = {132, 90, 56, 30, 12, 2};
+    int64_t t = MODAL_ONE;
+    for (int k = 0; k < 6; k++)
+        t = MODAL_ONE - ((w2 * t) >> 30) / div[k];
+    return (int32_t) (neg ? -t : t);
+}
+
+/* exp(-ln 2 / @samples) in Q30: the pole radius of a mode halving every
+ * @samples samples
+ */
+static int32_t modal_radius(uint32_t samples)
+{
+    int64_t x = 744261118 / (int64_t) (samples ? samples : 1); /* ln 2 */
+    int64_t t = MODAL_ONE;
+    for (int k = 8; k >= 1; k--)
+        t = MODAL_ONE - ((x * t) >> 30) / k;
+    return (int32_t) t;
+}
+
+void picosynth_modes_set(picosynth_modes_t *modes,
+                         uint16_t k,
+                         uint32_t freq_hz,
+                         uint32_t half_life_ms,
+                         q15_t gain)
+{
+    if (!modes || k >= PICOSYNTH_MODAL_MAX)
+        return;
+    /* Fraction of a cycle per sample, in Q32, up to Nyquist */
+    uint64_t phase = ((uint64_t) freq_hz << 32) / SAMPLE_RATE;
+    int64_t c = modal_cos(phase > (1u << 31) ? 1u << 31 : (uint32_t) phase);
+    int64_t r = modal_radius(PICOSYNTH_MS(half_life_ms));
+    uint32_t sn =
+        isqrt64((uint64_t) (MODAL_ONE - c) * (uint64_t) (MODAL_ONE + c));
+
+    /* Q30 products shifted once more for Q29 */
+    modes->b1[k] = (int32_t) ((2 * r * c) >> 31);
+    modes->b2[k] = (int32_t) -((r * r) >> 31);
+    modes->a0[k] = (int32_t) (((int64_t) gain * sn) >> 16);
+    if (modes->count <= k)
+        modes->count = (uint16_t) (k + 1);
+}
+
+void picosynth_init_modal(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *in,
+                          const picosynth_modes_t *modes,
+                          int32_t *state)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_MODAL;
+    n->modal.in = in;
+    n->modal.modes = modes;
+    if (modes && state) {
+        n->modal.y = state;
+        n->modal.count = modes->count;
+        memset(state, 0, 2u * modes->count * sizeof(int32_t));
+    }
+}
+
+void picosynth_init_unison(picosynth_node_t *n,
+                           const q15_t *gain,
+                           const q15_t *freq,
+                           picosynth_wave_func_t wave,
+                           const picosynth_unison_params_t *params)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_UNISON;
+    n->uni.freq = freq;
+    n->uni.wave = wave;
+    n->uni.count = 1;
+    if (params) {
+        uint8_t voices = params->voices;
+        if (voices > PICOSYNTH_UNISON_MAX)
+            voices = PICOSYNTH_UNISON_MAX;
+        if (voices > 1) {
+            uint32_t detune =
+                params->detune < 0 ? 0u : (uint32_t) params->detune;
+            n->uni.count = voices;
+            n->uni.step = (detune << 16) / (voices - 1u);
         }
+        n->uni.phase = params->phase < 0 ? 0 : params->phase;
     }
+}
 
-    if (s->num_voices > 1) {
-        q15_t gain = Q15_MAX / s->num_voices;
-        out = (int32_t) (((int64_t) out * gain) >> 15);
+/* Fixed operator rate in 1/2^32 cycles per sample, up to Nyquist */
+static uint32_t fm_fixed_inc(uint32_t hz)
+{
+    if (hz > SAMPLE_RATE / 2)
+        hz = SAMPLE_RATE / 2;
+    return (uint32_t) (((uint64_t) hz << 32) / SAMPLE_RATE);
+}
+
+void picosynth_init_fm_op(picosynth_node_t *n,
+                          const q15_t *gain,
+                          const q15_t *freq,
+                          const q15_t *pm,
+                          const picosynth_fm_op_params_t *params)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_FM_OP;
+    n->fop.freq = freq;
+    n->fop.pm = pm;
+    n->fop.ratio = 1u << 16;
+    if (params) {
+        n->fop.ratio = params->ratio;
+        n->fop.fixed = fm_fixed_inc(params->fixed_hz);
+        n->fop.feedback = params->feedback;
     }
+}
 
-    /* DC blocker: y[n] = x[n] - x[n-1] + alpha * y[n-1]
-     * Removes DC offset introduced by waveshaping and asymmetric waveforms.
-     * Uses int64_t to prevent overflow, clamps state. No rounding on feedback
-     * (truncation ensures full decay to zero, rounding leaves residual DC).
+static const struct {
+    uint8_t ops;
+    uint8_t mod[PICOSYNTH_FM_OPS];
+    uint8_t carriers;
+} fm_algorithms[] = {
+    [PICOSYNTH_FM_STACK4] = {4, {1 << 1, 1 << 2, 1 << 3}, 0x01},
+    [PICOSYNTH_FM_PAIRS4] = {4, {1 << 1, 0, 1 << 3}, 0x05},
+    [PICOSYNTH_FM_BRANCH4] = {4, {0x0E}, 0x01},
+    [PICOSYNTH_FM_ORGAN4] = {4, {0}, 0x0F},
+    [PICOSYNTH_FM_DX1] = {6, {1 << 1, 0, 1 << 3, 1 << 4, 1 << 5}, 0x05},
+    [PICOSYNTH_FM_DX5] = {6, {1 << 1, 0, 1 << 3, 0, 1 << 5}, 0x15},
+};
+
+bool picosynth_fm_set_algorithm(picosynth_fm_patch_t *patch,
+                                picosynth_fm_algorithm_t algo,
+                                q15_t feedback)
+{
+    if (!patch ||
+        (unsigned) algo >= sizeof(fm_algorithms) / sizeof(fm_algorithms[0]))
+        return false;
+    patch->ops = fm_algorithms[algo].ops;
+    memcpy(patch->mod, fm_algorithms[algo].mod, sizeof(patch->mod));
+    patch->carriers = fm_algorithms[algo].carriers;
+    patch->feedback_op = (uint8_t) (patch->ops - 1);
+    patch->feedback = feedback;
+    return true;
+}
+
+void picosynth_fm_set_op(picosynth_fm_patch_t *patch,
+                         uint8_t k,
+                         uint32_t ratio,
+                         uint32_t fixed_hz,
+                         q15_t level,
+                         uint32_t half_life_ms)
+{
+    if (!patch || k >= PICOSYNTH_FM_OPS)
+        return;
+    picosynth_fm_operator_t *op = &patch->op[k];
+    op->ratio = ratio;
+    op->fixed = ratio ? 0 : fm_fixed_inc(fixed_hz);
+    op->level = level;
+    op->rate = 0;
+    if (half_life_ms) {
+        /* Q16.16 halvings per sample, as for partials */
+        uint32_t hl = PICOSYNTH_MS(half_life_ms);
+        op->rate = hl ? (65536u + hl / 2) / hl : 65536u;
+    }
+}
+
+void picosynth_init_fm(picosynth_node_t *n,
+                       const q15_t *gain,
+                       const q15_t *freq,
+                       const picosynth_fm_patch_t *patch)
+{
+    memset(n, 0, sizeof(picosynth_node_t));
+    n->gain = gain;
+    n->type = PICOSYNTH_NODE_FM;
+    n->fm.freq = freq;
+    n->fm.patch = patch;
+}
+
+/* Branch-free select: returns @a when @cond is 1, @b when @cond is 0 */
+static inline int32_t ct_sel(int32_t cond, int32_t a, int32_t b)
+{
+    return b ^ ((a ^ b) & -cond);
+}
+
+/* Node kernels, written on plain values so the per-instance graph walk and
+ * the group's per-member rows share the exact same arithmetic.
+ */
+static inline int32_t sat32(int64_t x)
+{
+    x = x > 0x7FFFFFFF ? 0x7FFFFFFF : x;
+    return (int32_t) (x < -0x7FFFFFFF - 1 ? -0x7FFFFFFF - 1 : x);
+}
+
+/* Amplitude modulation by a gain input */
+static inline int32_t apply_gain(int32_t x, q15_t gain)
+{
+    return (int32_t) (((int64_t) x * gain) >> 15);
+}
+
+/* Oscillator phase advance */
+static inline int32_t osc_step(int32_t phase, int32_t freq, int32_t detune)
+{
+    return (int32_t) (((uint32_t) (phase + freq + detune)) &
+                      (uint32_t) Q15_MAX);
+}
+
+/* Envelope output is scaled down and squared for a non-linear curve */
+static inline int32_t env_level(int32_t state, q15_t sustain)
+{
+    int32_t x = (state & ENVELOPE_STATE_VALUE_MASK) >> 4;
+    x = (x * x) >> 15; /* Squared curve */
+    return sustain < 0 ? -x : x;
+}
+
+/* Single-pole low-pass output; high-pass is the input minus this */
+static inline int32_t lp_level(int32_t accum, q15_t coeff)
+{
+    return (int32_t) (((int64_t) accum * coeff) >> 15);
+}
+
+/* SVF high-pass: hp = in - lp - q*bp
+ * Computed at internal <<8 scale for consistency with state, then scaled
+ * down. Uses int64_t to prevent overflow.
+ */
+static inline int32_t svf_hp_level(int32_t in, int32_t lp, int32_t bp, q15_t q)
+{
+    int64_t q_bp = ((int64_t) bp * q) >> 15;
+    return sat32(((int64_t) in << 8) - lp - q_bp) >> 8;
+}
+
+/* Smooth coefficient changes to avoid zipper noise.
+ * Time constant: ~256 samples (~23ms @ 11kHz, ~6ms @ 44kHz).
+ */
+static inline q15_t glide(q15_t cur, q15_t target)
+{
+    int32_t delta = (int32_t) target - cur;
+    int32_t step = delta >> 8;
+    step = step ? step : (delta > 0) - (delta < 0);
+    return q15_sat((int32_t) cur + step);
+}
+
+/* Single-pole filter accumulator update:
+ * accum += (input - output)
+ * where output is the filtered signal from the previous sample.
+ * This implements a simple recursive filter.
+ */
+static inline int32_t flt_step(int32_t accum, int32_t in, q15_t out)
+{
+    /* Saturating 32-bit add: overflow when both operands share a sign the
+     * wrapped result lacks
      */
-    int64_t delta = (int64_t) out - (int64_t) s->dc_x_prev;
-    int64_t fb = ((int64_t) DC_BLOCK_ALPHA * (int64_t) s->dc_y_prev) >> 15;
-    int64_t acc = delta + fb;
+    int32_t d = in - out;
+    int32_t r = (int32_t) ((uint32_t) accum + (uint32_t) d);
+    int32_t ovf = ((accum ^ r) & (d ^ r)) < 0;
+    return ct_sel(ovf, ct_sel(accum < 0, INT32_MIN, INT32_MAX), r);
+}
 
-    /* Clamp to int32 to keep state sane for the next sample */
-    if (acc > INT32_MAX)
-        acc = INT32_MAX;
-    else if (acc < INT32_MIN)
-        acc = INT32_MIN;
+/* State Variable Filter update:
+ * hp = in - lp - q*bp
+ * lp_new = lp + f*bp
+ * bp_new = bp + f*hp
+ *
+ * States stored with <<8 scaling for precision; int64_t intermediates
+ * prevent overflow with large scaled values.
+ */
+static inline void svf_step(int32_t in,
+                            q15_t f,
+                            q15_t q,
+                            int32_t *lp,
+                            int32_t *bp)
+{
+    int64_t q_bp = ((int64_t) *bp * q) >> 15;
+    int32_t hp = sat32(((int64_t) in << 8) - *lp - q_bp);
+    int32_t f_bp = (int32_t) (((int64_t) *bp * f) >> 15);
+    int32_t f_hp = (int32_t) (((int64_t) hp * f) >> 15);
+    *lp = sat32((int64_t) *lp + f_bp);
+    *bp = sat32((int64_t) *bp + f_hp);
+}
+
+/* ((int64_t) x * c) >> 15 in 32-bit arithmetic, exact for |x| < 2^30:
+ * splitting x at bit 15 keeps both partial products in range, and the low
+ * part's floor is the only rounding. Lets envelope rows vectorize on targets
+ * without a 64-bit multiply.
+ */
+static inline int32_t mul_q15_split(int32_t x, q15_t c)
+{
+    return (x >> 15) * c + (((x & 0x7FFF) * c) >> 15);
+}
 
-    int32_t dc_out = (int32_t) acc;
-    s->dc_x_prev = out;
-    s->dc_y_prev = dc_out;
+/* 2^(-i/16) in Q15, for the fractional part of partial decay */
+static const int32_t decay_exp2[17] = {
+    32768, 31379, 30048, 28774, 27554, 26386, 25268, 24196, 23170,
+    22188, 21247, 20347, 19484, 18658, 17867, 17109, 16384,
+};
 
-    return soft_clip(dc_out);
+/* Master phase advance. Unlike an oscillator the phase runs over the full
+ * 32 bits, so partials with fractional ratios see no jump at its wrap.
+ */
+static inline int32_t additive_step(int32_t phase, int32_t freq)
+{
+    return (int32_t) ((uint32_t) phase + (uint32_t) freq);
+}
+
+/* Level of a partial halving every 1/@rate samples, @time samples in.
+ * Interpolates 2^-x between table points; zero after 16 halvings.
+ */
+static inline int32_t decay_gain(uint32_t rate, uint32_t time)
+{
+    uint64_t x = (uint64_t) time * rate;
+    uint32_t ip = (uint32_t) (x >> 16);
+    uint32_t idx = (uint32_t) (x >> 12) & 15;
+    int32_t fr = (int32_t) (x & 0xFFF);
+    int32_t g = decay_exp2[idx] +
+                (((decay_exp2[idx + 1] - decay_exp2[idx]) * fr) >> 12);
+    return g >> (ip > 16 ? 16 : ip);
+}
+
+/* Additive output: sum of the bank's partials at master phase @phase.
+ * Partial k's phase is @phase * ratio[k], which stays exact across the
+ * master phase's wrap because 2^32 is a multiple of the Q15 cycle.
+ * Partials at or above Nyquist are masked rather than skipped, so the
+ * loop has no data-dependent branches.
+ */
+static inline int32_t additive_level(const picosynth_partials_t *bank,
+                                     uint32_t phase,
+                                     uint32_t time,
+                                     int32_t freq)
+{
+    int32_t sum = 0;
+    for (int k = 0; k < bank->count; k++) {
+        uint32_t r = bank->ratio[k];
+        uint32_t p = (uint32_t) (((uint64_t) phase * r) >> 16) & Q15_MAX;
+        int32_t inc = (int32_t) (((int64_t) freq * r) >> 16);
+        int32_t amp = (bank->amp[k] * decay_gain(bank->rate[k], time)) >> 15;
+        amp &= -(int32_t) (inc < 16384 && inc > -16384);
+        sum += (picosynth_sine_impl((q15_t) p) * amp) >> 15;
+    }
+    return sum;
+}
+
+/* Sample @d (Q16.16, at least 1) behind write position @pos of a
+ * power-of-two ring, linearly interpolated. Wraps by masking.
+ */
+static inline int32_t line_tap(const q15_t *line,
+                               uint32_t mask,
+                               uint32_t pos,
+                               uint32_t d)
+{
+    uint32_t i = (pos - (d >> 16)) & mask;
+    int32_t a = line[i], b = line[(i - 1u) & mask];
+    return a + (((b - a) * (int32_t) ((d >> 1) & 0x7FFF) + 16384) >> 15);
+}
+
+static inline int32_t string_tap(const picosynth_string_t *st, uint32_t d)
+{
+    return line_tap(st->line, st->len - 1u, st->pos, d);
+}
+
+/* Advance the loop one sample: blend the tap with the one a sample older
+ * (the loss filter, delay damping / 2), scale by the loop gain, add the
+ * excitation input and write it back
+ */
+static inline void string_step(picosynth_string_t *st,
+                               int32_t freq,
+                               int32_t excite)
+{
+    uint32_t d = string_delay(st, freq);
+    int32_t x0 = string_tap(st, d), x1 = string_tap(st, d + 65536u);
+    /* The loop gain truncates toward zero: flooring would build up into DC
+     * and rounding would leave small values circulating forever
+     */
+    int32_t y = x0 + (((x1 - x0) * (st->damping >> 1) + 16384) >> 15);
+    y = y * st->feedback / 32768 + excite;
+    st->line[st->pos] = q15_sat(y);
+    st->pos = (uint16_t) ((st->pos + 1u) & (st->len - 1u));
+}
+
+/* Delay for modulation @mod, in Q16.16 samples, clamped to what the line
+ * holds: at least one sample, at most len - 2
+ */
+static inline uint32_t delay_time(const picosynth_delay_t *dl, int32_t mod)
+{
+    int64_t d = (int64_t) dl->time + (((int64_t) mod * dl->depth) >> 15);
+    int64_t hi = (int64_t) (dl->len - 2u) << 16;
+    d = d < 65536 ? 65536 : d;
+    return (uint32_t) (d > hi ? hi : d);
+}
+
+/* Delay output: the line read back from write position @pos */
+static inline q15_t delay_level(const picosynth_delay_t *dl, uint32_t pos)
+{
+    if (!dl->line)
+        return 0;
+    uint32_t d = delay_time(dl, dl->mod ? *dl->mod : 0);
+    return (q15_t) line_tap(dl->line, dl->len - 1u, pos, d);
+}
+
+/* Whether @sp wraps at its loop end with the key held (@gate) or not */
+static inline bool sampler_looping(const picosynth_sample_t *sp, bool gate)
+{
+    return sp->loop_start < sp->loop_end && sp->loop_end <= sp->len &&
+           (sp->loop == PICOSYNTH_LOOP_ON ||
+            (sp->loop == PICOSYNTH_LOOP_SUSTAIN && gate));
+}
+
+/* Sample at whole position @pos plus @frac (Q16), interpolated towards
+ * the next one: the loop start at the loop end, silence past the end
+ */
+static inline int32_t sampler_level(const picosynth_sample_t *sp,
+                                    uint32_t pos,
+                                    uint32_t frac,
+                                    bool gate)
+{
+    if (!sp || pos >= sp->len)
+        return 0;
+    uint32_t next = pos + 1;
+    if (next == sp->loop_end && sampler_looping(sp, gate))
+        next = sp->loop_start;
+    int32_t a = sp->data[pos], b = next < sp->len ? sp->data[next] : 0;
+    return a + (((b - a) * (int32_t) (frac >> 1)) >> 15);
+}
+
+/* Advance @pos and @frac by the step for @freq. Past the loop end the
+ * position wraps back into the loop; past the end it stays there.
+ */
+static inline uint32_t sampler_step(const picosynth_sampler_t *sm,
+                                    uint32_t pos,
+                                    uint32_t *frac,
+                                    int32_t freq,
+                                    bool gate)
+{
+    const picosynth_sample_t *sp = sm->sample;
+    if (!sp || pos >= sp->len)
+        return pos;
+    bool loop = sampler_looping(sp, gate);
+    /* Rounded, so the root note steps by exactly one sample */
+    uint64_t step =
+        ((uint64_t) (freq > 0 ? freq : 0) * sm->scale + 0x8000) >> 16;
+    uint64_t p = ((uint64_t) pos << 16 | *frac) + step;
+    uint64_t whole = p >> 16;
+    *frac = (uint32_t) p & 0xFFFF;
+    if (loop && whole >= sp->loop_end)
+        return sp->loop_start + (uint32_t) ((whole - sp->loop_start) %
+                                            (sp->loop_end - sp->loop_start));
+    if (whole >= sp->len) {
+        *frac = 0;
+        return sp->len;
+    }
+    return (uint32_t) whole;
+}
+
+/* Stream frame @k of the current note: 1 with it in *@x, 0 if it has not
+ * arrived, -1 (and silence) past the end of the note
+ */
+static inline int stream_frame(picosynth_stream_t *st, uint32_t k, int32_t *x)
+{
+    *x = 0;
+    if (atomic_load_explicit(&st->ack, memory_order_acquire) !=
+        atomic_load_explicit(&st->gen, memory_order_relaxed))
+        return 0;
+    if (k < atomic_load_explicit(&st->fill, memory_order_acquire)) {
+        *x = st->buf[k & st->mask];
+        return 1;
+    }
+    return k >= atomic_load_explicit(&st->total, memory_order_acquire) ? -1
+                                                                        : 0;
+}
+
+/* Frame @u of a note played from the first @b frames of @sp, then @st */
+static inline int streamed_frame(picosynth_stream_t *st,
+                                 const picosynth_sample_t *sp,
+                                 uint32_t b,
+                                 uint32_t u,
+                                 int32_t *x)
+{
+    if (u < b) {
+        *x = sp->data[u];
+        return 1;
+    }
+    return stream_frame(st, u - b, x);
+}
+
+/* Streamed sampler output at @u plus @frac; silent while frames are
+ * missing
+ */
+static inline int32_t stream_level(const picosynth_sampler_t *sm,
+                                   uint32_t b,
+                                   uint32_t u,
+                                   uint32_t frac)
+{
+    int32_t a, c;
+    if (!streamed_frame(sm->stream, sm->sample, b, u, &a) ||
+        !streamed_frame(sm->stream, sm->sample, b, u + 1, &c))
+        return 0;
+    return a + (((c - a) * (int32_t) (frac >> 1)) >> 15);
+}
+
+/* Advance a streamed note. The position only moves once the frame after
+ * it has arrived, and it tells the producer which frames are free.
+ */
+static inline uint32_t stream_step(const picosynth_sampler_t *sm,
+                                   uint32_t b,
+                                   uint32_t u,
+                                   uint32_t *frac,
+                                   int32_t freq,
+                                   bool gate)
+{
+    picosynth_stream_t *st = sm->stream;
+    if (!gate && !atomic_load_explicit(&st->released, memory_order_relaxed))
+        atomic_store_explicit(&st->released, 1, memory_order_relaxed);
+
+    int32_t x;
+    int ready = streamed_frame(st, sm->sample, b, u + 1, &x);
+    if (ready < 0) {
+        /* Step onto the end of the note and stay there */
+        if (streamed_frame(st, sm->sample, b, u, &x) > 0) {
+            *frac = 0;
+            u++;
+        }
+        return u;
+    }
+    if (!ready) {
+        unsigned lost =
+            atomic_load_explicit(&st->underruns, memory_order_relaxed);
+        atomic_store_explicit(&st->underruns, lost + 1, memory_order_relaxed);
+        return u;
+    }
+    uint64_t step =
+        ((uint64_t) (freq > 0 ? freq : 0) * sm->scale + 0x8000) >> 16;
+    uint64_t p = ((uint64_t) u << 16 | *frac) + step;
+    *frac = (uint32_t) p & 0xFFFF;
+    u = p >> 47 ? INT32_MAX : (uint32_t) (p >> 16);
+    if (u > b) {
+        /* A step of several frames stops at the last one written, so read
+         * never passes fill while the note is still streaming
+         */
+        uint32_t fill = atomic_load_explicit(&st->fill, memory_order_acquire);
+        if (u - b >= fill &&
+            fill != atomic_load_explicit(&st->total, memory_order_acquire))
+            u = b + fill - 1;
+    }
+    if (u > b)
+        atomic_store_explicit(&st->read, u - b, memory_order_release);
+    return u;
+}
+
+/* Modal output: the sum of every mode's latest value, Q23 to Q15 */
+static inline int32_t modal_level(const picosynth_modal_t *m)
+{
+    int64_t sum = 0;
+    for (int k = 0; k < m->count; k++)
+        sum += m->y[k];
+    return (int32_t) (sum >> 8);
+}
+
+/* Advance every mode one sample with input @x. The coefficient and state
+ * rows are walked in lockstep with no branches, so the loop vectorizes.
+ * Values are clamped rather than wrapped if a mode is driven at its
+ * resonance hard enough to leave the Q23 headroom.
+ */
+static inline void modal_step(picosynth_modal_t *m, int32_t x)
+{
+    const picosynth_modes_t *md = m->modes;
+    int32_t *y1 = m->y, *y2 = m->y + m->count;
+    int64_t in = (int64_t) x << 8;
+    for (int k = 0; k < m->count; k++) {
+        int64_t acc = (int64_t) md->b1[k] * y1[k] +
+                      (int64_t) md->b2[k] * y2[k] + md->a0[k] * in;
+        acc = (acc + (1 << 28)) >> 29;
+        acc = acc > INT32_MAX ? INT32_MAX : acc;
+        acc = acc < -INT32_MAX ? -INT32_MAX : acc;
+        y2[k] = y1[k];
+        y1[k] = (int32_t) acc;
+    }
+}
+
+/* 1/sqrt(n) in Q15: unison voices add up like uncorrelated signals. One
+ * voice passes unscaled.
+ */
+static const uint16_t unison_norm[PICOSYNTH_UNISON_MAX + 1] = {
+    0,     32768, 23170, 18919, 16384, 14654, 13377, 12385, 11585,
+    10923, 10362, 9880,  9459,  9088,  8758,  8461,  8192,
+};
+
+/* Unison output at master phase @master and spread phase @spread. Voice k
+ * starts at a golden-ratio fraction of a cycle times the phase spread.
+ * Sawtooth voices are computed inline over all PICOSYNTH_UNISON_MAX slots
+ * with unused ones masked, so the loop has a fixed trip count and
+ * vectorizes; other waveforms go through the function pointer.
+ */
+static inline int32_t unison_level(const picosynth_unison_t *u,
+                                   uint32_t master,
+                                   uint32_t spread)
+{
+    uint32_t p = master - (u->count - 1u) * spread;
+    uint32_t ph = (uint32_t) u->phase << 1;
+    int32_t sum = 0;
+    if (u->wave == picosynth_wave_saw) {
+        for (uint32_t k = 0; k < PICOSYNTH_UNISON_MAX; k++) {
+            uint32_t pk = p + 2 * k * spread + ((k * 0x9E3779B9u) >> 16) * ph;
+            int32_t x = (int32_t) ((pk >> 17) * 2) - Q15_MAX;
+            sum += x & -(int32_t) (k < u->count);
+        }
+    } else if (u->wave) {
+        for (uint32_t k = 0; k < u->count; k++) {
+            uint32_t pk = p + 2 * k * spread + ((k * 0x9E3779B9u) >> 16) * ph;
+            sum += u->wave((q15_t) (pk >> 17));
+        }
+    }
+    return (int32_t) (((int64_t) sum * unison_norm[u->count]) >> 15);
+}
+
+/* Master phase advance, from a Q15 phase increment to 1/2^32 cycles */
+static inline int32_t unison_step(int32_t master, int32_t freq)
+{
+    return (int32_t) ((uint32_t) master + ((uint32_t) freq << 17));
+}
+
+/* Spread phase advance: @freq (in 1/2^32 cycles) times u->step */
+static inline uint32_t unison_spread_inc(const picosynth_unison_t *u,
+                                         int32_t freq)
+{
+    return (uint32_t) (((int64_t) freq * u->step) >> 14);
+}
+
+/* Operator phase in Q15 cycles: @ratio times the master phase (exact
+ * across its wrap, see additive_level()) or @time samples at the fixed
+ * rate
+ */
+static inline uint32_t fm_phase(uint32_t ratio,
+                                uint32_t fixed,
+                                uint32_t master,
+                                uint32_t time)
+{
+    return ratio ? (uint32_t) (((uint64_t) master * ratio) >> 16)
+                 : (time * fixed) >> 17;
+}
+
+/* Self-modulation from the average of the last two outputs in @history */
+static inline int32_t fm_feedback(uint32_t history, q15_t depth)
+{
+    int32_t sum = (int16_t) (history & 0xFFFF) + (int16_t) (history >> 16);
+    return (sum * depth) >> 16;
+}
+
+static inline uint32_t fm_push(uint32_t history, q15_t out)
+{
+    return (history << 16) | (uint16_t) out;
+}
+
+/* Phase-modulated sine. Modulation is doubled, so a full-scale modulator
+ * swings the phase by +/- 2 cycles (index 4 pi).
+ */
+static inline int32_t fm_sine(uint32_t phase, int32_t pm)
+{
+    return picosynth_sine_impl((q15_t) ((phase + ((uint32_t) pm << 1)) &
+                                        Q15_MAX));
+}
+
+static inline int32_t fm_op_level(const picosynth_fm_op_t *op,
+                                  uint32_t master,
+                                  uint32_t time,
+                                  uint32_t history,
+                                  int32_t pm)
+{
+    uint32_t ph = fm_phase(op->ratio, op->fixed, master, time);
+    return fm_sine(ph, pm + fm_feedback(history, op->feedback));
+}
+
+/* 1/n in Q15 for the carrier sum */
+static const uint16_t fm_carrier_norm[PICOSYNTH_FM_OPS + 1] = {
+    0, 32768, 16384, 10923, 8192, 6554, 5461,
+};
+
+/* All operators of @p for one sample, highest first so every modulator
+ * is ready before the operators it feeds. Modulator and carrier masks are
+ * applied arithmetically. The feedback operator's output is returned in
+ * @fb_out for the caller to push into the history once the sample is
+ * committed.
+ */
+static inline int32_t fm_level(const picosynth_fm_patch_t *p,
+                               uint32_t master,
+                               uint32_t time,
+                               uint32_t history,
+                               q15_t *fb_out)
+{
+    int32_t out[PICOSYNTH_FM_OPS] = {0};
+    int32_t sum = 0, carriers = 0;
+    int ops = p->ops > PICOSYNTH_FM_OPS ? PICOSYNTH_FM_OPS : p->ops;
+    for (int k = ops - 1; k >= 0; k--) {
+        const picosynth_fm_operator_t *op = &p->op[k];
+        int32_t pm = 0;
+        /* Walk only the set bits above k; masked to the active ops */
+        unsigned m = (p->mod[k] & ((1u << ops) - 1)) >> (k + 1);
+        for (const int32_t *src = out + k + 1; m; m >>= 1, src++)
+            pm += *src & -(int32_t) (m & 1);
+        int32_t is_fb = -(int32_t) (k == p->feedback_op);
+        pm += fm_feedback(history, p->feedback) & is_fb;
+        int32_t amp = (op->level * decay_gain(op->rate, time)) >> 15;
+        out[k] = (fm_sine(fm_phase(op->ratio, op->fixed, master, time), pm) *
+                  amp) >> 15;
+        int32_t is_carrier = (p->carriers >> k) & 1;
+        sum += out[k] & -is_carrier;
+        carriers += is_carrier;
+    }
+    *fb_out = p->feedback_op < ops ? (q15_t) out[p->feedback_op] : 0;
+    return (sum * fm_carrier_norm[carriers]) >> 15;
+}
+
+/* Inputs gathered per summing bus chunk */
+#define SUM_CHUNK 16
+
+/* Summing bus for one sample. Inputs are gathered into a fixed-size,
+ * zero-padded chunk so the multiply-accumulate runs as one vectorized
+ * loop per chunk. Each product is scaled back to Q15 before it is added,
+ * so 255 full-scale inputs fit the int32 accumulator; saturation is left
+ * to the single q15_sat() when the node output is committed.
+ */
+static int32_t sum_level(const picosynth_sum_t *b)
+{
+    int32_t acc = 0;
+    for (int base = 0; base < b->count; base += SUM_CHUNK) {
+        int32_t x[SUM_CHUNK], g[SUM_CHUNK];
+        int left = b->count - base;
+        for (int j = 0; j < SUM_CHUNK; j++) {
+            const q15_t *in = j < left ? b->in[base + j] : NULL;
+            x[j] = in ? *in : 0;
+            /* 32768 is exact unity; Q15_MAX would lose an LSB */
+            g[j] = b->gains && j < left ? b->gains[base + j] : 32768;
+        }
+        for (int j = 0; j < SUM_CHUNK; j++)
+            acc += (x[j] * g[j]) >> 15;
+    }
+    return acc;
+}
+
+/* Quarter cycle of sin(2 pi i / 1024) in Q15: FFT twiddles and partial
+ * phases for every supported frame size
+ */
+static const int16_t spectral_sin_q[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809,
+    2009, 2210, 2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811,
+    4011, 4210, 4410, 4609, 4808, 5007, 5205, 5404, 5602, 5800,
+    5998, 6195, 6393, 6590, 6786, 6983, 7179, 7375, 7571, 7767,
+    7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319, 9512, 9704,
+    9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+    11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462,
+    13645, 13828, 14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+    15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673, 16846, 17018,
+    17189, 17360, 17530, 17700, 17869, 18037, 18204, 18371, 18537, 18703,
+    18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000, 20159, 20317,
+    20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+    22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311,
+    23452, 23592, 23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680,
+    24811, 24942, 25072, 25201, 25329, 25456, 25582, 25708, 25832, 25955,
+    26077, 26198, 26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+    27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001, 28105, 28208,
+    28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+    29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037,
+    30117, 30195, 30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783,
+    30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297, 31356, 31414,
+    31470, 31526, 31580, 31633, 31685, 31736, 31785, 31833, 31880, 31926,
+    31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250, 32285, 32318,
+    32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+    32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737,
+    32745, 32752, 32757, 32761, 32765, 32766, 32767,
+};
+
+static inline int32_t spectral_sin(uint32_t i)
+{
+    uint32_t q = i & 255;
+    switch ((i >> 8) & 3) {
+    case 0:
+        return spectral_sin_q[q];
+    case 1:
+        return spectral_sin_q[256 - q];
+    case 2:
+        return -spectral_sin_q[q];
+    default:
+        return -spectral_sin_q[256 - q];
+    }
+}
+
+/* Hann window spectrum in Q15 at bin offsets 0..4 in steps of 1/32, for a
+ * frame normalized to one sample: 0.5 at the partial's own frequency.
+ * Offsets of 4 bins and more are dropped (below -41dB).
+ */
+static const int16_t spectral_hann[129] = {
+    16384, 16373, 16342, 16291, 16219, 16127, 16015, 15884, 15734, 15565,
+    15377, 15172, 14951, 14712, 14458, 14190, 13907, 13611, 13302, 12981,
+    12650, 12310, 11960, 11603, 11238, 10868, 10493, 10114, 9731, 9347,
+    8962, 8576, 8192, 7809, 7428, 7051, 6678, 6311, 5949, 5593,
+    5245, 4904, 4572, 4248, 3934, 3630, 3337, 3053, 2781, 2520,
+    2271, 2033, 1807, 1593, 1391, 1200, 1022, 855, 700, 556,
+    423, 302, 191, 90, 0, -81, -152, -214, -267, -312,
+    -350, -380, -403, -420, -431, -437, -437, -433, -425, -413,
+    -397, -379, -359, -336, -312, -286, -259, -232, -204, -177,
+    -149, -122, -96, -70, -45, -22, 0, 21, 40, 57,
+    73, 87, 99, 110, 119, 126, 131, 135, 137, 138,
+    138, 136, 132, 128, 123, 117, 109, 102, 93, 84,
+    75, 66, 56, 46, 37, 27, 18, 9, 0,
+};
+
+/* Window spectrum at bin offset @d (Q16.16), linearly interpolated */
+static inline int32_t spectral_kernel(int32_t d)
+{
+    uint32_t a = (uint32_t) (d < 0 ? -d : d);
+    if (a >= 4u << 16)
+        return 0;
+    uint32_t i = a >> 11, fr = a & 2047;
+    int32_t k0 = spectral_hann[i], k1 = spectral_hann[i + 1];
+    return k0 + (((k1 - k0) * (int32_t) fr) >> 11);
+}
+
+/* Extra fraction bits kept through the inverse FFT */
+#define SPECTRAL_GUARD 2
+
+/* In-place radix-2 FFT, forward or inverse, halving at every stage so the
+ * result is scaled by 1/size. Inputs must stay below 2^30 in magnitude.
+ */
+static void spectral_fft(int32_t *re,
+                         int32_t *im,
+                         uint8_t log2_size,
+                         bool inverse)
+{
+    uint32_t n = 1u << log2_size;
+
+    for (uint32_t i = 1, j = 0; i < n; i++) {
+        uint32_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            int32_t t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint32_t half = len / 2;
+        uint32_t step = (1u << PICOSYNTH_SPECTRAL_MAX_LOG2) / len;
+        for (uint32_t k = 0; k < half; k++) {
+            int32_t wr = spectral_sin(k * step + 256);
+            int32_t wi = inverse ? spectral_sin(k * step)
+                                 : -spectral_sin(k * step);
+            for (uint32_t i = k; i < n; i += len) {
+                uint32_t b = i + half;
+                int32_t tr = (int32_t) (((int64_t) re[b] * wr -
+                                         (int64_t) im[b] * wi) >> 15);
+                int32_t ti = (int32_t) (((int64_t) re[b] * wi +
+                                         (int64_t) im[b] * wr) >> 15);
+                re[b] = (re[i] - tr) >> 1;
+                im[b] = (im[i] - ti) >> 1;
+                re[i] = (re[i] + tr) >> 1;
+                im[i] = (im[i] + ti) >> 1;
+            }
+        }
+    }
+}
+
+/* Start a hop: retire the samples just played, then add the next frame,
+ * centred half a frame ahead. Each partial contributes the Hann window's
+ * spectrum around its frequency, rotated to its phase at the centre; the
+ * real part of the inverse transform is then the sum of Hann-windowed
+ * partials, and Hann windows a quarter frame apart add up to 2.
+ */
+static void spectral_hop(picosynth_spectral_t *sp,
+                         const picosynth_partials_t *bank,
+                         uint32_t phase,
+                         uint32_t time,
+                         int32_t freq)
+{
+    uint32_t size = sp->size, hop = sp->hop, mask = size - 1;
+    uint8_t lg = sp->log2_size;
+
+    memmove(sp->ola, sp->ola + hop, (size - hop) * sizeof(int32_t));
+    memset(sp->ola + size - hop, 0, hop * sizeof(int32_t));
+    memset(sp->re, 0, size * sizeof(int32_t));
+    memset(sp->im, 0, size * sizeof(int32_t));
+
+    uint32_t centre = phase + (uint32_t) freq * (size / 2);
+    time += size / 2;
+    for (int k = 0; k < bank->count; k++) {
+        uint32_t r = bank->ratio[k];
+        /* Partial frequency in bins, Q16.16 */
+        int64_t bin = ((int64_t) freq * r * (int64_t) size) >> 15;
+        if (bin <= 0 || bin >= (int64_t) (size / 2) << 16)
+            continue;
+        int32_t amp = (bank->amp[k] * decay_gain(bank->rate[k], time)) >> 15;
+        if (!amp)
+            continue;
+        /* Rotating by -j makes the real part a sine, like an oscillator */
+        uint32_t p = (uint32_t) (((uint64_t) centre * r) >> 16) & Q15_MAX;
+        uint32_t ti = (p + 16) >> 5; /* Nearest of 1024 table phases */
+        int32_t c = spectral_sin(ti + 256), s = spectral_sin(ti);
+
+        int32_t b0 = (int32_t) (bin >> 16);
+        for (int32_t b = b0 - 3; b <= b0 + 4; b++) {
+            int32_t d = (int32_t) (((int64_t) b << 16) - bin);
+            int32_t x = ((amp * spectral_kernel(d)) >> 15) *
+                        (1 << (lg + SPECTRAL_GUARD));
+            uint32_t j = (uint32_t) b & mask;
+            sp->re[j] += (int32_t) (((int64_t) x * s) >> 15);
+            sp->im[j] -= (int32_t) (((int64_t) x * c) >> 15);
+        }
+    }
+
+    spectral_fft(sp->re, sp->im, lg, true);
+    for (uint32_t i = 0; i < size; i++)
+        sp->ola[i] += sp->re[(i + size / 2) & mask];
+    sp->pos = 0;
+}
+
+/* Branch-free AHDSR update, used by the constant-time kernel and by
+ * instance groups. Evaluates attack, hold, decay and release every sample
+ * and selects the result, matching env_update() exactly.
+ */
+static PICOSYNTH_ALWAYS_INLINE void env_step(const picosynth_env_t *env,
+                                             int32_t gate,
+                                             int32_t *state,
+                                             int32_t *block_rate,
+                                             uint8_t *block_counter,
+                                             int32_t *hold_counter)
+{
+    const int32_t peak = (int32_t) Q15_MAX << 4;
+    const int32_t mode_hold = (int32_t) ENVELOPE_MODE_HOLD;
+    const int32_t mode_decay = (int32_t) ENVELOPE_MODE_DECAY;
+    uint32_t mode = ((uint32_t) *state) & ENVELOPE_MODE_MASK;
+    int32_t val = *state & ENVELOPE_STATE_VALUE_MASK;
+    int32_t is_hold = mode == ENVELOPE_MODE_HOLD;
+    int32_t is_decay = mode == ENVELOPE_MODE_DECAY;
+    int32_t is_attack = !is_hold & !is_decay;
+
+    /* Block rate reload, same selection order as the default kernel */
+    int32_t reload = *block_counter == 0;
+    int32_t rate =
+        ct_sel(is_decay, -env->decay, ct_sel(is_hold, 0, env->attack));
+    rate = ct_sel(gate, rate, -env->release);
+    int32_t b_rate = ct_sel(reload, rate, *block_rate);
+    int32_t counter = ct_sel(reload, PICOSYNTH_BLOCK_SIZE, *block_counter) - 1;
+
+    /* Attack: ramp to peak, then enter hold (if configured) or decay */
+    int32_t a_val = val + b_rate;
+    int32_t a_done = a_val >= peak;
+    a_val = ct_sel(a_done, peak, a_val);
+    int32_t has_hold = env->hold > 0;
+    int32_t a_mode = ct_sel(a_done, ct_sel(has_hold, mode_hold, mode_decay), 0);
+
+    /* Hold: stay at peak while the counter runs down */
+    int32_t hc = *hold_counter - (*hold_counter > 0);
+    int32_t h_done = hc == 0;
+    int32_t h_mode = ct_sel(h_done, mode_decay, mode_hold);
+
+    /* Decay: exponential approach toward sustain */
+    int32_t sus_abs = env->sustain < 0 ? -env->sustain : env->sustain;
+    int32_t sus_level = sus_abs << 4;
+    int32_t d_val =
+        sus_level + mul_q15_split(val - sus_level, env->decay_coeff);
+    d_val = ct_sel(d_val < sus_level, sus_level, d_val);
+
+    /* Release: exponential fade, snapped to zero near the floor */
+    int32_t r_val = mul_q15_split(val, env->release_coeff);
+    r_val = ct_sel(r_val < 16, 0, r_val);
+
+    int32_t g_val = ct_sel(is_decay, d_val, ct_sel(is_hold, peak, a_val));
+    int32_t g_mode =
+        ct_sel(is_decay, mode_decay, ct_sel(is_hold, h_mode, a_mode));
+    int32_t transition = (is_attack & a_done) | (is_hold & h_done);
+    int32_t g_hc = ct_sel(
+        is_hold, hc,
+        ct_sel(is_attack & a_done & has_hold, env->hold, *hold_counter));
+
+    *state = ct_sel(gate, g_val | g_mode, r_val);
+    *block_rate = b_rate;
+    *block_counter = (uint8_t) ct_sel(gate & transition, 0, counter);
+    *hold_counter = ct_sel(gate, g_hc, *hold_counter);
+}
+
+#if !PICOSYNTH_CONSTANT_TIME
+/* Block-based AHDSR envelope: compute rate at block boundaries, check for
+ * phase transitions per-sample.
+ */
+static void env_update(picosynth_node_t *n, bool gate)
+{
+    uint32_t mode = ((uint32_t) n->state) & ENVELOPE_MODE_MASK;
+
+    /* Recompute rate at block boundary */
+    if (n->env.block_counter == 0) {
+        n->env.block_counter = PICOSYNTH_BLOCK_SIZE;
+        if (!gate) {
+            n->env.block_rate = -n->env.release; /* Informational */
+        } else if (mode == ENVELOPE_MODE_DECAY) {
+            n->env.block_rate = -n->env.decay; /* Informational */
+        } else if (mode == ENVELOPE_MODE_HOLD) {
+            n->env.block_rate = 0; /* Hold at peak */
+        } else {
+            n->env.block_rate = n->env.attack;
+        }
+    }
+    n->env.block_counter--;
+
+    /* Apply rate based on mode */
+    int32_t val = n->state & ENVELOPE_STATE_VALUE_MASK;
+    if (gate) {
+        if (mode == ENVELOPE_MODE_DECAY) {
+            /* Decay/Sustain phase */
+            q15_t sus_abs =
+                n->env.sustain < 0 ? -n->env.sustain : n->env.sustain;
+            int32_t sus_level = sus_abs << 4;
+            int32_t delta = val - sus_level;
+            /* Exponential decay of delta toward sustain */
+            val = sus_level +
+                  (int32_t) (((int64_t) delta * n->env.decay_coeff) >> 15);
+            if (val < sus_level)
+                val = sus_level;
+        } else if (mode == ENVELOPE_MODE_HOLD) {
+            /* Hold phase: maintain peak, count down */
+            val = (int32_t) Q15_MAX << 4; /* Stay at peak */
+            if (n->env.hold_counter > 0)
+                n->env.hold_counter--;
+            if (n->env.hold_counter == 0) {
+                /* Transition to decay mode */
+                mode = ENVELOPE_MODE_DECAY;
+                n->env.block_counter = 0;
+            }
+        } else {
+            /* Attack phase: ramp up to peak */
+            val += n->env.block_rate;
+            if (val >= (int32_t) Q15_MAX << 4) {
+                val = (int32_t) Q15_MAX << 4;
+                /* Check if hold phase is configured */
+                if (n->env.hold > 0) {
+                    mode = ENVELOPE_MODE_HOLD;
+                    n->env.hold_counter = n->env.hold;
+                } else {
+                    mode = ENVELOPE_MODE_DECAY;
+                }
+                /* Force rate recalculation next sample */
+                n->env.block_counter = 0;
+            }
+        }
+        n->state = (int32_t) (((uint32_t) val) | mode);
+    } else {
+        /* Exponential release (mode cleared) */
+        val = (int32_t) (((int64_t) val * n->env.release_coeff) >> 15);
+        if (val < 16)
+            val = 0;
+        n->state = val; /* mode bits clear during release */
+    }
+}
+#endif
+
+static q15_t soft_clip(int32_t x)
+{
+    int32_t sign = x < 0 ? -1 : 1;
+    uint32_t abs_x = x < 0 ? (uint32_t) (-(int64_t) x) : (uint32_t) x;
+    uint32_t a = abs_x >> 3;
+    if (a > Q15_MAX / 4)
+        a = Q15_MAX / 4;
+    return q15_sat(picosynth_sine_impl((q15_t) a) * sign);
+}
+
+/* Run every active voice for one sample; returns the sum of voice outputs
+ * and adds each voice's sends into @sends (one entry per bus)
+ */
+static int32_t process_voices(picosynth_t *s, int32_t *sends)
+{
+    int32_t out = 0;
+    uint32_t *prev_seed = lfsr_seed;
+    lfsr_seed = &s->noise_seed;
+
+    for (int vi = 0; vi < s->num_voices; vi++) {
+#if !PICOSYNTH_CONSTANT_TIME
+        /* Skip inactive voices via bitfield check (voices 0-15 only) */
+        if (vi < 16 && !(s->voice_enable_mask & (1u << vi)))
+            continue;
+#endif
+
+        picosynth_voice_t *v = &s->voices[vi];
+        picosynth_node_t *nodes = v->nodes;
+        int32_t tmp[PICOSYNTH_MAX_NODES];
+        if (s->noise_per_note)
+            lfsr_seed = &v->noise_seed;
+
+        /* Two-pass processing per voice:
+         * 1. Compute outputs from current state of all nodes.
+         *    This ensures inputs for a node (e.g. filter) are based on the
+         *    outputs of other nodes (e.g. oscillator) from the same sample.
+         * 2. Update the internal state of all nodes for the next sample.
+         *    This prevents race conditions where a node's state is updated
+         *    before its output has been consumed by other nodes.
+         */
+
+        /* Pass 1: compute outputs from current state.
+         * Constant-time mode ignores the usage mask so every wired node runs.
+         */
+        uint8_t mask = PICOSYNTH_CONSTANT_TIME ? 0 : v->node_usage_mask;
+        for (int i = 0; i < v->n_nodes && nodes[i].type != PICOSYNTH_NODE_NONE;
+             i++) {
+            /* Skip nodes that don't affect output (if mask is set) */
+            if (mask && !(mask & (1u << i))) {
+                tmp[i] = 0;
+                continue;
+            }
+            picosynth_node_t *n = &nodes[i];
+            switch (n->type) {
+            case PICOSYNTH_NODE_OSC:
+                tmp[i] = n->osc.wave(n->state & Q15_MAX);
+                break;
+            case PICOSYNTH_NODE_ENV:
+                tmp[i] = env_level(n->state, n->env.sustain);
+                break;
+            case PICOSYNTH_NODE_LP:
+                tmp[i] = lp_level(n->flt.accum, n->flt.coeff);
+                break;
+            case PICOSYNTH_NODE_HP:
+                /* High-pass is the input signal minus the low-pass signal */
+                tmp[i] = n->flt.in
+                             ? *n->flt.in - lp_level(n->flt.accum, n->flt.coeff)
+                             : 0;
+                break;
+            case PICOSYNTH_NODE_SVF_LP:
+                /* SVF low-pass output: scaled down from internal precision */
+                tmp[i] = n->svf.lp >> 8;
+                break;
+            case PICOSYNTH_NODE_SVF_HP:
+                tmp[i] = svf_hp_level(n->svf.in ? *n->svf.in : 0, n->svf.lp,
+                                      n->svf.bp, n->svf.q);
+                break;
+            case PICOSYNTH_NODE_SVF_BP:
+                /* SVF band-pass output */
+                tmp[i] = n->svf.bp >> 8;
+                break;
+            case PICOSYNTH_NODE_MIX: {
+                int32_t sum = 0;
+                for (int j = 0; j < 3; j++)
+                    if (n->mix.in[j])
+                        sum += *n->mix.in[j];
+                tmp[i] = sum;
+                break;
+            }
+            case PICOSYNTH_NODE_SUM:
+                tmp[i] = sum_level(&n->sum);
+                break;
+            case PICOSYNTH_NODE_DELAY:
+                n->dly.wet = delay_level(&n->dly, (uint32_t) n->state);
+                tmp[i] = n->dly.wet;
+                break;
+            case PICOSYNTH_NODE_SAMPLER: {
+                uint32_t b = n->smp.stream ? stream_start(n->smp.sample) : 0;
+                tmp[i] = b ? stream_level(&n->smp, b, (uint32_t) n->state,
+                                          n->smp.frac)
+                           : sampler_level(n->smp.sample, (uint32_t) n->state,
+                                           n->smp.frac, v->gate);
+                break;
+            }
+            case PICOSYNTH_NODE_ADDITIVE:
+                tmp[i] = additive_level(n->add.bank, (uint32_t) n->state,
+                                        n->add.time,
+                                        n->add.freq ? *n->add.freq : 0);
+                break;
+            case PICOSYNTH_NODE_SPECTRAL: {
+                picosynth_spectral_t *sp = n->spec.engine;
+                if (!sp || !n->spec.bank) {
+                    tmp[i] = 0;
+                    break;
+                }
+                if (sp->pos >= sp->hop)
+                    spectral_hop(sp, n->spec.bank, (uint32_t) n->state,
+                                 n->spec.time,
+                                 n->spec.freq ? *n->spec.freq : 0);
+                tmp[i] = sp->ola[sp->pos] >> (SPECTRAL_GUARD + 1);
+                break;
+            }
+            case PICOSYNTH_NODE_STRING: {
+                int32_t f = n->str.freq ? *n->str.freq : 0;
+                tmp[i] = n->str.line
+                             ? string_tap(&n->str, string_delay(&n->str, f))
+                             : 0;
+                break;
+            }
+            case PICOSYNTH_NODE_MODAL:
+                tmp[i] = n->modal.y ? modal_level(&n->modal) : 0;
+                break;
+            case PICOSYNTH_NODE_UNISON:
+                tmp[i] = unison_level(&n->uni, (uint32_t) n->state,
+                                      n->uni.spread);
+                break;
+            case PICOSYNTH_NODE_FM_OP:
+                tmp[i] = fm_op_level(&n->fop, (uint32_t) n->state, n->fop.time,
+                                     n->fop.history,
+                                     n->fop.pm ? *n->fop.pm : 0);
+                break;
+            case PICOSYNTH_NODE_FM:
+                tmp[i] = n->fm.patch ? fm_level(n->fm.patch,
+                                                (uint32_t) n->state,
+                                                n->fm.time, n->fm.history,
+                                                &n->fm.fb_next)
+                                     : 0;
+                break;
+            default:
+                tmp[i] = 0;
+                break;
+            }
+
+            if (n->gain)
+                tmp[i] = apply_gain(tmp[i], *n->gain);
+        }
+
+        /* Pass 2: update state for next sample */
+        for (int i = 0; i < v->n_nodes && nodes[i].type != PICOSYNTH_NODE_NONE;
+             i++) {
+            /* Skip nodes that don't affect output (if mask is set) */
+            if (mask && !(mask & (1u << i)))
+                continue;
+            picosynth_node_t *n = &nodes[i];
+            n->out = q15_sat(tmp[i]);
+
+            switch (n->type) {
+            case PICOSYNTH_NODE_OSC:
+                n->state = osc_step(n->state, n->osc.freq ? *n->osc.freq : 0,
+                                    n->osc.detune ? *n->osc.detune : 0);
+                break;
+            case PICOSYNTH_NODE_ENV:
+#if PICOSYNTH_CONSTANT_TIME
+                env_step(&n->env, v->gate, &n->state, &n->env.block_rate,
+                         &n->env.block_counter, &n->env.hold_counter);
+#else
+                env_update(n, v->gate);
+#endif
+                break;
+            case PICOSYNTH_NODE_LP:
+            case PICOSYNTH_NODE_HP:
+                n->flt.coeff = glide(n->flt.coeff, n->flt.coeff_target);
+                n->flt.accum = flt_step(n->flt.accum,
+                                        n->flt.in ? *n->flt.in : 0, n->out);
+                break;
+            case PICOSYNTH_NODE_SVF_LP:
+            case PICOSYNTH_NODE_SVF_HP:
+            case PICOSYNTH_NODE_SVF_BP:
+                n->svf.f = glide(n->svf.f, n->svf.f_target);
+                svf_step(n->svf.in ? *n->svf.in : 0, n->svf.f, n->svf.q,
+                         &n->svf.lp, &n->svf.bp);
+                break;
+            case PICOSYNTH_NODE_ADDITIVE:
+                n->state = additive_step(n->state,
+                                         n->add.freq ? *n->add.freq : 0);
+                n->add.time += n->add.time != UINT32_MAX;
+                break;
+            case PICOSYNTH_NODE_SPECTRAL:
+                n->state = additive_step(n->state,
+                                         n->spec.freq ? *n->spec.freq : 0);
+                n->spec.time += n->spec.time != UINT32_MAX;
+                if (n->spec.engine)
+                    n->spec.engine->pos++;
+                break;
+            case PICOSYNTH_NODE_STRING:
+                if (n->str.line)
+                    string_step(&n->str, n->str.freq ? *n->str.freq : 0,
+                                n->str.excite ? *n->str.excite : 0);
+                break;
+            case PICOSYNTH_NODE_MODAL:
+                if (n->modal.y)
+                    modal_step(&n->modal, n->modal.in ? *n->modal.in : 0);
+                break;
+            case PICOSYNTH_NODE_UNISON: {
+                int32_t f = n->uni.freq ? *n->uni.freq : 0;
+                n->state = unison_step(n->state, f);
+                n->uni.spread += unison_spread_inc(&n->uni, f);
+                break;
+            }
+            case PICOSYNTH_NODE_FM_OP:
+                n->state = additive_step(n->state,
+                                         n->fop.freq ? *n->fop.freq : 0);
+                n->fop.time += n->fop.time != UINT32_MAX;
+                n->fop.history = fm_push(n->fop.history, n->out);
+                break;
+            case PICOSYNTH_NODE_FM:
+                n->state = additive_step(n->state,
+                                         n->fm.freq ? *n->fm.freq : 0);
+                n->fm.time += n->fm.time != UINT32_MAX;
+                n->fm.history = fm_push(n->fm.history, n->fm.fb_next);
+                break;
+            case PICOSYNTH_NODE_DELAY:
+                /* Feedback truncates toward zero so echoes die out */
+                if (n->dly.line) {
+                    int32_t x = (n->dly.in ? *n->dly.in : 0) +
+                                n->dly.wet * n->dly.feedback / 32768;
+                    n->dly.line[n->state] = q15_sat(x);
+                    n->state = (int32_t) (((uint32_t) n->state + 1u) &
+                                          (n->dly.len - 1u));
+                }
+                break;
+            case PICOSYNTH_NODE_SAMPLER: {
+                uint32_t b = n->smp.stream ? stream_start(n->smp.sample) : 0;
+                int32_t freq = n->smp.freq ? *n->smp.freq : 0;
+                n->state = (int32_t) (b ? stream_step(&n->smp, b,
+                                                      (uint32_t) n->state,
+                                                      &n->smp.frac, freq,
+                                                      v->gate)
+                                        : sampler_step(&n->smp,
+                                                       (uint32_t) n->state,
+                                                       &n->smp.frac, freq,
+                                                       v->gate));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+#if PICOSYNTH_CONSTANT_TIME
+        /* Inactive voices were computed anyway; mask their contribution and
+         * scan every node for silence without early exit.
+         */
+        int32_t enabled = vi < 16 ? (s->voice_enable_mask >> vi) & 1 : 1;
+        int32_t vout = v->nodes[v->out_idx].out & -enabled;
+        out += vout;
+
+        int32_t level = 0;
+        for (int i = 0; i < v->n_nodes; i++)
+            level |= nodes[i].state & ENVELOPE_STATE_VALUE_MASK &
+                     -(int32_t) (nodes[i].type == PICOSYNTH_NODE_ENV);
+        if (vi < 16) {
+            int32_t silent = !v->gate & (level == 0);
+            s->voice_enable_mask &= (uint16_t) ~(-silent & (1 << vi));
+        }
+#else
+        int32_t vout = v->nodes[v->out_idx].out;
+        out += vout;
+
+        /* Disable voice when fully silent (gate off, all envelopes at zero).
+         * Only applies to voices 0-15 tracked by 16-bit mask. */
+        if (vi < 16 && !v->gate) {
+            bool silent = true;
+            for (int i = 0; i < v->n_nodes && silent; i++) {
+                if (nodes[i].type == PICOSYNTH_NODE_ENV &&
+                    (nodes[i].state & ENVELOPE_STATE_VALUE_MASK) != 0)
+                    silent = false;
+            }
+            if (silent)
+                s->voice_enable_mask &= (uint16_t) ~(1u << vi);
+        }
+#endif
+        if (s->bus_mask)
+            for (int b = 0; b < PICOSYNTH_BUSES; b++)
+                sends[b] += (vout * v->send[b]) >> 15;
+    }
+
+    lfsr_seed = prev_seed;
+    return out;
+}
+
+/* Master stage: voice-count gain, DC blocker and soft clipper */
+static inline q15_t master_step(int32_t out,
+                                uint8_t num_voices,
+                                int32_t *dc_x_prev,
+                                int32_t *dc_y_prev)
+{
+    if (num_voices > 1) {
+        q15_t gain = Q15_MAX / num_voices;
+        out = (int32_t) (((int64_t) out * gain) >> 15);
+    }
+
+    /* DC blocker: y[n] = x[n] - x[n-1] + alpha * y[n-1]
+     * Removes DC offset introduced by waveshaping and asymmetric waveforms.
+     * Uses int64_t to prevent overflow, clamps state. No rounding on feedback
+     * (truncation ensures full decay to zero, rounding leaves residual DC).
+     * Divide rather than shift: an arithmetic shift floors negative values,
+     * which would park the output at a negative offset after a note ends.
+     */
+    int64_t delta = (int64_t) out - (int64_t) *dc_x_prev;
+    int64_t fb = ((int64_t) DC_BLOCK_ALPHA * (int64_t) *dc_y_prev) / 32768;
+
+    /* Clamp to int32 to keep state sane for the next sample */
+    int32_t dc_out = sat32(delta + fb);
+    *dc_x_prev = out;
+    *dc_y_prev = dc_out;
+
+    return soft_clip(dc_out);
+}
+
+static q15_t process_master(picosynth_t *s, int32_t out)
+{
+    return master_step(out, s->num_voices, &s->dc_x_prev, &s->dc_y_prev);
+}
+
+/* Voice sum plus bus returns for @n <= PICOSYNTH_BUS_BLOCK samples. Sends
+ * are gathered for the whole block first, then every used bus runs its
+ * effect chain over its buffer once.
+ */
+static void process_block(picosynth_t *s, int32_t *sum, uint32_t n)
+{
+    if (!s->bus_mask) {
+        int32_t unused[PICOSYNTH_BUSES];
+        for (uint32_t i = 0; i < n; i++)
+            sum[i] = process_voices(s, unused);
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t sends[PICOSYNTH_BUSES] = {0};
+        sum[i] = process_voices(s, sends);
+        for (int b = 0; b < PICOSYNTH_BUSES; b++)
+            s->bus_buf[b][i] = sends[b];
+    }
+    for (int b = 0; b < PICOSYNTH_BUSES; b++) {
+        if (!(s->bus_mask & (1u << b)))
+            continue;
+        int32_t *buf = s->bus_buf[b];
+        for (int k = 0; k < s->bus_effects[b]; k++)
+            s->bus_fx[b][k](s->bus_ctx[b][k], buf, n);
+        for (uint32_t i = 0; i < n; i++)
+            sum[i] += buf[i];
+    }
+}
+
+q15_t picosynth_process(picosynth_t *s)
+{
+    if (!s)
+        return 0;
+    int32_t sum;
+    process_block(s, &sum, 1);
+    return process_master(s, sum);
+}
+
+void picosynth_render(picosynth_t *s, q15_t *out, uint32_t n)
+{
+    if (!out)
+        return;
+    if (!s) {
+        memset(out, 0, n * sizeof(q15_t));
+        return;
+    }
+    int32_t sum[PICOSYNTH_BUS_BLOCK];
+    for (uint32_t done = 0; done < n; done += PICOSYNTH_BUS_BLOCK) {
+        uint32_t len = n - done < PICOSYNTH_BUS_BLOCK ? n - done
+                                                      : PICOSYNTH_BUS_BLOCK;
+        process_block(s, sum, len);
+        for (uint32_t i = 0; i < len; i++)
+            out[done + i] = process_master(s, sum[i]);
+    }
+}
+
+void picosynth_render_voices(picosynth_t *s, int32_t *sum, uint32_t n)
+{
+    if (!s || !sum)
+        return;
+    for (uint32_t done = 0; done < n; done += PICOSYNTH_BUS_BLOCK)
+        process_block(s, sum + done,
+                      n - done < PICOSYNTH_BUS_BLOCK ? n - done
+                                                     : PICOSYNTH_BUS_BLOCK);
+}
+
+void picosynth_render_premix(picosynth_t *s,
+                             q15_t *out,
+                             const int32_t *premix,
+                             uint32_t n)
+{
+    if (!s || !out || !premix)
+        return;
+    int32_t sum[PICOSYNTH_BUS_BLOCK];
+    for (uint32_t done = 0; done < n; done += PICOSYNTH_BUS_BLOCK) {
+        uint32_t len = n - done < PICOSYNTH_BUS_BLOCK ? n - done
+                                                      : PICOSYNTH_BUS_BLOCK;
+        process_block(s, sum, len);
+        for (uint32_t i = 0; i < len; i++)
+            out[done + i] = process_master(s, sum[i] + premix[done + i]);
+    }
+}
+
+/* FDN reverb. Every line is at least a bus block long, so a block's reads
+ * all come before any of its writes could reach them: the block is read
+ * out of the lines, mixed, and written back, and each step runs across the
+ * eight lines at once.
+ */
+#define REVERB_LINES 8
+
+struct picosynth_reverb {
+    q15_t *line[REVERB_LINES];
+    uint16_t len[REVERB_LINES];
+    uint16_t pos[REVERB_LINES]; /* Oldest sample, read next */
+    int32_t gain[REVERB_LINES]; /* Q14 loop gain with 1/sqrt(8) of the mix */
+    int32_t lp[REVERB_LINES];   /* Damping low-pass state */
+    int32_t damp;               /* Low-pass coefficient, Q15_MAX = open */
+    q15_t wet;
+};
+
+/* Relative line lengths, within a ratio of two */
+static const uint8_t reverb_weight[REVERB_LINES] = {
+    89, 97, 107, 113, 127, 137, 149, 163,
+};
+
+/* Input and output signs per line, so a click does not enter or leave
+ * the network in phase on every line
+ */
+static const int32_t reverb_sign[REVERB_LINES] = {1, -1, 1, -1, -1, 1, -1, 1};
+
+/* Largest prime no greater than @n (@n >= 2) */
+static uint32_t reverb_prime(uint32_t n)
+{
+    for (;; n--) {
+        uint32_t d = 2;
+        while (d * d <= n && n % d)
+            d++;
+        if (d * d > n)
+            return n;
+    }
+}
+
+size_t picosynth_reverb_size(uint32_t memory)
+{
+    /* Struct and lines are separate arena blocks, each 8-byte aligned */
+    return ((sizeof(picosynth_reverb_t) + 7) & ~(size_t) 7) +
+           REVERB_LINES * 8u + memory;
+}
+
+picosynth_reverb_t *picosynth_reverb_create(
+    picosynth_t *s,
+    const picosynth_reverb_params_t *params)
+{
+    if (!s || !params)
+        return NULL;
+    uint32_t total = 0;
+    for (int k = 0; k < REVERB_LINES; k++)
+        total += reverb_weight[k];
+
+    /* Scaled weights are no longer coprime, so each line is rounded down
+     * to a prime, below the next line's so no two lengths are equal
+     */
+    uint16_t len[REVERB_LINES];
+    uint32_t samples = params->memory / sizeof(q15_t);
+    uint32_t next = UINT16_MAX + 1u;
+    for (int k = REVERB_LINES - 1; k >= 0; k--) {
+        uint64_t l = (uint64_t) samples * reverb_weight[k] / total;
+        l = l < next ? l : next - 1;
+        if (l < PICOSYNTH_BUS_BLOCK)
+            return NULL;
+        next = reverb_prime((uint32_t) l);
+        if (next < PICOSYNTH_BUS_BLOCK)
+            return NULL;
+        len[k] = (uint16_t) next;
+    }
+
+    size_t used = s->arena_used;
+    picosynth_reverb_t *r =
+        picosynth_arena_alloc(s, sizeof(picosynth_reverb_t));
+    if (!r)
+        return NULL;
+    memset(r, 0, sizeof(picosynth_reverb_t));
+    for (int k = 0; k < REVERB_LINES; k++) {
+        r->len[k] = len[k];
+        r->line[k] = picosynth_arena_alloc(s, len[k] * sizeof(q15_t));
+        if (!r->line[k]) {
+            s->arena_used = used;
+            return NULL;
+        }
+        memset(r->line[k], 0, len[k] * sizeof(q15_t));
+    }
+    picosynth_reverb_set(r, params);
+    return r;
+}
+
+void picosynth_reverb_set(picosynth_reverb_t *r,
+                          const picosynth_reverb_params_t *params)
+{
+    if (!r || !params)
+        return;
+    /* 60 dB is 9.966 halvings: a line of length l loses 9.966 * l / rt60
+     * of them per trip, in the Q16 fraction decay_gain() takes as a rate
+     */
+    uint32_t rt60 = PICOSYNTH_MS(params->decay_ms);
+    for (int k = 0; k < REVERB_LINES; k++) {
+        uint64_t x = rt60 ? (653135ull * r->len[k] + rt60 / 2) / rt60
+                          : UINT32_MAX;
+        int32_t g = decay_gain(x > UINT32_MAX ? UINT32_MAX : (uint32_t) x, 1);
+        /* 11585 = 32768 / sqrt(8) keeps the Hadamard mix orthonormal. Q14
+         * because mixed values reach 8 * Q15_MAX.
+         */
+        r->gain[k] = (g * 11585) >> 16;
+    }
+    r->damp = Q15_MAX - (params->damping > 0 ? params->damping : 0);
+    r->wet = params->wet;
+}
+
+/* Unnormalized 8-point Hadamard transform in place. Three identical
+ * stages of sums and differences of neighbours, each of which is a single
+ * vector step, instead of butterflies of a different span per stage.
+ */
+static inline void reverb_mix(int32_t *v)
+{
+    for (int stage = 0; stage < 3; stage++) {
+        int32_t t[REVERB_LINES];
+        for (int m = 0; m < REVERB_LINES / 2; m++) {
+            t[m] = v[2 * m] + v[2 * m + 1];
+            t[m + REVERB_LINES / 2] = v[2 * m] - v[2 * m + 1];
+        }
+        memcpy(v, t, sizeof(t));
+    }
+}
+
+static void reverb_block(picosynth_reverb_t *r, int32_t *buf, uint32_t n)
+{
+    int32_t y[PICOSYNTH_BUS_BLOCK][REVERB_LINES];
+
+    /* Read the block's oldest samples from every line */
+    for (int k = 0; k < REVERB_LINES; k++) {
+        const q15_t *line = r->line[k];
+        uint32_t p = r->pos[k];
+        for (uint32_t i = 0; i < n; i++) {
+            y[i][k] = line[p];
+            p = p + 1 == r->len[k] ? 0 : p + 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        int32_t *v = y[i];
+        /* Damping: one-pole low-pass in each loop */
+        for (int k = 0; k < REVERB_LINES; k++) {
+            r->lp[k] += (v[k] - r->lp[k]) * r->damp / 32768;
+            v[k] = r->lp[k];
+        }
+        int32_t in = q15_sat(buf[i]) / 4, out = 0;
+        for (int k = 0; k < REVERB_LINES; k++)
+            out += v[k] * reverb_sign[k];
+        /* Mix, then loop gain (truncated toward zero so the tail dies out
+         * instead of settling into a limit cycle) plus the new input
+         */
+        reverb_mix(v);
+        for (int k = 0; k < REVERB_LINES; k++)
+            v[k] = v[k] * r->gain[k] / 16384 + in * reverb_sign[k];
+        buf[i] = out / 4 * r->wet / 32768;
+    }
+
+    /* Write the block back where it was read */
+    for (int k = 0; k < REVERB_LINES; k++) {
+        q15_t *line = r->line[k];
+        uint32_t p = r->pos[k];
+        for (uint32_t i = 0; i < n; i++) {
+            line[p] = q15_sat(y[i][k]);
+            p = p + 1 == r->len[k] ? 0 : p + 1;
+        }
+        r->pos[k] = (uint16_t) p;
+    }
+}
+
+void picosynth_reverb_process(void *ctx, int32_t *buf, uint32_t n)
+{
+    picosynth_reverb_t *r = ctx;
+    if (!r || !buf)
+        return;
+    for (uint32_t done = 0; done < n; done += PICOSYNTH_BUS_BLOCK)
+        reverb_block(r, buf + done,
+                     n - done < PICOSYNTH_BUS_BLOCK ? n - done
+                                                    : PICOSYNTH_BUS_BLOCK);
+}
+
+/* Uniformly partitioned convolution (overlap-save). The response is cut
+ * into partitions of one bus block, each kept as the spectrum of the
+ * partition zero-padded to two blocks. Every block of input is transformed
+ * once into the frequency-domain delay line (FDL), multiplied against
+ * every partition's spectrum at the matching age, summed, and transformed
+ * back; the second half of the result is the next block of output.
+ */
+#define CONV_BLOCK PICOSYNTH_BUS_BLOCK
+
+#if (CONV_BLOCK & (CONV_BLOCK - 1)) != 0 || CONV_BLOCK > 512
+#error "PICOSYNTH_BUS_BLOCK must be a power of two of at most 512"
+#endif
+
+/* log2 of the transform size, two blocks */
+#define CONV_LOG2                                                   \
+    (1 + (CONV_BLOCK >= 2) + (CONV_BLOCK >= 4) + (CONV_BLOCK >= 8) + \
+     (CONV_BLOCK >= 16) + (CONV_BLOCK >= 32) + (CONV_BLOCK >= 64) +  \
+     (CONV_BLOCK >= 128) + (CONV_BLOCK >= 256) + (CONV_BLOCK >= 512))
+
+/* Input enters the FFT as Q23 and the response as Q27; the output leaves
+ * the inverse FFT with CONV_GUARD extra fraction bits. The product of the
+ * two scaled spectra is shifted by CONV_SHIFT to make up the difference
+ * and the 1/size of both forward transforms.
+ */
+#define CONV_GUARD 4
+#define CONV_SHIFT (35 - CONV_GUARD - 2 * CONV_LOG2)
+
+/* A spectrum holds bins 0..CONV_BLOCK-1 as CONV_BLOCK real parts followed
+ * by CONV_BLOCK imaginary parts. The spectra of real signals mirror about
+ * bin CONV_BLOCK, and bins 0 and CONV_BLOCK are real, so the latter is
+ * kept in the imaginary slot of bin 0.
+ */
+#define CONV_SPECTRUM (2 * CONV_BLOCK)
+
+struct picosynth_conv {
+    const int32_t *h; /* Partition spectra, earliest first */
+    int32_t *fdl;     /* Input spectra, newest at head, older after it */
+    uint32_t parts;
+    uint32_t head;
+    uint32_t pos;                /* Samples of the current block taken */
+    int32_t in[2 * CONV_BLOCK];  /* Previous and current input block */
+    int32_t out[CONV_BLOCK];     /* Output for the current block */
+    q15_t wet;
+};
+
+size_t picosynth_conv_size(uint32_t ir_len)
+{
+    size_t parts = ((size_t) ir_len + CONV_BLOCK - 1) / CONV_BLOCK;
+    return ((sizeof(picosynth_conv_t) + 7) & ~(size_t) 7) +
+           2 * parts * CONV_SPECTRUM * sizeof(int32_t);
+}
+
+/* Transform two blocks of @x, scaled by @shift, into packed spectrum @out */
+static void conv_spectrum(int32_t *out, const int32_t *x, int shift)
+{
+    int32_t re[2 * CONV_BLOCK], im[2 * CONV_BLOCK];
+    for (uint32_t j = 0; j < 2 * CONV_BLOCK; j++) {
+        re[j] = x[j] * (1 << shift);
+        im[j] = 0;
+    }
+    spectral_fft(re, im, CONV_LOG2, false);
+    memcpy(out, re, CONV_BLOCK * sizeof(int32_t));
+    memcpy(out + CONV_BLOCK, im, CONV_BLOCK * sizeof(int32_t));
+    out[CONV_BLOCK] = re[CONV_BLOCK];
+}
+
+picosynth_conv_t *picosynth_conv_create(picosynth_t *s,
+                                        const q15_t *ir,
+                                        uint32_t ir_len,
+                                        q15_t wet)
+{
+    if (!s || !ir || !ir_len)
+        return NULL;
+
+    uint32_t parts = (ir_len + CONV_BLOCK - 1) / CONV_BLOCK;
+    size_t bytes = (size_t) parts * CONV_SPECTRUM * sizeof(int32_t);
+    size_t used = s->arena_used;
+    picosynth_conv_t *c = picosynth_arena_alloc(s, sizeof(picosynth_conv_t));
+    int32_t *h = c ? picosynth_arena_alloc(s, bytes) : NULL;
+    int32_t *fdl = h ? picosynth_arena_alloc(s, bytes) : NULL;
+    if (!fdl) {
+        s->arena_used = used;
+        return NULL;
+    }
+    memset(c, 0, sizeof(picosynth_conv_t));
+    memset(fdl, 0, bytes);
+    c->fdl = fdl;
+    c->h = h;
+    c->parts = parts;
+    c->wet = wet;
+
+    for (uint32_t p = 0; p < parts; p++) {
+        int32_t x[2 * CONV_BLOCK] = {0};
+        for (uint32_t j = 0; j < CONV_BLOCK && p * CONV_BLOCK + j < ir_len;
+             j++)
+            x[j] = ir[p * CONV_BLOCK + j];
+        conv_spectrum(h + p * CONV_SPECTRUM, x, 12);
+    }
+    return c;
+}
+
+void picosynth_conv_set_wet(picosynth_conv_t *c, q15_t wet)
+{
+    if (c)
+        c->wet = wet;
+}
+
+/* Products summed over partitions, scaled into the inverse FFT's range */
+static inline int32_t conv_scale(int64_t acc)
+{
+    acc >>= CONV_SHIFT;
+    if (acc > (1 << 30) - 1)
+        return (1 << 30) - 1;
+    if (acc < -(1 << 30) + 1)
+        return -(1 << 30) + 1;
+    return (int32_t) acc;
+}
+
+static void conv_block(picosynth_conv_t *c)
+{
+    /* The new block's spectrum takes the slot of the oldest one */
+    c->head = c->head ? c->head - 1 : c->parts - 1;
+    conv_spectrum(c->fdl + c->head * CONV_SPECTRUM, c->in, 8);
+    memcpy(c->in, c->in + CONV_BLOCK, CONV_BLOCK * sizeof(int32_t));
+
+    /* Multiply-accumulate partition p against the input p blocks old */
+    int64_t ar[CONV_BLOCK] = {0}, ai[CONV_BLOCK] = {0};
+    uint32_t slot = c->head;
+    for (uint32_t p = 0; p < c->parts; p++) {
+        const int32_t *xr = c->fdl + slot * CONV_SPECTRUM;
+        const int32_t *hr = c->h + p * CONV_SPECTRUM;
+        const int32_t *xi = xr + CONV_BLOCK, *hi = hr + CONV_BLOCK;
+        ar[0] += (int64_t) xr[0] * hr[0];
+        ai[0] += (int64_t) xi[0] * hi[0];
+        for (uint32_t k = 1; k < CONV_BLOCK; k++) {
+            ar[k] += (int64_t) xr[k] * hr[k] - (int64_t) xi[k] * hi[k];
+            ai[k] += (int64_t) xr[k] * hi[k] + (int64_t) xi[k] * hr[k];
+        }
+        slot = slot + 1 == c->parts ? 0 : slot + 1;
+    }
+
+    /* Unpack into the full mirrored spectrum and transform back */
+    int32_t re[2 * CONV_BLOCK], im[2 * CONV_BLOCK];
+    re[0] = conv_scale(ar[0]);
+    re[CONV_BLOCK] = conv_scale(ai[0]);
+    im[0] = im[CONV_BLOCK] = 0;
+    for (uint32_t k = 1; k < CONV_BLOCK; k++) {
+        re[k] = re[2 * CONV_BLOCK - k] = conv_scale(ar[k]);
+        im[k] = conv_scale(ai[k]);
+        im[2 * CONV_BLOCK - k] = -im[k];
+    }
+    spectral_fft(re, im, CONV_LOG2, true);
+    for (uint32_t j = 0; j < CONV_BLOCK; j++)
+        c->out[j] = re[CONV_BLOCK + j] >> CONV_GUARD;
+}
+
+void picosynth_conv_process(void *ctx, int32_t *buf, uint32_t n)
+{
+    picosynth_conv_t *c = ctx;
+    if (!c || !buf)
+        return;
+    for (uint32_t i = 0; i < n; i++) {
+        c->in[CONV_BLOCK + c->pos] = q15_sat(buf[i]);
+        buf[i] = (int32_t) ((int64_t) c->out[c->pos] * c->wet / 32768);
+        if (++c->pos == CONV_BLOCK) {
+            conv_block(c);
+            c->pos = 0;
+        }
+    }
+}
+
+/* Double-buffered output.
+ * The event queue is single-producer/single-consumer: the queuing context
+ * owns tail, the render context owns head, and each publishes its index
+ * with release ordering after touching the slot.
+ */
+#if (PICOSYNTH_DBUF_EVENTS & (PICOSYNTH_DBUF_EVENTS - 1)) != 0
+#error "PICOSYNTH_DBUF_EVENTS must be a power of two"
+#endif
+
+typedef struct {
+    uint8_t on; /* 1 = note-on, 0 = note-off */
+    uint8_t voice;
+    uint8_t note;
+} dbuf_event_t;
+
+struct picosynth_dbuf {
+    picosynth_t *synth;
+    q15_t *buf;
+    uint32_t half;
+    bool owns_buf;
+    uint8_t next_half; /* Half the next interrupt should ask for */
+    uint32_t overruns;
+    atomic_uint head, tail;
+    dbuf_event_t events[PICOSYNTH_DBUF_EVENTS];
+};
+
+picosynth_dbuf_t *picosynth_dbuf_create(picosynth_t *s,
+                                        q15_t *buf,
+                                        uint32_t half)
+{
+    if (!s || half == 0 || half > UINT32_MAX / 2 / sizeof(q15_t))
+        return NULL;
+    picosynth_dbuf_t *d = calloc(1, sizeof(picosynth_dbuf_t));
+    if (!d)
+        return NULL;
+    d->owns_buf = !buf;
+    if (!buf)
+        buf = malloc(2 * half * sizeof(q15_t));
+    if (!buf) {
+        free(d);
+        return NULL;
+    }
+    memset(buf, 0, 2 * half * sizeof(q15_t));
+    d->synth = s;
+    d->buf = buf;
+    d->half = half;
+    atomic_init(&d->head, 0);
+    atomic_init(&d->tail, 0);
+    return d;
+}
+
+void picosynth_dbuf_destroy(picosynth_dbuf_t *d)
+{
+    if (!d)
+        return;
+    if (d->owns_buf)
+        free(d->buf);
+    free(d);
+}
+
+q15_t *picosynth_dbuf_buffer(picosynth_dbuf_t *d)
+{
+    return d ? d->buf : NULL;
+}
+
+static bool dbuf_queue(picosynth_dbuf_t *d, dbuf_event_t e)
+{
+    if (!d)
+        return false;
+    unsigned tail = atomic_load_explicit(&d->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&d->head, memory_order_acquire);
+    if (tail - head >= PICOSYNTH_DBUF_EVENTS)
+        return false;
+    d->events[tail & (PICOSYNTH_DBUF_EVENTS - 1)] = e;
+    atomic_store_explicit(&d->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool picosynth_dbuf_note_on(picosynth_dbuf_t *d, uint8_t voice, uint8_t note)
+{
+    return dbuf_queue(d, (dbuf_event_t) {1, voice, note});
+}
+
+bool picosynth_dbuf_note_off(picosynth_dbuf_t *d, uint8_t voice)
+{
+    return dbuf_queue(d, (dbuf_event_t) {0, voice, 0});
+}
+
+void picosynth_dbuf_render(picosynth_dbuf_t *d, uint8_t half)
+{
+    if (!d || half > 1)
+        return;
+    if (half != d->next_half)
+        d->overruns++;
+    d->next_half = (uint8_t) (half ^ 1);
+
+    unsigned head = atomic_load_explicit(&d->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&d->tail, memory_order_acquire);
+    for (; head != tail; head++) {
+        const dbuf_event_t *e = &d->events[head & (PICOSYNTH_DBUF_EVENTS - 1)];
+        if (e->on)
+            picosynth_note_on(d->synth, e->voice, e->note);
+        else
+            picosynth_note_off(d->synth, e->voice);
+    }
+    atomic_store_explicit(&d->head, head, memory_order_release);
+
+    picosynth_render(d->synth, d->buf + (size_t) half * d->half, d->half);
+}
+
+uint32_t picosynth_dbuf_overruns(const picosynth_dbuf_t *d)
+{
+    return d ? d->overruns : 0;
+}
+
+/* Instance groups.
+ * A group runs many copies of one patch as a structure of arrays: every
+ * piece of per-instance state is a row indexed by member, so each node
+ * kernel becomes a loop over members with contiguous loads and no
+ * per-member dispatch or pointer chasing, which the compiler can turn into
+ * SIMD code. Patch parameters are shared and stay scalar. Members are
+ * rendered a tile at a time so the rows in use stay in L1 over a block.
+ *
+ * Unlike picosynth_process(), a voice is computed for all members of a tile
+ * once any of them plays it; members whose voice is idle keep their state
+ * (stores are masked by the run row), so results match per-instance
+ * rendering exactly.
+ */
+#ifndef PICOSYNTH_GROUP_TILE
+#define PICOSYNTH_GROUP_TILE 64
+#endif
+
+/* Node input: a per-member row, a shared value, or unconnected (NULL) */
+typedef struct {
+    const q15_t *src;
+    bool row; /* src[j] belongs to member j; otherwise *src is shared */
+} group_input_t;
+
+typedef struct {
+    picosynth_node_type_t type;
+    picosynth_wave_func_t wave;
+    group_input_t gain;
+    group_input_t in[3]; /* OSC: freq, detune. Filters: in. MIX: in[0..2] */
+    picosynth_env_t env; /* Envelope parameters */
+    const picosynth_partials_t *bank; /* ADDITIVE partials; in[0] is freq */
+    picosynth_unison_t uni; /* UNISON voices and detune; in[0] is freq */
+    picosynth_fm_op_t fop;  /* FM_OP ratio, feedback; in[0] freq, in[1] pm */
+    const picosynth_fm_patch_t *patch; /* FM operators; in[0] is freq */
+    picosynth_sampler_t smp; /* SAMPLER sample and scale; in[0] is freq */
+    q15_t target;        /* Filter coeff_target, SVF f_target */
+    q15_t q;             /* SVF damping */
+    const q15_t *row[4]; /* gain and in[] for the current tile */
+    q15_t *fill;         /* Backing for shared and unconnected rows */
+    /* Per-member state rows */
+    q15_t *out;
+    int32_t *state;   /* OSC/ADDITIVE/UNISON/FM phase, ENV level and mode,
+                       * SAMPLER position */
+    int32_t *a;       /* LP/HP accum, SVF lp, ENV block_rate, ADDITIVE and FM
+                       * time, UNISON spread, SAMPLER frac */
+    int32_t *b;       /* SVF bp, ENV hold_counter, FM history */
+    q15_t *coeff;     /* LP/HP coeff, SVF f, FM feedback output scratch */
+    uint8_t *counter; /* ENV block_counter */
+} group_node_t;
+
+typedef struct {
+    group_node_t *nodes;
+    uint8_t n_nodes;
+    uint8_t n_run; /* Nodes before the first unused one */
+    uint8_t out_idx;
+    uint8_t usage_mask;
+    uint8_t n_env;
+    uint8_t env_idx[PICOSYNTH_MAX_NODES];
+    /* Per-member rows */
+    uint8_t *note;
+    uint8_t *gate;
+    q15_t *freq;
+    uint32_t *noise_seed;
+} group_voice_t;
+
+struct picosynth_group {
+    group_voice_t *voices;
+    uint8_t num_voices;
+    uint16_t count;
+    uint32_t rows; /* count rounded up to whole tiles */
+    bool noise_per_note;
+    /* Per-member rows */
+    uint16_t *voice_enable_mask;
+    int32_t *dc_x_prev, *dc_y_prev;
+    uint32_t *noise_seed;
+    /* Tile scratch */
+    int32_t *tmp; /* Pass 1 outputs, one row per node */
+    int32_t *sum;
+    uint8_t *run;
+};
+
+/* Resolve a wiring pointer of @proto to a group input */
+static group_input_t group_wire(const picosynth_t *proto,
+                                const picosynth_group_t *g,
+                                const q15_t *p)
+{
+    for (int vi = 0; p && vi < proto->num_voices; vi++) {
+        const picosynth_voice_t *pv = &proto->voices[vi];
+        if (p == &pv->freq)
+            return (group_input_t) {g->voices[vi].freq, true};
+        int idx = ptr_to_node_idx(pv, p);
+        if (idx >= 0)
+            return (group_input_t) {g->voices[vi].nodes[idx].out, true};
+    }
+    return (group_input_t) {p, false};
+}
+
+static bool group_alloc_rows(picosynth_group_t *g, const picosynth_t *proto)
+{
+    size_t n = g->rows;
+    uint8_t max_nodes = 0;
+
+    g->voice_enable_mask = calloc(n, sizeof(uint16_t));
+    g->dc_x_prev = calloc(n, sizeof(int32_t));
+    g->dc_y_prev = calloc(n, sizeof(int32_t));
+    g->noise_seed = calloc(n, sizeof(uint32_t));
+    bool ok = g->voice_enable_mask && g->dc_x_prev && g->dc_y_prev &&
+              g->noise_seed;
+
+    for (int vi = 0; ok && vi < g->num_voices; vi++) {
+        group_voice_t *v = &g->voices[vi];
+        v->n_nodes = proto->voices[vi].n_nodes;
+        if (v->n_nodes > max_nodes)
+            max_nodes = v->n_nodes;
+        v->nodes = calloc(v->n_nodes ? v->n_nodes : 1, sizeof(group_node_t));
+        v->note = calloc(n, sizeof(uint8_t));
+        v->gate = calloc(n, sizeof(uint8_t));
+        v->freq = calloc(n, sizeof(q15_t));
+        v->noise_seed = calloc(n, sizeof(uint32_t));
+        ok = v->nodes && v->note && v->gate && v->freq && v->noise_seed;
+        for (int i = 0; ok && i < v->n_nodes; i++) {
+            group_node_t *nd = &v->nodes[i];
+            nd->out = calloc(n, sizeof(q15_t));
+            nd->state = calloc(n, sizeof(int32_t));
+            nd->a = calloc(n, sizeof(int32_t));
+            nd->b = calloc(n, sizeof(int32_t));
+            nd->coeff = calloc(n, sizeof(q15_t));
+            nd->counter = calloc(n, sizeof(uint8_t));
+            nd->fill = calloc(4 * PICOSYNTH_GROUP_TILE, sizeof(q15_t));
+            ok = nd->out && nd->state && nd->a && nd->b && nd->coeff &&
+                 nd->counter && nd->fill;
+        }
+    }
+
+    g->tmp = calloc((size_t) (max_nodes ? max_nodes : 1) * PICOSYNTH_GROUP_TILE,
+                    sizeof(int32_t));
+    g->sum = calloc(PICOSYNTH_GROUP_TILE, sizeof(int32_t));
+    g->run = calloc(PICOSYNTH_GROUP_TILE, sizeof(uint8_t));
+    return ok && g->tmp && g->sum && g->run;
+}
+
+/* Fill all members' rows from the prototype's node @pn */
+static void group_clone_node(picosynth_group_t *g,
+                             const picosynth_t *proto,
+                             group_node_t *nd,
+                             const picosynth_node_t *pn)
+{
+    nd->type = pn->type;
+    nd->gain = group_wire(proto, g, pn->gain);
+    int32_t a = 0, b = 0;
+    q15_t coeff = 0;
+    uint8_t counter = 0;
+
+    switch (pn->type) {
+    case PICOSYNTH_NODE_OSC:
+        nd->wave = pn->osc.wave;
+        nd->in[0] = group_wire(proto, g, pn->osc.freq);
+        nd->in[1] = group_wire(proto, g, pn->osc.detune);
+        break;
+    case PICOSYNTH_NODE_ENV:
+        nd->env = pn->env;
+        a = pn->env.block_rate;
+        b = pn->env.hold_counter;
+        counter = pn->env.block_counter;
+        break;
+    case PICOSYNTH_NODE_LP:
+    case PICOSYNTH_NODE_HP:
+        nd->in[0] = group_wire(proto, g, pn->flt.in);
+        nd->target = pn->flt.coeff_target;
+        a = pn->flt.accum;
+        coeff = pn->flt.coeff;
+        break;
+    case PICOSYNTH_NODE_SVF_LP:
+    case PICOSYNTH_NODE_SVF_HP:
+    case PICOSYNTH_NODE_SVF_BP:
+        nd->in[0] = group_wire(proto, g, pn->svf.in);
+        nd->target = pn->svf.f_target;
+        nd->q = pn->svf.q;
+        a = pn->svf.lp;
+        b = pn->svf.bp;
+        coeff = pn->svf.f;
+        break;
+    case PICOSYNTH_NODE_MIX:
+        for (int j = 0; j < 3; j++)
+            nd->in[j] = group_wire(proto, g, pn->mix.in[j]);
+        break;
+    case PICOSYNTH_NODE_ADDITIVE:
+        nd->bank = pn->add.bank;
+        nd->in[0] = group_wire(proto, g, pn->add.freq);
+        a = (int32_t) pn->add.time;
+        break;
+    case PICOSYNTH_NODE_UNISON:
+        nd->uni = pn->uni;
+        nd->in[0] = group_wire(proto, g, pn->uni.freq);
+        a = (int32_t) pn->uni.spread;
+        break;
+    case PICOSYNTH_NODE_FM_OP:
+        nd->fop = pn->fop;
+        nd->in[0] = group_wire(proto, g, pn->fop.freq);
+        nd->in[1] = group_wire(proto, g, pn->fop.pm);
+        a = (int32_t) pn->fop.time;
+        b = (int32_t) pn->fop.history;
+        break;
+    case PICOSYNTH_NODE_FM:
+        nd->patch = pn->fm.patch;
+        nd->in[0] = group_wire(proto, g, pn->fm.freq);
+        a = (int32_t) pn->fm.time;
+        b = (int32_t) pn->fm.history;
+        coeff = pn->fm.fb_next;
+        break;
+    case PICOSYNTH_NODE_SAMPLER:
+        nd->smp = pn->smp;
+        nd->in[0] = group_wire(proto, g, pn->smp.freq);
+        a = (int32_t) pn->smp.frac;
+        break;
+    default:
+        break;
+    }
+
+    for (uint32_t j = 0; j < g->rows; j++) {
+        nd->out[j] = pn->out;
+        nd->state[j] = pn->state;
+        nd->a[j] = a;
+        nd->b[j] = b;
+        nd->coeff[j] = coeff;
+        nd->counter[j] = counter;
+    }
+}
+
+picosynth_group_t *picosynth_group_create(const picosynth_t *proto,
+                                          uint16_t count)
+{
+    if (!proto || count == 0)
+        return NULL;
+    /* Spectral engines, string and delay lines, resonators, bus inputs
+     * and streams belong to one node
+     */
+    for (int vi = 0; vi < proto->num_voices; vi++) {
+        for (int i = 0; i < proto->voices[vi].n_nodes; i++) {
+            picosynth_node_type_t t = proto->voices[vi].nodes[i].type;
+            if (t == PICOSYNTH_NODE_SPECTRAL || t == PICOSYNTH_NODE_STRING ||
+                t == PICOSYNTH_NODE_MODAL || t == PICOSYNTH_NODE_SUM ||
+                t == PICOSYNTH_NODE_DELAY ||
+                (t == PICOSYNTH_NODE_SAMPLER &&
+                 proto->voices[vi].nodes[i].smp.stream))
+                return NULL;
+        }
+    }
+    /* Effect chains run once per instance */
+    if (proto->bus_mask)
+        return NULL;
+
+    picosynth_group_t *g = calloc(1, sizeof(picosynth_group_t));
+    if (!g)
+        return NULL;
+    g->count = count;
+    g->rows = (count + PICOSYNTH_GROUP_TILE - 1u) / PICOSYNTH_GROUP_TILE *
+              PICOSYNTH_GROUP_TILE;
+    g->num_voices = proto->num_voices;
+    g->noise_per_note = proto->noise_per_note;
+    g->voices = calloc(g->num_voices ? g->num_voices : 1,
+                       sizeof(group_voice_t));
+    if (!g->voices || !group_alloc_rows(g, proto)) {
+        picosynth_group_destroy(g);
+        return NULL;
+    }
+
+    for (int vi = 0; vi < g->num_voices; vi++) {
+        const picosynth_voice_t *pv = &proto->voices[vi];
+        group_voice_t *v = &g->voices[vi];
+        v->out_idx = pv->out_idx;
+        v->usage_mask = pv->node_usage_mask;
+        while (v->n_run < v->n_nodes &&
+               pv->nodes[v->n_run].type != PICOSYNTH_NODE_NONE)
+            v->n_run++;
+        for (int i = 0; i < v->n_nodes; i++) {
+            group_clone_node(g, proto, &v->nodes[i], &pv->nodes[i]);
+            if (pv->nodes[i].type == PICOSYNTH_NODE_ENV)
+                v->env_idx[v->n_env++] = (uint8_t) i;
+        }
+        for (uint32_t j = 0; j < g->rows; j++) {
+            v->note[j] = pv->note;
+            v->gate[j] = pv->gate;
+            v->freq[j] = pv->freq;
+            v->noise_seed[j] = pv->noise_seed;
+        }
+    }
+    for (uint32_t j = 0; j < g->rows; j++) {
+        g->voice_enable_mask[j] = proto->voice_enable_mask;
+        g->dc_x_prev[j] = proto->dc_x_prev;
+        g->dc_y_prev[j] = proto->dc_y_prev;
+        g->noise_seed[j] = proto->noise_seed;
+    }
+    return g;
+}
+
+void picosynth_group_destroy(picosynth_group_t *g)
+{
+    if (!g)
+        return;
+
+    for (int vi = 0; g->voices && vi < g->num_voices; vi++) {
+        group_voice_t *v = &g->voices[vi];
+        for (int i = 0; v->nodes && i < v->n_nodes; i++) {
+            free(v->nodes[i].out);
+            free(v->nodes[i].state);
+            free(v->nodes[i].a);
+            free(v->nodes[i].b);
+            free(v->nodes[i].coeff);
+            free(v->nodes[i].counter);
+            free(v->nodes[i].fill);
+        }
+        free(v->nodes);
+        free(v->note);
+        free(v->gate);
+        free(v->freq);
+        free(v->noise_seed);
+    }
+    free(g->voices);
+    free(g->voice_enable_mask);
+    free(g->dc_x_prev);
+    free(g->dc_y_prev);
+    free(g->noise_seed);
+    free(g->tmp);
+    free(g->sum);
+    free(g->run);
+    free(g);
+}
+
+uint16_t picosynth_group_size(const picosynth_group_t *g)
+{
+    return g ? g->count : 0;
+}
+
+void picosynth_group_note_on(picosynth_group_t *g,
+                             uint16_t member,
+                             uint8_t voice,
+                             uint8_t note)
+{
+    if (!g || member >= g->count || voice >= g->num_voices)
+        return;
+
+    /* Same resets as voice_note_on() */
+    group_voice_t *v = &g->voices[voice];
+    v->note[member] = note;
+    v->gate[member] = 1;
+    v->freq[member] = picosynth_midi_to_freq(note);
+    for (int i = 0; i < v->n_nodes; i++) {
+        group_node_t *nd = &v->nodes[i];
+        nd->state[member] = 0;
+        nd->out[member] = 0;
+        nd->a[member] = 0;
+        nd->b[member] = 0;
+        nd->counter[member] = 0;
+        nd->coeff[member] = nd->target;
+    }
+    if (g->noise_per_note)
+        v->noise_seed[member] = noise_note_seed(g->noise_seed[member], note);
+    if (voice < 16)
+        g->voice_enable_mask[member] |= (uint16_t) (1u << voice);
+}
+
+void picosynth_group_note_off(picosynth_group_t *g,
+                              uint16_t member,
+                              uint8_t voice)
+{
+    if (!g || member >= g->count || voice >= g->num_voices)
+        return;
+
+    group_voice_t *v = &g->voices[voice];
+    v->gate[member] = 0;
+    for (int i = 0; i < v->n_nodes; i++)
+        if (v->nodes[i].type == PICOSYNTH_NODE_ENV)
+            v->nodes[i].counter[member] = 0;
+}
+
+void picosynth_group_set_noise_seed(picosynth_group_t *g,
+                                    uint16_t member,
+                                    uint32_t seed)
+{
+    if (g && member < g->count)
+        g->noise_seed[member] = seed ? seed : LFSR_DEFAULT_SEED;
+}
+
+/* Point @nd's input rows at the tile starting at @first. Shared values
+ * are constant during a render, so they are expanded once per tile.
+ */
+static void group_bind(group_node_t *nd, uint32_t first)
+{
+    const group_input_t *in[4] = {&nd->gain, &nd->in[0], &nd->in[1],
+                                  &nd->in[2]};
+
+    for (int k = 0; k < 4; k++) {
+        q15_t *fill = nd->fill + k * PICOSYNTH_GROUP_TILE;
+        if (in[k]->src && in[k]->row) {
+            nd->row[k] = in[k]->src + first;
+            continue;
+        }
+        q15_t x = in[k]->src ? *in[k]->src : 0;
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            fill[j] = x;
+        nd->row[k] = fill;
+    }
+}
+
+/* Pass 1 for one node over the tile */
+static void group_output(picosynth_group_t *g,
+                         const group_voice_t *v,
+                         const group_node_t *nd,
+                         uint32_t first,
+                         int32_t *restrict tmp)
+{
+    const int32_t *restrict st = nd->state + first;
+    const int32_t *restrict a = nd->a + first;
+    const int32_t *restrict b = nd->b + first;
+    const q15_t *restrict c = nd->coeff + first;
+    const uint8_t *restrict run = g->run;
+
+    switch (nd->type) {
+    case PICOSYNTH_NODE_OSC: {
+        /* Built-in waveforms are pure and inline into the loop */
+#define WAVE_ROW(fn)                              \
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) \
+        tmp[j] = fn((q15_t) (st[j] & Q15_MAX))
+        if (nd->wave == picosynth_wave_sine) {
+            WAVE_ROW(picosynth_sine_impl);
+        } else if (nd->wave == picosynth_wave_saw) {
+            WAVE_ROW(picosynth_wave_saw);
+        } else if (nd->wave == picosynth_wave_square) {
+            WAVE_ROW(picosynth_wave_square);
+        } else if (nd->wave == picosynth_wave_triangle) {
+            WAVE_ROW(picosynth_wave_triangle);
+        } else if (nd->wave == picosynth_wave_falling) {
+            WAVE_ROW(picosynth_wave_falling);
+        } else if (nd->wave == picosynth_wave_exp) {
+            WAVE_ROW(picosynth_wave_exp);
+        } else {
+            /* Noise and user waveforms: running members only, each on its
+             * own LFSR
+             */
+            uint32_t *seeds =
+                g->noise_per_note ? v->noise_seed : g->noise_seed;
+            for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+                if (!run[j])
+                    continue;
+                lfsr_seed = &seeds[first + (uint32_t) j];
+                tmp[j] = nd->wave((q15_t) (st[j] & Q15_MAX));
+            }
+        }
+#undef WAVE_ROW
+        break;
+    }
+    case PICOSYNTH_NODE_ENV:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = env_level(st[j], nd->env.sustain);
+        break;
+    case PICOSYNTH_NODE_LP:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = lp_level(a[j], c[j]);
+        break;
+    case PICOSYNTH_NODE_HP: {
+        const q15_t *in = nd->row[1];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = nd->in[0].src ? in[j] - lp_level(a[j], c[j]) : 0;
+        break;
+    }
+    case PICOSYNTH_NODE_SVF_LP:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = a[j] >> 8;
+        break;
+    case PICOSYNTH_NODE_SVF_HP: {
+        const q15_t *in = nd->row[1];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = svf_hp_level(in[j], a[j], b[j], nd->q);
+        break;
+    }
+    case PICOSYNTH_NODE_SVF_BP:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = b[j] >> 8;
+        break;
+    case PICOSYNTH_NODE_MIX: {
+        const q15_t *in0 = nd->row[1];
+        const q15_t *in1 = nd->row[2];
+        const q15_t *in2 = nd->row[3];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = in0[j] + in1[j] + in2[j];
+        break;
+    }
+    case PICOSYNTH_NODE_ADDITIVE: {
+        const q15_t *freq = nd->row[1];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = additive_level(nd->bank, (uint32_t) st[j],
+                                    (uint32_t) a[j], freq[j]);
+        break;
+    }
+    case PICOSYNTH_NODE_UNISON:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = unison_level(&nd->uni, (uint32_t) st[j], (uint32_t) a[j]);
+        break;
+    case PICOSYNTH_NODE_FM_OP: {
+        const q15_t *pm = nd->row[2];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = fm_op_level(&nd->fop, (uint32_t) st[j], (uint32_t) a[j],
+                                 (uint32_t) b[j], pm[j]);
+        break;
+    }
+    case PICOSYNTH_NODE_FM: {
+        /* The coefficient row is scratch here, committed in pass 2 */
+        q15_t *fb = nd->coeff + first;
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = nd->patch ? fm_level(nd->patch, (uint32_t) st[j],
+                                          (uint32_t) a[j], (uint32_t) b[j],
+                                          &fb[j])
+                               : 0;
+        break;
+    }
+    case PICOSYNTH_NODE_SAMPLER: {
+        const uint8_t *gate = v->gate + first;
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = sampler_level(nd->smp.sample, (uint32_t) st[j],
+                                   (uint32_t) a[j], gate[j]);
+        break;
+    }
+    default:
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = 0;
+        break;
+    }
+
+    if (nd->gain.src) {
+        const q15_t *gain = nd->row[0];
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            tmp[j] = apply_gain(tmp[j], gain[j]);
+    }
+}
+
+/* Pass 2 row kernels. Rows passed here never overlap (a filter wired to its
+ * own output only reads it after group_latch()), and saying so lets the
+ * compiler vectorize without runtime alias checks. Idle members keep their
+ * state through the run row.
+ */
+static void group_latch(q15_t *restrict out,
+                        const int32_t *restrict tmp,
+                        const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+        out[j] = (q15_t) ct_sel(run[j], q15_sat(tmp[j]), out[j]);
+}
+
+static void group_osc_step(int32_t *restrict phase,
+                           const q15_t *restrict freq,
+                           const q15_t *restrict detune,
+                           const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+        phase[j] = ct_sel(run[j], osc_step(phase[j], freq[j], detune[j]),
+                          phase[j]);
+}
+
+static void group_env_step(const picosynth_env_t *params,
+                           const uint8_t *restrict gate,
+                           int32_t *restrict state,
+                           int32_t *restrict block_rate,
+                           uint8_t *restrict block_counter,
+                           int32_t *restrict hold_counter,
+                           const uint8_t *restrict run)
+{
+    const picosynth_env_t env = *params; /* Loop-invariant, not aliased */
+
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        int32_t s = state[j], rate = block_rate[j], hold = hold_counter[j];
+        uint8_t cnt = block_counter[j];
+        env_step(&env, gate[j], &s, &rate, &cnt, &hold);
+        state[j] = ct_sel(run[j], s, state[j]);
+        block_rate[j] = ct_sel(run[j], rate, block_rate[j]);
+        hold_counter[j] = ct_sel(run[j], hold, hold_counter[j]);
+        block_counter[j] = (uint8_t) ct_sel(run[j], cnt, block_counter[j]);
+    }
+}
+
+static void group_flt_step(q15_t target,
+                           const q15_t *restrict in,
+                           const q15_t *restrict out,
+                           int32_t *restrict accum,
+                           q15_t *restrict coeff,
+                           const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        q15_t c = glide(coeff[j], target);
+        int32_t acc = flt_step(accum[j], in[j], out[j]);
+        coeff[j] = (q15_t) ct_sel(run[j], c, coeff[j]);
+        accum[j] = ct_sel(run[j], acc, accum[j]);
+    }
+}
+
+static void group_svf_step(q15_t target,
+                           q15_t q,
+                           const q15_t *restrict in,
+                           int32_t *restrict lp,
+                           int32_t *restrict bp,
+                           q15_t *restrict f,
+                           const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        q15_t fj = glide(f[j], target);
+        int32_t l = lp[j], b = bp[j];
+        svf_step(in[j], fj, q, &l, &b);
+        f[j] = (q15_t) ct_sel(run[j], fj, f[j]);
+        lp[j] = ct_sel(run[j], l, lp[j]);
+        bp[j] = ct_sel(run[j], b, bp[j]);
+    }
+}
+
+static void group_additive_step(int32_t *restrict phase,
+                                int32_t *restrict time,
+                                const q15_t *restrict freq,
+                                const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        uint32_t t = (uint32_t) time[j];
+        t += t != UINT32_MAX;
+        phase[j] = ct_sel(run[j], additive_step(phase[j], freq[j]), phase[j]);
+        time[j] = ct_sel(run[j], (int32_t) t, time[j]);
+    }
+}
+
+static void group_unison_step(const picosynth_unison_t *u,
+                              int32_t *restrict phase,
+                              int32_t *restrict spread,
+                              const q15_t *restrict freq,
+                              const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        uint32_t sp = (uint32_t) spread[j] + unison_spread_inc(u, freq[j]);
+        phase[j] = ct_sel(run[j], unison_step(phase[j], freq[j]), phase[j]);
+        spread[j] = ct_sel(run[j], (int32_t) sp, spread[j]);
+    }
+}
+
+/* FM_OP pushes its own output into the history, FM the feedback
+ * operator's output left in @fb by pass 1
+ */
+static void group_fm_step(int32_t *restrict phase,
+                          int32_t *restrict time,
+                          int32_t *restrict history,
+                          const q15_t *restrict fb,
+                          const q15_t *restrict freq,
+                          const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        uint32_t t = (uint32_t) time[j];
+        t += t != UINT32_MAX;
+        uint32_t h = fm_push((uint32_t) history[j], fb[j]);
+        phase[j] = ct_sel(run[j], additive_step(phase[j], freq[j]), phase[j]);
+        time[j] = ct_sel(run[j], (int32_t) t, time[j]);
+        history[j] = ct_sel(run[j], (int32_t) h, history[j]);
+    }
+}
+
+static void group_sampler_step(const picosynth_sampler_t *sm,
+                               int32_t *restrict pos,
+                               int32_t *restrict frac,
+                               const q15_t *restrict freq,
+                               const uint8_t *restrict gate,
+                               const uint8_t *restrict run)
+{
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        uint32_t f = (uint32_t) frac[j];
+        uint32_t p = sampler_step(sm, (uint32_t) pos[j], &f, freq[j], gate[j]);
+        pos[j] = ct_sel(run[j], (int32_t) p, pos[j]);
+        frac[j] = ct_sel(run[j], (int32_t) f, frac[j]);
+    }
+}
+
+/* Pass 2 for one node over the tile */
+static void group_update(picosynth_group_t *g,
+                         const group_voice_t *v,
+                         group_node_t *nd,
+                         uint32_t first,
+                         const int32_t *tmp)
+{
+    const uint8_t *run = g->run;
+
+    group_latch(nd->out + first, tmp, run);
+
+    switch (nd->type) {
+    case PICOSYNTH_NODE_OSC:
+        group_osc_step(nd->state + first, nd->row[1], nd->row[2], run);
+        break;
+    case PICOSYNTH_NODE_ENV:
+        group_env_step(&nd->env, v->gate + first, nd->state + first,
+                       nd->a + first, nd->counter + first, nd->b + first,
+                       run);
+        break;
+    case PICOSYNTH_NODE_LP:
+    case PICOSYNTH_NODE_HP:
+        group_flt_step(nd->target, nd->row[1], nd->out + first,
+                       nd->a + first, nd->coeff + first, run);
+        break;
+    case PICOSYNTH_NODE_SVF_LP:
+    case PICOSYNTH_NODE_SVF_HP:
+    case PICOSYNTH_NODE_SVF_BP:
+        group_svf_step(nd->target, nd->q, nd->row[1], nd->a + first,
+                       nd->b + first, nd->coeff + first, run);
+        break;
+    case PICOSYNTH_NODE_ADDITIVE:
+        group_additive_step(nd->state + first, nd->a + first, nd->row[1],
+                            run);
+        break;
+    case PICOSYNTH_NODE_UNISON:
+        group_unison_step(&nd->uni, nd->state + first, nd->a + first,
+                          nd->row[1], run);
+        break;
+    case PICOSYNTH_NODE_FM_OP:
+        group_fm_step(nd->state + first, nd->a + first, nd->b + first,
+                      nd->out + first, nd->row[1], run);
+        break;
+    case PICOSYNTH_NODE_FM:
+        group_fm_step(nd->state + first, nd->a + first, nd->b + first,
+                      nd->coeff + first, nd->row[1], run);
+        break;
+    case PICOSYNTH_NODE_SAMPLER:
+        group_sampler_step(&nd->smp, nd->state + first, nd->a + first,
+                           nd->row[1], v->gate + first, run);
+        break;
+    default:
+        break;
+    }
+}
+
+/* One sample of voice @vi for the tile, added to g->sum */
+static void group_voice(picosynth_group_t *g,
+                        int vi,
+                        uint32_t first)
+{
+    group_voice_t *v = &g->voices[vi];
+    const uint16_t *enable = g->voice_enable_mask + first;
+    uint8_t *run = g->run;
+    uint8_t any = 0;
+
+    /* Constant-time mode computes idle voices too, like process_voices() */
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        run[j] = (uint8_t) (PICOSYNTH_CONSTANT_TIME || vi >= 16 ||
+                            ((enable[j] >> vi) & 1));
+        any |= run[j];
+    }
+    if (!any)
+        return;
+
+    uint8_t mask = PICOSYNTH_CONSTANT_TIME ? 0 : v->usage_mask;
+    for (int i = 0; i < v->n_run; i++) {
+        if (mask && !(mask & (1u << i)))
+            continue;
+        group_output(g, v, &v->nodes[i], first,
+                     g->tmp + i * PICOSYNTH_GROUP_TILE);
+    }
+    for (int i = 0; i < v->n_run; i++) {
+        if (mask && !(mask & (1u << i)))
+            continue;
+        group_update(g, v, &v->nodes[i], first,
+                     g->tmp + i * PICOSYNTH_GROUP_TILE);
+    }
+
+    /* Mix enabled voices; retire silent ones as process_voices() does */
+    const q15_t *out = v->nodes[v->out_idx].out + first;
+    const uint8_t *gate = v->gate + first;
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        int32_t enabled = vi < 16 ? (enable[j] >> vi) & 1 : 1;
+        g->sum[j] += out[j] & -enabled;
+    }
+    if (vi >= 16)
+        return;
+    int32_t level[PICOSYNTH_GROUP_TILE] = {0};
+    for (int k = 0; k < v->n_env; k++) {
+        const int32_t *st = v->nodes[v->env_idx[k]].state + first;
+        for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+            level[j] |= st[j] & ENVELOPE_STATE_VALUE_MASK;
+    }
+    uint16_t *mask_row = g->voice_enable_mask + first;
+    for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++) {
+        int32_t silent = !gate[j] & (level[j] == 0);
+        mask_row[j] &= (uint16_t) ~(-silent & (1 << vi));
+    }
+}
+
+void picosynth_group_render(picosynth_group_t *g,
+                            q15_t *const *out,
+                            uint32_t n)
+{
+    if (!g || !out)
+        return;
+
+    uint32_t *prev_seed = lfsr_seed;
+    for (uint32_t first = 0; first < g->count; first += PICOSYNTH_GROUP_TILE) {
+        /* The last tile may run past count into permanently idle rows */
+        uint32_t len = g->count - first < PICOSYNTH_GROUP_TILE
+                           ? g->count - first
+                           : PICOSYNTH_GROUP_TILE;
+        for (int vi = 0; vi < g->num_voices; vi++)
+            for (int i = 0; i < g->voices[vi].n_nodes; i++)
+                group_bind(&g->voices[vi].nodes[i], first);
+        for (uint32_t t = 0; t < n; t++) {
+            for (int j = 0; j < PICOSYNTH_GROUP_TILE; j++)
+                g->sum[j] = 0;
+            for (int vi = 0; vi < g->num_voices; vi++)
+                group_voice(g, vi, first);
+            for (uint32_t j = 0; j < len; j++) {
+                uint32_t m = first + j;
+                q15_t y = master_step(g->sum[j], g->num_voices,
+                                      &g->dc_x_prev[m], &g->dc_y_prev[m]);
+                if (out[m])
+                    out[m][t] = y;
+            }
+        }
+    }
+    lfsr_seed = prev_seed;
+}
+
+/* Snapshot stream: a header followed by the mutable fields in a fixed order.
+ * The same walker serves sizing (buf NULL), saving and restoring, so the
+ * three can never disagree on the layout.
+ */
+#define SNAPSHOT_MAGIC 0x50534E31u /* "PSN1" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t layout; /* Hash of voice count, node counts and node types */
+    uint32_t size;   /* Total snapshot size including this header */
+} snapshot_header_t;
+
+typedef struct {
+    uint8_t *buf; /* NULL when only measuring */
+    size_t pos;
+    bool restore;
+} snapshot_io_t;
+
+static void snapshot_field(snapshot_io_t *io, void *field, size_t size)
+{
+    if (io->buf) {
+        if (io->restore)
+            memcpy(field, io->buf + io->pos, size);
+        else
+            memcpy(io->buf + io->pos, field, size);
+    }
+    io->pos += size;
+}
+
+#define SNAPSHOT_FIELD(io, f) snapshot_field(io, &(f), sizeof(f))
+
+/* FNV-1a over the instance layout; guards restores against foreign data */
+static uint32_t snapshot_layout(const picosynth_t *s)
+{
+    uint32_t h = 2166136261u;
+#define LAYOUT_MIX(x) (h = (h ^ (uint32_t) (x)) * 16777619u)
+    LAYOUT_MIX(s->num_voices);
+    for (int vi = 0; vi < s->num_voices; vi++) {
+        const picosynth_voice_t *v = &s->voices[vi];
+        LAYOUT_MIX(v->n_nodes);
+        for (int i = 0; i < v->n_nodes; i++) {
+            const picosynth_node_t *n = &v->nodes[i];
+            LAYOUT_MIX(n->type);
+            if (n->type == PICOSYNTH_NODE_SPECTRAL && n->spec.engine)
+                LAYOUT_MIX(n->spec.engine->size);
+            if (n->type == PICOSYNTH_NODE_STRING)
+                LAYOUT_MIX(n->str.len);
+            if (n->type == PICOSYNTH_NODE_DELAY)
+                LAYOUT_MIX(n->dly.len);
+            if (n->type == PICOSYNTH_NODE_MODAL)
+                LAYOUT_MIX(n->modal.count);
+        }
+    }
+#undef LAYOUT_MIX
+    return h;
+}
+
+static void snapshot_walk(picosynth_t *s, snapshot_io_t *io)
+{
+    SNAPSHOT_FIELD(io, s->voice_enable_mask);
+    SNAPSHOT_FIELD(io, s->dc_x_prev);
+    SNAPSHOT_FIELD(io, s->dc_y_prev);
+    SNAPSHOT_FIELD(io, s->noise_seed);
+    SNAPSHOT_FIELD(io, s->noise_per_note);
+
+    for (int vi = 0; vi < s->num_voices; vi++) {
+        picosynth_voice_t *v = &s->voices[vi];
+        uint8_t gate = v->gate;
+        SNAPSHOT_FIELD(io, v->note);
+        SNAPSHOT_FIELD(io, gate);
+        if (io->restore)
+            v->gate = gate != 0;
+        SNAPSHOT_FIELD(io, v->freq);
+        SNAPSHOT_FIELD(io, v->noise_seed);
+
+        for (int i = 0; i < v->n_nodes; i++) {
+            picosynth_node_t *n = &v->nodes[i];
+            SNAPSHOT_FIELD(io, n->state);
+            SNAPSHOT_FIELD(io, n->out);
+            switch (n->type) {
+            case PICOSYNTH_NODE_ENV:
+                SNAPSHOT_FIELD(io, n->env.block_rate);
+                SNAPSHOT_FIELD(io, n->env.block_counter);
+                SNAPSHOT_FIELD(io, n->env.hold_counter);
+                break;
+            case PICOSYNTH_NODE_LP:
+            case PICOSYNTH_NODE_HP:
+                SNAPSHOT_FIELD(io, n->flt.accum);
+                SNAPSHOT_FIELD(io, n->flt.coeff);
+                SNAPSHOT_FIELD(io, n->flt.coeff_target);
+                break;
+            case PICOSYNTH_NODE_SVF_LP:
+            case PICOSYNTH_NODE_SVF_HP:
+            case PICOSYNTH_NODE_SVF_BP:
+                SNAPSHOT_FIELD(io, n->svf.lp);
+                SNAPSHOT_FIELD(io, n->svf.bp);
+                SNAPSHOT_FIELD(io, n->svf.f);
+                SNAPSHOT_FIELD(io, n->svf.f_target);
+                break;
+            case PICOSYNTH_NODE_ADDITIVE:
+                SNAPSHOT_FIELD(io, n->add.time);
+                break;
+            case PICOSYNTH_NODE_SPECTRAL:
+                SNAPSHOT_FIELD(io, n->spec.time);
+                if (n->spec.engine) {
+                    picosynth_spectral_t *sp = n->spec.engine;
+                    SNAPSHOT_FIELD(io, sp->pos);
+                    if (io->restore && sp->pos > sp->hop)
+                        sp->pos = sp->hop;
+                    snapshot_field(io, sp->ola, sp->size * sizeof(int32_t));
+                }
+                break;
+            case PICOSYNTH_NODE_STRING:
+                SNAPSHOT_FIELD(io, n->str.pos);
+                if (n->str.line) {
+                    if (io->restore)
+                        n->str.pos &= (uint16_t) (n->str.len - 1u);
+                    snapshot_field(io, n->str.line,
+                                   n->str.len * sizeof(q15_t));
+                }
+                break;
+            case PICOSYNTH_NODE_DELAY:
+                SNAPSHOT_FIELD(io, n->dly.wet);
+                if (n->dly.line) {
+                    if (io->restore)
+                        n->state &= n->dly.len - 1;
+                    snapshot_field(io, n->dly.line,
+                                   n->dly.len * sizeof(q15_t));
+                }
+                break;
+            case PICOSYNTH_NODE_MODAL:
+                if (n->modal.y)
+                    snapshot_field(io, n->modal.y,
+                                   2u * n->modal.count * sizeof(int32_t));
+                break;
+            case PICOSYNTH_NODE_UNISON:
+                SNAPSHOT_FIELD(io, n->uni.spread);
+                break;
+            case PICOSYNTH_NODE_SAMPLER:
+                SNAPSHOT_FIELD(io, n->smp.frac);
+                break;
+            case PICOSYNTH_NODE_FM_OP:
+                SNAPSHOT_FIELD(io, n->fop.time);
+                SNAPSHOT_FIELD(io, n->fop.history);
+                break;
+            case PICOSYNTH_NODE_FM:
+                SNAPSHOT_FIELD(io, n->fm.time);
+                SNAPSHOT_FIELD(io, n->fm.history);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+size_t picosynth_snapshot_size(const picosynth_t *s)
+{
+    if (!s)
+        return 0;
+    snapshot_io_t io = {.pos = sizeof(snapshot_header_t)};
+    /* Measuring never writes, so dropping const is safe here */
+    snapshot_walk((picosynth_t *) s, &io);
+    return io.pos;
+}
+
+size_t picosynth_snapshot_save(const picosynth_t *s, void *buf, size_t len)
+{
+    size_t size = picosynth_snapshot_size(s);
+    if (!size || !buf || len < size)
+        return 0;
+
+    snapshot_header_t hdr = {
+        .magic = SNAPSHOT_MAGIC,
+        .layout = snapshot_layout(s),
+        .size = (uint32_t) size,
+    };
+    memcpy(buf, &hdr, sizeof(hdr));
+    snapshot_io_t io = {.buf = buf, .pos = sizeof(hdr)};
+    /* Saving only reads the instance */
+    snapshot_walk((picosynth_t *) s, &io);
+    return size;
+}
+
+bool picosynth_snapshot_restore(picosynth_t *s, const void *buf, size_t len)
+{
+    snapshot_header_t hdr;
+    if (!s || !buf || len < sizeof(hdr))
+        return false;
+
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.magic != SNAPSHOT_MAGIC || hdr.layout != snapshot_layout(s) ||
+        hdr.size != picosynth_snapshot_size(s) || len < hdr.size)
+        return false;
+
+    /* Restoring only reads the buffer */
+    snapshot_io_t io = {
+        .buf = (uint8_t *) buf,
+        .pos = sizeof(hdr),
+        .restore = true,
+    };
+    snapshot_walk(s, &io);
+    return true;
 }
 
 q15_t picosynth_wave_saw(q15_t phase)
@@ -956,10 +4262,13 @@ q15_t picosynth_wave_exp(q15_t phase)
 q15_t picosynth_wave_noise(q15_t phase)
 {
     (void) phase;
-    lfsr_seed ^= lfsr_seed << 13;
-    lfsr_seed ^= lfsr_seed >> 17;
-    lfsr_seed ^= lfsr_seed << 5;
-    return (q15_t) (lfsr_seed >> 16);
+    uint32_t *seed = lfsr_seed ? lfsr_seed : &lfsr_default_seed;
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return (q15_t) (x >> 16);
 }
 
 q15_t picosynth_wave_sine(q15_t phase)
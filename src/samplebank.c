@@ -0,0 +1,673 @@
+/*
+ * samplebank.c - Read-only PCM sample banks for the PicoSynth sampler node
+ *
+ * Files are mapped, never read: parsing walks the headers in the mapping
+ * and leaves sample data where it is, so opening a bank costs the same
+ * whatever its size and only the pages notes play are ever loaded.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "samplebank.h"
+
+/* Root note of a WAV file without a 'smpl' chunk */
+#define BANK_DEFAULT_ROOT 60
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+           (uint32_t) p[3] << 24;
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+/* 2^(k/12) for k = 0..11, Q30 */
+static const uint32_t bank_semitones[12] = {
+    1073741824, 1137589835, 1205234447, 1276901417, 1352829926, 1433273380,
+    1518500250, 1608794974, 1704458901, 1805811301, 1913190429, 2026954652,
+};
+
+/* @base * 2^(@cents / 1200) with @cents in 1/256 cent, rounded and
+ * saturated. Semitones come from the table and the rest of the interval
+ * from a third-order series, within 0.01 cent.
+ */
+static uint32_t bank_scale(uint32_t base, int32_t cents)
+{
+    const int32_t octave = 1200 * 256, semitone = 100 * 256;
+    int32_t oct = cents / octave - (cents % octave < 0);
+    int32_t rem = cents - oct * octave;
+
+    /* e^x for x = (rem % semitone) * ln(2) / (1200 * 256), in Q32 */
+    uint64_t x = ((uint64_t) (rem % semitone) * 9923482) >> 10;
+    uint64_t x2 = (x * x) >> 32, x3 = (x2 * x) >> 32;
+    uint64_t m = (1ull << 32) + x + x2 / 2 + x3 / 6;
+    uint64_t f = (bank_semitones[rem / semitone] * m) >> 32;
+
+    int32_t shift = 30 - oct;
+    if (shift <= 0)
+        return base ? UINT32_MAX : 0;
+    if (shift >= 64)
+        return 0;
+    uint64_t v = ((uint64_t) base * f + (1ull << (shift - 1))) >> shift;
+    return v > UINT32_MAX ? UINT32_MAX : (uint32_t) v;
+}
+
+/* Gain of an attenuation of @cb centibels (clamped at 0) */
+static q15_t bank_cb_gain(int32_t cb)
+{
+    if (cb < 0)
+        cb = 0;
+    if (cb > 1440)
+        cb = 1440;
+    /* 10^(-cb/200) = 2^(-cb * 19.93 cents / 1200) */
+    return (q15_t) bank_scale(Q15_MAX, -cb * 5102);
+}
+
+/* Grow the sample and zone tables, which run in step, to hold @n more */
+static bool bank_reserve(bank_t *bank, uint32_t *cap, uint32_t n)
+{
+    if (bank->count + n <= *cap)
+        return true;
+    uint32_t want = *cap ? *cap : 16;
+    while (want < bank->count + n)
+        want *= 2;
+    picosynth_sample_t *sp =
+        realloc(bank->samples, want * sizeof(picosynth_sample_t));
+    if (!sp)
+        return false;
+    bank->samples = sp;
+    bank_zone_t *zp = realloc(bank->zones, want * sizeof(bank_zone_t));
+    if (!zp)
+        return false;
+    bank->zones = zp;
+    *cap = want;
+    return true;
+}
+
+static void bank_free_tables(bank_t *bank)
+{
+    free(bank->samples);
+    free(bank->zones);
+    free(bank->presets);
+    bank->samples = NULL;
+    bank->zones = NULL;
+    bank->presets = NULL;
+}
+
+bank_error_t bank_parse_wav(bank_t *bank, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    memset(bank, 0, sizeof(bank_t));
+    bank->fd = -1;
+    if (!p || size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+        return BANK_ERR_FORMAT;
+
+    const uint8_t *fmt = NULL, *pcm = NULL, *smpl = NULL;
+    uint32_t pcm_size = 0, smpl_size = 0;
+    for (size_t pos = 12; pos + 8 <= size;) {
+        const uint8_t *id = p + pos;
+        uint32_t len = rd32(p + pos + 4);
+        if (len > size - pos - 8)
+            return BANK_ERR_FORMAT;
+        if (!memcmp(id, "fmt ", 4) && len >= 16) {
+            fmt = id + 8;
+        } else if (!memcmp(id, "data", 4)) {
+            pcm = id + 8;
+            pcm_size = len;
+        } else if (!memcmp(id, "smpl", 4) && len >= 36) {
+            smpl = id + 8;
+            smpl_size = len;
+        }
+        /* Chunks are padded to an even size */
+        pos += 8 + (size_t) len + (len & 1);
+    }
+
+    /* Only what the sampler can play in place: 16-bit mono PCM */
+    if (!fmt || !pcm || rd16(fmt) != 1 || rd16(fmt + 2) != 1 ||
+        rd16(fmt + 14) != 16 || ((uintptr_t) pcm & 1) ||
+        pcm_size / 2 > INT32_MAX)
+        return BANK_ERR_FORMAT;
+
+    picosynth_sample_t *sp = calloc(1, sizeof(picosynth_sample_t));
+    bank_zone_t *zone = calloc(1, sizeof(bank_zone_t));
+    bank_preset_t *preset = calloc(1, sizeof(bank_preset_t));
+    if (!sp || !zone || !preset) {
+        free(sp);
+        free(zone);
+        free(preset);
+        return BANK_ERR_NOMEM;
+    }
+    sp->data = (const q15_t *) (const void *) pcm;
+    sp->len = pcm_size / 2;
+    sp->rate = rd32(fmt + 4);
+    sp->root = BANK_DEFAULT_ROOT;
+    if (smpl) {
+        uint32_t note = rd32(smpl + 12);
+        sp->root = (uint8_t) (note < 128 ? note : BANK_DEFAULT_ROOT);
+        /* Fine tuning is a Q32 fraction of a semitone sharp */
+        int32_t sharp = (int32_t) (((uint64_t) rd32(smpl + 16) * 25600) >> 32);
+        sp->rate = bank_scale(sp->rate, -sharp);
+        /* The first loop if it runs forward; WAV loop ends are inclusive */
+        if (rd32(smpl + 28) > 0 && smpl_size >= 36 + 24 &&
+            rd32(smpl + 36 + 4) == 0) {
+            uint32_t start = rd32(smpl + 36 + 8), end = rd32(smpl + 36 + 12);
+            if (start <= end && end < sp->len) {
+                sp->loop_start = start;
+                sp->loop_end = end + 1;
+                sp->loop = PICOSYNTH_LOOP_ON;
+            }
+        }
+    }
+
+    /* One zone over every key, with a transparent envelope */
+    *zone = (bank_zone_t) {
+        .key_hi = 127,
+        .vel_hi = 127,
+        .env = {.atk_ms = 1, .dec_ms = 1, .sus_pct = 100, .rel_ms = 1},
+        .gain = Q15_MAX,
+        .q = Q15_MAX,
+    };
+    preset->zones = 1;
+
+    bank->data = p;
+    bank->size = size;
+    bank->samples = sp;
+    bank->count = 1;
+    bank->zones = zone;
+    bank->zone_count = 1;
+    bank->presets = preset;
+    bank->preset_count = 1;
+    return BANK_OK;
+}
+
+/* SoundFont 2 generator operators used here */
+enum {
+    SF2_START = 0,
+    SF2_END = 1,
+    SF2_LOOP_START = 2,
+    SF2_LOOP_END = 3,
+    SF2_START_COARSE = 4,
+    SF2_FILTER_FC = 8,
+    SF2_FILTER_Q = 9,
+    SF2_END_COARSE = 12,
+    SF2_ATTACK = 34,
+    SF2_HOLD = 35,
+    SF2_DECAY = 36,
+    SF2_SUSTAIN = 37,
+    SF2_RELEASE = 38,
+    SF2_INSTRUMENT = 41,
+    SF2_KEY_RANGE = 43,
+    SF2_VEL_RANGE = 44,
+    SF2_LOOP_START_COARSE = 45,
+    SF2_ATTENUATION = 48,
+    SF2_LOOP_END_COARSE = 50,
+    SF2_COARSE_TUNE = 51,
+    SF2_FINE_TUNE = 52,
+    SF2_SAMPLE_ID = 53,
+    SF2_SAMPLE_MODES = 54,
+    SF2_ROOT_KEY = 58,
+    SF2_GEN_COUNT = 61,
+};
+
+/* Record sizes of the 'pdta' sub-chunks */
+#define SF2_PHDR_SIZE 38
+#define SF2_BAG_SIZE 4
+#define SF2_GEN_SIZE 4
+#define SF2_INST_SIZE 22
+#define SF2_SHDR_SIZE 46
+
+/* Filter cutoffs at or above this (absolute cents) leave the zone open */
+#define SF2_FILTER_OPEN 13500
+
+/* Hydra: the preset and instrument records, each ending in a terminal
+ * record that only bounds the one before it
+ */
+typedef struct {
+    const uint8_t *phdr, *pbag, *pgen, *inst, *ibag, *igen, *shdr;
+    uint32_t nphdr, npbag, npgen, ninst, nibag, nigen, nshdr;
+    const q15_t *smpl; /* Sample data of every sample */
+    uint32_t smpl_len; /* Frames at smpl */
+} sf2_t;
+
+/* Find sub-chunk @id in the LIST chunk body @p of @size bytes */
+static const uint8_t *sf2_chunk(const uint8_t *p,
+                                size_t size,
+                                const char *id,
+                                uint32_t *len)
+{
+    for (size_t pos = 4; pos + 8 <= size;) {
+        uint32_t n = rd32(p + pos + 4);
+        if (n > size - pos - 8)
+            return NULL;
+        if (!memcmp(p + pos, id, 4)) {
+            *len = n;
+            return p + pos + 8;
+        }
+        pos += 8 + (size_t) n + (n & 1);
+    }
+    return NULL;
+}
+
+/* Records of @rec bytes in pdta chunk @id; at least the terminal one */
+static bool sf2_records(const uint8_t *pdta,
+                        size_t size,
+                        const char *id,
+                        uint32_t rec,
+                        const uint8_t **out,
+                        uint32_t *count)
+{
+    uint32_t len;
+    *out = sf2_chunk(pdta, size, id, &len);
+    if (!*out || len % rec || len < rec)
+        return false;
+    *count = len / rec;
+    return true;
+}
+
+/* Bag range [*from, *to) of record @i whose bag index sits at @off */
+static bool sf2_range(const uint8_t *recs,
+                      uint32_t rec,
+                      uint32_t off,
+                      uint32_t i,
+                      uint32_t nbags,
+                      uint32_t *from,
+                      uint32_t *to)
+{
+    *from = rd16(recs + i * rec + off);
+    *to = rd16(recs + (i + 1) * rec + off);
+    return *from <= *to && *to < nbags;
+}
+
+/* Apply the generators of bag @b to @gen; true if the last one is
+ * @terminal, which marks a zone that is not global
+ */
+static bool sf2_apply(const uint8_t *bags,
+                      const uint8_t *gens,
+                      uint32_t ngens,
+                      uint32_t b,
+                      uint16_t terminal,
+                      int32_t *gen,
+                      bool *ok)
+{
+    uint32_t g0, g1;
+    if (!sf2_range(bags, SF2_BAG_SIZE, 0, b, ngens, &g0, &g1)) {
+        *ok = false;
+        return false;
+    }
+    uint16_t last = 0xFFFF;
+    for (uint32_t g = g0; g < g1; g++) {
+        const uint8_t *r = gens + g * SF2_GEN_SIZE;
+        uint16_t op = rd16(r), amount = rd16(r + 2);
+        if (op >= SF2_GEN_COUNT)
+            continue;
+        /* Ranges keep their two bytes; the rest are signed or indices */
+        if (op == SF2_KEY_RANGE || op == SF2_VEL_RANGE ||
+            op == SF2_INSTRUMENT || op == SF2_SAMPLE_ID)
+            gen[op] = amount;
+        else
+            gen[op] = (int16_t) amount;
+        last = op;
+    }
+    return last == terminal;
+}
+
+static void sf2_defaults(int32_t *gen, bool instrument)
+{
+    memset(gen, 0, SF2_GEN_COUNT * sizeof(int32_t));
+    gen[SF2_KEY_RANGE] = gen[SF2_VEL_RANGE] = 127 << 8;
+    if (!instrument)
+        return;
+    gen[SF2_FILTER_FC] = SF2_FILTER_OPEN;
+    gen[SF2_ATTACK] = gen[SF2_HOLD] = gen[SF2_DECAY] = gen[SF2_RELEASE] =
+        -12000;
+    gen[SF2_ROOT_KEY] = -1;
+}
+
+/* Milliseconds of @tc timecents, clamped to what an envelope holds */
+static uint16_t sf2_ms(int32_t tc)
+{
+    if (tc < -12000)
+        tc = -12000;
+    if (tc > 8000)
+        tc = 8000;
+    uint32_t ms = bank_scale(1000, tc * 256);
+    return (uint16_t) (ms > UINT16_MAX ? UINT16_MAX : ms);
+}
+
+/* Intersect key or velocity ranges @a and @b into *@lo..*@hi */
+static bool sf2_overlap(int32_t a, int32_t b, uint8_t *lo, uint8_t *hi)
+{
+    int32_t l = (a & 0xFF) > (b & 0xFF) ? a & 0xFF : b & 0xFF;
+    int32_t h = (a >> 8) < (b >> 8) ? a >> 8 : b >> 8;
+    if (h > 127)
+        h = 127;
+    *lo = (uint8_t) l;
+    *hi = (uint8_t) h;
+    return l <= h;
+}
+
+/* Append the zone of instrument generators @ig under preset generators
+ * @pg, which add to them; zones with nothing playable are skipped
+ */
+static bool sf2_zone(bank_t *bank,
+                     uint32_t *cap,
+                     const sf2_t *sf,
+                     const int32_t *ig,
+                     const int32_t *pg)
+{
+    uint32_t id = (uint32_t) ig[SF2_SAMPLE_ID];
+    if (id + 1 >= sf->nshdr)
+        return true;
+    const uint8_t *sh = sf->shdr + id * SF2_SHDR_SIZE;
+    /* ROM samples are not in the file; compressed ones cannot play */
+    if (rd16(sh + 44) & (0x8000 | 0x10))
+        return true;
+
+    bank_zone_t z = {.sample = bank->count};
+    if (!sf2_overlap(ig[SF2_KEY_RANGE], pg[SF2_KEY_RANGE], &z.key_lo,
+                     &z.key_hi) ||
+        !sf2_overlap(ig[SF2_VEL_RANGE], pg[SF2_VEL_RANGE], &z.vel_lo,
+                     &z.vel_hi))
+        return true;
+
+    int64_t start = (int64_t) rd32(sh + 20) + ig[SF2_START] +
+                    32768 * (int64_t) ig[SF2_START_COARSE];
+    int64_t end = (int64_t) rd32(sh + 24) + ig[SF2_END] +
+                  32768 * (int64_t) ig[SF2_END_COARSE];
+    int64_t ls = (int64_t) rd32(sh + 28) + ig[SF2_LOOP_START] +
+                 32768 * (int64_t) ig[SF2_LOOP_START_COARSE];
+    int64_t le = (int64_t) rd32(sh + 32) + ig[SF2_LOOP_END] +
+                 32768 * (int64_t) ig[SF2_LOOP_END_COARSE];
+    if (start < 0 || end <= start || end > sf->smpl_len)
+        return true;
+
+    picosynth_sample_t smp = {
+        .data = sf->smpl + start,
+        .len = (uint32_t) (end - start),
+        .rate = rd32(sh + 36),
+        .root = sh[40] < 128 ? sh[40] : BANK_DEFAULT_ROOT,
+    };
+    if (ig[SF2_ROOT_KEY] >= 0 && ig[SF2_ROOT_KEY] < 128)
+        smp.root = (uint8_t) ig[SF2_ROOT_KEY];
+    int32_t cents = (ig[SF2_COARSE_TUNE] + pg[SF2_COARSE_TUNE]) * 100 +
+                    ig[SF2_FINE_TUNE] + pg[SF2_FINE_TUNE] + (int8_t) sh[41];
+    smp.rate = bank_scale(smp.rate, cents * 256);
+    if (!smp.rate)
+        return true;
+
+    /* Modes: 1 loops throughout, 3 loops until release */
+    int32_t mode = ig[SF2_SAMPLE_MODES] & 3;
+    if ((mode == 1 || mode == 3) && start <= ls && ls < le && le <= end) {
+        smp.loop_start = (uint32_t) (ls - start);
+        smp.loop_end = (uint32_t) (le - start);
+        smp.loop = mode == 1 ? PICOSYNTH_LOOP_ON : PICOSYNTH_LOOP_SUSTAIN;
+    }
+
+    int32_t sus = ig[SF2_SUSTAIN] + pg[SF2_SUSTAIN];
+    z.env = (picosynth_env_ms_params_t) {
+        .atk_ms = sf2_ms(ig[SF2_ATTACK] + pg[SF2_ATTACK]),
+        .hold_ms = sf2_ms(ig[SF2_HOLD] + pg[SF2_HOLD]),
+        .dec_ms = sf2_ms(ig[SF2_DECAY] + pg[SF2_DECAY]),
+        .sus_pct = (uint8_t) ((bank_cb_gain(sus) * 100 + 16384) >> 15),
+        .rel_ms = sf2_ms(ig[SF2_RELEASE] + pg[SF2_RELEASE]),
+    };
+    z.gain = bank_cb_gain(ig[SF2_ATTENUATION] + pg[SF2_ATTENUATION]);
+    int32_t fc = ig[SF2_FILTER_FC] + pg[SF2_FILTER_FC];
+    if (fc < SF2_FILTER_OPEN) {
+        /* Absolute cents above 8.176 Hz */
+        uint32_t hz = bank_scale(8176, (fc > 0 ? fc : 0) * 256) / 1000;
+        z.cutoff_hz = (uint16_t) (hz ? hz : 1);
+    }
+    /* Resonance in centibels above unity Q; the SVF takes 1/Q */
+    z.q = bank_cb_gain(ig[SF2_FILTER_Q] + pg[SF2_FILTER_Q]);
+    if (z.q < Q15_MAX / 16)
+        z.q = Q15_MAX / 16;
+
+    if (!bank_reserve(bank, cap, 1))
+        return false;
+    bank->samples[bank->count] = smp;
+    bank->zones[bank->count] = z;
+    bank->count++;
+    return true;
+}
+
+/* Zones of preset @i; *@ok is cleared for a malformed hydra */
+static bool sf2_preset(bank_t *bank,
+                       uint32_t *cap,
+                       const sf2_t *sf,
+                       uint32_t i,
+                       bool *ok)
+{
+    uint32_t b0, b1;
+    if (!sf2_range(sf->phdr, SF2_PHDR_SIZE, 24, i, sf->npbag, &b0, &b1)) {
+        *ok = false;
+        return true;
+    }
+    int32_t pglobal[SF2_GEN_COUNT], pg[SF2_GEN_COUNT];
+    int32_t iglobal[SF2_GEN_COUNT], ig[SF2_GEN_COUNT];
+    sf2_defaults(pglobal, false);
+    for (uint32_t b = b0; b < b1 && *ok; b++) {
+        memcpy(pg, pglobal, sizeof(pg));
+        if (!sf2_apply(sf->pbag, sf->pgen, sf->npgen, b, SF2_INSTRUMENT,
+                       pg, ok)) {
+            if (b == b0)
+                memcpy(pglobal, pg, sizeof(pg));
+            continue;
+        }
+        uint32_t inst = (uint32_t) pg[SF2_INSTRUMENT], z0, z1;
+        if (inst + 1 >= sf->ninst ||
+            !sf2_range(sf->inst, SF2_INST_SIZE, 20, inst, sf->nibag, &z0,
+                       &z1)) {
+            *ok = false;
+            break;
+        }
+        sf2_defaults(iglobal, true);
+        for (uint32_t z = z0; z < z1 && *ok; z++) {
+            memcpy(ig, iglobal, sizeof(ig));
+            if (!sf2_apply(sf->ibag, sf->igen, sf->nigen, z, SF2_SAMPLE_ID,
+                           ig, ok)) {
+                if (z == z0)
+                    memcpy(iglobal, ig, sizeof(ig));
+                continue;
+            }
+            if (!sf2_zone(bank, cap, sf, ig, pg))
+                return false;
+        }
+    }
+    return true;
+}
+
+bank_error_t bank_parse_sf2(bank_t *bank, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    memset(bank, 0, sizeof(bank_t));
+    bank->fd = -1;
+    if (!p || size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "sfbk", 4))
+        return BANK_ERR_FORMAT;
+
+    /* Only the hydra is read; sample data stays in place */
+    const uint8_t *sdta = NULL, *pdta = NULL;
+    uint32_t sdta_size = 0, pdta_size = 0;
+    for (size_t pos = 12; pos + 12 <= size;) {
+        uint32_t len = rd32(p + pos + 4);
+        if (len > size - pos - 8)
+            return BANK_ERR_FORMAT;
+        if (!memcmp(p + pos, "LIST", 4) && len >= 4) {
+            if (!memcmp(p + pos + 8, "sdta", 4)) {
+                sdta = p + pos + 8;
+                sdta_size = len;
+            } else if (!memcmp(p + pos + 8, "pdta", 4)) {
+                pdta = p + pos + 8;
+                pdta_size = len;
+            }
+        }
+        pos += 8 + (size_t) len + (len & 1);
+    }
+    if (!sdta || !pdta)
+        return BANK_ERR_FORMAT;
+
+    sf2_t sf;
+    uint32_t smpl_size;
+    const uint8_t *smpl = sf2_chunk(sdta, sdta_size, "smpl", &smpl_size);
+    if (!smpl || ((uintptr_t) smpl & 1) ||
+        !sf2_records(pdta, pdta_size, "phdr", SF2_PHDR_SIZE, &sf.phdr,
+                     &sf.nphdr) ||
+        !sf2_records(pdta, pdta_size, "pbag", SF2_BAG_SIZE, &sf.pbag,
+                     &sf.npbag) ||
+        !sf2_records(pdta, pdta_size, "pgen", SF2_GEN_SIZE, &sf.pgen,
+                     &sf.npgen) ||
+        !sf2_records(pdta, pdta_size, "inst", SF2_INST_SIZE, &sf.inst,
+                     &sf.ninst) ||
+        !sf2_records(pdta, pdta_size, "ibag", SF2_BAG_SIZE, &sf.ibag,
+                     &sf.nibag) ||
+        !sf2_records(pdta, pdta_size, "igen", SF2_GEN_SIZE, &sf.igen,
+                     &sf.nigen) ||
+        !sf2_records(pdta, pdta_size, "shdr", SF2_SHDR_SIZE, &sf.shdr,
+                     &sf.nshdr))
+        return BANK_ERR_FORMAT;
+    sf.smpl = (const q15_t *) (const void *) smpl;
+    sf.smpl_len = smpl_size / 2;
+
+    bank->presets = calloc(sf.nphdr - 1 ? sf.nphdr - 1 : 1,
+                           sizeof(bank_preset_t));
+    if (!bank->presets)
+        return BANK_ERR_NOMEM;
+    uint32_t cap = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i + 1 < sf.nphdr; i++) {
+        const uint8_t *ph = sf.phdr + i * SF2_PHDR_SIZE;
+        bank_preset_t *pr = &bank->presets[i];
+        memcpy(pr->name, ph, 20);
+        pr->program = rd16(ph + 20);
+        pr->bank = rd16(ph + 22);
+        pr->zone = bank->count;
+        if (!sf2_preset(bank, &cap, &sf, i, &ok)) {
+            bank_free_tables(bank);
+            return BANK_ERR_NOMEM;
+        }
+        if (!ok) {
+            bank_free_tables(bank);
+            return BANK_ERR_FORMAT;
+        }
+        pr->zones = bank->count - pr->zone;
+    }
+
+    bank->data = p;
+    bank->size = size;
+    bank->zone_count = bank->count;
+    bank->preset_count = sf.nphdr - 1;
+    return BANK_OK;
+}
+
+bank_error_t bank_open(bank_t *bank, const char *path)
+{
+    memset(bank, 0, sizeof(bank_t));
+    bank->fd = -1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return BANK_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return BANK_ERR_IO;
+    }
+    size_t size = (size_t) st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return BANK_ERR_IO;
+    }
+
+    bank_error_t err = size >= 12 && !memcmp((const uint8_t *) map + 8,
+                                             "sfbk", 4)
+                           ? bank_parse_sf2(bank, map, size)
+                           : bank_parse_wav(bank, map, size);
+    if (err != BANK_OK) {
+        munmap(map, size);
+        close(fd);
+        return err;
+    }
+    bank->mapped = true;
+    /* Kept for streaming samples with pread() instead of page faults */
+    bank->fd = fd;
+    return BANK_OK;
+}
+
+void bank_close(bank_t *bank)
+{
+    if (!bank)
+        return;
+    bank_free_tables(bank);
+    if (bank->mapped)
+        munmap((void *) bank->data, bank->size);
+    if (bank->fd >= 0)
+        close(bank->fd);
+    memset(bank, 0, sizeof(bank_t));
+    bank->fd = -1;
+}
+
+const bank_preset_t *bank_find_preset(const bank_t *bank,
+                                      uint16_t bank_num,
+                                      uint16_t program)
+{
+    for (uint32_t i = 0; i < bank->preset_count; i++) {
+        const bank_preset_t *p = &bank->presets[i];
+        if (p->bank == bank_num && p->program == program)
+            return p;
+    }
+    return NULL;
+}
+
+const bank_zone_t *bank_find_zone(const bank_t *bank,
+                                  const bank_preset_t *preset,
+                                  uint8_t note,
+                                  uint8_t velocity)
+{
+    if (!preset)
+        return NULL;
+    for (uint32_t i = 0; i < preset->zones; i++) {
+        const bank_zone_t *z = &bank->zones[preset->zone + i];
+        if (note >= z->key_lo && note <= z->key_hi &&
+            velocity >= z->vel_lo && velocity <= z->vel_hi)
+            return z;
+    }
+    return NULL;
+}
+
+void bank_zone_init(const bank_t *bank,
+                    const bank_zone_t *zone,
+                    picosynth_node_t *env,
+                    picosynth_node_t *smp,
+                    picosynth_node_t *flt,
+                    const q15_t *freq)
+{
+    picosynth_init_env_ms(env, &zone->gain, &zone->env);
+    picosynth_init_sampler(smp, &env->out, freq,
+                           &bank->samples[zone->sample]);
+    if (!flt)
+        return;
+    if (zone->cutoff_hz)
+        picosynth_init_svf_lp(flt, NULL, &smp->out,
+                              picosynth_svf_freq(zone->cutoff_hz), zone->q);
+    else
+        picosynth_init_mix(flt, NULL, &smp->out, NULL, NULL);
+}
+
+void bank_prefetch(const bank_t *bank, const bank_zone_t *zone)
+{
+    if (!bank->mapped)
+        return;
+    const picosynth_sample_t *sp = &bank->samples[zone->sample];
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t) sp->data & ~(page - 1);
+    uintptr_t to = (uintptr_t) (sp->data + sp->len);
+    madvise((void *) from, to - from, MADV_WILLNEED);
+}
@@ -0,0 +1,290 @@
+/*
+ * samplestream.c - Disk streaming for the PicoSynth sampler node
+ *
+ * One thread services every ring: it picks up note-ons, then reads each
+ * note's frames in playback order, following loops, until the ring is
+ * full. The audio side never waits on it (see picosynth_stream_t).
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "samplestream.h"
+
+/* Most frames read per ring per pass, so one note cannot starve others */
+#define STREAM_CHUNK 4096
+
+/* What a ring is playing and where its next frame comes from */
+typedef struct {
+    picosynth_stream_t *ring;
+    const stream_sample_t *src; /* NULL when the note needs no frames */
+    uint32_t pos;               /* Next frame of src to write */
+} stream_slot_t;
+
+struct stream {
+    pthread_t thread;
+    bool threaded;
+    atomic_bool stop;
+    uint32_t period_us;
+    pthread_mutex_t lock; /* Guards the tables between adds and passes */
+    stream_slot_t *slots;
+    uint32_t count, cap;
+    const stream_sample_t **samples; /* Registered, by sample address */
+    uint32_t sample_count, sample_cap;
+    atomic_uint errors;
+};
+
+bool stream_sample_init(stream_sample_t *ss,
+                        const bank_t *bank,
+                        uint32_t index,
+                        uint32_t preload_ms)
+{
+    memset(ss, 0, sizeof(stream_sample_t));
+    ss->fd = -1;
+    if (!bank || index >= bank->count || bank->fd < 0)
+        return false;
+    const picosynth_sample_t *sp = &bank->samples[index];
+    uint64_t want = (uint64_t) preload_ms * sp->rate / 1000;
+    uint32_t head = want < sp->len ? (uint32_t) want : sp->len;
+    if (!head)
+        head = 1;
+
+    ss->head = malloc(head * sizeof(q15_t));
+    if (!ss->head)
+        return false;
+    memcpy(ss->head, sp->data, head * sizeof(q15_t));
+    ss->sample = *sp;
+    ss->sample.data = ss->head;
+    ss->sample.resident = head < sp->len ? head : 0;
+    ss->fd = bank->fd;
+    ss->offset = (off_t) ((const uint8_t *) sp->data - bank->data);
+    return true;
+}
+
+void stream_sample_free(stream_sample_t *ss)
+{
+    if (!ss)
+        return;
+    free(ss->head);
+    ss->head = NULL;
+    ss->fd = -1;
+}
+
+/* Whether playback of @sp wraps at its loop end */
+static bool stream_looping(const picosynth_sample_t *sp, bool released)
+{
+    return sp->loop_start < sp->loop_end && sp->loop_end <= sp->len &&
+           (sp->loop == PICOSYNTH_LOOP_ON ||
+            (sp->loop == PICOSYNTH_LOOP_SUSTAIN && !released));
+}
+
+/* The registered sample playing @sp, or NULL */
+static const stream_sample_t *stream_lookup(const stream_t *s,
+                                            const picosynth_sample_t *sp)
+{
+    uint32_t lo = 0, hi = s->sample_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const picosynth_sample_t *at = &s->samples[mid]->sample;
+        if (at == sp)
+            return s->samples[mid];
+        if ((uintptr_t) at < (uintptr_t) sp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+/* Write as many frames of the slot's note as fit in its ring */
+static void stream_fill(stream_t *s, stream_slot_t *sl)
+{
+    const picosynth_sample_t *sp;
+    uint32_t pos;
+    if (picosynth_stream_poll(sl->ring, &sp, &pos)) {
+        sl->src = sp ? stream_lookup(s, sp) : NULL;
+        sl->pos = pos;
+        if (sp && !sl->src) {
+            /* Not ours to read: end the note after its resident frames */
+            atomic_fetch_add(&s->errors, 1);
+            picosynth_stream_end(sl->ring);
+        }
+    }
+    const stream_sample_t *ss = sl->src;
+    if (!ss)
+        return;
+    sp = &ss->sample;
+
+    for (uint32_t budget = STREAM_CHUNK; budget;) {
+        bool loop = stream_looping(sp, picosynth_stream_released(sl->ring));
+        if (loop && sl->pos >= sp->loop_end)
+            sl->pos = sp->loop_start;
+        uint32_t stop = loop ? sp->loop_end : sp->len;
+        if (sl->pos >= stop) {
+            picosynth_stream_end(sl->ring);
+            sl->src = NULL;
+            return;
+        }
+
+        uint32_t n;
+        q15_t *dst = picosynth_stream_reserve(sl->ring, &n);
+        if (!n)
+            return;
+        if (n > stop - sl->pos)
+            n = stop - sl->pos;
+        if (n > budget)
+            n = budget;
+        if (sl->pos < sp->resident) {
+            /* Loops back into the resident head cost no I/O */
+            if (n > sp->resident - sl->pos)
+                n = sp->resident - sl->pos;
+            memcpy(dst, sp->data + sl->pos, n * sizeof(q15_t));
+        } else {
+            ssize_t got = pread(ss->fd, dst, n * sizeof(q15_t),
+                                ss->offset + (off_t) sl->pos * 2);
+            if (got < (ssize_t) sizeof(q15_t)) {
+                atomic_fetch_add(&s->errors, 1);
+                picosynth_stream_end(sl->ring);
+                sl->src = NULL;
+                return;
+            }
+            n = (uint32_t) got / sizeof(q15_t);
+        }
+        picosynth_stream_commit(sl->ring, n);
+        sl->pos += n;
+        budget -= n;
+    }
+}
+
+void stream_service(stream_t *s)
+{
+    if (!s)
+        return;
+    pthread_mutex_lock(&s->lock);
+    for (uint32_t i = 0; i < s->count; i++)
+        stream_fill(s, &s->slots[i]);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *stream_thread(void *arg)
+{
+    stream_t *s = arg;
+    struct timespec ts = {
+        .tv_sec = s->period_us / 1000000,
+        .tv_nsec = (long) (s->period_us % 1000000) * 1000,
+    };
+    while (!atomic_load(&s->stop)) {
+        stream_service(s);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+stream_t *stream_create(uint32_t period_us)
+{
+    stream_t *s = calloc(1, sizeof(stream_t));
+    if (!s)
+        return NULL;
+    s->period_us = period_us;
+    atomic_init(&s->stop, false);
+    atomic_init(&s->errors, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    if (period_us) {
+        if (pthread_create(&s->thread, NULL, stream_thread, s) != 0) {
+            pthread_mutex_destroy(&s->lock);
+            free(s);
+            return NULL;
+        }
+        s->threaded = true;
+    }
+    return s;
+}
+
+void stream_destroy(stream_t *s)
+{
+    if (!s)
+        return;
+    if (s->threaded) {
+        atomic_store(&s->stop, true);
+        pthread_join(s->thread, NULL);
+    }
+    pthread_mutex_destroy(&s->lock);
+    free(s->slots);
+    free(s->samples);
+    free(s);
+}
+
+bool stream_add(stream_t *s, picosynth_stream_t *ring)
+{
+    if (!s || !ring)
+        return false;
+    pthread_mutex_lock(&s->lock);
+    bool ok = true;
+    if (s->count == s->cap) {
+        uint32_t cap = s->cap ? 2 * s->cap : 8;
+        stream_slot_t *slots = realloc(s->slots, cap * sizeof(stream_slot_t));
+        if (slots) {
+            s->slots = slots;
+            s->cap = cap;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok)
+        s->slots[s->count++] = (stream_slot_t) {.ring = ring};
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+bool stream_add_sample(stream_t *s, const stream_sample_t *ss)
+{
+    if (!s || !ss || ss->fd < 0)
+        return false;
+    pthread_mutex_lock(&s->lock);
+    bool ok = true;
+    if (s->sample_count == s->sample_cap) {
+        uint32_t cap = s->sample_cap ? 2 * s->sample_cap : 64;
+        const stream_sample_t **samples =
+            realloc(s->samples, cap * sizeof(stream_sample_t *));
+        if (samples) {
+            s->samples = samples;
+            s->sample_cap = cap;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok) {
+        /* Keep the table sorted for stream_lookup() */
+        uint32_t at = s->sample_count;
+        while (at && (uintptr_t) &s->samples[at - 1]->sample >
+                         (uintptr_t) &ss->sample) {
+            s->samples[at] = s->samples[at - 1];
+            at--;
+        }
+        s->samples[at] = ss;
+        s->sample_count++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok;
+}
+
+uint32_t stream_underruns(stream_t *s)
+{
+    if (!s)
+        return 0;
+    uint32_t sum = 0;
+    pthread_mutex_lock(&s->lock);
+    for (uint32_t i = 0; i < s->count; i++)
+        sum += picosynth_stream_underruns(s->slots[i].ring);
+    pthread_mutex_unlock(&s->lock);
+    return sum;
+}
+
+uint32_t stream_errors(stream_t *s)
+{
+    return s ? atomic_load(&s->errors) : 0;
+}
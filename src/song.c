@@ -0,0 +1,789 @@
+/*
+ * song.c - Note sequences and offline player for PicoSynth
+ *
+ * Melody text and Standard MIDI Files are flattened into one sorted list of
+ * note events in samples; the player applies them at their exact sample
+ * positions while rendering.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midifile.h"
+#include "song.h"
+
+/* Melody text timing, matching tests/example.c: a note with B beats lasts
+ * 2000/B ms and is released this long before the next one starts.
+ */
+#define SONG_TEXT_GAP_MS 18
+
+#define VOICE_FREE 0xFF
+
+/* Samples mixed per step when playing cached notes */
+#define MIX_CHUNK 256
+
+#define CACHE_BUCKETS 256 /* Power of two */
+
+static song_error_t song_push(song_t *song,
+                              uint32_t time,
+                              uint8_t type,
+                              uint8_t note)
+{
+    if (song->count == song->capacity) {
+        uint32_t cap = song->capacity ? song->capacity * 2 : 64;
+        song_event_t *ev = realloc(song->events, cap * sizeof(song_event_t));
+        if (!ev)
+            return SONG_ERR_NOMEM;
+        song->events = ev;
+        song->capacity = cap;
+    }
+    song->events[song->count++] = (song_event_t) {
+        .time = time,
+        .type = type,
+        .note = note,
+    };
+    if (time > song->length)
+        song->length = time;
+    return SONG_OK;
+}
+
+/* Order by time; note-offs sort before note-ons at the same instant so a
+ * repeated note is released before it is struck again.
+ */
+static int event_cmp(const void *a, const void *b)
+{
+    const song_event_t *x = a, *y = b;
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+    if (x->type != y->type)
+        return (int) x->type - (int) y->type;
+    return (int) x->note - (int) y->note;
+}
+
+/* Parse "C4", "D#5", "Bb3" to a MIDI note number; rests ('-', 'R') give 0.
+ * Returns -1 on malformed input.
+ */
+static int parse_note(const char *str)
+{
+    static const int8_t base[7] = {9, 11, 0, 2, 4, 5, 7}; /* A..G */
+
+    if (str[0] == '-' || str[0] == 'R' || str[0] == 'r')
+        return 0;
+
+    char upper = (char) toupper((unsigned char) str[0]);
+    if (upper < 'A' || upper > 'G')
+        return -1;
+    int semitone = base[upper - 'A'];
+
+    const char *p = str + 1;
+    if (*p == '#') {
+        semitone++;
+        p++;
+    } else if (*p == 'b') {
+        semitone--;
+        p++;
+    }
+    if (!isdigit((unsigned char) *p) && *p != '-')
+        return -1;
+
+    int octave = atoi(p);
+    int midi = (octave + 1) * 12 + semitone;
+    if (octave < -1 || octave > 9 || midi < 1 || midi > 127)
+        return -1;
+    return midi;
+}
+
+song_error_t song_parse_text(song_t *song, const char *text, size_t len)
+{
+    memset(song, 0, sizeof(*song));
+
+    uint32_t t = 0;
+    size_t i = 0;
+    while (i < len) {
+        /* Extract one line */
+        char line[256];
+        size_t n = 0;
+        while (i < len && text[i] != '\n') {
+            if (n < sizeof(line) - 1)
+                line[n++] = text[i];
+            i++;
+        }
+        i++;
+        line[n] = '\0';
+
+        char *p = line;
+        while (isspace((unsigned char) *p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        char note_str[16];
+        int beats;
+        if (sscanf(p, "%15s %d", note_str, &beats) != 2 || beats <= 0) {
+            song_free(song);
+            return SONG_ERR_PARSE;
+        }
+        int note = parse_note(note_str);
+        if (note < 0) {
+            song_free(song);
+            return SONG_ERR_PARSE;
+        }
+
+        uint32_t dur = PICOSYNTH_MS(2000 / beats);
+        uint32_t gap = PICOSYNTH_MS(SONG_TEXT_GAP_MS);
+        if (note && dur > 0) {
+            uint32_t hold = dur > gap ? dur - gap : 1;
+            if (song_push(song, t, SONG_EVENT_NOTE_ON, (uint8_t) note) ||
+                song_push(song, t + hold, SONG_EVENT_NOTE_OFF,
+                          (uint8_t) note)) {
+                song_free(song);
+                return SONG_ERR_NOMEM;
+            }
+        }
+        t += dur;
+    }
+    if (t > song->length)
+        song->length = t;
+    return SONG_OK;
+}
+
+/* Tempo change in a MIDI file (microseconds per quarter note) */
+typedef struct {
+    uint32_t tick;
+    uint32_t tempo;
+} tempo_change_t;
+
+static int tempo_cmp(const void *a, const void *b)
+{
+    const tempo_change_t *x = a, *y = b;
+    return x->tick < y->tick ? -1 : x->tick > y->tick;
+}
+
+song_error_t song_parse_midi(song_t *song, const uint8_t *data, size_t len)
+{
+    midi_file_t mf;
+    midi_event_t evt;
+    tempo_change_t *tempos = NULL;
+    uint32_t n_tempos = 0, cap_tempos = 0;
+    song_error_t err = SONG_OK;
+
+    memset(song, 0, sizeof(*song));
+    if (midi_file_open(&mf, data, len) != MIDI_OK)
+        return SONG_ERR_MIDI;
+    const midi_header_t *hdr = midi_file_get_header(&mf);
+    if (hdr->division == 0)
+        return SONG_ERR_MIDI;
+
+    /* Collect note events (timed in ticks for now) and the tempo map from
+     * every track.
+     */
+    for (uint16_t t = 0; t < hdr->ntracks && !err; t++) {
+        if (midi_file_select_track(&mf, t) != MIDI_OK) {
+            err = SONG_ERR_MIDI;
+            break;
+        }
+        midi_error_t r;
+        while ((r = midi_file_next_event(&mf, &evt)) == MIDI_OK) {
+            if (evt.type == 0xFF && evt.meta_type == MIDI_META_TEMPO &&
+                evt.meta_length == 3) {
+                if (n_tempos == cap_tempos) {
+                    cap_tempos = cap_tempos ? cap_tempos * 2 : 8;
+                    tempo_change_t *tc =
+                        realloc(tempos, cap_tempos * sizeof(tempo_change_t));
+                    if (!tc) {
+                        err = SONG_ERR_NOMEM;
+                        break;
+                    }
+                    tempos = tc;
+                }
+                tempos[n_tempos++] = (tempo_change_t) {
+                    .tick = evt.abs_time,
+                    .tempo = (uint32_t) evt.meta_data[0] << 16 |
+                             (uint32_t) evt.meta_data[1] << 8 |
+                             evt.meta_data[2],
+                };
+            } else if (midi_is_note_on(&evt)) {
+                err = song_push(song, evt.abs_time, SONG_EVENT_NOTE_ON,
+                                midi_note_number(&evt));
+            } else if (midi_is_note_off(&evt)) {
+                err = song_push(song, evt.abs_time, SONG_EVENT_NOTE_OFF,
+                                midi_note_number(&evt));
+            }
+            if (err)
+                break;
+        }
+        if (!err && r != MIDI_ERR_END_OF_TRACK)
+            err = SONG_ERR_MIDI;
+    }
+    if (err) {
+        free(tempos);
+        song_free(song);
+        return err;
+    }
+
+    /* Convert ticks to samples, integrating over tempo changes */
+    qsort(song->events, song->count, sizeof(song_event_t), event_cmp);
+    qsort(tempos, n_tempos, sizeof(tempo_change_t), tempo_cmp);
+
+    uint64_t seg_us = 0;
+    uint32_t seg_tick = 0, tempo = 500000, ti = 0;
+    song->length = 0;
+    for (uint32_t i = 0; i < song->count; i++) {
+        uint32_t tick = song->events[i].time;
+        uint64_t us;
+        if (hdr->uses_smpte) {
+            us = (uint64_t) tick * 1000000 / hdr->division;
+        } else {
+            while (ti < n_tempos && tempos[ti].tick <= tick) {
+                seg_us += (uint64_t) (tempos[ti].tick - seg_tick) * tempo /
+                          hdr->division;
+                seg_tick = tempos[ti].tick;
+                tempo = tempos[ti].tempo;
+                ti++;
+            }
+            us = seg_us + (uint64_t) (tick - seg_tick) * tempo / hdr->division;
+        }
+        uint64_t samples = us * SAMPLE_RATE / 1000000;
+        song->events[i].time =
+            samples > UINT32_MAX ? UINT32_MAX : (uint32_t) samples;
+        if (song->events[i].time > song->length)
+            song->length = song->events[i].time;
+    }
+    free(tempos);
+    return SONG_OK;
+}
+
+song_error_t song_load_file(song_t *song, const char *path)
+{
+    memset(song, 0, sizeof(*song));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return SONG_ERR_IO;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len < 0) {
+        fclose(fp);
+        return SONG_ERR_IO;
+    }
+
+    uint8_t *buf = malloc((size_t) len + 1);
+    if (!buf) {
+        fclose(fp);
+        return SONG_ERR_NOMEM;
+    }
+    if (fread(buf, 1, (size_t) len, fp) != (size_t) len) {
+        free(buf);
+        fclose(fp);
+        return SONG_ERR_IO;
+    }
+    fclose(fp);
+
+    song_error_t err;
+    if (len >= 4 && memcmp(buf, "MThd", 4) == 0)
+        err = song_parse_midi(song, buf, (size_t) len);
+    else
+        err = song_parse_text(song, (const char *) buf, (size_t) len);
+    free(buf);
+    return err;
+}
+
+void song_free(song_t *song)
+{
+    if (!song)
+        return;
+    free(song->events);
+    memset(song, 0, sizeof(*song));
+}
+
+/* Piano patch levels (read through node gain pointers) */
+static const q15_t piano_mix_gain = Q15_MAX / 2;
+static const q15_t piano_noise_level = Q15_MAX / 10;
+
+/* Piano voice layout:
+ *   0: SVF low-pass (output)   1: mixer
+ *   2: fundamental envelope    3: fundamental sine
+ *   4: 2nd partial envelope    5: 2nd partial sine (detune = base freq)
+ *   6: hammer envelope         7: hammer noise
+ */
+static void piano_setup(picosynth_voice_t *v)
+{
+    picosynth_node_t *flt = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *mix = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *env1 = picosynth_voice_get_node(v, 2);
+    picosynth_node_t *osc1 = picosynth_voice_get_node(v, 3);
+    picosynth_node_t *env2 = picosynth_voice_get_node(v, 4);
+    picosynth_node_t *osc2 = picosynth_voice_get_node(v, 5);
+    picosynth_node_t *env3 = picosynth_voice_get_node(v, 6);
+    picosynth_node_t *noise = picosynth_voice_get_node(v, 7);
+
+    picosynth_init_env_ms(env1, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 4,
+                              .dec_ms = 1500,
+                              .sus_pct = 20,
+                              .rel_ms = 250,
+                          });
+    picosynth_init_osc(osc1, &env1->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+
+    picosynth_init_env_ms(env2, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 3,
+                              .dec_ms = 500,
+                              .sus_pct = 5,
+                              .rel_ms = 200,
+                          });
+    picosynth_init_osc(osc2, &env2->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+    osc2->osc.detune = picosynth_voice_freq_ptr(v); /* 2 * base frequency */
+
+    picosynth_init_env_ms(env3, &piano_noise_level,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 1,
+                              .dec_ms = 40,
+                              .sus_pct = 0,
+                              .rel_ms = 30,
+                          });
+    picosynth_init_osc(noise, &env3->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_noise);
+
+    picosynth_init_mix(mix, &piano_mix_gain, &osc1->out, &osc2->out,
+                       &noise->out);
+    picosynth_init_svf_lp(flt, NULL, &mix->out, picosynth_svf_freq(1200),
+                          Q15_MAX);
+    picosynth_voice_set_out(v, 0);
+}
+
+static void piano_note_on(picosynth_t *s, uint8_t voice, uint8_t note)
+{
+    /* Key-tracked cutoff, set before note-on so the filter starts there */
+    int32_t fc = 600 + 20 * ((int32_t) note - 48);
+    if (fc < 500)
+        fc = 500;
+    if (fc > 1500)
+        fc = 1500;
+    picosynth_voice_t *v = picosynth_get_voice(s, voice);
+    picosynth_svf_set_freq(picosynth_voice_get_node(v, 0),
+                           picosynth_svf_freq((uint16_t) fc));
+    picosynth_note_on(s, voice, note);
+}
+
+const song_patch_t song_patch_piano = {
+    .name = "piano",
+    .nodes = 8,
+    .setup = piano_setup,
+    .note_on = piano_note_on,
+    .tail = PICOSYNTH_MS(300),
+};
+
+picosynth_t *song_patch_create(const song_patch_t *patch, uint8_t voices)
+{
+    if (!patch || !patch->setup)
+        return NULL;
+    picosynth_t *s = picosynth_create(voices, patch->nodes);
+    if (!s)
+        return NULL;
+    for (uint8_t i = 0; i < voices; i++)
+        patch->setup(picosynth_get_voice(s, i));
+    return s;
+}
+
+void song_player_init(song_player_t *p,
+                      picosynth_t *s,
+                      const song_patch_t *patch,
+                      const song_t *song)
+{
+    memset(p, 0, sizeof(*p));
+    p->synth = s;
+    p->patch = patch;
+    p->song = song;
+    p->end = song->length + patch->tail;
+    while (p->voices < SONG_MAX_VOICES && picosynth_get_voice(s, p->voices))
+        p->voices++;
+    memset(p->held, VOICE_FREE, sizeof(p->held));
+}
+
+struct song_clip {
+    const song_patch_t *patch; /* Key: patch, note, hold and tail */
+    uint32_t hold;
+    uint32_t tail;
+    uint8_t note;
+    bool cached;   /* In the table; otherwise owned by one player */
+    uint32_t refs; /* Players currently mixing this clip */
+    song_clip_t *lru_prev, *lru_next;
+    song_clip_t *hash_next;
+    uint32_t len; /* Samples, trailing silence trimmed */
+    q15_t samples[];
+};
+
+struct song_cache {
+    size_t max_bytes;
+    song_clip_t *buckets[CACHE_BUCKETS];
+    song_clip_t *lru_head, *lru_tail; /* Most recently used first */
+    picosynth_t *scratch;             /* One-voice instance rendering clips */
+    const song_patch_t *scratch_patch;
+    song_cache_stats_t stats;
+};
+
+static uint32_t clip_hash(const song_patch_t *patch,
+                          uint8_t note,
+                          uint32_t hold,
+                          uint32_t tail)
+{
+    uint32_t h = 2166136261u;
+    uint32_t words[4] = {(uint32_t) (uintptr_t) patch, note, hold, tail};
+    for (int i = 0; i < 4; i++) {
+        h ^= words[i];
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 16)) & (CACHE_BUCKETS - 1);
+}
+
+static size_t clip_bytes(uint32_t len)
+{
+    return sizeof(song_clip_t) + (size_t) len * sizeof(q15_t);
+}
+
+static void lru_unlink(song_cache_t *c, song_clip_t *e)
+{
+    if (e->lru_prev)
+        e->lru_prev->lru_next = e->lru_next;
+    else
+        c->lru_head = e->lru_next;
+    if (e->lru_next)
+        e->lru_next->lru_prev = e->lru_prev;
+    else
+        c->lru_tail = e->lru_prev;
+    e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(song_cache_t *c, song_clip_t *e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head)
+        c->lru_head->lru_prev = e;
+    else
+        c->lru_tail = e;
+    c->lru_head = e;
+}
+
+static void cache_remove(song_cache_t *c, song_clip_t *e)
+{
+    song_clip_t **pp = &c->buckets[clip_hash(e->patch, e->note, e->hold,
+                                             e->tail)];
+    while (*pp != e)
+        pp = &(*pp)->hash_next;
+    *pp = e->hash_next;
+    lru_unlink(c, e);
+    c->stats.bytes -= clip_bytes(e->len);
+    c->stats.entries--;
+    free(e);
+}
+
+/* Evict unreferenced entries, oldest first, until @need more bytes fit */
+static bool cache_make_room(song_cache_t *c, size_t need)
+{
+    song_clip_t *e = c->lru_tail;
+    while (c->stats.bytes + need > c->max_bytes && e) {
+        song_clip_t *prev = e->lru_prev;
+        if (e->refs == 0) {
+            cache_remove(c, e);
+            c->stats.evictions++;
+        }
+        e = prev;
+    }
+    return c->stats.bytes + need <= c->max_bytes;
+}
+
+/* Render one note on voice 0 of the scratch instance */
+static song_clip_t *clip_render(song_cache_t *c,
+                                const song_patch_t *patch,
+                                uint8_t note,
+                                uint32_t hold)
+{
+    if (c->scratch_patch != patch) {
+        picosynth_destroy(c->scratch);
+        c->scratch = song_patch_create(patch, 1);
+        c->scratch_patch = c->scratch ? patch : NULL;
+        if (!c->scratch)
+            return NULL;
+        picosynth_set_noise_seed(c->scratch, 0, true);
+    }
+
+    uint32_t len = hold + patch->tail;
+    song_clip_t *e = malloc(clip_bytes(len));
+    if (!e)
+        return NULL;
+
+    if (patch->note_on)
+        patch->note_on(c->scratch, 0, note);
+    else
+        picosynth_note_on(c->scratch, 0, note);
+
+    int32_t sum[MIX_CHUNK];
+    for (uint32_t pos = 0; pos < len;) {
+        if (pos == hold)
+            picosynth_note_off(c->scratch, 0);
+        uint32_t stop = pos < hold ? hold : len;
+        uint32_t n = stop - pos < MIX_CHUNK ? stop - pos : MIX_CHUNK;
+        picosynth_render_voices(c->scratch, sum, n);
+        for (uint32_t i = 0; i < n; i++)
+            e->samples[pos + i] = (q15_t) sum[i]; /* One voice fits Q15 */
+        pos += n;
+    }
+
+    /* A released voice that has gone silent contributes exact zeros */
+    while (len > 0 && e->samples[len - 1] == 0)
+        len--;
+    song_clip_t *shrunk = realloc(e, clip_bytes(len));
+    if (shrunk)
+        e = shrunk;
+
+    *e = (song_clip_t) {
+        .patch = patch,
+        .hold = hold,
+        .tail = patch->tail,
+        .note = note,
+        .refs = 1,
+        .len = len,
+    };
+    return e;
+}
+
+static song_clip_t *cache_acquire(song_cache_t *c,
+                                  const song_patch_t *patch,
+                                  uint8_t note,
+                                  uint32_t hold)
+{
+    uint32_t h = clip_hash(patch, note, hold, patch->tail);
+    for (song_clip_t *e = c->buckets[h]; e; e = e->hash_next) {
+        if (e->patch == patch && e->note == note && e->hold == hold &&
+            e->tail == patch->tail) {
+            e->refs++;
+            lru_unlink(c, e);
+            lru_push(c, e);
+            c->stats.hits++;
+            return e;
+        }
+    }
+
+    c->stats.misses++;
+    song_clip_t *e = clip_render(c, patch, note, hold);
+    if (!e) {
+        c->stats.failures++;
+        return NULL;
+    }
+    size_t size = clip_bytes(e->len);
+    if (size > c->max_bytes || !cache_make_room(c, size)) {
+        c->stats.uncached++;
+        return e;
+    }
+    e->cached = true;
+    e->hash_next = c->buckets[h];
+    c->buckets[h] = e;
+    lru_push(c, e);
+    c->stats.bytes += size;
+    c->stats.entries++;
+    return e;
+}
+
+static void cache_release(song_clip_t *e)
+{
+    if (!e->cached)
+        free(e);
+    else
+        e->refs--;
+}
+
+/* Samples from the note-on at @e until the note's release */
+static uint32_t note_hold(const song_player_t *p, const song_event_t *e)
+{
+    const song_event_t *end = p->song->events + p->song->count;
+    for (const song_event_t *f = e + 1; f < end; f++)
+        if (f->type == SONG_EVENT_NOTE_OFF && f->note == e->note)
+            return f->time - e->time;
+    return p->song->length - e->time;
+}
+
+/* Pick a voice for a new note: retrigger the voice already holding it, else
+ * the free voice released longest ago, else steal the oldest note.
+ */
+static uint8_t player_alloc(const song_player_t *p, uint8_t note)
+{
+    int best = -1;
+    for (uint8_t i = 0; i < p->voices; i++) {
+        if (p->held[i] == note)
+            return i;
+        if (p->held[i] == VOICE_FREE &&
+            (best < 0 || p->released[i] < p->released[best]))
+            best = i;
+    }
+    if (best >= 0)
+        return (uint8_t) best;
+
+    best = 0;
+    for (uint8_t i = 1; i < p->voices; i++)
+        if (p->started[i] < p->started[best])
+            best = i;
+    return (uint8_t) best;
+}
+
+/* Apply @e to the allocator and, if @audible, to the synth. Cached notes
+ * need @e to lie in the song, since the note length is looked up there.
+ */
+static void player_apply(song_player_t *p,
+                         const song_event_t *e,
+                         bool audible,
+                         bool cached)
+{
+    if (e->type == SONG_EVENT_NOTE_ON) {
+        uint8_t v = player_alloc(p, e->note);
+        p->held[v] = e->note;
+        p->started[v] = e->time;
+        if (!audible)
+            return;
+        if (cached) {
+            if (p->clip[v])
+                cache_release(p->clip[v]);
+            p->clip[v] = cache_acquire(p->cache, p->patch, e->note,
+                                       note_hold(p, e));
+            p->clip_pos[v] = 0;
+            return;
+        }
+        if (p->patch->note_on)
+            p->patch->note_on(p->synth, v, e->note);
+        else
+            picosynth_note_on(p->synth, v, e->note);
+        return;
+    }
+
+    for (uint8_t v = 0; v < p->voices; v++) {
+        if (p->held[v] != e->note)
+            continue;
+        p->held[v] = VOICE_FREE;
+        p->released[v] = e->time;
+        if (audible && !cached) /* Cached notes include the release */
+            picosynth_note_off(p->synth, v);
+        return;
+    }
+}
+
+/* Mix the cached notes into the master stage. Returns samples rendered. */
+static uint32_t player_mix_clips(song_player_t *p, q15_t *out, uint32_t n)
+{
+    int32_t mix[MIX_CHUNK] = {0};
+
+    if (n > MIX_CHUNK)
+        n = MIX_CHUNK;
+    for (uint8_t v = 0; v < p->voices; v++) {
+        song_clip_t *e = p->clip[v];
+        if (!e)
+            continue;
+        uint32_t pos = p->clip_pos[v];
+        uint32_t k = e->len - pos < n ? e->len - pos : n;
+        for (uint32_t i = 0; i < k; i++)
+            mix[i] += e->samples[pos + i];
+        p->clip_pos[v] = pos + k;
+        if (p->clip_pos[v] >= e->len) {
+            cache_release(e);
+            p->clip[v] = NULL;
+        }
+    }
+    picosynth_render_premix(p->synth, out, mix, n);
+    return n;
+}
+
+uint32_t song_player_render(song_player_t *p, q15_t *out, uint32_t n)
+{
+    if (p->voices == 0)
+        return 0;
+
+    uint32_t done = 0;
+    while (done < n && p->pos < p->end) {
+        while (p->next < p->song->count &&
+               p->song->events[p->next].time <= p->pos)
+            player_apply(p, &p->song->events[p->next++], true,
+                         p->cache != NULL);
+
+        /* Render up to the next event, the end, or the buffer limit */
+        uint32_t stop = p->end;
+        if (p->next < p->song->count && p->song->events[p->next].time < stop)
+            stop = p->song->events[p->next].time;
+        uint32_t chunk = stop - p->pos;
+        if (chunk > n - done)
+            chunk = n - done;
+        if (p->cache)
+            chunk = player_mix_clips(p, out + done, chunk);
+        else
+            picosynth_render(p->synth, out + done, chunk);
+        done += chunk;
+        p->pos += chunk;
+    }
+    return done;
+}
+
+void song_player_event(song_player_t *p, const song_event_t *e)
+{
+    if (p->voices)
+        player_apply(p, e, true, false);
+}
+
+void song_player_skip(song_player_t *p, uint32_t pos)
+{
+    while (p->next < p->song->count && p->song->events[p->next].time < pos)
+        player_apply(p, &p->song->events[p->next++], false, false);
+    if (pos > p->pos)
+        p->pos = pos;
+}
+
+uint32_t song_player_warm_start(const song_player_t *p)
+{
+    uint32_t start = p->pos;
+    for (uint8_t v = 0; v < p->voices; v++) {
+        uint32_t since = p->pos - p->released[v];
+        bool audible = p->held[v] != VOICE_FREE ||
+                       (p->released[v] && since < p->patch->tail);
+        if (audible && p->started[v] < start)
+            start = p->started[v];
+    }
+    return start;
+}
+
+song_cache_t *song_cache_create(size_t max_bytes)
+{
+    song_cache_t *c = calloc(1, sizeof(song_cache_t));
+    if (c)
+        c->max_bytes = max_bytes;
+    return c;
+}
+
+void song_cache_destroy(song_cache_t *c)
+{
+    if (!c)
+        return;
+    while (c->lru_head)
+        cache_remove(c, c->lru_head);
+    picosynth_destroy(c->scratch);
+    free(c);
+}
+
+void song_cache_get_stats(const song_cache_t *c, song_cache_stats_t *st)
+{
+    if (c && st)
+        *st = c->stats;
+}
+
+void song_player_set_cache(song_player_t *p, song_cache_t *c)
+{
+    for (uint8_t v = 0; v < SONG_MAX_VOICES; v++) {
+        if (p->clip[v])
+            cache_release(p->clip[v]);
+        p->clip[v] = NULL;
+    }
+    p->cache = c;
+}
@@ -13,6 +13,9 @@ extern void test_waveform_all(void);
 extern void test_envelope_all(void);
 extern void test_synth_all(void);
 extern void test_midi_all(void);
+extern void test_song_all(void);
+extern void test_bank_all(void);
+extern void test_stream_all(void);
 
 int main(void)
 {
@@ -35,6 +38,15 @@ int main(void)
     printf("\n--- MIDI Parser Tests ---\n");
     test_midi_all();
 
+    printf("\n--- Song Player Tests ---\n");
+    test_song_all();
+
+    printf("\n--- Sample Bank Tests ---\n");
+    test_bank_all();
+
+    printf("\n--- Sample Streaming Tests ---\n");
+    test_stream_all();
+
     TEST_SUMMARY();
 
     return TEST_RESULT();
@@ -0,0 +1,16 @@
+/* Synth fixtures shared by the test suites */
+
+#include "fixture.h"
+
+void fixture_voices(picosynth_t **out, int n, fixture_init_t init, void *arg)
+{
+    for (int k = 0; k < n; k++) {
+        out[k] = picosynth_create(1, 2);
+        if (!out[k])
+            continue;
+        picosynth_voice_t *v = picosynth_get_voice(out[k], 0);
+        init(v, picosynth_voice_get_node(v, 0), picosynth_voice_get_node(v, 1),
+             arg);
+        picosynth_voice_set_out(v, 1);
+    }
+}
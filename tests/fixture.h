@@ -0,0 +1,20 @@
+/* Synth fixtures shared by the test suites */
+
+#ifndef FIXTURE_H_
+#define FIXTURE_H_
+
+#include "picosynth.h"
+
+/* Set up the envelope in slot 0 and the node in slot 1 of @v */
+typedef void (*fixture_init_t)(picosynth_voice_t *v,
+                               picosynth_node_t *env,
+                               picosynth_node_t *node,
+                               void *arg);
+
+/* Fill @out with @n one-voice, two-node synths, NULL where creation
+ * failed. Slot 1 becomes the voice output only after @init has wired it,
+ * so the envelope it reads is not skipped as unused.
+ */
+void fixture_voices(picosynth_t **out, int n, fixture_init_t init, void *arg);
+
+#endif /* FIXTURE_H_ */
@@ -0,0 +1,537 @@
+/* Sample bank tests */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "samplebank.h"
+#include "test.h"
+
+#define BANK_FRAMES 64
+
+/* Size of the test WAV: RIFF header, fmt, smpl with one loop, data */
+#define BANK_WAV_SIZE (12 + 24 + 68 + 8 + 2 * BANK_FRAMES)
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+/* A 16-bit mono ramp rooted at @root, @frac of a semitone sharp, with a
+ * forward loop over frames 16..47 when @loop is set
+ */
+static void make_wav(uint8_t *w, uint8_t root, uint32_t frac, bool loop)
+{
+    memset(w, 0, BANK_WAV_SIZE);
+    memcpy(w, "RIFF", 4);
+    put32(w + 4, BANK_WAV_SIZE - 8);
+    memcpy(w + 8, "WAVE", 4);
+
+    uint8_t *fmt = w + 12;
+    memcpy(fmt, "fmt ", 4);
+    put32(fmt + 4, 16);
+    put16(fmt + 8, 1);  /* PCM */
+    put16(fmt + 10, 1); /* mono */
+    put32(fmt + 12, SAMPLE_RATE);
+    put32(fmt + 16, SAMPLE_RATE * 2);
+    put16(fmt + 20, 2);
+    put16(fmt + 22, 16);
+
+    uint8_t *smpl = fmt + 24;
+    memcpy(smpl, "smpl", 4);
+    put32(smpl + 4, 60);
+    put32(smpl + 8 + 12, root);
+    put32(smpl + 8 + 16, frac);
+    put32(smpl + 8 + 28, loop ? 1 : 0);
+    put32(smpl + 8 + 36 + 8, 16);
+    put32(smpl + 8 + 36 + 12, 47);
+
+    uint8_t *data = smpl + 68;
+    memcpy(data, "data", 4);
+    put32(data + 4, 2 * BANK_FRAMES);
+    for (int i = 0; i < BANK_FRAMES; i++)
+        put16(data + 8 + 2 * i, (uint16_t) (i * 256));
+}
+
+static void test_bank_parse_wav(void)
+{
+    static uint32_t storage[(BANK_WAV_SIZE + 3) / 4];
+    uint8_t *wav = (uint8_t *) storage;
+    bank_t bank;
+
+    make_wav(wav, 69, 0, true);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE), BANK_OK,
+                   "parse WAV with smpl chunk");
+    TEST_ASSERT_EQ(bank.count, 1, "one sample");
+    const picosynth_sample_t *sp = &bank.samples[0];
+    TEST_ASSERT((const uint8_t *) sp->data > wav &&
+                    (const uint8_t *) sp->data < wav + BANK_WAV_SIZE,
+                "sample data is used in place");
+    TEST_ASSERT_EQ(sp->len, BANK_FRAMES, "frame count");
+    TEST_ASSERT_EQ(sp->data[10], 10 * 256, "frames read in place");
+    TEST_ASSERT_EQ(sp->root, 69, "root from smpl");
+    TEST_ASSERT_EQ(sp->rate, SAMPLE_RATE, "untuned rate");
+    TEST_ASSERT_EQ(sp->loop, PICOSYNTH_LOOP_ON, "loop from smpl");
+    TEST_ASSERT_EQ(sp->loop_start, 16, "loop start");
+    TEST_ASSERT_EQ(sp->loop_end, 48, "inclusive loop end made exclusive");
+    TEST_ASSERT(!bank.mapped, "parsed memory is not owned");
+    bank_close(&bank);
+
+    /* 50 cents sharp: the rate drops by 2^(1/24) to play the root in tune */
+    make_wav(wav, 60, 0x80000000u, false);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE), BANK_OK,
+                   "parse tuned WAV");
+    uint32_t want = (uint32_t) (SAMPLE_RATE * 0.9715319412 + 0.5);
+    TEST_ASSERT(bank.samples[0].rate + 1 >= want &&
+                    bank.samples[0].rate <= want + 1,
+                "fine tuning scales the rate");
+    TEST_ASSERT_EQ(bank.samples[0].loop, PICOSYNTH_LOOP_NONE, "no loop");
+    bank_close(&bank);
+
+    /* Formats the sampler cannot play in place are rejected */
+    make_wav(wav, 60, 0, false);
+    put16(wav + 12 + 10, 2);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE), BANK_ERR_FORMAT,
+                   "reject stereo");
+    make_wav(wav, 60, 0, false);
+    put16(wav + 12 + 22, 8);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE), BANK_ERR_FORMAT,
+                   "reject 8-bit");
+    make_wav(wav, 60, 0, false);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE - 2),
+                   BANK_ERR_FORMAT, "reject truncated chunk");
+    memcpy(wav + 8, "AVI ", 4);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, wav, BANK_WAV_SIZE), BANK_ERR_FORMAT,
+                   "reject non-WAVE RIFF");
+    TEST_ASSERT(bank.samples == NULL, "nothing left after error");
+}
+
+static void test_bank_open(void)
+{
+    static uint32_t storage[(BANK_WAV_SIZE + 3) / 4];
+    uint8_t *wav = (uint8_t *) storage;
+    bank_t bank;
+
+    TEST_ASSERT_EQ(bank_open(&bank, "/nonexistent/bank.wav"), BANK_ERR_IO,
+                   "missing file");
+
+    char path[] = "/tmp/picosynth-bank-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "temp file");
+    if (fd < 0)
+        return;
+    make_wav(wav, 60, 0, true);
+    bool written = write(fd, wav, BANK_WAV_SIZE) == BANK_WAV_SIZE;
+    close(fd);
+    TEST_ASSERT(written, "write temp bank");
+
+    TEST_ASSERT_EQ(bank_open(&bank, path), BANK_OK, "open mapped bank");
+    unlink(path);
+    TEST_ASSERT(bank.mapped, "bank owns its mapping");
+    TEST_ASSERT_EQ(bank.size, BANK_WAV_SIZE, "whole file mapped");
+
+    /* A sampler plays the mapped frames directly, wrapping at the loop */
+    picosynth_t *s = picosynth_create(1, 1);
+    TEST_ASSERT(s != NULL, "synth creation");
+    if (s) {
+        picosynth_voice_t *v = picosynth_get_voice(s, 0);
+        picosynth_node_t *n = picosynth_voice_get_node(v, 0);
+        picosynth_init_sampler(n, NULL, picosynth_voice_freq_ptr(v),
+                               &bank.samples[0]);
+        picosynth_voice_set_out(v, 0);
+        picosynth_note_on(s, 0, 60);
+        int mismatches = 0;
+        for (int i = 0; i < 100; i++) {
+            picosynth_process(s);
+            int frame = i < 48 ? i : 16 + (i - 16) % 32;
+            mismatches += n->out != frame * 256;
+        }
+        TEST_ASSERT_EQ(mismatches, 0, "mapped sample plays and loops");
+        picosynth_destroy(s);
+    }
+    bank_close(&bank);
+    TEST_ASSERT(bank.data == NULL && !bank.mapped, "bank closed");
+}
+
+/* Writer for the test SoundFont */
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} sf2_writer_t;
+
+static uint8_t *emit(sf2_writer_t *w, const void *src, size_t n)
+{
+    uint8_t *at = w->buf + w->len;
+    if (src)
+        memcpy(at, src, n);
+    else
+        memset(at, 0, n);
+    w->len += n;
+    return at;
+}
+
+/* Chunk header; returns where its size goes */
+static uint8_t *emit_chunk(sf2_writer_t *w, const char *id, const char *type)
+{
+    emit(w, id, 4);
+    uint8_t *size = emit(w, NULL, 4);
+    if (type)
+        emit(w, type, 4);
+    return size;
+}
+
+static void emit_gen(sf2_writer_t *w, uint16_t op, uint16_t amount)
+{
+    uint8_t r[4];
+    put16(r, op);
+    put16(r + 2, amount);
+    emit(w, r, 4);
+}
+
+static void emit_bag(sf2_writer_t *w, uint16_t gen)
+{
+    emit_gen(w, gen, 0);
+}
+
+static void emit_phdr(sf2_writer_t *w,
+                      const char *name,
+                      uint16_t program,
+                      uint16_t bank_num,
+                      uint16_t bag)
+{
+    uint8_t *r = emit(w, NULL, 38);
+    memcpy(r, name, strlen(name));
+    put16(r + 20, program);
+    put16(r + 22, bank_num);
+    put16(r + 24, bag);
+}
+
+static void emit_inst(sf2_writer_t *w, const char *name, uint16_t bag)
+{
+    uint8_t *r = emit(w, NULL, 22);
+    memcpy(r, name, strlen(name));
+    put16(r + 20, bag);
+}
+
+static void emit_shdr(sf2_writer_t *w,
+                      uint32_t start,
+                      uint32_t end,
+                      uint32_t loop_start,
+                      uint32_t loop_end,
+                      uint32_t rate,
+                      uint8_t pitch,
+                      int8_t correction)
+{
+    uint8_t *r = emit(w, NULL, 46);
+    memcpy(r, "smp", 3);
+    put32(r + 20, start);
+    put32(r + 24, end);
+    put32(r + 28, loop_start);
+    put32(r + 32, loop_end);
+    put32(r + 36, rate);
+    r[40] = pitch;
+    r[41] = (uint8_t) correction;
+    put16(r + 44, 1); /* mono */
+}
+
+/* Chunk size from the byte after its size field to the writer position */
+static void close_chunk(sf2_writer_t *w, uint8_t *size, uint32_t extra)
+{
+    put32(size, (uint32_t) (w->buf + w->len - size - 4) + extra);
+}
+
+#define SF2_FRAMES 200
+
+/* Two presets over two instruments and two samples, the hydra first and
+ * the sample data last. @frames declares the smpl chunk length, of which
+ * only the first SF2_FRAMES (a ramp) are written. Returns bytes written.
+ *
+ *   "Piano" 0:5   global: attenuation 60 cB, fine tune +10
+ *                 keys 0-100 -> "Keys"
+ *   "Pad" 128:0   -> "Pad"
+ *   "Keys"        global: attack 0 tc (1 s), sustain 60 cB
+ *                 keys 0-59, root 48 -> sample 0
+ *                 keys 60-127, loop, coarse +1, cutoff 6900 cents
+ *                   -> sample 1
+ *   "Pad"         loop until release -> sample 1
+ *   sample 0      frames 0-63, 22050 Hz, pitch 60
+ *   sample 1      frames 100-199, loop 120-180, 11025 Hz, pitch 72, -10
+ */
+static size_t make_sf2(uint8_t *buf, uint32_t frames)
+{
+    sf2_writer_t w = {buf, 0};
+    uint8_t *riff = emit_chunk(&w, "RIFF", "sfbk");
+
+    uint8_t *list = emit_chunk(&w, "LIST", "INFO");
+    uint8_t *size = emit_chunk(&w, "ifil", NULL);
+    emit_gen(&w, 2, 1);
+    close_chunk(&w, size, 0);
+    close_chunk(&w, list, 0);
+
+    list = emit_chunk(&w, "LIST", "pdta");
+    size = emit_chunk(&w, "phdr", NULL);
+    emit_phdr(&w, "Piano", 5, 0, 0);
+    emit_phdr(&w, "Pad", 0, 128, 2);
+    emit_phdr(&w, "EOP", 0, 0, 3);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "pbag", NULL);
+    emit_bag(&w, 0);
+    emit_bag(&w, 2);
+    emit_bag(&w, 4);
+    emit_bag(&w, 5);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "pmod", NULL);
+    emit(&w, NULL, 10);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "pgen", NULL);
+    emit_gen(&w, 48, 60);
+    emit_gen(&w, 52, 10);
+    emit_gen(&w, 43, 100 << 8);
+    emit_gen(&w, 41, 0);
+    emit_gen(&w, 41, 1);
+    emit_gen(&w, 0, 0);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "inst", NULL);
+    emit_inst(&w, "Keys", 0);
+    emit_inst(&w, "Pad", 3);
+    emit_inst(&w, "EOI", 4);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "ibag", NULL);
+    emit_bag(&w, 0);
+    emit_bag(&w, 2);
+    emit_bag(&w, 5);
+    emit_bag(&w, 10);
+    emit_bag(&w, 12);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "imod", NULL);
+    emit(&w, NULL, 10);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "igen", NULL);
+    emit_gen(&w, 34, 0);
+    emit_gen(&w, 37, 60);
+    emit_gen(&w, 43, 59 << 8);
+    emit_gen(&w, 58, 48);
+    emit_gen(&w, 53, 0);
+    emit_gen(&w, 43, 60 | 127 << 8);
+    emit_gen(&w, 54, 1);
+    emit_gen(&w, 51, 1);
+    emit_gen(&w, 8, 6900);
+    emit_gen(&w, 53, 1);
+    emit_gen(&w, 54, 3);
+    emit_gen(&w, 53, 1);
+    emit_gen(&w, 0, 0);
+    close_chunk(&w, size, 0);
+    size = emit_chunk(&w, "shdr", NULL);
+    emit_shdr(&w, 0, 64, 16, 48, 22050, 60, 0);
+    emit_shdr(&w, 100, 200, 120, 180, SAMPLE_RATE, 72, -10);
+    emit(&w, NULL, 46);
+    close_chunk(&w, size, 0);
+    close_chunk(&w, list, 0);
+
+    uint32_t unwritten = 2 * (frames - SF2_FRAMES);
+    list = emit_chunk(&w, "LIST", "sdta");
+    size = emit_chunk(&w, "smpl", NULL);
+    for (int i = 0; i < SF2_FRAMES; i++)
+        put16(emit(&w, NULL, 2), (uint16_t) (i * 100));
+    close_chunk(&w, size, unwritten);
+    close_chunk(&w, list, unwritten);
+    close_chunk(&w, riff, unwritten);
+    return w.len;
+}
+
+static void test_bank_parse_sf2(void)
+{
+    static uint32_t storage[256];
+    uint8_t *sf2 = (uint8_t *) storage;
+    size_t len = make_sf2(sf2, SF2_FRAMES);
+    bank_t bank;
+
+    TEST_ASSERT(len <= sizeof(storage), "test bank fits");
+    TEST_ASSERT_EQ(bank_parse_sf2(&bank, sf2, len), BANK_OK, "parse SF2");
+    TEST_ASSERT_EQ(bank.preset_count, 2, "two presets");
+    TEST_ASSERT_EQ(bank.zone_count, 3, "global zones are folded in");
+    TEST_ASSERT_EQ(bank.count, bank.zone_count, "one sample per zone");
+
+    const bank_preset_t *piano = bank_find_preset(&bank, 0, 5);
+    const bank_preset_t *pad = bank_find_preset(&bank, 128, 0);
+    TEST_ASSERT(piano && !strcmp(piano->name, "Piano"), "find preset");
+    TEST_ASSERT(pad && !strcmp(pad->name, "Pad"), "find drum-bank preset");
+    TEST_ASSERT(bank_find_preset(&bank, 0, 0) == NULL, "missing preset");
+    if (!piano || !pad) {
+        bank_close(&bank);
+        return;
+    }
+    TEST_ASSERT_EQ(piano->zones, 2, "piano zones");
+
+    /* Low zone: root override, preset fine tune and attenuation, and the
+     * instrument global zone's envelope
+     */
+    const bank_zone_t *z = bank_find_zone(&bank, piano, 40, 100);
+    TEST_ASSERT(z != NULL, "low zone");
+    if (!z) {
+        bank_close(&bank);
+        return;
+    }
+    const picosynth_sample_t *sp = &bank.samples[z->sample];
+    TEST_ASSERT(sp->data == (const q15_t *) (const void *) (sf2 + len) -
+                                SF2_FRAMES,
+                "sample data is used in place");
+    TEST_ASSERT_EQ(sp->len, 64, "sample length");
+    TEST_ASSERT_EQ(sp->root, 48, "overriding root key");
+    TEST_ASSERT(abs((int) sp->rate - 22178) <= 1, "fine tune +10 cents");
+    TEST_ASSERT_EQ(sp->loop, PICOSYNTH_LOOP_NONE, "no loop by default");
+    TEST_ASSERT_EQ(z->env.atk_ms, 1000, "attack from global zone");
+    TEST_ASSERT_EQ(z->env.hold_ms, 1, "default hold");
+    TEST_ASSERT_EQ(z->env.sus_pct, 50, "sustain 60 cB down");
+    TEST_ASSERT(abs(z->gain - 16422) <= 2, "attenuation 60 cB");
+    TEST_ASSERT_EQ(z->cutoff_hz, 0, "no filter by default");
+
+    /* High zone: offset sample, loop, tuning and filter; the preset key
+     * range clips it
+     */
+    z = bank_find_zone(&bank, piano, 72, 100);
+    TEST_ASSERT(z != NULL, "high zone");
+    if (!z) {
+        bank_close(&bank);
+        return;
+    }
+    sp = &bank.samples[z->sample];
+    TEST_ASSERT_EQ(z->key_lo, 60, "key range low");
+    TEST_ASSERT_EQ(z->key_hi, 100, "key range clipped by preset");
+    TEST_ASSERT_EQ(sp->data[0], 100 * 100, "sample start");
+    TEST_ASSERT_EQ(sp->len, 100, "sample length");
+    TEST_ASSERT_EQ(sp->root, 72, "original pitch");
+    TEST_ASSERT(abs((int) sp->rate - 11681) <= 1,
+                "coarse +100, fine +10, correction -10 cents");
+    TEST_ASSERT_EQ(sp->loop, PICOSYNTH_LOOP_ON, "loop mode 1");
+    TEST_ASSERT_EQ(sp->loop_start, 20, "loop start within sample");
+    TEST_ASSERT_EQ(sp->loop_end, 80, "loop end within sample");
+    TEST_ASSERT_EQ(z->cutoff_hz, 440, "6900 cents is 440 Hz");
+    TEST_ASSERT_EQ(z->env.atk_ms, 1000, "global zone covers every zone");
+    TEST_ASSERT(bank_find_zone(&bank, piano, 101, 100) == NULL,
+                "no zone past the preset range");
+
+    z = bank_find_zone(&bank, pad, 30, 1);
+    TEST_ASSERT(z != NULL, "pad zone");
+    if (z) {
+        sp = &bank.samples[z->sample];
+        TEST_ASSERT_EQ(sp->loop, PICOSYNTH_LOOP_SUSTAIN, "loop mode 3");
+        TEST_ASSERT_EQ(z->gain, Q15_MAX, "other presets unattenuated");
+        TEST_ASSERT(abs((int) sp->rate - 10962) <= 1, "pitch correction");
+    }
+    bank_close(&bank);
+
+    /* Hydra indices past their tables are rejected */
+    make_sf2(sf2, SF2_FRAMES);
+    TEST_ASSERT_EQ(bank_parse_wav(&bank, sf2, len), BANK_ERR_FORMAT,
+                   "SF2 is not WAV");
+    /* RIFF, INFO list with ifil, pdta list header, phdr chunk header */
+    uint8_t *phdr = sf2 + 12 + 24 + 12 + 8;
+    put16(phdr + 38 + 24, 9);
+    TEST_ASSERT_EQ(bank_parse_sf2(&bank, sf2, len), BANK_ERR_FORMAT,
+                   "reject bag index out of range");
+    TEST_ASSERT(bank.presets == NULL && bank.zones == NULL,
+                "nothing left after error");
+}
+
+static void test_bank_sf2_voice(void)
+{
+    static uint32_t storage[256];
+    uint8_t *sf2 = (uint8_t *) storage;
+    size_t len = make_sf2(sf2, SF2_FRAMES);
+    bank_t bank;
+    TEST_ASSERT_EQ(bank_parse_sf2(&bank, sf2, len), BANK_OK, "parse SF2");
+
+    picosynth_t *s = picosynth_create(1, 3);
+    TEST_ASSERT(s != NULL, "synth creation");
+    if (!s) {
+        bank_close(&bank);
+        return;
+    }
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *smp = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *flt = picosynth_voice_get_node(v, 2);
+    const bank_preset_t *piano = bank_find_preset(&bank, 0, 5);
+
+    /* Zones with a cutoff get an SVF, the rest a pass-through */
+    const bank_zone_t *z = bank_find_zone(&bank, piano, 72, 127);
+    bank_zone_init(&bank, z, env, smp, flt, picosynth_voice_freq_ptr(v));
+    picosynth_voice_set_out(v, 2);
+    TEST_ASSERT(env->gain == &z->gain, "envelope scaled by attenuation");
+    TEST_ASSERT(smp->smp.sample == &bank.samples[z->sample],
+                "sampler plays the zone's sample");
+    TEST_ASSERT(smp->gain == &env->out, "sampler scaled by envelope");
+    TEST_ASSERT_EQ(flt->type, PICOSYNTH_NODE_SVF_LP, "zone filter");
+    TEST_ASSERT(flt->svf.in == &smp->out, "filter follows sampler");
+
+    z = bank_find_zone(&bank, piano, 40, 127);
+    bank_zone_init(&bank, z, env, smp, flt, picosynth_voice_freq_ptr(v));
+    TEST_ASSERT_EQ(flt->type, PICOSYNTH_NODE_MIX, "open zone");
+
+    /* The looping zone sounds through envelope, sampler and filter */
+    z = bank_find_zone(&bank, piano, 72, 127);
+    bank_zone_init(&bank, z, env, smp, flt, picosynth_voice_freq_ptr(v));
+    bank_prefetch(&bank, z);
+    picosynth_note_on(s, 0, 72);
+    int32_t peak = 0;
+    for (int i = 0; i < 4000; i++) {
+        int32_t x = abs(picosynth_process(s));
+        peak = x > peak ? x : peak;
+    }
+    TEST_ASSERT(peak > 0, "zone plays through the voice");
+    picosynth_destroy(s);
+    bank_close(&bank);
+}
+
+/* A bank far larger than anything the tests read: opening it maps the
+ * file and parses the hydra without touching the sample data
+ */
+static void test_bank_open_large_sf2(void)
+{
+    static uint32_t storage[256];
+    uint8_t *sf2 = (uint8_t *) storage;
+    const uint32_t frames = 128u << 20; /* 256 MB of samples */
+    size_t len = make_sf2(sf2, frames);
+
+    char path[] = "/tmp/picosynth-sf2-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "temp file");
+    if (fd < 0)
+        return;
+    bool written = write(fd, sf2, len) == (ssize_t) len &&
+                   ftruncate(fd, (off_t) len + 2 * (off_t) (frames -
+                                                            SF2_FRAMES)) == 0;
+    close(fd);
+    TEST_ASSERT(written, "write sparse bank");
+
+    bank_t bank;
+    TEST_ASSERT_EQ(bank_open(&bank, path), BANK_OK, "open large SF2");
+    unlink(path);
+    TEST_ASSERT(bank.mapped, "bank is mapped");
+    TEST_ASSERT_EQ(bank.zone_count, 3, "hydra parsed");
+    const bank_zone_t *z =
+        bank_find_zone(&bank, bank_find_preset(&bank, 0, 5), 72, 127);
+    TEST_ASSERT(z && bank.samples[z->sample].data[0] == 100 * 100,
+                "sample read from the mapping");
+    bank_close(&bank);
+}
+
+void test_bank_all(void)
+{
+    TEST_RUN(test_bank_parse_wav);
+    TEST_RUN(test_bank_open);
+    TEST_RUN(test_bank_parse_sf2);
+    TEST_RUN(test_bank_sf2_voice);
+    TEST_RUN(test_bank_open_large_sf2);
+}
@@ -0,0 +1,313 @@
+/* Song loader and player tests */
+
+#include <stdlib.h>
+#include <string.h>
+#include "song.h"
+#include "test.h"
+
+/* Two tracks: tempo map (120 BPM, then 60 BPM from beat 1) and notes */
+static const uint8_t midi_two_tracks[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, /* format 1 */
+    0, 2,                                 /* 2 tracks */
+    0x01, 0xE0,                           /* 480 ticks per quarter */
+    /* Track 0: tempo changes */
+    'M', 'T', 'r', 'k', 0, 0, 0, 19,
+    0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20, /* 500000 us/quarter */
+    0x83, 0x60, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40, /* +480: 1000000 */
+    0x00, 0xFF, 0x2F, 0x00,
+    /* Track 1: C4 for two beats, E4 for one beat */
+    'M', 'T', 'r', 'k', 0, 0, 0, 22,
+    0x00, 0x90, 0x3C, 0x64,       /* C4 on at 0 */
+    0x87, 0x40, 0x80, 0x3C, 0x00, /* C4 off at 960 */
+    0x00, 0x90, 0x40, 0x64,       /* E4 on at 960 */
+    0x83, 0x60, 0x90, 0x40, 0x00, /* E4 off (vel 0) at 1440 */
+    0x00, 0xFF, 0x2F, 0x00,
+};
+
+static void test_song_parse_text(void)
+{
+    static const char text[] = "# comment\n"
+                               "C4 4\n"
+                               "\n"
+                               "- 4\n"
+                               "  E4 2\n";
+    song_t song;
+
+    TEST_ASSERT_EQ(song_parse_text(&song, text, strlen(text)), SONG_OK,
+                   "parse melody text");
+    TEST_ASSERT_EQ(song.count, 4, "two notes, rest skipped");
+    TEST_ASSERT_EQ(song.events[0].type, SONG_EVENT_NOTE_ON, "C4 on");
+    TEST_ASSERT_EQ(song.events[0].note, 60, "C4 is MIDI 60");
+    TEST_ASSERT_EQ(song.events[0].time, 0, "C4 starts at 0");
+    TEST_ASSERT_EQ(song.events[1].type, SONG_EVENT_NOTE_OFF, "C4 off");
+    TEST_ASSERT(song.events[1].time < PICOSYNTH_MS(500),
+                "C4 released before its slot ends");
+    TEST_ASSERT_EQ(song.events[2].note, 64, "E4 is MIDI 64");
+    TEST_ASSERT_EQ(song.events[2].time, PICOSYNTH_MS(500) * 2,
+                   "E4 starts after quarter note and quarter rest");
+    TEST_ASSERT_EQ(song.length, PICOSYNTH_MS(500) * 2 + PICOSYNTH_MS(1000),
+                   "length covers the last slot");
+    song_free(&song);
+
+    TEST_ASSERT_EQ(song_parse_text(&song, "H4 4\n", 5), SONG_ERR_PARSE,
+                   "reject bad note name");
+    TEST_ASSERT_EQ(song_parse_text(&song, "C4\n", 3), SONG_ERR_PARSE,
+                   "reject missing duration");
+    TEST_ASSERT(song.events == NULL, "no events left after error");
+}
+
+static void test_song_parse_midi(void)
+{
+    song_t song;
+
+    TEST_ASSERT_EQ(
+        song_parse_midi(&song, midi_two_tracks, sizeof(midi_two_tracks)),
+        SONG_OK, "parse two-track MIDI");
+    TEST_ASSERT_EQ(song.count, 4, "tracks merged");
+    if (song.count != 4)
+        return;
+
+    /* Beat 0 lasts 0.5 s at 120 BPM, later beats 1 s at 60 BPM */
+    TEST_ASSERT_EQ(song.events[0].time, 0, "C4 on at 0");
+    TEST_ASSERT_EQ(song.events[0].note, 60, "first note C4");
+    TEST_ASSERT_EQ(song.events[1].type, SONG_EVENT_NOTE_OFF,
+                   "note-off sorts first on tie");
+    TEST_ASSERT_EQ(song.events[1].time, SAMPLE_RATE * 3 / 2,
+                   "C4 off at 1.5 s (tempo map applied)");
+    TEST_ASSERT_EQ(song.events[2].note, 64, "then E4 on");
+    TEST_ASSERT_EQ(song.events[3].time, SAMPLE_RATE * 5 / 2,
+                   "E4 off at 2.5 s");
+    TEST_ASSERT_EQ(song.length, SAMPLE_RATE * 5 / 2, "length");
+    song_free(&song);
+
+    static const uint8_t junk[] = {'M', 'T', 'h', 'd', 0, 0};
+    TEST_ASSERT_EQ(song_parse_midi(&song, junk, sizeof(junk)), SONG_ERR_MIDI,
+                   "reject truncated MIDI");
+}
+
+static void song_add(song_t *song, uint32_t on, uint32_t off, uint8_t note)
+{
+    song_event_t *e = &song->events[song->count];
+    e[0] = (song_event_t) {on, SONG_EVENT_NOTE_ON, note};
+    e[1] = (song_event_t) {off, SONG_EVENT_NOTE_OFF, note};
+    song->count += 2;
+    if (off > song->length)
+        song->length = off;
+}
+
+/* Sort by time, note-offs first on ties */
+static void song_sort(song_t *song)
+{
+    song_event_t *ev = song->events;
+    for (uint32_t i = 1; i < song->count; i++) {
+        song_event_t e = ev[i];
+        uint32_t j = i;
+        while (j > 0 &&
+               (ev[j - 1].time > e.time ||
+                (ev[j - 1].time == e.time && ev[j - 1].type > e.type))) {
+            ev[j] = ev[j - 1];
+            j--;
+        }
+        ev[j] = e;
+    }
+}
+
+static void test_song_allocator(void)
+{
+    song_event_t events[8];
+    song_t song = {.events = events, .capacity = 8};
+    song_player_t p;
+
+    /* Three overlapping notes on two voices */
+    song_add(&song, 0, 300, 60);
+    song_add(&song, 100, 300, 64);
+    song_add(&song, 200, 300, 67);
+    song_sort(&song);
+    picosynth_t *s = song_patch_create(&song_patch_piano, 2);
+    TEST_ASSERT(s != NULL, "create piano");
+    if (!s)
+        return;
+
+    song_player_init(&p, s, &song_patch_piano, &song);
+    TEST_ASSERT_EQ(p.voices, 2, "player sees both voices");
+    song_player_skip(&p, 150);
+    TEST_ASSERT_EQ(p.held[0], 60, "first note on voice 0");
+    TEST_ASSERT_EQ(p.held[1], 64, "second note on voice 1");
+    song_player_skip(&p, 250);
+    TEST_ASSERT_EQ(p.held[0], 67, "third note steals oldest voice");
+    TEST_ASSERT_EQ(song_player_warm_start(&p), 100,
+                   "warm start at earliest sounding note");
+    song_player_skip(&p, 301);
+    TEST_ASSERT_EQ(p.held[0], 0xFF, "voice 0 released");
+    TEST_ASSERT_EQ(p.held[1], 0xFF, "voice 1 released");
+    song_player_skip(&p, 300 + song_patch_piano.tail);
+    TEST_ASSERT_EQ(song_player_warm_start(&p), 300 + song_patch_piano.tail,
+                   "silent after the tail");
+    picosynth_destroy(s);
+}
+
+/* Rendering from the warm start reproduces the sequential render */
+static void test_song_warm_start_render(void)
+{
+    song_event_t events[64];
+    song_t song = {.events = events, .capacity = 64};
+
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t on = i * PICOSYNTH_MS(150);
+        song_add(&song, on, on + PICOSYNTH_MS(90 + 40 * (i % 4)),
+                 (uint8_t) (48 + (i * 7) % 24));
+    }
+    song_sort(&song);
+
+    picosynth_t *ref = song_patch_create(&song_patch_piano, 4);
+    picosynth_t *seg = song_patch_create(&song_patch_piano, 4);
+    uint32_t total = song.length + song_patch_piano.tail;
+    q15_t *a = calloc(total, sizeof(q15_t));
+    q15_t *b = calloc(total, sizeof(q15_t));
+    TEST_ASSERT(ref && seg && a && b, "allocate");
+    if (!ref || !seg || !a || !b)
+        goto out;
+    picosynth_set_noise_seed(ref, 0, true);
+    picosynth_set_noise_seed(seg, 0, true);
+
+    song_player_t p;
+    song_player_init(&p, ref, &song_patch_piano, &song);
+    TEST_ASSERT_EQ(song_player_render(&p, a, total + 100), total,
+                   "render whole song");
+    TEST_ASSERT_EQ(song_player_render(&p, a, 16), 0, "finished");
+
+    uint32_t boundary = PICOSYNTH_MS(1000);
+    song_player_init(&p, seg, &song_patch_piano, &song);
+    song_player_skip(&p, boundary);
+    uint32_t start = song_player_warm_start(&p);
+    TEST_ASSERT(start < boundary, "sounding notes need a warm start");
+
+    song_player_init(&p, seg, &song_patch_piano, &song);
+    song_player_skip(&p, start);
+    song_player_render(&p, b + start, boundary - start);
+    song_player_render(&p, b + boundary, total - boundary);
+
+    int max_diff = 0;
+    for (uint32_t i = boundary; i < total; i++) {
+        int d = abs((int) a[i] - (int) b[i]);
+        if (d > max_diff)
+            max_diff = d;
+    }
+    TEST_ASSERT_EQ(max_diff, 0, "segment matches sequential render");
+
+out:
+    free(a);
+    free(b);
+    picosynth_destroy(ref);
+    picosynth_destroy(seg);
+}
+
+/* Events applied one by one match the player's own scheduling */
+static void test_song_player_event(void)
+{
+    static const char text[] = "C4 4\nE4 8\n- 8\nG4 4\nC5 2\n";
+    song_t song, none = {0};
+    TEST_ASSERT_EQ(song_parse_text(&song, text, strlen(text)), SONG_OK,
+                   "parse melody");
+
+    uint32_t total = song.length + song_patch_piano.tail;
+    q15_t *ref = calloc(total, sizeof(q15_t));
+    q15_t *out = calloc(total, sizeof(q15_t));
+    picosynth_t *a = song_patch_create(&song_patch_piano, 2);
+    picosynth_t *b = song_patch_create(&song_patch_piano, 2);
+    TEST_ASSERT(ref && out && a && b, "allocate");
+    if (ref && out && a && b) {
+        song_player_t p, q;
+        song_player_init(&p, a, &song_patch_piano, &song);
+        song_player_render(&p, ref, total);
+
+        song_player_init(&q, b, &song_patch_piano, &none);
+        uint32_t pos = 0;
+        for (uint32_t i = 0; i <= song.count; i++) {
+            uint32_t t = i < song.count ? song.events[i].time : total;
+            picosynth_render(b, out + pos, t - pos);
+            pos = t;
+            if (i < song.count)
+                song_player_event(&q, &song.events[i]);
+        }
+        TEST_ASSERT_EQ(memcmp(out, ref, total * sizeof(q15_t)), 0,
+                       "live events match song playback");
+    }
+    picosynth_destroy(a);
+    picosynth_destroy(b);
+    free(ref);
+    free(out);
+    song_free(&song);
+}
+
+/* Cached notes mix in exactly like synthesized ones */
+static void test_song_cache(void)
+{
+    static const char text[] = "C4 4\nC4 4\nG4 4\nG4 4\nA4 8\nA4 8\nG4 2\n"
+                               "C4 4\nC4 4\nG4 4\nG4 4\n";
+    song_t song;
+    TEST_ASSERT_EQ(song_parse_text(&song, text, strlen(text)), SONG_OK,
+                   "parse melody");
+
+    uint32_t total = song.length + song_patch_piano.tail;
+    q15_t *ref = calloc(total, sizeof(q15_t));
+    q15_t *out = calloc(total, sizeof(q15_t));
+    picosynth_t *s = song_patch_create(&song_patch_piano, 4);
+    song_cache_t *big = song_cache_create(1 << 20);
+    song_cache_t *tiny = song_cache_create(PICOSYNTH_MS(700) * sizeof(q15_t));
+    TEST_ASSERT(ref && out && s && big && tiny, "allocate");
+    if (!ref || !out || !s || !big || !tiny)
+        goto out;
+
+    song_player_t p;
+    picosynth_set_noise_seed(s, 0, true);
+    song_player_init(&p, s, &song_patch_piano, &song);
+    song_player_render(&p, ref, total);
+    picosynth_destroy(s);
+
+    /* Fresh instance for each cached render: master DC state starts clean */
+    song_cache_t *caches[2] = {big, tiny};
+    for (int i = 0; i < 2; i++) {
+        s = song_patch_create(&song_patch_piano, 4);
+        TEST_ASSERT(s != NULL, "create piano");
+        if (!s)
+            goto out;
+        song_player_init(&p, s, &song_patch_piano, &song);
+        song_player_set_cache(&p, caches[i]);
+        TEST_ASSERT_EQ(song_player_render(&p, out, total), total,
+                       "cached render length");
+        TEST_ASSERT_EQ(memcmp(out, ref, total * sizeof(q15_t)), 0,
+                       "cached render matches synthesis");
+        song_player_set_cache(&p, NULL);
+        picosynth_destroy(s);
+    }
+    s = NULL;
+
+    song_cache_stats_t st;
+    song_cache_get_stats(big, &st);
+    TEST_ASSERT_EQ(st.misses, 4, "one miss per distinct note and length");
+    TEST_ASSERT_EQ(st.hits, 7, "repeats served from cache");
+    TEST_ASSERT_EQ(st.evictions, 0, "no evictions under a large cap");
+    song_cache_get_stats(tiny, &st);
+    TEST_ASSERT(st.evictions > 0, "small cap evicts");
+    TEST_ASSERT(st.bytes <= PICOSYNTH_MS(700) * sizeof(q15_t),
+                "usage stays under the cap");
+
+out:
+    picosynth_destroy(s);
+    song_cache_destroy(big);
+    song_cache_destroy(tiny);
+    free(ref);
+    free(out);
+    song_free(&song);
+}
+
+void test_song_all(void)
+{
+    TEST_RUN(test_song_parse_text);
+    TEST_RUN(test_song_parse_midi);
+    TEST_RUN(test_song_allocator);
+    TEST_RUN(test_song_warm_start_render);
+    TEST_RUN(test_song_player_event);
+    TEST_RUN(test_song_cache);
+}
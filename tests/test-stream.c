@@ -0,0 +1,382 @@
+/* Sample streaming tests */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixture.h"
+#include "samplestream.h"
+#include "test.h"
+
+#define STREAM_FRAMES 4096
+#define STREAM_LONG 40000 /* Past 32768, where Q16.16 frames reach bit 31 */
+#define STREAM_RING 512
+
+/* Size of a test WAV of @frames: RIFF header, fmt, smpl with one loop,
+ * data
+ */
+#define STREAM_WAV_SIZE(frames) (12 + 24 + 68 + 8 + 2 * (frames))
+
+/* Frame @i of the test ramp; never zero, so silence is told apart */
+static q15_t ramp(uint32_t i)
+{
+    return (q15_t) (i * 4 + 1);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+/* Write @frames of the ramp as a WAV file rooted at 60, looping frames
+ * 1000..2999 when @loop is set, and open it as @bank
+ */
+static bool open_wav(bank_t *bank, bool loop, uint32_t frames)
+{
+    static uint8_t w[STREAM_WAV_SIZE(STREAM_LONG)];
+    uint32_t size = STREAM_WAV_SIZE(frames);
+    memset(bank, 0, sizeof(bank_t));
+    bank->fd = -1;
+    memset(w, 0, size);
+    memcpy(w, "RIFF", 4);
+    put32(w + 4, size - 8);
+    memcpy(w + 8, "WAVE", 4);
+
+    uint8_t *fmt = w + 12;
+    memcpy(fmt, "fmt ", 4);
+    put32(fmt + 4, 16);
+    put16(fmt + 8, 1);  /* PCM */
+    put16(fmt + 10, 1); /* mono */
+    put32(fmt + 12, SAMPLE_RATE);
+    put32(fmt + 16, SAMPLE_RATE * 2);
+    put16(fmt + 20, 2);
+    put16(fmt + 22, 16);
+
+    uint8_t *smpl = fmt + 24;
+    memcpy(smpl, "smpl", 4);
+    put32(smpl + 4, 60);
+    put32(smpl + 8 + 12, 60);
+    put32(smpl + 8 + 28, loop ? 1 : 0);
+    put32(smpl + 8 + 36 + 8, 1000);
+    put32(smpl + 8 + 36 + 12, 2999);
+
+    uint8_t *data = smpl + 68;
+    memcpy(data, "data", 4);
+    put32(data + 4, 2 * frames);
+    for (uint32_t i = 0; i < frames; i++)
+        put16(data + 8 + 2 * i, (uint16_t) ramp(i));
+
+    char path[] = "/tmp/picosynth-stream-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return false;
+    bool written = write(fd, w, size) == (ssize_t) size;
+    close(fd);
+    bool ok = written && bank_open(bank, path) == BANK_OK;
+    unlink(path); /* The bank keeps the file open */
+    return ok;
+}
+
+static void stream_init(picosynth_voice_t *v,
+                        picosynth_node_t *env,
+                        picosynth_node_t *node,
+                        void *sample)
+{
+    picosynth_init_env(env, NULL,
+                       &(picosynth_env_params_t) {
+                           .attack = 30000,
+                           .decay = 100,
+                           .sustain = Q15_MAX,
+                           .release = 10,
+                       });
+    picosynth_init_sampler(node, &env->out, picosynth_voice_freq_ptr(v),
+                           sample);
+}
+
+/* One voice playing @sample raw through a sampler with a ring. The gain
+ * goes once the envelope is wired, which keeps the voice alive through the
+ * release.
+ */
+static picosynth_t *make_stream_synth(const picosynth_sample_t *sample,
+                                      picosynth_stream_t **ring)
+{
+    picosynth_t *s;
+    fixture_voices(&s, 1, stream_init, (void *) sample);
+    if (!s)
+        return NULL;
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    smp->gain = NULL;
+    *ring = NULL;
+    if (picosynth_arena_init(s, NULL, picosynth_stream_size(STREAM_RING)))
+        *ring = picosynth_stream_create(s, STREAM_RING);
+    if (!*ring) {
+        picosynth_destroy(s);
+        return NULL;
+    }
+    picosynth_sampler_set_stream(smp, *ring);
+    return s;
+}
+
+/* Render @n samples, servicing @st every 64 like an audio callback would
+ * wake it, and count outputs that differ from @want(i)
+ */
+static int stream_run(picosynth_t *s,
+                      stream_t *st,
+                      uint32_t start,
+                      uint32_t n,
+                      q15_t (*want)(uint32_t))
+{
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    int mismatches = 0;
+    for (uint32_t i = start; i < start + n; i++) {
+        if (i % 64 == 0)
+            stream_service(st);
+        picosynth_process(s);
+        mismatches += smp->out != want(i);
+    }
+    return mismatches;
+}
+
+static q15_t want_once(uint32_t i)
+{
+    return i < STREAM_FRAMES ? ramp(i) : 0;
+}
+
+/* The first 16 frames only */
+static q15_t want_head(uint32_t i)
+{
+    return i < 16 ? ramp(i) : 0;
+}
+
+static q15_t want_long(uint32_t i)
+{
+    return i < STREAM_LONG ? ramp(i) : 0;
+}
+
+static q15_t want_loop(uint32_t i)
+{
+    return ramp(i < 3000 ? i : 1000 + (i - 1000) % 2000);
+}
+
+static void test_stream_sample_init(void)
+{
+    bank_t bank;
+    TEST_ASSERT(open_wav(&bank, false, STREAM_FRAMES), "open temp bank");
+    TEST_ASSERT(bank.fd >= 0, "bank keeps its file open");
+
+    stream_sample_t ss;
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 20), "init stream");
+    TEST_ASSERT_EQ(ss.sample.resident, SAMPLE_RATE * 20 / 1000,
+                   "20 ms resident");
+    TEST_ASSERT(ss.sample.data != bank.samples[0].data,
+                "head copied out of the mapping");
+    TEST_ASSERT_EQ(ss.sample.data[100], ramp(100), "head frames");
+    TEST_ASSERT_EQ(ss.sample.len, STREAM_FRAMES, "full length kept");
+    stream_sample_free(&ss);
+
+    /* Samples shorter than the preload are copied whole */
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 1000), "init short");
+    TEST_ASSERT_EQ(ss.sample.resident, 0, "fully resident");
+    TEST_ASSERT_EQ(ss.sample.data[STREAM_FRAMES - 1],
+                   ramp(STREAM_FRAMES - 1), "whole sample copied");
+    stream_sample_free(&ss);
+
+    TEST_ASSERT(!stream_sample_init(&ss, &bank, 1, 20), "bad index");
+    bank_close(&bank);
+    TEST_ASSERT_EQ(bank.fd, -1, "file closed with the bank");
+    TEST_ASSERT(!stream_sample_init(&ss, &bank, 0, 20), "closed bank");
+}
+
+static void test_stream_playback(void)
+{
+    bank_t bank;
+    TEST_ASSERT(open_wav(&bank, false, STREAM_FRAMES), "open temp bank");
+    stream_sample_t ss;
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 20), "init stream");
+    picosynth_stream_t *ring;
+    picosynth_t *s = make_stream_synth(&ss.sample, &ring);
+    stream_t *st = stream_create(0);
+    TEST_ASSERT(s && st, "synth and streamer");
+    if (!s || !st)
+        goto out;
+    TEST_ASSERT(stream_add(st, ring), "add ring");
+    TEST_ASSERT(stream_add_sample(st, &ss), "add sample");
+
+    /* Every frame plays in order from a ring far smaller than the sample */
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, STREAM_FRAMES + 100, want_once), 0,
+                   "streamed sample plays sample for sample, then stops");
+    TEST_ASSERT_EQ(stream_underruns(st), 0, "no underruns");
+
+    /* Retriggering streams from the start again */
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, 1000, want_once), 0, "retrigger");
+    TEST_ASSERT_EQ(stream_underruns(st), 0, "no underruns on retrigger");
+    TEST_ASSERT_EQ(stream_errors(st), 0, "no read errors");
+
+    /* Samples the stream does not know are never read from, even when they
+     * claim to be streamed
+     */
+    static q15_t head[16];
+    for (uint32_t i = 0; i < 16; i++)
+        head[i] = ramp(i);
+    picosynth_sample_t stray = ss.sample;
+    stray.data = head;
+    stray.resident = 16;
+    TEST_ASSERT(!stream_add_sample(st, &(stream_sample_t) {.fd = -1}),
+                "uninitialized sample rejected");
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    picosynth_sampler_set(smp, &stray);
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, 100, want_head), 0,
+                   "unknown sample stops after its resident frames");
+    TEST_ASSERT_EQ(stream_errors(st), 1, "and counts as an error");
+
+out:
+    stream_destroy(st);
+    picosynth_destroy(s);
+    stream_sample_free(&ss);
+    bank_close(&bank);
+}
+
+/* Positions past frame 32768 no longer fit Q16.16 in 31 bits */
+static void test_stream_long(void)
+{
+    bank_t bank;
+    TEST_ASSERT(open_wav(&bank, false, STREAM_LONG), "open long bank");
+    stream_sample_t ss;
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 20), "init stream");
+    picosynth_stream_t *ring;
+    picosynth_t *s = make_stream_synth(&ss.sample, &ring);
+    stream_t *st = stream_create(0);
+    TEST_ASSERT(s && st, "synth and streamer");
+    if (!s || !st)
+        goto out;
+    stream_add(st, ring);
+    stream_add_sample(st, &ss);
+
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, STREAM_LONG + 100, want_long), 0,
+                   "long sample plays to its end");
+    TEST_ASSERT_EQ(stream_underruns(st), 0, "no underruns");
+
+out:
+    stream_destroy(st);
+    picosynth_destroy(s);
+    stream_sample_free(&ss);
+    bank_close(&bank);
+}
+
+static void test_stream_loop(void)
+{
+    bank_t bank;
+    TEST_ASSERT(open_wav(&bank, true, STREAM_FRAMES), "open looped bank");
+    stream_sample_t ss;
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 20), "init stream");
+    TEST_ASSERT_EQ(ss.sample.loop_end, 3000, "loop end");
+    picosynth_stream_t *ring;
+    picosynth_t *s = make_stream_synth(&ss.sample, &ring);
+    stream_t *st = stream_create(0);
+    TEST_ASSERT(s && st, "synth and streamer");
+    if (!s || !st)
+        goto out;
+    stream_add(st, ring);
+    stream_add_sample(st, &ss);
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+
+    /* The producer unrolls the loop into the ring */
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, 8000, want_loop), 0,
+                   "loop streamed seamlessly");
+    picosynth_note_off(s, 0);
+    TEST_ASSERT_EQ(stream_run(s, st, 8000, 2000, want_loop), 0,
+                   "forward loop holds through release");
+
+    /* A sustain loop plays out to the end once the key is up */
+    ss.sample.loop = PICOSYNTH_LOOP_SUSTAIN;
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(stream_run(s, st, 0, 5000, want_loop), 0,
+                   "sustain loop while held");
+    picosynth_note_off(s, 0);
+    bool tail = false;
+    for (uint32_t i = 0; i < 4000; i++) {
+        if (i % 64 == 0)
+            stream_service(st);
+        picosynth_process(s);
+        tail |= smp->out == ramp(STREAM_FRAMES - 1);
+    }
+    TEST_ASSERT(tail, "released note reaches the sample end");
+    TEST_ASSERT_EQ(smp->out, 0, "and stops");
+    TEST_ASSERT_EQ(stream_underruns(st), 0, "no underruns");
+
+out:
+    stream_destroy(st);
+    picosynth_destroy(s);
+    stream_sample_free(&ss);
+    bank_close(&bank);
+}
+
+static void test_stream_thread(void)
+{
+    bank_t bank;
+    TEST_ASSERT(open_wav(&bank, false, STREAM_FRAMES), "open temp bank");
+    stream_sample_t ss;
+    TEST_ASSERT(stream_sample_init(&ss, &bank, 0, 20), "init stream");
+    picosynth_stream_t *ring;
+    picosynth_t *s = make_stream_synth(&ss.sample, &ring);
+    stream_t *st = stream_create(500);
+    TEST_ASSERT(s && st, "synth and prefetch thread");
+    if (!s || !st)
+        goto out;
+    stream_add(st, ring);
+    stream_add_sample(st, &ss);
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+
+    /* Underruns may insert silence, but every frame plays once, in order */
+    picosynth_note_on(s, 0, 60);
+    q15_t last = 0;
+    int skips = 0;
+    for (uint32_t i = 0; i < 64 * STREAM_FRAMES; i++) {
+        if (i % 64 == 0)
+            usleep(200);
+        picosynth_process(s);
+        if (!smp->out)
+            continue;
+        skips += smp->out != (last ? last + 4 : ramp(0));
+        last = smp->out;
+        if (last == ramp(STREAM_FRAMES - 1))
+            break;
+    }
+    TEST_ASSERT_EQ(skips, 0, "frames in order from the thread");
+    TEST_ASSERT_EQ(last, ramp(STREAM_FRAMES - 1), "whole sample played");
+    TEST_ASSERT_EQ(stream_errors(st), 0, "no read errors");
+
+out:
+    stream_destroy(st);
+    picosynth_destroy(s);
+    stream_sample_free(&ss);
+    bank_close(&bank);
+}
+
+void test_stream_all(void)
+{
+    TEST_RUN(test_stream_sample_init);
+    TEST_RUN(test_stream_playback);
+    TEST_RUN(test_stream_long);
+    TEST_RUN(test_stream_loop);
+    TEST_RUN(test_stream_thread);
+}
@@ -1,4 +1,8 @@
 /* Unit tests for synthesizer core functionality */
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixture.h"
 #include "picosynth.h"
 #include "test.h"
 
@@ -380,7 +384,2120 @@ static void test_null_graph_inputs(void)
     picosynth_destroy(s);
 }
 
+/* Build a one-voice env -> saw patch used by the block rendering tests */
+static picosynth_t *make_saw_synth(void)
+{
+    picosynth_t *s = picosynth_create(1, 2);
+    if (!s)
+        return NULL;
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_init_env(env, NULL,
+                       &(picosynth_env_params_t) {
+                           .attack = 3000,
+                           .hold = 20,
+                           .decay = 400,
+                           .sustain = Q15_MAX / 3,
+                           .release = 300,
+                       });
+    picosynth_init_osc(osc, &env->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_saw);
+    picosynth_voice_set_out(v, 1);
+    return s;
+}
+
+/* Test picosynth_render matches per-sample processing */
+static void test_render_block(void)
+{
+    picosynth_t *a = make_saw_synth();
+    picosynth_t *b = make_saw_synth();
+    TEST_ASSERT(a != NULL && b != NULL, "synth creation");
+
+    picosynth_note_on(a, 0, 64);
+    picosynth_note_on(b, 0, 64);
+
+    q15_t block[100];
+    int mismatches = 0;
+    for (int round = 0; round < 20; round++) {
+        if (round == 12) {
+            picosynth_note_off(a, 0);
+            picosynth_note_off(b, 0);
+        }
+        picosynth_render(a, block, 100);
+        for (int i = 0; i < 100; i++)
+            if (block[i] != picosynth_process(b))
+                mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "block render equals per-sample output");
+
+    /* NULL buffer is ignored */
+    picosynth_render(a, NULL, 16);
+    TEST_ASSERT(1, "render with NULL buffer didn't crash");
+
+    picosynth_destroy(a);
+    picosynth_destroy(b);
+}
+
+/* Build a two-voice patch touching every stateful node type: envelope with
+ * hold, noise and saw oscillators, one-pole and SVF filters.
+ */
+static picosynth_t *make_snapshot_synth(void)
+{
+    picosynth_t *s = picosynth_create(2, 5);
+    if (!s)
+        return NULL;
+    for (uint8_t i = 0; i < 2; i++) {
+        picosynth_voice_t *v = picosynth_get_voice(s, i);
+        picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+        picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+        picosynth_node_t *noise = picosynth_voice_get_node(v, 2);
+        picosynth_node_t *mix = picosynth_voice_get_node(v, 3);
+        picosynth_node_t *flt = picosynth_voice_get_node(v, 4);
+        picosynth_init_env(env, NULL,
+                           &(picosynth_env_params_t) {
+                               .attack = 4000,
+                               .hold = 50,
+                               .decay = 300,
+                               .sustain = Q15_MAX / 3,
+                               .release = 200,
+                           });
+        picosynth_init_osc(osc, &env->out, picosynth_voice_freq_ptr(v),
+                           picosynth_wave_saw);
+        picosynth_init_osc(noise, &env->out, picosynth_voice_freq_ptr(v),
+                           picosynth_wave_noise);
+        picosynth_init_mix(mix, NULL, &osc->out, &noise->out, NULL);
+        if (i == 0)
+            picosynth_init_svf_lp(flt, NULL, &mix->out,
+                                  picosynth_svf_freq(800), Q15_MAX / 2);
+        else
+            picosynth_init_lp(flt, NULL, &mix->out, 4000);
+        picosynth_voice_set_out(v, 4);
+    }
+    return s;
+}
+
+/* Test snapshot save/restore reproduces output exactly */
+static void test_snapshot_roundtrip(void)
+{
+    picosynth_t *s = make_snapshot_synth();
+    TEST_ASSERT(s != NULL, "synth creation");
+
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_note_on(s, 0, 60);
+    picosynth_note_on(s, 1, 67);
+    for (int i = 0; i < 300; i++)
+        picosynth_process(s);
+    /* Pending cutoff glide is state too */
+    picosynth_svf_set_freq(picosynth_voice_get_node(v, 4),
+                           picosynth_svf_freq(2000));
+
+    size_t size = picosynth_snapshot_size(s);
+    TEST_ASSERT(size > 0, "snapshot size positive");
+    uint8_t buf[1024];
+    TEST_ASSERT(size <= sizeof(buf), "snapshot fits test buffer");
+    TEST_ASSERT_EQ(picosynth_snapshot_save(s, buf, sizeof(buf)), size,
+                   "snapshot save returns size");
+
+    /* Render past a note-off, rewind, render again */
+    q15_t first[600];
+    for (int i = 0; i < 600; i++) {
+        if (i == 200)
+            picosynth_note_off(s, 0);
+        first[i] = picosynth_process(s);
+    }
+    TEST_ASSERT(picosynth_snapshot_restore(s, buf, size),
+                "snapshot restore succeeds");
+    int mismatches = 0;
+    for (int i = 0; i < 600; i++) {
+        if (i == 200)
+            picosynth_note_off(s, 0);
+        if (picosynth_process(s) != first[i])
+            mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "restored instance replays identically");
+
+    /* Fork: a second instance built by the same setup code */
+    picosynth_t *fork = make_snapshot_synth();
+    TEST_ASSERT(fork != NULL, "fork creation");
+    TEST_ASSERT(picosynth_snapshot_restore(fork, buf, size),
+                "restore into fork succeeds");
+    mismatches = 0;
+    for (int i = 0; i < 600; i++) {
+        if (i == 200)
+            picosynth_note_off(fork, 0);
+        if (picosynth_process(fork) != first[i])
+            mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "forked instance matches original");
+
+    picosynth_destroy(fork);
+    picosynth_destroy(s);
+}
+
+/* Test snapshot rejects bad buffers and foreign layouts */
+static void test_snapshot_errors(void)
+{
+    picosynth_t *s = make_snapshot_synth();
+    picosynth_t *other = make_saw_synth();
+    TEST_ASSERT(s != NULL && other != NULL, "synth creation");
+
+    uint8_t buf[1024];
+    size_t size = picosynth_snapshot_size(s);
+    TEST_ASSERT_EQ(picosynth_snapshot_save(s, buf, size - 1), 0,
+                   "save into short buffer fails");
+    TEST_ASSERT_EQ(picosynth_snapshot_save(s, buf, sizeof(buf)), size,
+                   "save succeeds");
+    TEST_ASSERT(!picosynth_snapshot_restore(s, buf, size - 1),
+                "truncated restore fails");
+    TEST_ASSERT(!picosynth_snapshot_restore(other, buf, size),
+                "restore into different layout fails");
+
+    buf[0] ^= 0xFF;
+    TEST_ASSERT(!picosynth_snapshot_restore(s, buf, size),
+                "corrupt magic rejected");
+
+    TEST_ASSERT_EQ(picosynth_snapshot_size(NULL), 0, "size(NULL) is 0");
+    TEST_ASSERT(!picosynth_snapshot_restore(NULL, buf, size),
+                "restore(NULL) fails");
+
+    picosynth_destroy(other);
+    picosynth_destroy(s);
+}
+
+/* Test that each instance owns its noise sequence */
+static void test_noise_per_instance(void)
+{
+    picosynth_t *a = make_snapshot_synth();
+    picosynth_t *b = make_snapshot_synth();
+    TEST_ASSERT(a != NULL && b != NULL, "synth creation");
+
+    picosynth_note_on(a, 0, 60);
+    picosynth_note_on(b, 0, 60);
+
+    /* Interleaved rendering must not perturb either noise stream */
+    q15_t ref[256];
+    for (int i = 0; i < 256; i++)
+        ref[i] = picosynth_process(a);
+    int mismatches = 0;
+    picosynth_t *c = make_snapshot_synth();
+    TEST_ASSERT(c != NULL, "synth creation");
+    picosynth_note_on(c, 0, 60);
+    for (int i = 0; i < 256; i++) {
+        q15_t x = picosynth_process(b);
+        picosynth_process(c);
+        picosynth_wave_noise(0);
+        if (x != ref[i])
+            mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "noise independent across instances");
+
+    picosynth_destroy(a);
+    picosynth_destroy(b);
+    picosynth_destroy(c);
+}
+
+/* Per-note seeding: a note's noise does not depend on earlier notes */
+static void test_noise_per_note(void)
+{
+    picosynth_t *a = make_snapshot_synth();
+    picosynth_t *b = make_snapshot_synth();
+    TEST_ASSERT(a != NULL && b != NULL, "synth creation");
+    picosynth_set_noise_seed(a, 0, true);
+    picosynth_set_noise_seed(b, 0, true);
+
+    /* Only @a plays a note first */
+    picosynth_note_on(a, 0, 48);
+    for (int i = 0; i < 300; i++)
+        picosynth_process(a);
+
+    picosynth_note_on(a, 0, 60);
+    picosynth_note_on(b, 0, 60);
+    int mismatches = 0;
+    for (int i = 0; i < 256; i++) {
+        picosynth_voice_t *va = picosynth_get_voice(a, 0);
+        picosynth_voice_t *vb = picosynth_get_voice(b, 0);
+        picosynth_process(a);
+        picosynth_process(b);
+        if (picosynth_voice_get_node(va, 2)->out !=
+            picosynth_voice_get_node(vb, 2)->out)
+            mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "noise restarts at note-on");
+
+    picosynth_destroy(a);
+    picosynth_destroy(b);
+}
+
+/* Shared modulation source wired into every member of a group */
+static q15_t group_detune = 40;
+
+/* Covers every node type and waveform family the group kernels special-case:
+ * inline waves, noise, shared and per-member inputs, both filter kinds.
+ */
+static picosynth_t *make_group_synth(void)
+{
+    picosynth_t *s = picosynth_create(2, 7);
+    if (!s)
+        return NULL;
+    /* Voice 0 detunes from a shared value, voice 1 from voice 0's osc */
+    const q15_t *detune = &group_detune;
+    for (uint8_t i = 0; i < 2; i++) {
+        picosynth_voice_t *v = picosynth_get_voice(s, i);
+        picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+        picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+        picosynth_node_t *noise = picosynth_voice_get_node(v, 2);
+        picosynth_node_t *mix = picosynth_voice_get_node(v, 3);
+        picosynth_node_t *flt = picosynth_voice_get_node(v, 4);
+        picosynth_node_t *svf = picosynth_voice_get_node(v, 5);
+        picosynth_node_t *sub = picosynth_voice_get_node(v, 6);
+        picosynth_init_env(env, NULL,
+                           &(picosynth_env_params_t) {
+                               .attack = 3000,
+                               .hold = 40,
+                               .decay = 300,
+                               .sustain = Q15_MAX / 3,
+                               .release = 250,
+                           });
+        picosynth_init_osc(osc, &env->out, picosynth_voice_freq_ptr(v),
+                           i ? picosynth_wave_square : picosynth_wave_sine);
+        picosynth_init_osc(noise, &env->out, picosynth_voice_freq_ptr(v),
+                           picosynth_wave_noise);
+        picosynth_init_osc(sub, &env->out, picosynth_voice_freq_ptr(v),
+                           picosynth_wave_triangle);
+        sub->osc.detune = detune;
+        detune = &osc->out;
+        picosynth_init_mix(mix, NULL, &osc->out, &noise->out, &sub->out);
+        if (i == 0)
+            picosynth_init_hp(flt, NULL, &mix->out, 3000);
+        else
+            picosynth_init_svf_bp(flt, NULL, &mix->out,
+                                  picosynth_svf_freq(900), Q15_MAX / 3);
+        picosynth_init_svf_hp(svf, &env->out, &flt->out,
+                              picosynth_svf_freq(300), Q15_MAX / 2);
+        picosynth_voice_set_out(v, 5);
+    }
+    return s;
+}
+
+/* Test a group renders each member exactly like a standalone instance */
+static void test_group_render(void)
+{
+    enum { MEMBERS = 70, LEN = 768, BLOCK = 64 };
+    static q15_t got[MEMBERS][LEN], want[MEMBERS][LEN];
+    picosynth_t *proto = make_group_synth();
+    picosynth_t *ref[MEMBERS];
+    TEST_ASSERT(proto != NULL, "prototype creation");
+    picosynth_group_t *g = picosynth_group_create(proto, MEMBERS);
+    TEST_ASSERT(g != NULL, "group creation");
+    TEST_ASSERT_EQ(picosynth_group_size(g), MEMBERS, "group size");
+    TEST_ASSERT(picosynth_group_create(proto, 0) == NULL,
+                "empty group rejected");
+
+    /* Members are independent: different notes, timing and noise seeds */
+    for (uint16_t j = 0; j < MEMBERS; j++) {
+        ref[j] = make_group_synth();
+        TEST_ASSERT(ref[j] != NULL, "reference creation");
+        if (j % 3 == 1) {
+            picosynth_group_set_noise_seed(g, j, j);
+            picosynth_set_noise_seed(ref[j], j, false);
+        }
+    }
+
+    q15_t *out[MEMBERS];
+    for (uint32_t pos = 0; pos < LEN; pos += BLOCK) {
+        uint32_t b = pos / BLOCK;
+        for (uint16_t j = 0; j < MEMBERS; j++) {
+            uint8_t voice = (uint8_t) ((j + b) & 1);
+            uint8_t note = (uint8_t) (40 + (j * 7 + b * 5) % 40);
+            if ((j + b) % 4 == 0) {
+                picosynth_group_note_on(g, j, voice, note);
+                picosynth_note_on(ref[j], voice, note);
+            } else if ((j + b) % 4 == 2) {
+                picosynth_group_note_off(g, j, voice);
+                picosynth_note_off(ref[j], voice);
+            }
+            out[j] = got[j] + pos;
+            picosynth_render(ref[j], want[j] + pos, BLOCK);
+        }
+        /* Only a few members sound in the last blocks */
+        if (b == 8)
+            for (uint16_t j = 0; j < MEMBERS; j += 2)
+                out[j] = NULL;
+        picosynth_group_render(g, out, BLOCK);
+    }
+
+    int mismatches = 0, nonzero = 0;
+    for (uint16_t j = 0; j < MEMBERS; j++) {
+        for (int i = 0; i < LEN; i++) {
+            if (i / BLOCK == 8 && j % 2 == 0)
+                continue; /* Not stored */
+            mismatches += got[j][i] != want[j][i];
+            nonzero += got[j][i] != 0;
+        }
+    }
+    TEST_ASSERT(nonzero > 0, "group produces audio");
+    TEST_ASSERT_EQ(mismatches, 0, "group output matches instances");
+
+    picosynth_group_destroy(g);
+    for (uint16_t j = 0; j < MEMBERS; j++)
+        picosynth_destroy(ref[j]);
+    picosynth_destroy(proto);
+}
+
+/* Test per-note noise seeding and out-of-range calls on a group */
+static void test_group_noise_per_note(void)
+{
+    picosynth_t *proto = make_group_synth();
+    picosynth_t *ref[2] = {make_group_synth(), make_group_synth()};
+    TEST_ASSERT(proto && ref[0] && ref[1], "synth creation");
+    picosynth_set_noise_seed(proto, 99, true);
+    picosynth_group_t *g = picosynth_group_create(proto, 3);
+    TEST_ASSERT(g != NULL, "group creation");
+
+    /* Ignored rather than crashing */
+    picosynth_group_note_on(g, 3, 0, 60);
+    picosynth_group_note_on(g, 0, 2, 60);
+    picosynth_group_note_off(NULL, 0, 0);
+    picosynth_group_render(NULL, NULL, 16);
+    TEST_ASSERT_EQ(picosynth_group_size(NULL), 0, "size(NULL) is 0");
+
+    q15_t got[2][384], want[2][384];
+    q15_t *out[3] = {got[0], got[1], NULL};
+    for (int k = 0; k < 2; k++)
+        picosynth_set_noise_seed(ref[k], 99, true);
+    picosynth_group_note_on(g, 0, 1, 64);
+    picosynth_note_on(ref[0], 1, 64);
+    picosynth_group_note_on(g, 1, 0, 50);
+    picosynth_note_on(ref[1], 0, 50);
+    picosynth_group_render(g, out, 128);
+    out[0] += 128;
+    out[1] += 128;
+    picosynth_group_note_on(g, 1, 1, 64);
+    picosynth_group_render(g, out, 256);
+
+    picosynth_render(ref[0], want[0], 384);
+    picosynth_render(ref[1], want[1], 128);
+    picosynth_note_on(ref[1], 1, 64);
+    picosynth_render(ref[1], want[1] + 128, 256);
+
+    int mismatches = 0;
+    for (int k = 0; k < 2; k++)
+        for (int i = 0; i < 384; i++)
+            mismatches += got[k][i] != want[k][i];
+    TEST_ASSERT_EQ(mismatches, 0, "per-note noise matches instances");
+
+    picosynth_group_destroy(g);
+    picosynth_destroy(ref[0]);
+    picosynth_destroy(ref[1]);
+    picosynth_destroy(proto);
+}
+
+/* Test the double buffer applies queued events at the start of a half */
+static void test_dbuf_render(void)
+{
+    enum { HALF = 48 };
+    picosynth_t *s = make_snapshot_synth();
+    picosynth_t *ref = make_snapshot_synth();
+    TEST_ASSERT(s != NULL && ref != NULL, "synth creation");
+    picosynth_dbuf_t *d = picosynth_dbuf_create(s, NULL, HALF);
+    TEST_ASSERT(d != NULL, "dbuf creation");
+    q15_t *buf = picosynth_dbuf_buffer(d);
+
+    int nonzero = 0;
+    for (int i = 0; i < 2 * HALF; i++)
+        nonzero += buf[i] != 0;
+    TEST_ASSERT_EQ(nonzero, 0, "buffer starts silent");
+
+    /* Queued mid-half, the event waits for the next render */
+    int mismatches = 0;
+    q15_t want[HALF];
+    for (int k = 0; k < 8; k++) {
+        if (k == 1) {
+            TEST_ASSERT(picosynth_dbuf_note_on(d, 0, 60), "note-on queued");
+            picosynth_note_on(ref, 0, 60);
+        } else if (k == 5) {
+            TEST_ASSERT(picosynth_dbuf_note_off(d, 0), "note-off queued");
+            picosynth_note_off(ref, 0);
+        }
+        picosynth_dbuf_render(d, (uint8_t) (k & 1));
+        picosynth_render(ref, want, HALF);
+        for (int i = 0; i < HALF; i++) {
+            mismatches += buf[(k & 1) * HALF + i] != want[i];
+            nonzero += want[i] != 0;
+        }
+    }
+    TEST_ASSERT(nonzero > 0, "dbuf produces audio");
+    TEST_ASSERT_EQ(mismatches, 0, "halves match picosynth_render");
+    TEST_ASSERT_EQ(picosynth_dbuf_overruns(d), 0, "no overruns");
+
+    /* Repeating a half means the other one was never refilled */
+    picosynth_dbuf_render(d, 1);
+    picosynth_dbuf_render(d, 0);
+    TEST_ASSERT_EQ(picosynth_dbuf_overruns(d), 1, "missed half counted");
+
+    picosynth_dbuf_destroy(d);
+    picosynth_destroy(ref);
+    picosynth_destroy(s);
+}
+
+/* Test caller-supplied buffers, queue capacity and argument checks */
+static void test_dbuf_queue(void)
+{
+    static q15_t dma[2 * 16];
+    picosynth_t *s = make_snapshot_synth();
+    TEST_ASSERT(s != NULL, "synth creation");
+    TEST_ASSERT(picosynth_dbuf_create(NULL, NULL, 16) == NULL,
+                "NULL synth rejected");
+    TEST_ASSERT(picosynth_dbuf_create(s, NULL, 0) == NULL,
+                "empty half rejected");
+
+    for (int i = 0; i < 32; i++)
+        dma[i] = 1234;
+    picosynth_dbuf_t *d = picosynth_dbuf_create(s, dma, 16);
+    TEST_ASSERT(d != NULL, "dbuf creation");
+    TEST_ASSERT(picosynth_dbuf_buffer(d) == dma, "caller buffer used");
+    TEST_ASSERT_EQ(dma[31], 0, "caller buffer cleared");
+
+    int queued = 0;
+    for (int i = 0; i < PICOSYNTH_DBUF_EVENTS + 4; i++)
+        queued += picosynth_dbuf_note_on(d, 0, (uint8_t) (40 + i));
+    TEST_ASSERT_EQ(queued, PICOSYNTH_DBUF_EVENTS, "queue holds its size");
+    picosynth_dbuf_render(d, 0);
+    TEST_ASSERT(picosynth_dbuf_note_off(d, 0), "queue drained by render");
+
+    /* Ignored rather than crashing */
+    picosynth_dbuf_render(d, 2);
+    picosynth_dbuf_render(NULL, 0);
+    TEST_ASSERT(!picosynth_dbuf_note_on(NULL, 0, 60), "NULL queue refused");
+    TEST_ASSERT(picosynth_dbuf_buffer(NULL) == NULL, "buffer(NULL)");
+    TEST_ASSERT_EQ(picosynth_dbuf_overruns(NULL), 0, "overruns(NULL)");
+    picosynth_dbuf_destroy(NULL);
+
+    picosynth_dbuf_destroy(d);
+    picosynth_destroy(s);
+}
+
 /* Test NULL pointer handling */
+/* Additive node against oscillators, decay, Nyquist masking and ratios */
+static void test_additive_node(void)
+{
+    static picosynth_partials_t bank;
+    picosynth_partials_set(&bank, 0, 1u << 16, Q15_MAX, 0);
+    TEST_ASSERT_EQ(bank.count, 1, "set grows count");
+    picosynth_partials_set(&bank, PICOSYNTH_ADDITIVE_MAX, 1u << 16, 1, 0);
+    TEST_ASSERT_EQ(bank.count, 1, "out-of-range partial ignored");
+
+    picosynth_t *s = picosynth_create(1, 3);
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *add = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_init_additive(add, NULL, picosynth_voice_freq_ptr(v), &bank);
+    picosynth_init_osc(osc, NULL, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+    /* Keep both nodes in the usage mask */
+    picosynth_init_mix(picosynth_voice_get_node(v, 2), NULL, &add->out,
+                       &osc->out, NULL);
+    picosynth_voice_set_out(v, 2);
+    TEST_ASSERT_EQ(add->type, PICOSYNTH_NODE_ADDITIVE, "additive type");
+
+    /* One undamped fundamental tracks a sine oscillator */
+    picosynth_note_on(s, 0, 69);
+    int max_err = 0;
+    for (int i = 0; i < 2000; i++) {
+        picosynth_process(s);
+        int err = abs(add->out - osc->out);
+        max_err = err > max_err ? err : max_err;
+    }
+    TEST_ASSERT(max_err <= 1, "fundamental matches sine oscillator");
+
+    /* Half-life of 100ms: peak near 100ms is about half the first peak */
+    picosynth_partials_set(&bank, 0, 1u << 16, Q15_MAX, 100);
+    picosynth_note_on(s, 0, 69);
+    uint32_t hl = PICOSYNTH_MS(100);
+    int peak0 = 0, peak1 = 0;
+    for (uint32_t i = 0; i < hl + 64; i++) {
+        picosynth_process(s);
+        int x = abs(add->out);
+        if (i < 64)
+            peak0 = x > peak0 ? x : peak0;
+        else if (i >= hl)
+            peak1 = x > peak1 ? x : peak1;
+    }
+    TEST_ASSERT(peak0 > 31000, "undecayed start");
+    TEST_ASSERT(peak1 > 15500 && peak1 < 16800, "halved after half-life");
+    TEST_ASSERT(add->add.time == hl + 64, "time counts samples");
+
+    /* An 8th harmonic of a high note is past Nyquist and muted */
+    picosynth_partials_set(&bank, 0, 8u << 16, Q15_MAX, 0);
+    picosynth_note_on(s, 0, 100);
+    int nonzero = 0;
+    for (int i = 0; i < 200; i++) {
+        picosynth_process(s);
+        nonzero += add->out != 0;
+    }
+    TEST_ASSERT_EQ(nonzero, 0, "partial above Nyquist muted");
+
+    TEST_ASSERT_EQ(picosynth_partial_ratio(1, 0), 1u << 16, "ratio 1");
+    TEST_ASSERT_EQ(picosynth_partial_ratio(3, 0), 3u << 16, "ratio 3");
+    /* 10 * sqrt(1 + 0.001 * 100) = 10.488 */
+    uint32_t r = picosynth_partial_ratio(10, 1000);
+    TEST_ASSERT(r >= 687345 && r <= 687348, "stretched ratio");
+    picosynth_destroy(s);
+}
+
+static const picosynth_env_ms_params_t test_env = {
+    .atk_ms = 5,
+    .dec_ms = 200,
+    .sus_pct = 60,
+    .rel_ms = 100,
+};
+
+static void additive_init(picosynth_voice_t *v,
+                          picosynth_node_t *env,
+                          picosynth_node_t *node,
+                          void *bank)
+{
+    picosynth_init_env_ms(env, NULL, &test_env);
+    picosynth_init_additive(node, &env->out, picosynth_voice_freq_ptr(v),
+                            bank);
+}
+
+/* Additive state survives snapshots and matches in instance groups */
+static void test_additive_state(void)
+{
+    static picosynth_partials_t bank;
+    for (uint8_t k = 0; k < 12; k++)
+        picosynth_partials_set(&bank, k, picosynth_partial_ratio(k + 1, 400),
+                               (q15_t) (Q15_MAX / 4 / (k + 1)),
+                               (uint32_t) (400 / (k + 1)));
+
+    /* The instance under test, a group prototype and its reference */
+    picosynth_t *inst[3];
+    fixture_voices(inst, 3, additive_init, &bank);
+    picosynth_t *s = inst[0], *proto = inst[1], *ref = inst[2];
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_note_on(s, 0, 57);
+    q15_t buf[256];
+    picosynth_render(s, buf, 256);
+    uint8_t snap[256];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 0, "snapshot saved");
+
+    q15_t first[512], again[512];
+    picosynth_render(s, first, 512);
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    picosynth_render(s, again, 512);
+    int mismatches = 0;
+    for (int i = 0; i < 512; i++)
+        mismatches += first[i] != again[i];
+    TEST_ASSERT_EQ(mismatches, 0, "restored additive replays identically");
+
+    TEST_ASSERT(proto && ref, "synth creation");
+    picosynth_group_t *g = picosynth_group_create(proto, 2);
+    TEST_ASSERT(g != NULL, "group with additive node");
+    picosynth_group_note_on(g, 1, 0, 64);
+    picosynth_note_on(ref, 0, 64);
+    q15_t got[2][400], want[400];
+    q15_t *out[2] = {got[0], got[1]};
+    picosynth_group_render(g, out, 300);
+    picosynth_group_note_off(g, 1, 0);
+    out[0] += 300;
+    out[1] += 300;
+    picosynth_group_render(g, out, 100);
+    picosynth_render(ref, want, 300);
+    picosynth_note_off(ref, 0);
+    picosynth_render(ref, want + 300, 100);
+    mismatches = 0;
+    int loud = 0;
+    for (int i = 0; i < 400; i++) {
+        mismatches += got[1][i] != want[i];
+        loud += abs(want[i]) > 1000;
+    }
+    TEST_ASSERT(loud > 50, "additive voice audible");
+    TEST_ASSERT_EQ(mismatches, 0, "group additive matches instance");
+
+    picosynth_group_destroy(g);
+    picosynth_destroy(ref);
+    picosynth_destroy(proto);
+    picosynth_destroy(s);
+}
+
+/* Spectral node: tracks an oscillator, restarts cleanly, snapshots */
+static void test_spectral_node(void)
+{
+    TEST_ASSERT(picosynth_spectral_create(5) == NULL, "size too small");
+    TEST_ASSERT(picosynth_spectral_create(11) == NULL, "size too large");
+    picosynth_spectral_destroy(NULL);
+
+    static picosynth_partials_t bank;
+    picosynth_partials_set(&bank, 0, 1u << 16, Q15_MAX, 0);
+    picosynth_spectral_t *sp = picosynth_spectral_create(8);
+    picosynth_t *s = picosynth_create(1, 3);
+    TEST_ASSERT(sp && s, "creation");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *spec = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_init_spectral(spec, NULL, picosynth_voice_freq_ptr(v), &bank,
+                            sp);
+    picosynth_init_osc(osc, NULL, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+    picosynth_init_mix(picosynth_voice_get_node(v, 2), NULL, &spec->out,
+                       &osc->out, NULL);
+    picosynth_voice_set_out(v, 2);
+    TEST_ASSERT_EQ(spec->type, PICOSYNTH_NODE_SPECTRAL, "spectral type");
+
+    /* Once the first frame has faded in, the partial follows the sine
+     * oscillator to within the truncated window spectrum's error
+     */
+    q15_t first[1000];
+    picosynth_note_on(s, 0, 64);
+    int max_err = 0;
+    for (int i = 0; i < 1000; i++) {
+        picosynth_process(s);
+        first[i] = spec->out;
+        int err = abs(spec->out - osc->out);
+        if (i >= 192) /* Four frames overlap from here on */
+            max_err = err > max_err ? err : max_err;
+    }
+    TEST_ASSERT(abs(first[0]) < 64, "fades in at note-on");
+    TEST_ASSERT(max_err < 400, "partial matches sine oscillator");
+
+    uint8_t snap[2048];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 256 * sizeof(int32_t), "snapshot holds engine");
+    q15_t a[300];
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        a[i] = spec->out;
+    }
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    int mismatches = 0;
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        mismatches += spec->out != a[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "restored engine replays identically");
+
+    /* A new note restarts the engine from scratch */
+    picosynth_note_on(s, 0, 64);
+    mismatches = 0;
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        mismatches += spec->out != first[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "note-on restarts engine");
+
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL,
+                "groups reject spectral nodes");
+    picosynth_destroy(s);
+    picosynth_spectral_destroy(sp);
+}
+
+static void test_string_arena(void)
+{
+    picosynth_t *s = picosynth_create(1, 1);
+    TEST_ASSERT(picosynth_arena_alloc(s, 8) == NULL, "no arena attached");
+    static uint64_t buf[8];
+    TEST_ASSERT(picosynth_arena_init(s, buf, sizeof(buf)), "arena attached");
+    TEST_ASSERT(!picosynth_arena_init(s, NULL, 64), "arena attached once");
+    uint8_t *a = picosynth_arena_alloc(s, 3);
+    uint8_t *b = picosynth_arena_alloc(s, 40);
+    TEST_ASSERT(a == (uint8_t *) buf, "first block at arena start");
+    TEST_ASSERT(b == a + 8, "blocks are 8-byte aligned");
+    TEST_ASSERT(picosynth_arena_alloc(s, 24) == NULL, "exhausted arena");
+    TEST_ASSERT(picosynth_arena_alloc(s, 16) != NULL, "remainder fits");
+    picosynth_destroy(s);
+
+    TEST_ASSERT_EQ(picosynth_string_len(57), 32, "line for 440 Hz");
+    TEST_ASSERT_EQ(picosynth_string_len(33), 128, "line for 110 Hz");
+    TEST_ASSERT(picosynth_string_len(0) >= 1024, "line for lowest note");
+}
+
+/* Lag in [lo, hi] at which @x best matches itself */
+static int best_lag(const q15_t *x, int n, int lo, int hi)
+{
+    int best = lo;
+    int64_t best_c = INT64_MIN;
+    for (int lag = lo; lag <= hi; lag++) {
+        int64_t c = 0;
+        for (int i = 0; i + lag < n; i++)
+            c += (int64_t) x[i] * x[i + lag];
+        if (c > best_c) {
+            best_c = c;
+            best = lag;
+        }
+    }
+    return best;
+}
+
+static void test_string_node(void)
+{
+    picosynth_t *s = picosynth_create(1, 1);
+    TEST_ASSERT(picosynth_arena_init(s, NULL, 4096), "arena allocated");
+    uint16_t len = picosynth_string_len(33);
+    q15_t *line = picosynth_arena_alloc(s, len * sizeof(q15_t));
+    TEST_ASSERT(line != NULL, "delay line from arena");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *str = picosynth_voice_get_node(v, 0);
+    picosynth_init_string(str, NULL, picosynth_voice_freq_ptr(v), line,
+                          (uint16_t) (len + 1),
+                          &(picosynth_string_params_t) {
+                              .feedback = 32600,
+                              .damping = Q15_MAX / 4,
+                              .level = Q15_MAX / 2,
+                          });
+    picosynth_voice_set_out(v, 0);
+    TEST_ASSERT_EQ(str->type, PICOSYNTH_NODE_STRING, "string type");
+    TEST_ASSERT_EQ(str->str.len, len, "length rounded to power of two");
+
+    /* 440 Hz is 25.06 samples per period at 11025 Hz */
+    static q15_t first[4000];
+    picosynth_note_on(s, 0, 57);
+    for (int i = 0; i < 4000; i++) {
+        picosynth_process(s);
+        first[i] = str->out;
+    }
+    TEST_ASSERT_EQ(best_lag(first + 500, 1000, 15, 35), 25, "tuned to 440");
+    int64_t early = 0, late = 0;
+    for (int i = 0; i < 1000; i++) {
+        early += (int64_t) first[i] * first[i];
+        late += (int64_t) first[3000 + i] * first[3000 + i];
+    }
+    TEST_ASSERT(early > 0 && late * 4 < early, "string decays");
+
+    /* 110 Hz uses the whole line */
+    static q15_t low[2000];
+    picosynth_note_on(s, 0, 33);
+    for (int i = 0; i < 2000; i++) {
+        picosynth_process(s);
+        low[i] = str->out;
+    }
+    TEST_ASSERT_EQ(best_lag(low + 500, 1000, 90, 110), 100, "tuned to 110");
+
+    uint8_t snap[1024];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > len * sizeof(q15_t), "snapshot holds delay line");
+    q15_t a[300];
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        a[i] = str->out;
+    }
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    int mismatches = 0;
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        mismatches += str->out != a[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "restored string replays identically");
+
+    /* The burst is seeded by the note, so a replayed note is identical */
+    picosynth_note_on(s, 0, 57);
+    mismatches = 0;
+    for (int i = 0; i < 1000; i++) {
+        picosynth_process(s);
+        mismatches += str->out != first[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "note-on re-plucks identically");
+
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL,
+                "groups reject string nodes");
+    picosynth_destroy(s);
+}
+
+static void test_modal_node(void)
+{
+    static picosynth_modes_t modes;
+    picosynth_modes_set(&modes, PICOSYNTH_MODAL_MAX, 440, 100, Q15_MAX);
+    TEST_ASSERT_EQ(modes.count, 0, "out-of-range mode ignored");
+    picosynth_modes_set(&modes, 1, 1000, 20, Q15_MAX / 4);
+    picosynth_modes_set(&modes, 0, 441, 100, Q15_MAX / 2);
+    TEST_ASSERT_EQ(modes.count, 2, "count covers highest mode");
+
+    picosynth_t *s = picosynth_create(1, 1);
+    TEST_ASSERT(picosynth_arena_init(s, NULL, 256), "arena allocated");
+    int32_t *state = picosynth_arena_alloc(s, 2 * sizeof(int32_t) * 2);
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *modal = picosynth_voice_get_node(v, 0);
+    static q15_t in;
+    picosynth_init_modal(modal, NULL, &in, &modes, state);
+    picosynth_voice_set_out(v, 0);
+    TEST_ASSERT_EQ(modal->type, PICOSYNTH_NODE_MODAL, "modal type");
+
+    /* An impulse rings both modes. The fast one is gone after 200 ms,
+     * leaving 441 Hz (25 samples per period) at a quarter of its level
+     * and falling by half every 100 ms.
+     */
+    static q15_t first[3000];
+    picosynth_note_on(s, 0, 60);
+    for (int i = 0; i < 3000; i++) {
+        in = i == 0 ? Q15_MAX : 0;
+        picosynth_process(s);
+        first[i] = modal->out;
+    }
+    int peak0 = 0, peak1 = 0; /* At 200 and 250 ms */
+    for (int i = 0; i < 50; i++) {
+        int a0 = abs(first[2205 + i]), a1 = abs(first[2756 + i]);
+        peak0 = a0 > peak0 ? a0 : peak0;
+        peak1 = a1 > peak1 ? a1 : peak1;
+    }
+    TEST_ASSERT(peak0 > 3900 && peak0 < 4300, "mode level at 200 ms");
+    TEST_ASSERT(peak1 * 1000 > peak0 * 690 && peak1 * 1000 < peak0 * 725,
+                "mode halves every 100 ms");
+    TEST_ASSERT_EQ(best_lag(first + 2205, 500, 15, 35), 25, "tuned to 441");
+
+    uint8_t snap[512];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 0, "snapshot saved");
+    q15_t a[300];
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        a[i] = modal->out;
+    }
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    int mismatches = 0;
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        mismatches += modal->out != a[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "restored modes replay identically");
+
+    /* Note-on silences the resonators */
+    picosynth_note_on(s, 0, 60);
+    mismatches = 0;
+    for (int i = 0; i < 100; i++) {
+        in = i == 0 ? Q15_MAX : 0;
+        picosynth_process(s);
+        mismatches += modal->out != first[i];
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "note-on clears resonators");
+
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL,
+                "groups reject modal nodes");
+    picosynth_destroy(s);
+}
+
+/* Unison node against oscillators, and its detune */
+static void test_unison_node(void)
+{
+    picosynth_wave_func_t waves[2] = {picosynth_wave_saw,
+                                      picosynth_wave_triangle};
+    for (int w = 0; w < 2; w++) {
+        picosynth_t *s = picosynth_create(1, 3);
+        TEST_ASSERT(s != NULL, "synth creation");
+        picosynth_voice_t *v = picosynth_get_voice(s, 0);
+        picosynth_node_t *uni = picosynth_voice_get_node(v, 0);
+        picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+        picosynth_init_unison(uni, NULL, picosynth_voice_freq_ptr(v),
+                              waves[w], NULL);
+        picosynth_init_osc(osc, NULL, picosynth_voice_freq_ptr(v), waves[w]);
+        picosynth_init_mix(picosynth_voice_get_node(v, 2), NULL, &uni->out,
+                           &osc->out, NULL);
+        picosynth_voice_set_out(v, 2);
+        TEST_ASSERT_EQ(uni->type, PICOSYNTH_NODE_UNISON, "unison type");
+        picosynth_note_on(s, 0, 62);
+        int mismatches = 0;
+        for (int i = 0; i < 1000; i++) {
+            picosynth_process(s);
+            mismatches += uni->out != osc->out;
+        }
+        TEST_ASSERT_EQ(mismatches, 0, "one voice matches oscillator");
+        picosynth_destroy(s);
+    }
+
+    picosynth_node_t n;
+    picosynth_init_unison(&n, NULL, NULL, picosynth_wave_saw,
+                          &(picosynth_unison_params_t) {.voices = 40});
+    TEST_ASSERT_EQ(n.uni.count, PICOSYNTH_UNISON_MAX, "voices clamped");
+
+    /* Two aligned sines 1% either side of 440 Hz beat at 8.8 Hz: they
+     * cancel half a beat (626 samples) in
+     */
+    picosynth_t *s = picosynth_create(1, 1);
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *uni = picosynth_voice_get_node(v, 0);
+    picosynth_init_unison(uni, NULL, picosynth_voice_freq_ptr(v),
+                          picosynth_wave_sine,
+                          &(picosynth_unison_params_t) {
+                              .voices = 2,
+                              .detune = 328,
+                          });
+    picosynth_voice_set_out(v, 0);
+    picosynth_note_on(s, 0, 57);
+    int peak_start = 0, peak_null = 0, peak_beat = 0;
+    for (int i = 0; i < 1300; i++) {
+        picosynth_process(s);
+        int a = abs(uni->out);
+        if (i < 50)
+            peak_start = a > peak_start ? a : peak_start;
+        else if (i >= 601 && i < 651)
+            peak_null = a > peak_null ? a : peak_null;
+        else if (i >= 1228 && i < 1278)
+            peak_beat = a > peak_beat ? a : peak_beat;
+    }
+    TEST_ASSERT(peak_start > 40000 * 23170 / 32768, "voices start aligned");
+    TEST_ASSERT(peak_null < 3000, "detuned voices cancel");
+    TEST_ASSERT(peak_beat > 40000 * 23170 / 32768, "and realign a beat on");
+    picosynth_destroy(s);
+}
+
+static void unison_init(picosynth_voice_t *v,
+                        picosynth_node_t *env,
+                        picosynth_node_t *node,
+                        void *arg)
+{
+    (void) arg;
+    picosynth_init_env_ms(env, NULL, &test_env);
+    picosynth_init_unison(node, &env->out, picosynth_voice_freq_ptr(v),
+                          picosynth_wave_saw,
+                          &(picosynth_unison_params_t) {
+                              .voices = 7,
+                              .detune = 600,
+                              .phase = Q15_MAX,
+                          });
+}
+
+static void test_unison_state(void)
+{
+    /* The instance under test, a group prototype and its reference */
+    picosynth_t *inst[3];
+    fixture_voices(inst, 3, unison_init, NULL);
+    picosynth_t *s = inst[0], *proto = inst[1], *ref = inst[2];
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_node_t *uni =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    picosynth_note_on(s, 0, 57);
+    q15_t first[512], again[512];
+    for (int i = 0; i < 512; i++) {
+        picosynth_process(s);
+        first[i] = uni->out;
+    }
+    uint8_t snap[256];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 0, "snapshot saved");
+    q15_t a[512];
+    picosynth_render(s, a, 512);
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    picosynth_render(s, again, 512);
+    int mismatches = 0;
+    for (int i = 0; i < 512; i++)
+        mismatches += a[i] != again[i];
+    TEST_ASSERT_EQ(mismatches, 0, "restored unison replays identically");
+
+    /* Start phases are fixed, so a note replays identically */
+    picosynth_note_on(s, 0, 57);
+    for (int i = 0; i < 512; i++) {
+        picosynth_process(s);
+        again[i] = uni->out;
+    }
+    mismatches = 0;
+    for (int i = 0; i < 512; i++)
+        mismatches += first[i] != again[i];
+    TEST_ASSERT_EQ(mismatches, 0, "note-on restarts unison");
+
+    TEST_ASSERT(proto && ref, "synth creation");
+    picosynth_group_t *g = picosynth_group_create(proto, 2);
+    TEST_ASSERT(g != NULL, "group with unison node");
+    picosynth_group_note_on(g, 1, 0, 64);
+    picosynth_note_on(ref, 0, 64);
+    q15_t got[2][400], want[400];
+    q15_t *out[2] = {got[0], got[1]};
+    picosynth_group_render(g, out, 300);
+    picosynth_group_note_off(g, 1, 0);
+    out[0] += 300;
+    out[1] += 300;
+    picosynth_group_render(g, out, 100);
+    picosynth_render(ref, want, 300);
+    picosynth_note_off(ref, 0);
+    picosynth_render(ref, want + 300, 100);
+    mismatches = 0;
+    int loud = 0;
+    for (int i = 0; i < 400; i++) {
+        mismatches += got[1][i] != want[i];
+        loud += abs(want[i]) > 1000;
+    }
+    TEST_ASSERT(loud > 50, "unison voice audible");
+    TEST_ASSERT_EQ(mismatches, 0, "group unison matches instance");
+
+    picosynth_group_destroy(g);
+    picosynth_destroy(ref);
+    picosynth_destroy(proto);
+    picosynth_destroy(s);
+}
+
+/* FM operator node against oscillators */
+static void test_fm_op_node(void)
+{
+    static q15_t freq, freq2, pm;
+    picosynth_t *s = picosynth_create(1, 4);
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *op = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *op2 = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 2);
+    picosynth_init_fm_op(op, NULL, &freq, &pm, NULL);
+    picosynth_init_fm_op(op2, NULL, &freq, NULL,
+                         &(picosynth_fm_op_params_t) {.ratio = 2u << 16});
+    picosynth_init_osc(osc, NULL, &freq2, picosynth_wave_sine);
+    picosynth_init_mix(picosynth_voice_get_node(v, 3), NULL, &op->out,
+                       &op2->out, &osc->out);
+    picosynth_voice_set_out(v, 3);
+    TEST_ASSERT_EQ(op->type, PICOSYNTH_NODE_FM_OP, "fm op type");
+
+    /* Ratio 2 runs at twice the note, and half a cycle of modulation
+     * (a quarter of full scale, as depth is doubled) inverts the sine
+     */
+    freq = 300;
+    freq2 = 600;
+    pm = Q15_MAX / 4 + 1;
+    picosynth_note_on(s, 0, 60);
+    int ratio_err = 0, pm_err = 0;
+    for (int i = 0; i < 1000; i++) {
+        picosynth_process(s);
+        ratio_err += op2->out != osc->out;
+        pm_err += abs(op->out + picosynth_wave_sine(
+                                    (q15_t) ((i * 300) & Q15_MAX))) > 1;
+    }
+    TEST_ASSERT_EQ(ratio_err, 0, "ratio 2 matches oscillator");
+    TEST_ASSERT_EQ(pm_err, 0, "phase modulation offsets phase");
+
+    /* A fixed operator ignores the note: 441 Hz is 25 samples a cycle */
+    picosynth_init_fm_op(op2, NULL, &freq, NULL,
+                         &(picosynth_fm_op_params_t) {.fixed_hz = 441});
+    picosynth_voice_set_out(v, 3);
+    static q15_t fixed[600];
+    picosynth_note_on(s, 0, 30);
+    for (int i = 0; i < 600; i++) {
+        picosynth_process(s);
+        fixed[i] = op2->out;
+    }
+    TEST_ASSERT_EQ(best_lag(fixed, 600, 15, 35), 25, "fixed frequency");
+
+    /* Feedback bends the sine toward a saw; restarting replays it */
+    picosynth_init_fm_op(op, NULL, &freq, NULL,
+                         &(picosynth_fm_op_params_t) {
+                             .ratio = 1u << 16,
+                             .feedback = Q15_MAX / 2,
+                         });
+    picosynth_voice_set_out(v, 3);
+    q15_t fb[300];
+    int differ = 0, mismatches = 0;
+    picosynth_note_on(s, 0, 60);
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        fb[i] = op->out;
+        differ += abs(op->out - picosynth_wave_sine(
+                                    (q15_t) ((i * 300) & Q15_MAX))) > 2000;
+    }
+    picosynth_note_on(s, 0, 60);
+    for (int i = 0; i < 300; i++) {
+        picosynth_process(s);
+        mismatches += op->out != fb[i];
+    }
+    TEST_ASSERT(differ > 50, "feedback changes the waveform");
+    TEST_ASSERT_EQ(mismatches, 0, "note-on clears feedback history");
+    picosynth_destroy(s);
+}
+
+static void fm_init(picosynth_voice_t *v,
+                    picosynth_node_t *env,
+                    picosynth_node_t *node,
+                    void *patch)
+{
+    static const picosynth_env_ms_params_t fm_env = {
+        .atk_ms = 2,
+        .dec_ms = 300,
+        .sus_pct = 70,
+        .rel_ms = 100,
+    };
+    picosynth_init_env_ms(env, NULL, &fm_env);
+    picosynth_init_fm(node, &env->out, picosynth_voice_freq_ptr(v), patch);
+}
+
+/* FM algorithm node: routing, levels, decay, snapshots and groups */
+static void test_fm_node(void)
+{
+    static picosynth_fm_patch_t patch;
+    TEST_ASSERT(!picosynth_fm_set_algorithm(&patch, 99, 0),
+                "unknown algorithm rejected");
+    TEST_ASSERT(picosynth_fm_set_algorithm(&patch, PICOSYNTH_FM_ORGAN4, 0),
+                "organ algorithm");
+    TEST_ASSERT_EQ(patch.ops, 4, "four operators");
+    for (uint8_t k = 0; k < 4; k++)
+        picosynth_fm_set_op(&patch, k, (uint32_t) (k + 1) << 16, 0,
+                            (q15_t) (Q15_MAX / (k + 1)), 0);
+
+    /* All carriers: the average of four harmonics */
+    static q15_t freq = 200;
+    picosynth_t *s = picosynth_create(1, 1);
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *fm = picosynth_voice_get_node(v, 0);
+    picosynth_init_fm(fm, NULL, &freq, &patch);
+    picosynth_voice_set_out(v, 0);
+    TEST_ASSERT_EQ(fm->type, PICOSYNTH_NODE_FM, "fm type");
+    picosynth_note_on(s, 0, 60);
+    int mismatches = 0;
+    for (int i = 0; i < 500; i++) {
+        int32_t sum = 0;
+        for (int k = 0; k < 4; k++) {
+            q15_t ph = (q15_t) ((i * 200 * (k + 1)) & Q15_MAX);
+            sum += (picosynth_wave_sine(ph) * (Q15_MAX / (k + 1))) >> 15;
+        }
+        picosynth_process(s);
+        mismatches += fm->out != sum >> 2;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "organ sums carriers");
+
+    /* Pairs: operator 1 modulates carrier 0 by its level in the same
+     * sample; carrier 2 is heard unmodulated as operator 3 is silent
+     */
+    picosynth_fm_set_algorithm(&patch, PICOSYNTH_FM_PAIRS4, 0);
+    picosynth_fm_set_op(&patch, 0, 1u << 16, 0, Q15_MAX, 0);
+    picosynth_fm_set_op(&patch, 1, 3u << 16, 0, Q15_MAX / 8, 0);
+    picosynth_fm_set_op(&patch, 2, 2u << 16, 0, Q15_MAX, 0);
+    picosynth_fm_set_op(&patch, 3, 1u << 16, 0, 0, 0);
+    picosynth_note_on(s, 0, 60);
+    mismatches = 0;
+    for (int i = 0; i < 500; i++) {
+        q15_t pm = (q15_t) ((picosynth_wave_sine(
+                                 (q15_t) ((i * 600) & Q15_MAX)) *
+                             (Q15_MAX / 8)) >>
+                            15);
+        int32_t c0 = picosynth_wave_sine((q15_t) ((i * 200 + pm * 2) &
+                                                  Q15_MAX));
+        int32_t c2 = picosynth_wave_sine((q15_t) ((i * 400) & Q15_MAX));
+        picosynth_process(s);
+        mismatches += abs(fm->out - (c0 + c2) / 2) > 1;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "pairs route modulator to carrier");
+
+    /* Operator levels decay like partials */
+    picosynth_fm_set_algorithm(&patch, PICOSYNTH_FM_STACK4, 0);
+    picosynth_fm_set_op(&patch, 0, 1u << 16, 0, Q15_MAX, 100);
+    picosynth_fm_set_op(&patch, 1, 1u << 16, 0, 0, 0);
+    picosynth_fm_set_op(&patch, 2, 1u << 16, 0, 0, 0);
+    picosynth_note_on(s, 0, 60);
+    int peak = 0; /* Just after 100 ms */
+    for (int i = 0; i < 1200; i++) {
+        picosynth_process(s);
+        if (i >= 1102)
+            peak = abs(fm->out) > peak ? abs(fm->out) : peak;
+    }
+    TEST_ASSERT(peak > 16000 && peak < 16800, "carrier halves every 100 ms");
+    picosynth_destroy(s);
+
+    /* An electric piano on DX7 algorithm 5, with feedback */
+    TEST_ASSERT(picosynth_fm_set_algorithm(&patch, PICOSYNTH_FM_DX5,
+                                           Q15_MAX / 3),
+                "dx5 algorithm");
+    for (uint8_t k = 0; k < 6; k++)
+        picosynth_fm_set_op(&patch, k, (uint32_t) (1 + k % 2 * 13) << 16,
+                            0, (q15_t) (k % 2 ? Q15_MAX / 6 : Q15_MAX / 2),
+                            k % 2 ? 150 : 900);
+    picosynth_fm_set_op(&patch, 4, 0, 2000, Q15_MAX / 8, 50);
+
+    /* The instance under test, a group prototype and its reference */
+    picosynth_t *inst[3];
+    fixture_voices(inst, 3, fm_init, &patch);
+    s = inst[0];
+    picosynth_t *proto = inst[1], *ref = inst[2];
+    picosynth_note_on(s, 0, 57);
+    q15_t buf[256];
+    picosynth_render(s, buf, 256);
+    uint8_t snap[256];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 0, "snapshot saved");
+    q15_t a[512], again[512];
+    picosynth_render(s, a, 512);
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    picosynth_render(s, again, 512);
+    mismatches = 0;
+    for (int i = 0; i < 512; i++)
+        mismatches += a[i] != again[i];
+    TEST_ASSERT_EQ(mismatches, 0, "restored fm replays identically");
+
+    TEST_ASSERT(proto && ref, "synth creation");
+    picosynth_group_t *g = picosynth_group_create(proto, 2);
+    TEST_ASSERT(g != NULL, "group with fm node");
+    picosynth_group_note_on(g, 1, 0, 64);
+    picosynth_note_on(ref, 0, 64);
+    q15_t got[2][400], want[400];
+    q15_t *out[2] = {got[0], got[1]};
+    picosynth_group_render(g, out, 300);
+    picosynth_group_note_off(g, 1, 0);
+    out[0] += 300;
+    out[1] += 300;
+    picosynth_group_render(g, out, 100);
+    picosynth_render(ref, want, 300);
+    picosynth_note_off(ref, 0);
+    picosynth_render(ref, want + 300, 100);
+    mismatches = 0;
+    int loud = 0;
+    for (int i = 0; i < 400; i++) {
+        mismatches += got[1][i] != want[i];
+        loud += abs(want[i]) > 1000;
+    }
+    TEST_ASSERT(loud > 50, "fm voice audible");
+    TEST_ASSERT_EQ(mismatches, 0, "group fm matches instance");
+
+    picosynth_group_destroy(g);
+    picosynth_destroy(ref);
+    picosynth_destroy(proto);
+    picosynth_destroy(s);
+}
+
+static void test_sum_node(void)
+{
+    picosynth_t *s = picosynth_create(1, 4);
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *tri = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *mix = picosynth_voice_get_node(v, 2);
+    picosynth_node_t *bus = picosynth_voice_get_node(v, 3);
+
+    /* Unity bus over two inputs: their plain sum, as a mixer gives */
+    const q15_t *in[40] = {&osc->out, &tri->out, &mix->out};
+    picosynth_init_osc(osc, NULL, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+    picosynth_init_osc(tri, NULL, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_triangle);
+    picosynth_init_mix(mix, NULL, &osc->out, &tri->out, NULL);
+    picosynth_init_sum(bus, NULL, in, NULL, 2);
+    picosynth_voice_set_out(v, 3);
+    picosynth_note_on(s, 0, 60);
+    int mismatches = 0;
+    for (int i = 0; i < 500; i++) {
+        q15_t want = q15_sat(osc->out + tri->out);
+        picosynth_process(s);
+        mismatches += bus->out != want;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "unity bus sums inputs");
+
+    /* Per-input gains, including a phase-inverted one; the third input is
+     * the mixer of the first two
+     */
+    q15_t gains[40] = {Q15_MAX / 2, -Q15_MAX / 4, Q15_MAX / 8};
+    picosynth_init_sum(bus, NULL, in, gains, 3);
+    picosynth_voice_set_out(v, 3);
+    mismatches = 0;
+    for (int i = 0; i < 500; i++) {
+        int32_t want = ((osc->out * gains[0]) >> 15) +
+                       ((tri->out * gains[1]) >> 15) +
+                       ((mix->out * gains[2]) >> 15);
+        picosynth_process(s);
+        mismatches += bus->out != want;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "bus applies per-input gains");
+
+    /* Saturated once at the end, not per input */
+    q15_t hi = 30000, lo = -30000;
+    in[0] = &hi;
+    in[1] = &hi;
+    in[2] = &lo;
+    picosynth_init_sum(bus, NULL, in, NULL, 3);
+    picosynth_process(s);
+    TEST_ASSERT_EQ(bus->out, 30000, "intermediate sum not clipped");
+
+    /* More inputs than one chunk, with a gap */
+    q15_t unit = 1000;
+    for (int j = 0; j < 40; j++) {
+        in[j] = j == 17 ? NULL : &unit;
+        gains[j] = Q15_MAX / 2 + 1;
+    }
+    picosynth_init_sum(bus, NULL, in, gains, 40);
+    picosynth_process(s);
+    TEST_ASSERT_EQ(bus->out, 39 * 500, "40-input bus");
+    picosynth_init_sum(bus, NULL, in, NULL, 40);
+    picosynth_process(s);
+    TEST_ASSERT_EQ(bus->out, Q15_MAX, "bus saturates");
+
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL,
+                "groups reject summing buses");
+    picosynth_destroy(s);
+}
+
+/* Bus effects for test_send_buses(): record the send, or silence it */
+static int32_t bus_seen[256];
+static uint32_t bus_seen_len, bus_calls, bus_longest;
+
+static void bus_record(void *ctx, int32_t *buf, uint32_t n)
+{
+    (void) ctx;
+    for (uint32_t i = 0; i < n && bus_seen_len < 256; i++)
+        bus_seen[bus_seen_len++] = buf[i];
+    bus_calls++;
+    bus_longest = n > bus_longest ? n : bus_longest;
+}
+
+static void bus_mute(void *ctx, int32_t *buf, uint32_t n)
+{
+    *(uint32_t *) ctx += n;
+    for (uint32_t i = 0; i < n; i++)
+        buf[i] = 0;
+}
+
+static void test_send_buses(void)
+{
+    picosynth_t *dry = make_saw_synth();
+    picosynth_t *wet = make_saw_synth();
+    TEST_ASSERT(dry && wet, "synth creation");
+    TEST_ASSERT(!picosynth_set_send(wet, 1, 0, Q15_MAX), "invalid voice");
+    TEST_ASSERT(!picosynth_set_send(wet, 0, PICOSYNTH_BUSES, Q15_MAX),
+                "invalid bus");
+    TEST_ASSERT(!picosynth_bus_add_effect(wet, 0, NULL, NULL),
+                "NULL effect rejected");
+
+    /* The bus sees the voice at its send level, once per block, and its
+     * return is added to the voice sum
+     */
+    TEST_ASSERT(picosynth_set_send(wet, 0, 1, Q15_MAX / 2), "send set");
+    TEST_ASSERT(picosynth_bus_add_effect(wet, 1, bus_record, NULL),
+                "effect added");
+    picosynth_note_on(dry, 0, 60);
+    picosynth_note_on(wet, 0, 60);
+    int32_t want[256], got[256];
+    picosynth_render_voices(dry, want, 256);
+    picosynth_render_voices(wet, got, 256);
+    int mismatches = 0, sent = 0;
+    for (int i = 0; i < 256; i++) {
+        mismatches += bus_seen[i] != (want[i] * (Q15_MAX / 2)) >> 15;
+        mismatches += got[i] != want[i] + bus_seen[i];
+        sent += bus_seen[i] != 0;
+    }
+    TEST_ASSERT(sent > 200, "voice reaches bus");
+    TEST_ASSERT_EQ(mismatches, 0, "bus gets send, returns into voice sum");
+    TEST_ASSERT_EQ(bus_calls, 256 / PICOSYNTH_BUS_BLOCK, "once per block");
+    TEST_ASSERT_EQ(bus_longest, PICOSYNTH_BUS_BLOCK, "full blocks");
+
+    /* A chain that ends in silence leaves the dry signal, for rendered and
+     * per-sample output alike
+     */
+    uint32_t muted = 0;
+    TEST_ASSERT(picosynth_bus_add_effect(wet, 1, bus_mute, &muted),
+                "second effect added");
+    q15_t a[300], b[300];
+    picosynth_render(dry, a, 200);
+    picosynth_render(wet, b, 200);
+    for (int i = 200; i < 300; i++) {
+        a[i] = picosynth_process(dry);
+        b[i] = picosynth_process(wet);
+    }
+    mismatches = 0;
+    for (int i = 0; i < 300; i++)
+        mismatches += a[i] != b[i];
+    TEST_ASSERT_EQ(mismatches, 0, "muted bus leaves dry signal");
+    TEST_ASSERT_EQ(muted, 300, "chain runs in order on every sample");
+
+    /* Cleared, the bus returns its input unprocessed */
+    picosynth_bus_clear(wet, 1);
+    picosynth_render_voices(dry, want, 64);
+    picosynth_render_voices(wet, got, 64);
+    mismatches = 0;
+    for (int i = 0; i < 64; i++)
+        mismatches += got[i] != want[i] + ((want[i] * (Q15_MAX / 2)) >> 15);
+    TEST_ASSERT_EQ(mismatches, 0, "cleared bus passes send through");
+
+    TEST_ASSERT(picosynth_group_create(wet, 2) == NULL,
+                "groups reject effect sends");
+    TEST_ASSERT(picosynth_set_send(wet, 0, 1, 0), "send removed");
+    picosynth_group_t *g = picosynth_group_create(wet, 2);
+    TEST_ASSERT(g != NULL, "group without sends");
+    picosynth_group_destroy(g);
+
+    picosynth_destroy(dry);
+    picosynth_destroy(wet);
+}
+
+/* Energy of @n samples */
+static int64_t energy(const int32_t *x, uint32_t n)
+{
+    int64_t e = 0;
+    for (uint32_t i = 0; i < n; i++)
+        e += (int64_t) x[i] * x[i];
+    return e;
+}
+
+static void test_reverb(void)
+{
+    picosynth_reverb_params_t params = {
+        .memory = 8192,
+        .decay_ms = 1000,
+        .damping = Q15_MAX / 4,
+        .wet = Q15_MAX,
+    };
+    picosynth_t *s = picosynth_create(1, 2);
+    TEST_ASSERT(s != NULL, "synth creation");
+    TEST_ASSERT(picosynth_reverb_create(s, &params) == NULL, "needs arena");
+    TEST_ASSERT(picosynth_arena_init(s, NULL,
+                                     picosynth_reverb_size(8192) + 1024),
+                "arena");
+    params.memory = 1024;
+    TEST_ASSERT(picosynth_reverb_create(s, &params) == NULL,
+                "lines shorter than a bus block rejected");
+    params.memory = 8192;
+    picosynth_reverb_t *r = picosynth_reverb_create(s, &params);
+    TEST_ASSERT(r != NULL, "reverb created");
+    TEST_ASSERT(picosynth_reverb_create(s, &params) == NULL,
+                "arena exhausted");
+
+    /* A failed create gives its space back; a ragged tail stays full */
+    picosynth_t *odd = picosynth_create(1, 2);
+    size_t odd_size = picosynth_reverb_size(8192) / 2 + 1;
+    TEST_ASSERT(odd && picosynth_arena_init(odd, NULL, odd_size),
+                "odd-sized arena");
+    TEST_ASSERT(picosynth_reverb_create(odd, &params) == NULL,
+                "lines too big");
+    TEST_ASSERT(picosynth_arena_alloc(odd, odd_size) != NULL,
+                "failed create released its lines");
+    TEST_ASSERT(picosynth_reverb_create(odd, &params) == NULL,
+                "no reverb past a ragged end");
+    picosynth_destroy(odd);
+
+    /* A block at a time or a sample at a time, the tail is the same */
+    enum { LEN = 2 * SAMPLE_RATE / PICOSYNTH_BUS_BLOCK * PICOSYNTH_BUS_BLOCK };
+    static int32_t a[LEN], b[LEN];
+    picosynth_t *s2 = picosynth_create(1, 2);
+    TEST_ASSERT(s2 && picosynth_arena_init(s2, NULL,
+                                           picosynth_reverb_size(8192)),
+                "second arena");
+    picosynth_reverb_t *r2 = picosynth_reverb_create(s2, &params);
+    TEST_ASSERT(r2 != NULL, "reverb created in exact arena");
+    a[0] = b[0] = 20000;
+    for (uint32_t i = 0; i < LEN; i += PICOSYNTH_BUS_BLOCK)
+        picosynth_reverb_process(r, a + i, PICOSYNTH_BUS_BLOCK);
+    for (uint32_t i = 0; i < LEN; i++)
+        picosynth_reverb_process(r2, b + i, 1);
+    int mismatches = 0;
+    for (uint32_t i = 0; i < LEN; i++)
+        mismatches += a[i] != b[i];
+    TEST_ASSERT_EQ(mismatches, 0, "block size does not change output");
+
+    /* The tail falls by about 60 dB over decay_ms, and dies out to zero
+     * rather than ringing on at the bottom bit
+     */
+    uint32_t q = SAMPLE_RATE / 4;
+    int64_t e1 = energy(a + q / 2, q), e2 = energy(a + q / 2 + q, q);
+    TEST_ASSERT(e1 > 0 && e2 > 0, "impulse leaves a tail");
+    TEST_ASSERT(e2 * 100 < e1 && e2 * 4000 > e1, "tail decays at its rate");
+    for (uint32_t i = 0; i < LEN; i += PICOSYNTH_BUS_BLOCK) {
+        for (uint32_t j = 0; j < PICOSYNTH_BUS_BLOCK; j++)
+            a[i + j] = 0;
+        picosynth_reverb_process(r, a + i, PICOSYNTH_BUS_BLOCK);
+    }
+    TEST_ASSERT_EQ(energy(a + LEN / 2, LEN / 2), 0, "tail ends");
+
+    /* Longer decay and more damping */
+    params.decay_ms = 3000;
+    picosynth_reverb_set(r2, &params);
+    for (uint32_t i = 0; i < LEN; i++)
+        b[i] = i == 0 ? 20000 : 0;
+    for (uint32_t i = 0; i < LEN; i += PICOSYNTH_BUS_BLOCK)
+        picosynth_reverb_process(r2, b + i, PICOSYNTH_BUS_BLOCK);
+    TEST_ASSERT(energy(b + q / 2 + q, q) * 10 > energy(b + q / 2, q),
+                "longer decay rings longer");
+
+    /* On a send bus, the reverb keeps sounding after the voice stops */
+    picosynth_t *dry = make_saw_synth();
+    picosynth_t *wet = make_saw_synth();
+    TEST_ASSERT(dry && wet &&
+                    picosynth_arena_init(wet, NULL,
+                                         picosynth_reverb_size(8192)),
+                "synth creation");
+    params.decay_ms = 1000;
+    picosynth_reverb_t *rv = picosynth_reverb_create(wet, &params);
+    TEST_ASSERT(rv != NULL, "bus reverb");
+    picosynth_bus_add_effect(wet, 0, picosynth_reverb_process, rv);
+    picosynth_set_send(wet, 0, 0, Q15_MAX / 2);
+    picosynth_note_on(dry, 0, 57);
+    picosynth_note_on(wet, 0, 57);
+    q15_t out_dry[2048], out_wet[2048];
+    picosynth_render(dry, out_dry, 1000);
+    picosynth_render(wet, out_wet, 1000);
+    picosynth_note_off(dry, 0);
+    picosynth_note_off(wet, 0);
+    picosynth_render(dry, out_dry, 2048);
+    picosynth_render(wet, out_wet, 2048);
+    int loud_dry = 0, loud_wet = 0;
+    for (int i = 1024; i < 2048; i++) {
+        loud_dry += abs(out_dry[i]) > 100;
+        loud_wet += abs(out_wet[i]) > 100;
+    }
+    TEST_ASSERT_EQ(loud_dry, 0, "dry voice has ended");
+    TEST_ASSERT(loud_wet > 100, "reverb tail follows it");
+
+    picosynth_destroy(dry);
+    picosynth_destroy(wet);
+    picosynth_destroy(s2);
+    picosynth_destroy(s);
+}
+
+static void test_delay_node(void)
+{
+    TEST_ASSERT_EQ(picosynth_delay_len(0), 4, "shortest line");
+    TEST_ASSERT_EQ(picosynth_delay_len(20000), 256, "20 ms line");
+    TEST_ASSERT_EQ(picosynth_delay_len(UINT32_MAX), 32768, "longest line");
+
+    picosynth_t *s = picosynth_create(1, 1);
+    TEST_ASSERT(s && picosynth_arena_init(s, NULL, 4096), "synth creation");
+    picosynth_voice_t *v = picosynth_get_voice(s, 0);
+    picosynth_node_t *dl = picosynth_voice_get_node(v, 0);
+    q15_t src = 0, mod = 0;
+    picosynth_init_delay(dl, NULL, &src, &mod,
+                         picosynth_arena_alloc(s, 1024 * sizeof(q15_t)), 1024,
+                         &(picosynth_delay_params_t) {
+                             .time_us = 1000000 * 10 / SAMPLE_RATE + 1,
+                             .depth_us = 1000000 * 4 / SAMPLE_RATE + 1,
+                         });
+    picosynth_voice_set_out(v, 0);
+    picosynth_note_on(s, 0, 60);
+
+    /* Whole and half-sample delays of a ramp, then swung by modulation */
+    static const struct {
+        int32_t mod;
+        int32_t d2; /* Expected delay, half samples */
+    } cases[] = {{0, 20}, {0, 21}, {Q15_MAX, 28}, {-Q15_MAX, 12}};
+    q15_t hist[2048];
+    int t = 0, mismatches = 0;
+    for (int c = 0; c < 4; c++) {
+        dl->dly.time = c == 1 ? 10u << 16 | 1u << 15 : 10u << 16;
+        dl->dly.depth = 4u << 16;
+        mod = (q15_t) cases[c].mod;
+        for (int i = 0; i < 200; i++, t++) {
+            picosynth_process(s);
+            hist[t] = src;
+            src = (q15_t) (t * 23);
+            if (i < 20)
+                continue;
+            int32_t a = hist[t - cases[c].d2 / 2];
+            int32_t b = hist[t - (cases[c].d2 + 1) / 2];
+            mismatches += abs(dl->out - (a + b + 1) / 2) > 1;
+        }
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "delay follows time and modulation");
+
+    /* Out of range times are clamped to the line */
+    dl->dly.time = 0;
+    mod = 0;
+    for (int i = 0; i < 5; i++, t++) {
+        picosynth_process(s);
+        hist[t] = src;
+        src = (q15_t) (t * 11);
+    }
+    TEST_ASSERT_EQ(dl->out, hist[t - 2], "at least one sample");
+    dl->dly.time = UINT32_MAX;
+    picosynth_process(s);
+    TEST_ASSERT(1, "overlong time didn't crash");
+
+    /* Echoes halve with half feedback, truncated toward zero */
+    picosynth_note_on(s, 0, 60);
+    TEST_ASSERT_EQ(dl->dly.wet, 0, "note-on clears line");
+    dl->dly.time = 100u << 16;
+    dl->dly.feedback = Q15_MAX / 2 + 1;
+    src = 16000;
+    picosynth_process(s);
+    src = 0;
+    mismatches = 0;
+    int32_t peaks[4] = {0};
+    for (int i = 1; i < 400; i++) {
+        picosynth_process(s);
+        if (i % 100 == 0)
+            peaks[i / 100 - 1] = dl->out;
+        else if (dl->out != 0)
+            mismatches++;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "silent between echoes");
+    TEST_ASSERT(peaks[0] == 16000 && peaks[1] == 8000 && peaks[2] == 4000,
+                "echoes at the delay time, halving");
+
+    /* Snapshots carry the line */
+    size_t size = picosynth_snapshot_size(s);
+    static uint8_t snap[8192];
+    TEST_ASSERT(size <= sizeof(snap) &&
+                    picosynth_snapshot_save(s, snap, size) == size,
+                "snapshot saved");
+    q15_t a[300], again[300];
+    picosynth_render(s, a, 300);
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    picosynth_render(s, again, 300);
+    int diff = 0;
+    for (int i = 0; i < 300; i++)
+        diff += a[i] != again[i];
+    TEST_ASSERT_EQ(diff, 0, "restored delay replays identically");
+
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL,
+                "groups reject delay nodes");
+    picosynth_destroy(s);
+}
+
+static void test_conv(void)
+{
+    enum { IR_LEN = 300, LEN = 4096 };
+    static q15_t ir[IR_LEN];
+    static int32_t x[LEN], a[LEN], b[LEN];
+    uint32_t seed = 1;
+    for (int i = 0; i < IR_LEN; i++) {
+        seed = seed * 1103515245u + 12345u;
+        ir[i] = (q15_t) ((int32_t) (seed >> 16) % 20000 * (IR_LEN - i) /
+                         IR_LEN);
+    }
+    for (int i = 0; i < LEN; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = a[i] = b[i] = (int32_t) (seed >> 16) % 16000 - 8000;
+    }
+
+    picosynth_t *s = picosynth_create(1, 2);
+    TEST_ASSERT(s != NULL, "synth creation");
+    TEST_ASSERT(picosynth_conv_create(s, ir, IR_LEN, Q15_MAX) == NULL,
+                "needs arena");
+    TEST_ASSERT(picosynth_arena_init(s, NULL, picosynth_conv_size(IR_LEN)),
+                "arena");
+    TEST_ASSERT(picosynth_conv_create(s, ir, 0, Q15_MAX) == NULL,
+                "empty response rejected");
+    picosynth_conv_t *c = picosynth_conv_create(s, ir, IR_LEN, Q15_MAX);
+    TEST_ASSERT(c != NULL, "convolver created in exact arena");
+    TEST_ASSERT(picosynth_conv_create(s, ir, 1, Q15_MAX) == NULL,
+                "arena exhausted");
+
+    /* A failed create gives its space back; a ragged tail stays full */
+    picosynth_t *odd = picosynth_create(1, 2);
+    size_t odd_size = picosynth_conv_size(IR_LEN) - 1;
+    TEST_ASSERT(odd && picosynth_arena_init(odd, NULL, odd_size),
+                "odd-sized arena");
+    TEST_ASSERT(picosynth_conv_create(odd, ir, IR_LEN, Q15_MAX) == NULL,
+                "spectra too big");
+    TEST_ASSERT(picosynth_arena_alloc(odd, odd_size) != NULL,
+                "failed create released its spectra");
+    TEST_ASSERT(picosynth_conv_create(odd, ir, 1, Q15_MAX) == NULL,
+                "no convolver past a ragged end");
+    picosynth_destroy(odd);
+
+    /* Matches direct convolution one block late, to within FFT rounding */
+    picosynth_conv_process(c, a, LEN);
+    int mismatches = 0;
+    for (int t = 0; t < PICOSYNTH_BUS_BLOCK; t++)
+        mismatches += a[t] != 0;
+    TEST_ASSERT_EQ(mismatches, 0, "silent for the first block");
+    for (int t = 0; t + PICOSYNTH_BUS_BLOCK < LEN; t++) {
+        int64_t acc = 0;
+        for (int j = 0; j < IR_LEN && j <= t; j++)
+            acc += (int64_t) ir[j] * x[t - j];
+        acc = acc / 32768 * Q15_MAX / 32768;
+        mismatches += llabs(acc - a[t + PICOSYNTH_BUS_BLOCK]) > 32;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "matches direct convolution");
+
+    /* However the bus splits its calls, the output is the same */
+    picosynth_t *s2 = picosynth_create(1, 2);
+    TEST_ASSERT(s2 && picosynth_arena_init(s2, NULL,
+                                           picosynth_conv_size(IR_LEN)),
+                "second arena");
+    picosynth_conv_t *c2 = picosynth_conv_create(s2, ir, IR_LEN, Q15_MAX);
+    for (uint32_t i = 0, n = 1; i < LEN; i += n, n = n % 97 + 13)
+        picosynth_conv_process(c2, b + i, n < LEN - i ? n : LEN - i);
+    mismatches = 0;
+    for (int i = 0; i < LEN; i++)
+        mismatches += a[i] != b[i];
+    TEST_ASSERT_EQ(mismatches, 0, "call size does not change output");
+
+    /* The tail rings out for the length of the response, then stops */
+    for (int i = 0; i < LEN; i++)
+        a[i] = 0;
+    picosynth_conv_process(c, a, LEN);
+    TEST_ASSERT(energy(a, IR_LEN) > 0, "tail after input stops");
+    TEST_ASSERT_EQ(energy(a + IR_LEN + PICOSYNTH_BUS_BLOCK,
+                          LEN - IR_LEN - PICOSYNTH_BUS_BLOCK),
+                   0, "tail ends with the response");
+    picosynth_conv_set_wet(c, 0);
+    for (int i = 0; i < LEN; i++)
+        a[i] = x[i];
+    picosynth_conv_process(c, a, LEN);
+    TEST_ASSERT_EQ(energy(a, LEN), 0, "wet level scales output");
+
+    /* On a send bus, a unit impulse response returns the send delayed */
+    picosynth_t *dry = make_saw_synth();
+    picosynth_t *wet = make_saw_synth();
+    TEST_ASSERT(dry && wet &&
+                    picosynth_arena_init(wet, NULL, picosynth_conv_size(1)),
+                "synth creation");
+    q15_t unit = Q15_MAX;
+    picosynth_conv_t *cv = picosynth_conv_create(wet, &unit, 1, Q15_MAX);
+    TEST_ASSERT(cv != NULL, "bus convolver");
+    picosynth_bus_add_effect(wet, 0, picosynth_conv_process, cv);
+    picosynth_set_send(wet, 0, 0, Q15_MAX / 8);
+    picosynth_note_on(dry, 0, 57);
+    picosynth_note_on(wet, 0, 57);
+    int32_t want[512], got[512];
+    picosynth_render_voices(dry, want, 512);
+    picosynth_render_voices(wet, got, 512);
+    mismatches = 0;
+    for (int i = PICOSYNTH_BUS_BLOCK; i < 512; i++) {
+        int32_t late = (want[i - PICOSYNTH_BUS_BLOCK] * (Q15_MAX / 8)) >> 15;
+        mismatches += abs(got[i] - (want[i] + late)) > 4;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "unit response delays the bus a block");
+
+    picosynth_destroy(dry);
+    picosynth_destroy(wet);
+    picosynth_destroy(s2);
+    picosynth_destroy(s);
+}
+
+/* Ramp sample shared by the sampler tests: 100 * position */
+static q15_t sampler_ramp[200];
+
+/* The envelope only keeps the voice alive through the release */
+static void sampler_init(picosynth_voice_t *v,
+                         picosynth_node_t *env,
+                         picosynth_node_t *node,
+                         void *sample)
+{
+    picosynth_init_env(env, NULL,
+                       &(picosynth_env_params_t) {
+                           .attack = 30000,
+                           .decay = 100,
+                           .sustain = Q15_MAX,
+                           .release = 3000,
+                       });
+    picosynth_init_sampler(node, &env->out, picosynth_voice_freq_ptr(v),
+                           sample);
+}
+
+/* Raw sampler output for @n samples, starting with a note-on of @note */
+static void sampler_run(picosynth_t *s, uint8_t note, q15_t *out, int n)
+{
+    picosynth_node_t *smp =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    const q15_t *gain = smp->gain;
+    smp->gain = NULL;
+    picosynth_note_on(s, 0, note);
+    for (int i = 0; i < n; i++) {
+        picosynth_process(s);
+        out[i] = smp->out;
+    }
+    smp->gain = gain;
+}
+
+static void test_sampler_node(void)
+{
+    for (int i = 0; i < 200; i++)
+        sampler_ramp[i] = (q15_t) (i * 100);
+    picosynth_sample_t smp = {
+        .data = sampler_ramp,
+        .len = 100,
+        .rate = SAMPLE_RATE,
+        .root = 60,
+    };
+    /* The instance under test, a group prototype and its reference */
+    picosynth_t *inst[3];
+    fixture_voices(inst, 3, sampler_init, &smp);
+    picosynth_t *s = inst[0], *proto = inst[1], *ref = inst[2];
+    TEST_ASSERT(s != NULL, "synth creation");
+    picosynth_node_t *n =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    TEST_ASSERT(n->smp.sample == &smp, "sample is referenced, not copied");
+
+    /* The root note plays the recording sample for sample, then stops */
+    q15_t out[400];
+    sampler_run(s, 60, out, 120);
+    int mismatches = 0;
+    for (int i = 0; i < 120; i++)
+        mismatches += out[i] != (i < 100 ? i * 100 : 0);
+    TEST_ASSERT_EQ(mismatches, 0, "root note plays at the recorded rate");
+
+    /* An octave up steps twice as fast; at half the rate, half as fast */
+    sampler_run(s, 72, out, 40);
+    mismatches = 0;
+    for (int i = 0; i < 40; i++)
+        mismatches += abs(out[i] - i * 200) > 1 + i / 4;
+    TEST_ASSERT_EQ(mismatches, 0, "octave up doubles the step");
+    smp.rate = SAMPLE_RATE / 2;
+    picosynth_sampler_set(n, &smp);
+    sampler_run(s, 60, out, 40);
+    mismatches = 0;
+    for (int i = 0; i < 40; i++)
+        mismatches += abs(out[i] - i * 50) > 1;
+    TEST_ASSERT_EQ(mismatches, 0, "interpolates between samples");
+    smp.rate = SAMPLE_RATE;
+    picosynth_sampler_set(n, &smp);
+
+    /* A loop wraps for as long as the voice plays */
+    smp.loop_start = 50;
+    smp.loop_end = 100;
+    smp.loop = PICOSYNTH_LOOP_ON;
+    sampler_run(s, 60, out, 400);
+    mismatches = 0;
+    for (int i = 0; i < 400; i++)
+        mismatches += out[i] != (i < 100 ? i : 50 + (i - 50) % 50) * 100;
+    TEST_ASSERT_EQ(mismatches, 0, "loop wraps to its start");
+
+    /* A sustain loop plays out past its end once the key is released */
+    smp.len = 120;
+    smp.loop = PICOSYNTH_LOOP_SUSTAIN;
+    sampler_run(s, 60, out, 130);
+    TEST_ASSERT_EQ(out[129], 50 * 100 + 29 * 100, "held: still looping");
+    picosynth_note_off(s, 0);
+    n->gain = NULL;
+    int pos = 50 + 29 + 1, ended = 0;
+    mismatches = 0;
+    for (int i = 0; i < 100; i++, pos++) {
+        picosynth_process(s);
+        if (pos < 120)
+            mismatches += n->out != pos * 100;
+        else
+            ended += n->out == 0;
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "released: plays through the loop end");
+    TEST_ASSERT_EQ(ended, 100 - (120 - 80), "then falls silent");
+    n->gain = &picosynth_voice_get_node(picosynth_get_voice(s, 0), 0)->out;
+
+    /* No sample or a loop outside the data plays safely */
+    smp.loop_end = 500;
+    sampler_run(s, 60, out, 130);
+    TEST_ASSERT_EQ(out[129], 0, "invalid loop ignored");
+    picosynth_sampler_set(n, NULL);
+    sampler_run(s, 60, out, 10);
+    TEST_ASSERT_EQ(out[9], 0, "no sample is silent");
+    picosynth_sampler_set(n, &smp);
+
+    /* Snapshots and groups carry the position */
+    smp.loop_end = 100;
+    smp.loop = PICOSYNTH_LOOP_ON;
+    picosynth_note_on(s, 0, 67);
+    q15_t a[300], again[300];
+    picosynth_render(s, a, 37);
+    uint8_t snap[256];
+    size_t size = picosynth_snapshot_save(s, snap, sizeof(snap));
+    TEST_ASSERT(size > 0, "snapshot saved");
+    picosynth_render(s, a, 300);
+    TEST_ASSERT(picosynth_snapshot_restore(s, snap, size), "restored");
+    picosynth_render(s, again, 300);
+    mismatches = 0;
+    for (int i = 0; i < 300; i++)
+        mismatches += a[i] != again[i];
+    TEST_ASSERT_EQ(mismatches, 0, "restored sampler replays identically");
+
+    picosynth_group_t *g = picosynth_group_create(proto, 3);
+    TEST_ASSERT(proto && ref && g, "group with sampler node");
+    picosynth_group_note_on(g, 2, 0, 64);
+    picosynth_note_on(ref, 0, 64);
+    q15_t got[3][400], want[400];
+    q15_t *gout[3] = {got[0], got[1], got[2]};
+    picosynth_group_render(g, gout, 300);
+    picosynth_group_note_off(g, 2, 0);
+    for (int j = 0; j < 3; j++)
+        gout[j] += 300;
+    picosynth_group_render(g, gout, 100);
+    picosynth_render(ref, want, 300);
+    picosynth_note_off(ref, 0);
+    picosynth_render(ref, want + 300, 100);
+    mismatches = 0;
+    int loud = 0;
+    for (int i = 0; i < 400; i++) {
+        mismatches += got[2][i] != want[i];
+        loud += abs(want[i]) > 1000;
+    }
+    TEST_ASSERT(loud > 100, "sampler voice audible");
+    TEST_ASSERT_EQ(mismatches, 0, "group sampler matches instance");
+
+    picosynth_group_destroy(g);
+    picosynth_destroy(ref);
+    picosynth_destroy(proto);
+    picosynth_destroy(s);
+}
+
+/* Feed @st the frames of @ramp from *@pos up to @len; end the note there */
+static void stream_feed(picosynth_stream_t *st,
+                        const q15_t *ramp,
+                        uint32_t *pos,
+                        uint32_t len)
+{
+    uint32_t n;
+    q15_t *dst;
+    while (*pos < len && (dst = picosynth_stream_reserve(st, &n)) && n) {
+        if (n > len - *pos)
+            n = len - *pos;
+        memcpy(dst, ramp + *pos, n * sizeof(q15_t));
+        picosynth_stream_commit(st, n);
+        *pos += n;
+    }
+    if (*pos == len)
+        picosynth_stream_end(st);
+}
+
+static void test_sampler_stream(void)
+{
+    static q15_t ramp[300];
+    for (int i = 0; i < 300; i++)
+        ramp[i] = (q15_t) ((i + 1) * 100);
+    picosynth_sample_t smp = {
+        .data = ramp,
+        .len = 300,
+        .rate = SAMPLE_RATE,
+        .root = 60,
+        .resident = 40,
+    };
+    picosynth_t *s;
+    fixture_voices(&s, 1, sampler_init, &smp);
+    TEST_ASSERT(s != NULL, "synth creation");
+    if (!s)
+        return;
+    TEST_ASSERT(picosynth_arena_init(s, NULL, picosynth_stream_size(50)),
+                "arena for one stream");
+    picosynth_stream_t *st = picosynth_stream_create(s, 50);
+    TEST_ASSERT(st != NULL, "stream creation");
+    TEST_ASSERT(picosynth_stream_create(s, 50) == NULL, "arena exhausted");
+
+    /* A failed create gives its space back; a ragged tail stays full */
+    picosynth_t *odd = picosynth_create(1, 2);
+    size_t odd_size = picosynth_stream_size(50) - 1;
+    TEST_ASSERT(odd && picosynth_arena_init(odd, NULL, odd_size),
+                "odd-sized arena");
+    TEST_ASSERT(picosynth_stream_create(odd, 50) == NULL, "ring too big");
+    TEST_ASSERT(picosynth_arena_alloc(odd, odd_size) != NULL,
+                "failed create released its header");
+    TEST_ASSERT(picosynth_stream_create(odd, 2) == NULL,
+                "no stream past a ragged end");
+    picosynth_destroy(odd);
+    picosynth_node_t *n =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    picosynth_sampler_set_stream(n, st);
+
+    const picosynth_sample_t *sp;
+    uint32_t from;
+    TEST_ASSERT(!picosynth_stream_poll(st, &sp, &from), "no note yet");
+
+    /* Without a producer the resident frames play, then the node waits */
+    q15_t out[400];
+    sampler_run(s, 60, out, 60);
+    int mismatches = 0;
+    for (int i = 0; i < 60; i++)
+        mismatches += out[i] != (i < 39 ? ramp[i] : 0);
+    TEST_ASSERT_EQ(mismatches, 0, "resident frames, then silence");
+    TEST_ASSERT_EQ(picosynth_stream_underruns(st), 21,
+                   "one underrun per sample waiting for frame 40");
+
+    /* The producer answers the note and streams the rest in order */
+    TEST_ASSERT(picosynth_stream_poll(st, &sp, &from), "note-on polled");
+    TEST_ASSERT(sp == &smp, "streamed sample");
+    TEST_ASSERT_EQ(from, 40, "stream starts after the resident frames");
+    TEST_ASSERT(!picosynth_stream_poll(st, &sp, &from), "polled once");
+    const q15_t *gain = n->gain;
+    n->gain = NULL;
+    uint32_t pos = from;
+    mismatches = 0;
+    for (int i = 0; i < 400; i++) {
+        if (i % 32 == 0)
+            stream_feed(st, ramp, &pos, smp.len);
+        picosynth_process(s);
+        mismatches += n->out != (39 + i < 300 ? ramp[39 + i] : 0);
+    }
+    TEST_ASSERT_EQ(mismatches, 0, "streamed frames play, then silence");
+    TEST_ASSERT_EQ(picosynth_stream_underruns(st), 21,
+                   "no underruns while fed");
+    TEST_ASSERT(!picosynth_stream_released(st), "key held");
+    picosynth_note_off(s, 0);
+    picosynth_process(s);
+    TEST_ASSERT(picosynth_stream_released(st), "release reaches producer");
+
+    /* A new note drops frames already written for the last one */
+    picosynth_note_on(s, 0, 60);
+    for (int i = 0; i < 60; i++)
+        picosynth_process(s);
+    TEST_ASSERT_EQ(n->out, 0, "waiting again after the resident frames");
+    TEST_ASSERT(picosynth_stream_poll(st, &sp, &from) && from == 40,
+                "restarted stream");
+    uint32_t n_free;
+    picosynth_stream_reserve(st, &n_free);
+    TEST_ASSERT_EQ(n_free, 64, "ring emptied for the new note");
+    n->gain = gain;
+
+    /* Streams cannot be shared by group members */
+    TEST_ASSERT(picosynth_group_create(s, 2) == NULL, "group rejected");
+
+    /* Fully resident samples ignore the stream */
+    smp.resident = 0;
+    sampler_run(s, 60, out, 300);
+    mismatches = 0;
+    for (int i = 0; i < 300; i++)
+        mismatches += out[i] != ramp[i];
+    TEST_ASSERT_EQ(mismatches, 0, "resident sample plays in place");
+    TEST_ASSERT(picosynth_stream_poll(st, &sp, &from) && sp == NULL,
+                "nothing to stream");
+    picosynth_destroy(s);
+}
+
+/* A note transposed up steps several frames a sample; a producer that
+ * falls behind it only costs underruns, never the rest of the note
+ */
+static void test_sampler_stream_behind(void)
+{
+    static q15_t ramp[2000];
+    for (int i = 0; i < 2000; i++)
+        ramp[i] = (q15_t) (i * 16 + 1);
+    picosynth_sample_t smp = {
+        .data = ramp,
+        .len = 2000,
+        .rate = SAMPLE_RATE,
+        .root = 60,
+        .resident = 40,
+    };
+    picosynth_t *s;
+    fixture_voices(&s, 1, sampler_init, &smp);
+    TEST_ASSERT(s != NULL, "synth creation");
+    if (!s)
+        return;
+    picosynth_node_t *node =
+        picosynth_voice_get_node(picosynth_get_voice(s, 0), 1);
+    node->gain = NULL;
+    picosynth_stream_t *st = NULL;
+    if (picosynth_arena_init(s, NULL, picosynth_stream_size(256)))
+        st = picosynth_stream_create(s, 256);
+    TEST_ASSERT(st != NULL, "stream creation");
+    if (!st) {
+        picosynth_destroy(s);
+        return;
+    }
+    picosynth_sampler_set_stream(node, st);
+
+    /* Two octaves up plays four frames a sample; feed 3.5 on average */
+    picosynth_note_on(s, 0, 84);
+    const picosynth_sample_t *sp;
+    uint32_t pos = 0, stuck = 0;
+    int backwards = 0, end_at = -1;
+    q15_t last = 0;
+    for (int i = 0; i < 2000; i++) {
+        if (picosynth_stream_poll(st, &sp, &pos))
+            TEST_ASSERT_EQ(pos, 40, "streamed from the resident end");
+        uint32_t want = i % 2 ? 1 : 6, n;
+        q15_t *dst = picosynth_stream_reserve(st, &n);
+        if (n > want)
+            n = want;
+        if (n > smp.len - pos)
+            n = smp.len - pos;
+        memcpy(dst, ramp + pos, n * sizeof(q15_t));
+        picosynth_stream_commit(st, n);
+        pos += n;
+        if (pos == smp.len)
+            picosynth_stream_end(st);
+        stuck += !n && pos < smp.len;
+        picosynth_process(s);
+        if (node->out) {
+            backwards += node->out < last;
+            last = node->out;
+        }
+        if (end_at < 0 && last >= ramp[1990])
+            end_at = i;
+    }
+    TEST_ASSERT_EQ(stuck, 0, "ring always has room for the producer");
+    TEST_ASSERT_EQ(pos, smp.len, "whole sample produced");
+    TEST_ASSERT_EQ(backwards, 0, "playback only moves forward");
+    TEST_ASSERT(end_at > 2000 / 4, "note plays to its end at the feed rate");
+    TEST_ASSERT_EQ(node->out, 0, "then stops");
+    picosynth_destroy(s);
+}
+
 static void test_null_safety(void)
 {
     /* These should not crash */
@@ -413,5 +2530,32 @@ void test_synth_all(void)
     TEST_RUN(test_voice_freq_ptr);
     TEST_RUN(test_voice_set_out);
     TEST_RUN(test_null_graph_inputs);
+    TEST_RUN(test_render_block);
+    TEST_RUN(test_snapshot_roundtrip);
+    TEST_RUN(test_snapshot_errors);
+    TEST_RUN(test_noise_per_instance);
+    TEST_RUN(test_noise_per_note);
+    TEST_RUN(test_group_render);
+    TEST_RUN(test_group_noise_per_note);
+    TEST_RUN(test_dbuf_render);
+    TEST_RUN(test_dbuf_queue);
+    TEST_RUN(test_additive_node);
+    TEST_RUN(test_additive_state);
+    TEST_RUN(test_spectral_node);
+    TEST_RUN(test_string_arena);
+    TEST_RUN(test_string_node);
+    TEST_RUN(test_modal_node);
+    TEST_RUN(test_unison_node);
+    TEST_RUN(test_unison_state);
+    TEST_RUN(test_fm_op_node);
+    TEST_RUN(test_fm_node);
+    TEST_RUN(test_sum_node);
+    TEST_RUN(test_send_buses);
+    TEST_RUN(test_reverb);
+    TEST_RUN(test_delay_node);
+    TEST_RUN(test_conv);
+    TEST_RUN(test_sampler_node);
+    TEST_RUN(test_sampler_stream);
+    TEST_RUN(test_sampler_stream_behind);
     TEST_RUN(test_null_safety);
 }
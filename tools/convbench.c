@@ -0,0 +1,176 @@
+/*
+ * convbench - Cost of partitioned convolution against impulse length
+ *
+ * Usage:
+ *   convbench                # Synthetic responses of 64 to 65536 samples
+ *   convbench -n 50000       # Override the samples timed per case
+ *   convbench -i hall.wav    # Add a response read from a 16-bit WAV file
+ *
+ * Each case convolves noise with a decaying noise response through
+ * picosynth_conv_process() a bus block at a time and reports nanoseconds
+ * per sample, the share of one core needed in real time, and the arena
+ * the convolver takes. Direct FIR cost is measured on the shorter
+ * responses and extrapolated per tap on the longer ones, for comparison.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+#include "wav.h"
+
+/* Longest response timed by direct FIR; longer ones are extrapolated */
+#define FIR_MAX 2048
+
+static uint32_t seed = 1;
+
+static int32_t noise(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (int32_t) (seed >> 16) % 16384 - 8192;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Returns ns per sample of partitioned convolution, or a negative value
+ * on failure
+ */
+static double run_conv(const q15_t *ir, uint32_t len, uint32_t n)
+{
+    picosynth_t *s = picosynth_create(1, 1);
+    if (!s || !picosynth_arena_init(s, NULL, picosynth_conv_size(len))) {
+        picosynth_destroy(s);
+        return -1;
+    }
+    picosynth_conv_t *c = picosynth_conv_create(s, ir, len, Q15_MAX);
+
+    int32_t buf[PICOSYNTH_BUS_BLOCK];
+    int64_t sink = 0;
+    uint64_t t0 = now_ns();
+    for (uint32_t done = 0; done < n; done += PICOSYNTH_BUS_BLOCK) {
+        for (uint32_t i = 0; i < PICOSYNTH_BUS_BLOCK; i++)
+            buf[i] = noise();
+        picosynth_conv_process(c, buf, PICOSYNTH_BUS_BLOCK);
+        sink += buf[PICOSYNTH_BUS_BLOCK - 1];
+    }
+    uint64_t dt = now_ns() - t0;
+    picosynth_destroy(s);
+
+    /* Keep the work from being optimized away */
+    if (sink == INT64_MIN)
+        printf(" ");
+    uint32_t blocks = (n + PICOSYNTH_BUS_BLOCK - 1) / PICOSYNTH_BUS_BLOCK;
+    return (double) dt / ((double) blocks * PICOSYNTH_BUS_BLOCK);
+}
+
+/* Returns ns per sample of direct FIR over a history ring */
+static double run_fir(const q15_t *ir, uint32_t len, uint32_t n)
+{
+    int32_t *hist = calloc(2 * (size_t) len, sizeof(int32_t));
+    if (!hist)
+        return -1;
+    int64_t sink = 0;
+    uint64_t t0 = now_ns();
+    /* Each input is stored twice so taps read one contiguous window */
+    for (uint32_t i = 0, pos = 0; i < n; i++) {
+        int32_t x = noise();
+        hist[pos] = hist[pos + len] = x;
+        pos = pos + 1 == len ? 0 : pos + 1;
+        const int32_t *w = hist + pos;
+        int64_t acc = 0;
+        for (uint32_t j = 0; j < len; j++)
+            acc += (int64_t) ir[len - 1 - j] * w[j];
+        sink += acc >> 15;
+    }
+    uint64_t dt = now_ns() - t0;
+    free(hist);
+    if (sink == INT64_MIN)
+        printf(" ");
+    return (double) dt / n;
+}
+
+static void report(const char *name,
+                   const q15_t *ir,
+                   uint32_t len,
+                   uint32_t n,
+                   double *fir_tap)
+{
+    double conv = run_conv(ir, len, n);
+    if (conv < 0) {
+        fprintf(stderr, "%s: convolver creation failed\n", name);
+        exit(1);
+    }
+    double fir;
+    char mark = ' ';
+    if (len <= FIR_MAX) {
+        /* Direct FIR runs far slower; time fewer samples */
+        fir = run_fir(ir, len, n / 8 + 1);
+        *fir_tap = fir / len;
+    } else {
+        fir = *fir_tap * len;
+        mark = '*';
+    }
+    double ns_per_s = 1e9 / SAMPLE_RATE;
+    printf("%-12s %8u %8.2f %10.1f %7.1f%% %11.1f%c %8zu\n", name, len,
+           (double) len / SAMPLE_RATE * 1000, conv, 100 * conv / ns_per_s, fir,
+           mark, picosynth_conv_size(len) / 1024);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t n = 200000;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            n = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-n samples] [-i response.wav]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (!n) {
+        fprintf(stderr, "need samples > 0\n");
+        return 1;
+    }
+
+    printf("%u samples per case, %u-sample partitions\n", n,
+           PICOSYNTH_BUS_BLOCK);
+    printf("%-12s %8s %8s %10s %8s %12s %8s\n", "response", "samples", "ms",
+           "ns/sample", "core", "fir ns", "arena KB");
+
+    static q15_t ir[65536];
+    double fir_tap = 0;
+    for (uint32_t len = 64; len <= 65536; len *= 4) {
+        for (uint32_t i = 0; i < len; i++)
+            ir[i] = (q15_t) (noise() * (int32_t) (len - i) / (int32_t) len);
+        report("noise", ir, len, n, &fir_tap);
+    }
+
+    if (path) {
+        q15_t *wav;
+        uint32_t len, rate;
+        if (wav_read_file(path, &wav, &len, &rate) || !len) {
+            fprintf(stderr, "%s: not a 16-bit PCM WAV file\n", path);
+            return 1;
+        }
+        if (rate != SAMPLE_RATE)
+            fprintf(stderr, "%s: %u Hz response played at %u Hz\n", path,
+                    rate, SAMPLE_RATE);
+        report("file", wav, len, n, &fir_tap);
+        free(wav);
+    }
+    printf("* extrapolated from the per-tap cost of shorter responses\n");
+    return 0;
+}
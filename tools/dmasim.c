@@ -0,0 +1,332 @@
+/*
+ * dmasim - Exercise picosynth_dbuf_t against a simulated DMA peripheral
+ *
+ * Usage:
+ *   dmasim song.txt                   # 128-sample halves
+ *   dmasim song.mid -b 32 -o dma.wav  # Keep what the "DAC" played
+ *   dmasim song.txt -w 12000          # Slow handler: provoke overruns
+ *
+ * Options:
+ *   -b N        Samples per half buffer (default: 128)
+ *   -v N        Synth voices (default: 8)
+ *   -w US       Extra busy time per interrupt, in microseconds
+ *   -o FILE     Write the audio the DMA read to a WAV file
+ *
+ * Three threads stand in for an MCU:
+ *   dma     a timer thread that "reads" one half per half period on the
+ *           monotonic clock and raises the half/full-transfer interrupt
+ *           at each boundary, recording what it played
+ *   irq     the interrupt handler (or the task it wakes): it renders the
+ *           half just released with picosynth_dbuf_render()
+ *   main    the application: it plays the song by queuing note events at
+ *           their wall-clock time
+ *
+ * A half the DMA starts reading before its refill finished is an underrun;
+ * interrupts the handler was too slow to see are overruns (the dbuf counts
+ * those). Handler time is reported against the half period, and each
+ * event's latency from queuing to the DMA starting the half that carries
+ * it. Notes start with picosynth_note_on(), so the piano's key-tracked
+ * filter keeps its setup cutoff.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "wav.h"
+
+#define MAX_EVENTS 65536 /* Latency samples kept */
+
+typedef struct {
+    picosynth_dbuf_t *dbuf;
+    uint32_t half;
+    uint64_t period; /* ns per half */
+    uint64_t t0;     /* DMA starts half 0 */
+    uint64_t busy_ns;
+    FILE *wav;
+    uint64_t played;
+
+    /* dma -> irq */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t irqs; /* Interrupts raised */
+    bool done;
+
+    /* irq -> dma: interrupt number that last refilled each half */
+    _Atomic int64_t filled[2];
+    uint64_t underruns, missed;
+
+    /* Handler time */
+    uint64_t isr_min, isr_max, isr_sum, isr_n;
+
+    /* main -> irq: queue time of each event, applied in order */
+    uint64_t queued_ns[MAX_EVENTS];
+    _Atomic uint32_t queued;
+    uint32_t attributed;
+    uint64_t lat_min, lat_max, lat_sum, lat_n;
+} sim_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t) (t / 1000000000ull),
+        .tv_nsec = (long) (t % 1000000000ull),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+}
+
+/* Interrupt k fires when the DMA finishes half k & 1, at t0 + (k+1) * P,
+ * and the half it frees is next read from t0 + (k+2) * P.
+ */
+static void *dma_main(void *arg)
+{
+    sim_t *sim = arg;
+    q15_t *buf = picosynth_dbuf_buffer(sim->dbuf);
+
+    for (uint64_t k = 0;; k++) {
+        sleep_until(sim->t0 + (k + 1) * sim->period);
+        pthread_mutex_lock(&sim->lock);
+        bool done = sim->done;
+        sim->irqs = k + 1;
+        pthread_cond_signal(&sim->cond);
+        pthread_mutex_unlock(&sim->lock);
+        if (done)
+            break;
+
+        /* Start reading the other half: it must hold interrupt k-1's
+         * refill, the first two halves excepted
+         */
+        uint32_t h = (uint32_t) ((k + 1) & 1);
+        if (k >= 1 && atomic_load(&sim->filled[h]) != (int64_t) k - 1)
+            sim->underruns++;
+        if (sim->wav)
+            fwrite(buf + h * sim->half, sizeof(q15_t), sim->half, sim->wav);
+        sim->played += sim->half;
+    }
+    return NULL;
+}
+
+static void *irq_main(void *arg)
+{
+    sim_t *sim = arg;
+    uint64_t served = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&sim->lock);
+        while (sim->irqs == served && !sim->done)
+            pthread_cond_wait(&sim->cond, &sim->lock);
+        uint64_t raised = sim->irqs;
+        bool done = sim->done;
+        pthread_mutex_unlock(&sim->lock);
+        if (done)
+            break;
+
+        /* A pending interrupt that fires again is seen only once */
+        if (raised - served > 1) {
+            sim->missed += raised - served - 1;
+            served = raised - 1;
+        }
+        uint64_t k = served++;
+        uint32_t queued = atomic_load(&sim->queued);
+
+        uint64_t t = now_ns();
+        picosynth_dbuf_render(sim->dbuf, (uint8_t) (k & 1));
+        while (now_ns() - t < sim->busy_ns)
+            ;
+        uint64_t dt = now_ns() - t;
+        atomic_store(&sim->filled[k & 1], (int64_t) k);
+
+        if (sim->isr_n == 0 || dt < sim->isr_min)
+            sim->isr_min = dt;
+        if (dt > sim->isr_max)
+            sim->isr_max = dt;
+        sim->isr_sum += dt;
+        sim->isr_n++;
+
+        /* Events queued before this render sound when the half is read */
+        uint64_t heard = sim->t0 + (k + 2) * sim->period;
+        for (; sim->attributed < queued; sim->attributed++) {
+            uint64_t lat =
+                heard - sim->queued_ns[sim->attributed % MAX_EVENTS];
+            if (sim->lat_n == 0 || lat < sim->lat_min)
+                sim->lat_min = lat;
+            if (lat > sim->lat_max)
+                sim->lat_max = lat;
+            sim->lat_sum += lat;
+            sim->lat_n++;
+        }
+    }
+    return NULL;
+}
+
+/* Queue one event, retrying while the handler drains a full queue */
+static void queue_event(sim_t *sim, uint8_t on, uint8_t voice, uint8_t note)
+{
+    uint32_t i = atomic_load(&sim->queued);
+    sim->queued_ns[i % MAX_EVENTS] = now_ns();
+    while (!(on ? picosynth_dbuf_note_on(sim->dbuf, voice, note)
+                : picosynth_dbuf_note_off(sim->dbuf, voice))) {
+        struct timespec ts = {.tv_nsec = (long) (sim->period / 4)};
+        nanosleep(&ts, NULL);
+    }
+    atomic_store(&sim->queued, i + 1);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-b half] [-v voices] [-w us] [-o out.wav]"
+            " <song.txt|song.mid>\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *output = NULL;
+    unsigned long half = 128, voices = 8, busy_us = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            half = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            busy_us = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argv[i][0] != '-' && !input) {
+            input = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!input || half < 8 || half > 65536 || voices == 0 ||
+        voices > SONG_MAX_VOICES || busy_us > 1000000) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    song_t song;
+    if (song_load_file(&song, input) != SONG_OK) {
+        fprintf(stderr, "Error: cannot load %s\n", input);
+        return 1;
+    }
+    sim_t *sim = calloc(1, sizeof(sim_t));
+    picosynth_t *s = song_patch_create(&song_patch_piano, (uint8_t) voices);
+    if (!sim || !s ||
+        !(sim->dbuf = picosynth_dbuf_create(s, NULL, (uint32_t) half))) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    if (output && (!(sim->wav = fopen(output, "wb")) ||
+                   wav_write_header(sim->wav, 0) != 0)) {
+        perror(output);
+        return 1;
+    }
+    sim->half = (uint32_t) half;
+    sim->period = half * 1000000000ull / SAMPLE_RATE;
+    sim->busy_ns = busy_us * 1000;
+    atomic_init(&sim->filled[0], -1);
+    atomic_init(&sim->filled[1], -1);
+    pthread_mutex_init(&sim->lock, NULL);
+    pthread_cond_init(&sim->cond, NULL);
+
+    sim->t0 = now_ns();
+    pthread_t dma, irq;
+    pthread_create(&irq, NULL, irq_main, sim);
+    pthread_create(&dma, NULL, dma_main, sim);
+
+    /* Play the song with a simple allocator: free voices round-robin,
+     * stealing the next one when all are held
+     */
+    uint8_t held[SONG_MAX_VOICES];
+    memset(held, 0xFF, sizeof(held));
+    uint8_t next_voice = 0;
+    for (uint32_t i = 0; i < song.count; i++) {
+        const song_event_t *e = &song.events[i];
+        sleep_until(sim->t0 + (uint64_t) e->time * 1000000000ull /
+                                  SAMPLE_RATE);
+        if (e->type == SONG_EVENT_NOTE_ON) {
+            uint8_t v = next_voice;
+            for (uint8_t k = 0; k < voices; k++) {
+                uint8_t c = (uint8_t) ((next_voice + k) % voices);
+                if (held[c] == 0xFF) {
+                    v = c;
+                    break;
+                }
+            }
+            next_voice = (uint8_t) ((v + 1) % voices);
+            held[v] = e->note;
+            queue_event(sim, 1, v, e->note);
+        } else {
+            for (uint8_t v = 0; v < voices; v++) {
+                if (held[v] == e->note) {
+                    held[v] = 0xFF;
+                    queue_event(sim, 0, v, 0);
+                    break;
+                }
+            }
+        }
+    }
+    sleep_until(sim->t0 + (uint64_t) (song.length + song_patch_piano.tail) *
+                              1000000000ull / SAMPLE_RATE);
+
+    pthread_mutex_lock(&sim->lock);
+    sim->done = true;
+    pthread_cond_signal(&sim->cond);
+    pthread_mutex_unlock(&sim->lock);
+    pthread_join(dma, NULL);
+    pthread_join(irq, NULL);
+
+    double p_us = (double) sim->period / 1e3;
+    printf("halves:     %lu samples (%.0f us), %llu interrupts\n", half,
+           p_us, (unsigned long long) sim->isr_n);
+    printf("handler:    min %.1f  avg %.1f  max %.1f us (%.1f%% of a half "
+           "at peak)\n",
+           (double) sim->isr_min / 1e3,
+           sim->isr_n ? (double) sim->isr_sum / 1e3 / (double) sim->isr_n
+                      : 0,
+           (double) sim->isr_max / 1e3,
+           (double) sim->isr_max / 1e3 * 100 / p_us);
+    printf("latency:    min %.1f  avg %.1f  max %.1f ms over %llu events\n",
+           (double) sim->lat_min / 1e6,
+           sim->lat_n ? (double) sim->lat_sum / 1e6 / (double) sim->lat_n : 0,
+           (double) sim->lat_max / 1e6, (unsigned long long) sim->lat_n);
+    printf("faults:     %llu underruns, %llu missed interrupts, "
+           "%u overruns seen by dbuf\n",
+           (unsigned long long) sim->underruns,
+           (unsigned long long) sim->missed,
+           picosynth_dbuf_overruns(sim->dbuf));
+
+    int ret = 0;
+    if (sim->wav) {
+        if (fseek(sim->wav, 0, SEEK_SET) != 0 ||
+            wav_write_header(sim->wav, (uint32_t) sim->played) != 0)
+            ret = 1;
+        if (fclose(sim->wav) != 0 || ret) {
+            perror(output);
+            ret = 1;
+        }
+    }
+    picosynth_dbuf_destroy(sim->dbuf);
+    picosynth_destroy(s);
+    song_free(&song);
+    free(sim);
+    return ret;
+}
@@ -0,0 +1,193 @@
+/*
+ * groupbench - Compare separate instances against one instance group
+ *
+ * Usage:
+ *   groupbench                     # 256 instances, 2 voices, 2000 blocks
+ *   groupbench -i 512 -v 4 -n 500  # Override instance/voice/block counts
+ *
+ * Models many small emitters: every instance gets the same patch and its
+ * own pseudo-random note stream. The workload is rendered twice, once with
+ * picosynth_render() per instance and once with picosynth_group_render()
+ * on a group cloned from the same prototype, and the outputs are compared
+ * sample by sample.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+
+#define NODES_PER_VOICE 6
+
+/* Oscillator pair into an SVF with amplitude and filter envelopes */
+static void setup_voice(picosynth_voice_t *v, int idx)
+{
+    picosynth_node_t *amp = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *flt = picosynth_voice_get_node(v, 2);
+    picosynth_node_t *fenv = picosynth_voice_get_node(v, 3);
+    picosynth_node_t *sub = picosynth_voice_get_node(v, 4);
+    picosynth_node_t *mix = picosynth_voice_get_node(v, 5);
+
+    picosynth_init_env_ms(amp, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 5,
+                              .hold_ms = 20,
+                              .dec_ms = 150,
+                              .sus_pct = 60,
+                              .rel_ms = 120,
+                          });
+    picosynth_init_env_ms(fenv, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 2,
+                              .dec_ms = 300,
+                              .sus_pct = 30,
+                              .rel_ms = 200,
+                          });
+    picosynth_init_osc(osc, &amp->out, picosynth_voice_freq_ptr(v),
+                       (idx & 1) ? picosynth_wave_saw : picosynth_wave_sine);
+    picosynth_init_osc(sub, &amp->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_triangle);
+    picosynth_init_mix(mix, NULL, &osc->out, &sub->out, NULL);
+    picosynth_init_svf_lp(flt, &fenv->out, &mix->out, picosynth_svf_freq(1500),
+                          Q15_MAX / 2);
+    picosynth_voice_set_out(v, 2);
+}
+
+static picosynth_t *make_synth(uint8_t voices)
+{
+    picosynth_t *s = picosynth_create(voices, NODES_PER_VOICE);
+    if (s)
+        for (uint8_t i = 0; i < voices; i++)
+            setup_voice(picosynth_get_voice(s, i), i);
+    return s;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Deterministic event for (instance, block), shared by both passes */
+static int schedule(uint8_t voices, uint32_t inst, uint32_t b, uint8_t *voice)
+{
+    uint32_t x = (inst * 0x9E3779B9u) ^ (b * 0x85EBCA6Bu);
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+
+    *voice = (uint8_t) ((x >> 24) % voices);
+    if ((x & 0x1F) == 0)
+        return 36 + (int) ((x >> 8) % 48); /* Note-on */
+    return (x & 0x1F) == 1 ? 0 : -1;       /* Note-off, nothing */
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-i instances] [-v voices] [-n blocks]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long count = 256, voices = 2, blocks = 2000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            count = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            blocks = strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (count == 0 || count > UINT16_MAX || voices == 0 || voices > 16 ||
+        blocks == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    picosynth_t **insts = calloc(count, sizeof(picosynth_t *));
+    q15_t **bufs = calloc(count, sizeof(q15_t *));
+    q15_t *ref = calloc(count * PICOSYNTH_BLOCK_SIZE, sizeof(q15_t));
+    q15_t *got = calloc(count * PICOSYNTH_BLOCK_SIZE, sizeof(q15_t));
+    picosynth_t *proto = make_synth((uint8_t) voices);
+    picosynth_group_t *g =
+        proto ? picosynth_group_create(proto, (uint16_t) count) : NULL;
+    int ret = 1;
+    if (!insts || !bufs || !ref || !got || !g) {
+        fprintf(stderr, "Error: out of memory\n");
+        goto out;
+    }
+    for (uint32_t j = 0; j < count; j++) {
+        if (!(insts[j] = make_synth((uint8_t) voices))) {
+            fprintf(stderr, "Error: out of memory\n");
+            goto out;
+        }
+        bufs[j] = got + j * PICOSYNTH_BLOCK_SIZE;
+    }
+
+    uint64_t t_sep = 0, t_grp = 0, diffs = 0;
+    for (uint32_t b = 0; b < blocks; b++) {
+        for (uint32_t j = 0; j < count; j++) {
+            uint8_t voice;
+            int note = schedule((uint8_t) voices, j, b, &voice);
+            if (note > 0) {
+                picosynth_note_on(insts[j], voice, (uint8_t) note);
+                picosynth_group_note_on(g, (uint16_t) j, voice,
+                                        (uint8_t) note);
+            } else if (note == 0) {
+                picosynth_note_off(insts[j], voice);
+                picosynth_group_note_off(g, (uint16_t) j, voice);
+            }
+        }
+
+        uint64_t t0 = now_ns();
+        for (uint32_t j = 0; j < count; j++)
+            picosynth_render(insts[j], ref + j * PICOSYNTH_BLOCK_SIZE,
+                             PICOSYNTH_BLOCK_SIZE);
+        uint64_t t1 = now_ns();
+        picosynth_group_render(g, bufs, PICOSYNTH_BLOCK_SIZE);
+        uint64_t t2 = now_ns();
+        t_sep += t1 - t0;
+        t_grp += t2 - t1;
+
+        for (uint32_t k = 0; k < count * PICOSYNTH_BLOCK_SIZE; k++)
+            diffs += ref[k] != got[k];
+    }
+
+    double samples = (double) count * (double) blocks * PICOSYNTH_BLOCK_SIZE;
+    double audio = (double) blocks * PICOSYNTH_BLOCK_SIZE / SAMPLE_RATE;
+    printf("mode:      %s\n",
+           PICOSYNTH_CONSTANT_TIME ? "constant-time" : "default");
+    printf("workload:  %lu instances x %lu voices, %lu blocks (%.1f s)\n",
+           count, voices, blocks, audio);
+    printf("separate:  %.1f ns/instance-sample (%.0f instances realtime)\n",
+           (double) t_sep / samples,
+           t_sep ? (double) count * audio * 1e9 / (double) t_sep : 0);
+    printf("group:     %.1f ns/instance-sample (%.0f instances realtime)\n",
+           (double) t_grp / samples,
+           t_grp ? (double) count * audio * 1e9 / (double) t_grp : 0);
+    printf("speedup:   %.2fx\n", t_grp ? (double) t_sep / (double) t_grp : 0);
+    printf("verify:    %llu samples differ\n", (unsigned long long) diffs);
+    ret = diffs ? 1 : 0;
+
+out:
+    picosynth_group_destroy(g);
+    picosynth_destroy(proto);
+    for (uint32_t j = 0; insts && j < count; j++)
+        picosynth_destroy(insts[j]);
+    free(insts);
+    free(bufs);
+    free(ref);
+    free(got);
+    return ret;
+}
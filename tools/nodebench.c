@@ -0,0 +1,381 @@
+/*
+ * nodebench - Compare the per-voice cost of node types
+ *
+ * Usage:
+ *   nodebench                # 8 voices, 200000 samples per case
+ *   nodebench -v 16 -n 50000 # Override voice and sample counts
+ *
+ * Each case wires one voice patch into every voice, holds a note on all of
+ * them and times picosynth_render(). Reports nanoseconds per voice-sample,
+ * and per partial for patches that generate several, so a node can be
+ * weighed against the oscillator graph it replaces. Built with a
+ * 256-partial bank capacity for the spectral cases.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+
+#define BLOCK 256
+#define MAX_VOICES 16
+
+static picosynth_partials_t bank;
+static picosynth_spectral_t *engines[MAX_VOICES];
+static q15_t lines[MAX_VOICES][1024];
+static picosynth_modes_t modes;
+static int32_t resonators[MAX_VOICES][2 * PICOSYNTH_MODAL_MAX];
+static picosynth_fm_patch_t fm_patch;
+static const q15_t *bus_in[MAX_VOICES][8];
+static q15_t bus_gains[8];
+
+/* One enveloped sine: the cost of a partial built from oscillators */
+static void setup_osc(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    (void) partials;
+    picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_init_env_ms(env, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 5,
+                              .dec_ms = 300,
+                              .sus_pct = 50,
+                              .rel_ms = 100,
+                          });
+    picosynth_init_osc(osc, &env->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_sine);
+    picosynth_voice_set_out(v, 1);
+}
+
+/* Stretched, decaying partials (slowly, so none drop out while timing) */
+static void fill_bank(int partials)
+{
+    bank.count = 0;
+    for (int k = 0; k < partials; k++)
+        picosynth_partials_set(&bank, (uint16_t) k,
+                               picosynth_partial_ratio((uint16_t) (k + 1), 30),
+                               (q15_t) (Q15_MAX / 4 / (k + 1)),
+                               (uint32_t) (20000 / (k + 1)));
+}
+
+static picosynth_node_t *setup_env(picosynth_voice_t *v)
+{
+    picosynth_node_t *env = picosynth_voice_get_node(v, 0);
+    picosynth_init_env_ms(env, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 5,
+                              .dec_ms = 300,
+                              .sus_pct = 50,
+                              .rel_ms = 100,
+                          });
+    return env;
+}
+
+/* Enveloped partial bank, one sine per partial */
+static void setup_additive(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    fill_bank(partials);
+    picosynth_node_t *env = setup_env(v);
+    picosynth_init_additive(picosynth_voice_get_node(v, 1), &env->out,
+                            picosynth_voice_freq_ptr(v), &bank);
+    picosynth_voice_set_out(v, 1);
+}
+
+/* The same bank through the inverse-FFT engine, 256-sample frames */
+static void setup_spectral(picosynth_voice_t *v, int idx, int partials)
+{
+    fill_bank(partials);
+    if (!engines[idx])
+        engines[idx] = picosynth_spectral_create(8);
+    picosynth_node_t *env = setup_env(v);
+    picosynth_init_spectral(picosynth_voice_get_node(v, 1), &env->out,
+                            picosynth_voice_freq_ptr(v), &bank, engines[idx]);
+    picosynth_voice_set_out(v, 1);
+}
+
+/* Plucked string: one node in place of an oscillator/envelope/noise patch */
+static void setup_string(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) partials;
+    picosynth_init_string(picosynth_voice_get_node(v, 0), NULL,
+                          picosynth_voice_freq_ptr(v), lines[idx], 1024,
+                          &(picosynth_string_params_t) {
+                              .feedback = Q15_MAX,
+                              .damping = Q15_MAX / 8,
+                              .level = Q15_MAX / 2,
+                          });
+    picosynth_voice_set_out(v, 0);
+}
+
+/* Enveloped noise into a band-pass: one resonance as an SVF */
+static void setup_svf(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    (void) partials;
+    picosynth_node_t *env = setup_env(v);
+    picosynth_node_t *noise = picosynth_voice_get_node(v, 1);
+    picosynth_init_osc(noise, &env->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_noise);
+    picosynth_init_svf_bp(picosynth_voice_get_node(v, 2), NULL, &noise->out,
+                          picosynth_svf_freq(440), Q15_MAX / 16);
+    picosynth_voice_set_out(v, 2);
+}
+
+/* The same noise into a bank of modes */
+static void setup_modal(picosynth_voice_t *v, int idx, int partials)
+{
+    modes.count = 0;
+    for (int k = 0; k < partials; k++)
+        picosynth_modes_set(&modes, (uint16_t) k, (uint32_t) (110 + 97 * k),
+                            (uint32_t) (400 / (k + 1)),
+                            (q15_t) (Q15_MAX / 64));
+    picosynth_node_t *env = setup_env(v);
+    picosynth_node_t *noise = picosynth_voice_get_node(v, 1);
+    picosynth_init_osc(noise, &env->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_noise);
+    picosynth_init_modal(picosynth_voice_get_node(v, 2), NULL, &noise->out,
+                         &modes, resonators[idx]);
+    picosynth_voice_set_out(v, 2);
+}
+
+/* One enveloped sawtooth, for the unison cases */
+static void setup_saw(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    (void) partials;
+    picosynth_node_t *env = setup_env(v);
+    picosynth_init_osc(picosynth_voice_get_node(v, 1), &env->out,
+                       picosynth_voice_freq_ptr(v), picosynth_wave_saw);
+    picosynth_voice_set_out(v, 1);
+}
+
+/* Sawtooth through a chorus: slow LFO swinging a delay, mixed with the dry
+ * signal
+ */
+static void setup_chorus(picosynth_voice_t *v, int idx, int partials)
+{
+    static const q15_t lfo_rate = 2; /* About 0.7 Hz */
+    (void) partials;
+    setup_saw(v, idx, partials);
+    picosynth_node_t *saw = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *lfo = picosynth_voice_get_node(v, 2);
+    picosynth_node_t *dly = picosynth_voice_get_node(v, 3);
+    picosynth_init_osc(lfo, NULL, &lfo_rate, picosynth_wave_triangle);
+    picosynth_init_delay(dly, NULL, &saw->out, &lfo->out, lines[idx], 1024,
+                         &(picosynth_delay_params_t) {
+                             .time_us = 15000,
+                             .depth_us = 5000,
+                             .feedback = Q15_MAX / 4,
+                         });
+    picosynth_init_mix(picosynth_voice_get_node(v, 4), NULL, &saw->out,
+                       &dly->out, NULL);
+    picosynth_voice_set_out(v, 4);
+}
+
+/* Detuned sawtooth stack, one voice per "partial" */
+static void setup_unison(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    picosynth_node_t *env = setup_env(v);
+    picosynth_init_unison(picosynth_voice_get_node(v, 1), &env->out,
+                          picosynth_voice_freq_ptr(v), picosynth_wave_saw,
+                          &(picosynth_unison_params_t) {
+                              .voices = (uint8_t) partials,
+                              .detune = 600,
+                              .phase = Q15_MAX,
+                          });
+    picosynth_voice_set_out(v, 1);
+}
+
+/* Two-operator FM from operator nodes: envelope, modulator, carrier */
+static void setup_fm_ops(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    (void) partials;
+    picosynth_node_t *env = setup_env(v);
+    picosynth_node_t *mod = picosynth_voice_get_node(v, 1);
+    picosynth_init_fm_op(mod, &env->out, picosynth_voice_freq_ptr(v), NULL,
+                         &(picosynth_fm_op_params_t) {
+                             .ratio = 2u << 16,
+                             .feedback = Q15_MAX / 4,
+                         });
+    picosynth_init_fm_op(picosynth_voice_get_node(v, 2), &env->out,
+                         picosynth_voice_freq_ptr(v), &mod->out, NULL);
+    picosynth_voice_set_out(v, 2);
+}
+
+/* Four or six operators in one algorithm node */
+static void setup_fm(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    picosynth_fm_set_algorithm(&fm_patch,
+                               partials == 6 ? PICOSYNTH_FM_DX5
+                                             : PICOSYNTH_FM_STACK4,
+                               Q15_MAX / 4);
+    for (uint8_t k = 0; k < partials; k++)
+        picosynth_fm_set_op(&fm_patch, k, (uint32_t) (k + 1) << 16, 0,
+                            Q15_MAX / 4, 2000);
+    picosynth_node_t *env = setup_env(v);
+    picosynth_init_fm(picosynth_voice_get_node(v, 1), &env->out,
+                      picosynth_voice_freq_ptr(v), &fm_patch);
+    picosynth_voice_set_out(v, 1);
+}
+
+/* Eight saw and sine oscillators under one envelope, nodes 1-8 */
+static void setup_eight(picosynth_voice_t *v)
+{
+    picosynth_node_t *env = setup_env(v);
+    for (uint8_t k = 1; k <= 8; k++)
+        picosynth_init_osc(picosynth_voice_get_node(v, k), &env->out,
+                           picosynth_voice_freq_ptr(v),
+                           k & 1 ? picosynth_wave_saw : picosynth_wave_sine);
+}
+
+/* Eight oscillators through a chain of four 3-input mixers */
+static void setup_mix_chain(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) idx;
+    (void) partials;
+    setup_eight(v);
+    const q15_t *o[9];
+    for (uint8_t k = 1; k <= 8; k++)
+        o[k] = &picosynth_voice_get_node(v, k)->out;
+    picosynth_node_t *m = picosynth_voice_get_node(v, 9);
+    picosynth_init_mix(m, NULL, o[1], o[2], o[3]);
+    for (uint8_t k = 0; k < 3; k++) {
+        picosynth_node_t *next = picosynth_voice_get_node(v, 10 + k);
+        picosynth_init_mix(next, NULL, &m->out, o[4 + 2 * k],
+                           k < 2 ? o[5 + 2 * k] : NULL);
+        m = next;
+    }
+    picosynth_voice_set_out(v, 12);
+}
+
+/* The same eight oscillators into one summing bus with gains */
+static void setup_sum(picosynth_voice_t *v, int idx, int partials)
+{
+    (void) partials;
+    setup_eight(v);
+    for (uint8_t k = 0; k < 8; k++) {
+        bus_in[idx][k] = &picosynth_voice_get_node(v, k + 1)->out;
+        bus_gains[k] = Q15_MAX / 2;
+    }
+    picosynth_init_sum(picosynth_voice_get_node(v, 9), NULL, bus_in[idx],
+                       bus_gains, 8);
+    picosynth_voice_set_out(v, 9);
+}
+
+typedef struct {
+    const char *name;
+    void (*setup)(picosynth_voice_t *v, int idx, int partials);
+    uint8_t nodes;
+    int partials;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    {"osc sine", setup_osc, 2, 1},
+    {"additive x1", setup_additive, 2, 1},
+    {"additive x8", setup_additive, 2, 8},
+    {"additive x16", setup_additive, 2, 16},
+    {"additive x32", setup_additive, 2, 32},
+    {"additive x128", setup_additive, 2, 128},
+    {"spectral x8", setup_spectral, 2, 8},
+    {"spectral x32", setup_spectral, 2, 32},
+    {"spectral x128", setup_spectral, 2, 128},
+    {"spectral x256", setup_spectral, 2, 256},
+    {"string", setup_string, 1, 1},
+    {"svf bp", setup_svf, 3, 1},
+    {"modal x1", setup_modal, 3, 1},
+    {"modal x8", setup_modal, 3, 8},
+    {"modal x32", setup_modal, 3, 32},
+    {"osc saw", setup_saw, 2, 1},
+    {"chorus", setup_chorus, 5, 1},
+    {"unison x1", setup_unison, 2, 1},
+    {"unison x7", setup_unison, 2, 7},
+    {"unison x16", setup_unison, 2, 16},
+    {"fm op x2", setup_fm_ops, 3, 2},
+    {"fm stack x4", setup_fm, 2, 4},
+    {"fm dx5 x6", setup_fm, 2, 6},
+    {"mix chain x8", setup_mix_chain, 13, 8},
+    {"sum x8", setup_sum, 10, 8},
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Returns ns per voice-sample, or a negative value on failure */
+static double run_case(const bench_case_t *c, uint8_t voices, uint32_t n)
+{
+    picosynth_t *s = picosynth_create(voices, c->nodes);
+    if (!s)
+        return -1;
+    for (uint8_t i = 0; i < voices; i++)
+        c->setup(picosynth_get_voice(s, i), i, c->partials);
+    /* Low notes keep most partials of the large banks below Nyquist */
+    for (uint8_t i = 0; i < voices; i++)
+        picosynth_note_on(s, i, (uint8_t) (24 + i * 5 % 24));
+
+    q15_t buf[BLOCK];
+    int64_t sink = 0;
+    uint64_t t0 = now_ns();
+    for (uint32_t done = 0; done < n; done += BLOCK) {
+        picosynth_render(s, buf, BLOCK);
+        sink += buf[BLOCK - 1];
+    }
+    uint64_t dt = now_ns() - t0;
+    picosynth_destroy(s);
+
+    /* Keep the render from being optimized away */
+    if (sink == INT64_MIN)
+        printf(" ");
+    uint32_t blocks = (n + BLOCK - 1) / BLOCK;
+    return (double) dt / ((double) blocks * BLOCK * voices);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t n = 200000;
+    unsigned voices = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            n = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-v") && i + 1 < argc) {
+            voices = (unsigned) strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-n samples] [-v voices]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!n || !voices || voices > MAX_VOICES) {
+        fprintf(stderr, "need samples > 0 and 1-16 voices\n");
+        return 1;
+    }
+
+    printf("%u voices, %u samples per case\n", voices, n);
+    printf("%-14s %12s %12s\n", "case", "ns/voice", "ns/partial");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        double ns = run_case(&cases[i], (uint8_t) voices, n);
+        for (unsigned v = 0; v < voices && ns >= 0; v++)
+            if (cases[i].setup == setup_spectral && !engines[v])
+                ns = -1;
+        if (ns < 0) {
+            fprintf(stderr, "%s: synth creation failed\n", cases[i].name);
+            return 1;
+        }
+        printf("%-14s %12.1f %12.2f\n", cases[i].name, ns,
+               ns / cases[i].partials);
+    }
+    for (unsigned v = 0; v < MAX_VOICES; v++)
+        picosynth_spectral_destroy(engines[v]);
+    return 0;
+}
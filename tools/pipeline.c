@@ -0,0 +1,383 @@
+/*
+ * pipeline - Offline song export as three pipelined stages
+ *
+ * Usage:
+ *   pipeline song.txt                 # -> out.wav
+ *   pipeline song.mid -o song.wav -q 8
+ *   pipeline song.mid --serial        # Single-threaded baseline
+ *
+ * Options:
+ *   -o FILE     Output WAV (default: out.wav)
+ *   -v N        Synth voices (default: 8)
+ *   -q N        Queue depth in blocks, power of two (default: 32)
+ *   --serial    Parse, render and write on one thread for comparison
+ *
+ * Stages, each on its own thread:
+ *   parse   load the song and cut the timeline into blocks of at most
+ *           BLOCK samples, each carrying the note events due at its start
+ *   render  apply the events (voice allocation included) and synthesize
+ *   write   encode to little-endian PCM and write the WAV file
+ *
+ * Stages are connected by bounded lock-free SPSC queues (tools/spsc.h)
+ * whose slots are filled in place. A full queue stalls its producer, so a
+ * slow disk throttles synthesis instead of buffering without bound. Each
+ * stage reports time busy, time starved by its input and time blocked by
+ * its output; with full overlap the render stage is busy nearly all the
+ * wall time and the other stages mostly wait on it.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "spsc.h"
+#include "wav.h"
+
+#define BLOCK 512
+#define MAX_EVENTS 16 /* Per block; later events start a new block */
+
+/* parse -> render: a span of samples and the events at its start */
+typedef struct {
+    uint32_t n;
+    uint8_t n_events;
+    bool last;
+    song_event_t events[MAX_EVENTS];
+} sched_block_t;
+
+/* render -> write */
+typedef struct {
+    uint32_t n;
+    bool last;
+    q15_t pcm[BLOCK];
+} audio_block_t;
+
+typedef struct {
+    uint64_t busy;    /* Doing work */
+    uint64_t starved; /* Waiting for input */
+    uint64_t blocked; /* Waiting for output space (backpressure) */
+    uint64_t blocks;
+} stage_stats_t;
+
+typedef struct {
+    const char *input, *output;
+    uint8_t voices;
+    spsc_t sched_q, audio_q;
+    stage_stats_t parse, render, write;
+    uint32_t samples;
+    const char *error; /* First failure, set by the stage that hit it */
+    atomic_bool abort;
+} pipeline_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void fail(pipeline_t *pl, const char *msg)
+{
+    if (!atomic_exchange(&pl->abort, true))
+        pl->error = msg;
+}
+
+/* Spin briefly, then yield, until @get returns a slot. Time spent waiting
+ * is added to @wait. Returns NULL if the pipeline was aborted.
+ */
+static void *wait_slot(pipeline_t *pl,
+                       spsc_t *q,
+                       void *(*get)(spsc_t *),
+                       uint64_t *wait)
+{
+    void *slot = get(q);
+    if (slot)
+        return slot;
+
+    uint64_t t0 = now_ns();
+    for (unsigned spins = 0; !(slot = get(q)); spins++) {
+        if (atomic_load_explicit(&pl->abort, memory_order_relaxed))
+            break;
+        if (spins > 64)
+            sched_yield();
+    }
+    *wait += now_ns() - t0;
+    return slot;
+}
+
+static void *parse_stage(void *arg)
+{
+    pipeline_t *pl = arg;
+    stage_stats_t *st = &pl->parse;
+    song_t song;
+
+    uint64_t t0 = now_ns();
+    if (song_load_file(&song, pl->input) != SONG_OK) {
+        fail(pl, "cannot load input");
+        return NULL;
+    }
+    st->busy += now_ns() - t0;
+
+    uint32_t end = song.length + song_patch_piano.tail;
+    uint32_t pos = 0, i = 0;
+    bool last = false;
+    while (!last) {
+        sched_block_t *b =
+            wait_slot(pl, &pl->sched_q, spsc_write_slot, &st->blocked);
+        if (!b)
+            break;
+
+        t0 = now_ns();
+        b->n_events = 0;
+        while (i < song.count && song.events[i].time <= pos &&
+               b->n_events < MAX_EVENTS)
+            b->events[b->n_events++] = song.events[i++];
+        uint32_t next = i < song.count ? song.events[i].time : end;
+        if (next > end)
+            next = end;
+        b->n = next - pos < BLOCK ? next - pos : BLOCK;
+        pos += b->n;
+        last = b->last = pos >= end && i >= song.count;
+        spsc_commit(&pl->sched_q);
+        st->blocks++;
+        st->busy += now_ns() - t0;
+    }
+    song_free(&song);
+    return NULL;
+}
+
+static void *render_stage(void *arg)
+{
+    pipeline_t *pl = arg;
+    stage_stats_t *st = &pl->render;
+    song_t none = {0};
+    song_player_t p;
+
+    picosynth_t *s = song_patch_create(&song_patch_piano, pl->voices);
+    if (!s) {
+        fail(pl, "cannot create synth");
+        return NULL;
+    }
+    song_player_init(&p, s, &song_patch_piano, &none);
+
+    bool last = false;
+    while (!last) {
+        sched_block_t *b =
+            wait_slot(pl, &pl->sched_q, spsc_read_slot, &st->starved);
+        if (!b)
+            break;
+        last = b->last;
+
+        uint64_t t0 = now_ns();
+        for (uint8_t i = 0; i < b->n_events; i++)
+            song_player_event(&p, &b->events[i]);
+        uint32_t n = b->n;
+        spsc_release(&pl->sched_q);
+        st->busy += now_ns() - t0;
+        if (n == 0 && !last)
+            continue;
+
+        audio_block_t *a =
+            wait_slot(pl, &pl->audio_q, spsc_write_slot, &st->blocked);
+        if (!a)
+            break;
+        t0 = now_ns();
+        picosynth_render(s, a->pcm, n);
+        a->n = n;
+        a->last = last;
+        spsc_commit(&pl->audio_q);
+        st->blocks++;
+        st->busy += now_ns() - t0;
+    }
+    picosynth_destroy(s);
+    return NULL;
+}
+
+static void *write_stage(void *arg)
+{
+    pipeline_t *pl = arg;
+    stage_stats_t *st = &pl->write;
+    uint8_t bytes[BLOCK * 2];
+
+    FILE *f = fopen(pl->output, "wb");
+    if (!f || wav_write_header(f, 0) != 0) {
+        fail(pl, "cannot write output");
+        if (f)
+            fclose(f);
+        return NULL;
+    }
+
+    bool last = false;
+    while (!last) {
+        audio_block_t *a =
+            wait_slot(pl, &pl->audio_q, spsc_read_slot, &st->starved);
+        if (!a)
+            break;
+
+        uint64_t t0 = now_ns();
+        for (uint32_t i = 0; i < a->n; i++) {
+            uint16_t x = (uint16_t) a->pcm[i];
+            bytes[2 * i] = (uint8_t) x;
+            bytes[2 * i + 1] = (uint8_t) (x >> 8);
+        }
+        size_t n = a->n;
+        last = a->last;
+        spsc_release(&pl->audio_q);
+        if (fwrite(bytes, 2, n, f) != n) {
+            fail(pl, "write failed");
+            break;
+        }
+        pl->samples += (uint32_t) n;
+        st->blocks++;
+        st->busy += now_ns() - t0;
+    }
+
+    uint64_t t0 = now_ns();
+    if (fseek(f, 0, SEEK_SET) != 0 || wav_write_header(f, pl->samples) != 0)
+        fail(pl, "write failed");
+    if (fclose(f) != 0)
+        fail(pl, "write failed");
+    st->busy += now_ns() - t0;
+    return NULL;
+}
+
+/* Baseline: the same work on one thread */
+static void run_serial(pipeline_t *pl)
+{
+    song_t song;
+    song_player_t p;
+    q15_t buf[BLOCK];
+    uint32_t n;
+
+    if (song_load_file(&song, pl->input) != SONG_OK) {
+        fail(pl, "cannot load input");
+        return;
+    }
+    picosynth_t *s = song_patch_create(&song_patch_piano, pl->voices);
+    FILE *f = fopen(pl->output, "wb");
+    if (!s || !f || wav_write_header(f, 0) != 0) {
+        fail(pl, "cannot create synth or output");
+    } else {
+        song_player_init(&p, s, &song_patch_piano, &song);
+        while ((n = song_player_render(&p, buf, BLOCK)) > 0) {
+            if (fwrite(buf, 2, n, f) != n) {
+                fail(pl, "write failed");
+                break;
+            }
+            pl->samples += n;
+        }
+        if (fseek(f, 0, SEEK_SET) != 0 || wav_write_header(f, pl->samples))
+            fail(pl, "write failed");
+    }
+    if (f && fclose(f) != 0)
+        fail(pl, "write failed");
+    picosynth_destroy(s);
+    song_free(&song);
+}
+
+static void print_stage(const char *name,
+                        const stage_stats_t *st,
+                        uint64_t wall)
+{
+    double w = wall ? (double) wall : 1;
+    printf("%-7s %7llu blocks  busy %6.1f%%  starved %6.1f%%"
+           "  blocked %6.1f%%\n",
+           name, (unsigned long long) st->blocks,
+           100.0 * (double) st->busy / w, 100.0 * (double) st->starved / w,
+           100.0 * (double) st->blocked / w);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-o out.wav] [-v voices] [-q depth] [--serial]"
+            " song.txt|song.mid\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    pipeline_t pl = {.output = "out.wav", .voices = 8};
+    unsigned long voices = 8, depth = 32;
+    bool serial = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            pl.output = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            depth = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--serial") == 0) {
+            serial = true;
+        } else if (argv[i][0] != '-' && !pl.input) {
+            pl.input = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!pl.input || voices == 0 || voices > SONG_MAX_VOICES) {
+        usage(argv[0]);
+        return 1;
+    }
+    pl.voices = (uint8_t) voices;
+    atomic_init(&pl.abort, false);
+
+    if (serial) {
+        uint64_t t0 = now_ns();
+        run_serial(&pl);
+        uint64_t wall = now_ns() - t0;
+        if (pl.error) {
+            fprintf(stderr, "Error: %s\n", pl.error);
+            return 1;
+        }
+        double secs = (double) pl.samples / SAMPLE_RATE;
+        printf("serial:  %.2f s audio in %.1f ms (%.1fx realtime)\n", secs,
+               (double) wall / 1e6, wall ? secs * 1e9 / (double) wall : 0);
+        return 0;
+    }
+
+    if (depth > 1u << 16 ||
+        !spsc_init(&pl.sched_q, (uint32_t) depth, sizeof(sched_block_t)) ||
+        !spsc_init(&pl.audio_q, (uint32_t) depth, sizeof(audio_block_t))) {
+        fprintf(stderr, "Error: queue depth must be a power of two\n");
+        spsc_free(&pl.sched_q);
+        return 1;
+    }
+
+    pthread_t tid[3];
+    void *(*stages[3])(void *) = {parse_stage, render_stage, write_stage};
+    uint64_t t0 = now_ns();
+    int started = 0;
+    for (; started < 3; started++)
+        if (pthread_create(&tid[started], NULL, stages[started], &pl) != 0)
+            break;
+    if (started < 3)
+        fail(&pl, "cannot start threads");
+    for (int i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    uint64_t wall = now_ns() - t0;
+
+    spsc_free(&pl.sched_q);
+    spsc_free(&pl.audio_q);
+    if (pl.error) {
+        fprintf(stderr, "Error: %s\n", pl.error);
+        return 1;
+    }
+
+    double secs = (double) pl.samples / SAMPLE_RATE;
+    printf("pipeline: %.2f s audio in %.1f ms (%.1fx realtime), queues %lu\n",
+           secs, (double) wall / 1e6, wall ? secs * 1e9 / (double) wall : 0,
+           depth);
+    print_stage("parse", &pl.parse, wall);
+    print_stage("render", &pl.render, wall);
+    print_stage("write", &pl.write, wall);
+    return 0;
+}
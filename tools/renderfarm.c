@@ -0,0 +1,396 @@
+/*
+ * renderfarm - Render many melody or MIDI files to WAV on a thread pool
+ *
+ * Usage:
+ *   renderfarm a.txt b.mid c.txt        # Render into the current directory
+ *   renderfarm -j 8 -o out/ -l list.txt # Paths from a file, one per line
+ *   find songs -name '*.mid' | renderfarm -l - -c 4096
+ *
+ * Options:
+ *   -j N        Worker threads (default: online CPUs)
+ *   -l FILE     Read input paths from FILE ('-' for stdin), in addition to
+ *               any given on the command line
+ *   -o DIR      Output directory (default: .); foo.mid becomes DIR/foo.wav.
+ *               Inputs that would share an output file are refused.
+ *   -v N        Synth voices (default: 8)
+ *   -c KB       Rendered-note cache per worker (see song_cache_t)
+ *   -q          Summary only, no per-file lines
+ *
+ * Inputs are parsed at runtime (melody text as read by tools/midi2c, or
+ * Standard MIDI Files). Each worker owns one picosynth_t wired with the
+ * piano patch and snapshots it once; before every job it restores that
+ * snapshot instead of building a new instance. Audio is streamed to disk
+ * in blocks, so memory use does not grow with song length.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "wav.h"
+
+#define BLOCK 4096
+
+typedef struct {
+    const char *path;
+    uint32_t samples;
+    uint64_t parse_ns;
+    uint64_t render_ns; /* Rendering and writing */
+    const char *error;  /* NULL on success */
+} result_t;
+
+typedef struct {
+    char **paths;
+    char **outs; /* Output path of each input */
+    result_t *results;
+    uint32_t count;
+    const char *out_dir;
+    uint8_t voices;
+    size_t cache_bytes;
+    pthread_mutex_t lock;
+    uint32_t next;
+    song_cache_stats_t cache; /* Summed over workers */
+    uint64_t busy_ns;         /* Summed over workers */
+} farm_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* DIR/basename-without-extension.wav */
+static char *output_path(const char *dir, const char *input)
+{
+    const char *base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char *dot = strrchr(base, '.');
+    size_t stem = dot && dot != base ? (size_t) (dot - base) : strlen(base);
+
+    size_t len = strlen(dir) + 1 + stem + sizeof(".wav");
+    char *path = malloc(len);
+    if (path)
+        snprintf(path, len, "%s/%.*s.wav", dir, (int) stem, base);
+    return path;
+}
+
+/* Stream the song to @path, patching the WAV header once the length is
+ * known. Returns an error message or NULL.
+ */
+static const char *render_to_file(song_player_t *p,
+                                  const char *path,
+                                  uint32_t *samples)
+{
+    q15_t buf[BLOCK];
+    uint32_t n, total = 0;
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return "cannot open output";
+    const char *error = NULL;
+    if (wav_write_header(f, 0) != 0)
+        error = "write failed";
+    while (!error && (n = song_player_render(p, buf, BLOCK)) > 0) {
+        if (fwrite(buf, sizeof(q15_t), n, f) != n)
+            error = "write failed";
+        total += n;
+    }
+    if (!error && (fseek(f, 0, SEEK_SET) != 0 || wav_write_header(f, total)))
+        error = "write failed";
+    if (fclose(f) != 0 && !error)
+        error = "write failed";
+    *samples = total;
+    return error;
+}
+
+static void run_job(farm_t *farm,
+                    uint32_t idx,
+                    picosynth_t *s,
+                    const void *pristine,
+                    size_t pristine_len,
+                    song_cache_t *cache)
+{
+    result_t *r = &farm->results[idx];
+    song_t song;
+    song_player_t p;
+
+    r->path = farm->paths[idx];
+    uint64_t t0 = now_ns();
+    song_error_t err = song_load_file(&song, r->path);
+    uint64_t t1 = now_ns();
+    r->parse_ns = t1 - t0;
+    if (err != SONG_OK) {
+        r->error = err == SONG_ERR_IO ? "cannot read input" : "parse error";
+        return;
+    }
+
+    picosynth_snapshot_restore(s, pristine, pristine_len);
+    song_player_init(&p, s, &song_patch_piano, &song);
+    song_player_set_cache(&p, cache);
+    r->error = render_to_file(&p, farm->outs[idx], &r->samples);
+    song_player_set_cache(&p, NULL);
+    r->render_ns = now_ns() - t1;
+
+    song_free(&song);
+}
+
+static void *worker(void *arg)
+{
+    farm_t *farm = arg;
+    uint64_t busy = 0;
+
+    /* One instance per worker, reset from a snapshot between jobs */
+    picosynth_t *s = song_patch_create(&song_patch_piano, farm->voices);
+    size_t len = picosynth_snapshot_size(s);
+    void *pristine = s ? malloc(len) : NULL;
+    song_cache_t *cache =
+        farm->cache_bytes ? song_cache_create(farm->cache_bytes) : NULL;
+    bool ok = s && pristine && (!farm->cache_bytes || cache) &&
+              picosynth_snapshot_save(s, pristine, len) == len;
+
+    for (;;) {
+        pthread_mutex_lock(&farm->lock);
+        uint32_t idx = farm->next++;
+        pthread_mutex_unlock(&farm->lock);
+        if (idx >= farm->count)
+            break;
+
+        uint64_t t0 = now_ns();
+        if (ok) {
+            run_job(farm, idx, s, pristine, len, cache);
+        } else {
+            farm->results[idx].path = farm->paths[idx];
+            farm->results[idx].error = "out of memory";
+        }
+        busy += now_ns() - t0;
+    }
+
+    pthread_mutex_lock(&farm->lock);
+    farm->busy_ns += busy;
+    if (cache) {
+        song_cache_stats_t st;
+        song_cache_get_stats(cache, &st);
+        farm->cache.hits += st.hits;
+        farm->cache.misses += st.misses;
+        farm->cache.evictions += st.evictions;
+    }
+    pthread_mutex_unlock(&farm->lock);
+
+    song_cache_destroy(cache);
+    free(pristine);
+    picosynth_destroy(s);
+    return NULL;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Report every output path given to more than one input. Two workers
+ * writing the same file would silently corrupt it.
+ */
+static bool check_outputs(char **paths, char **outs, uint32_t count)
+{
+    char **sorted = malloc(count * sizeof(char *));
+    if (!sorted) {
+        fprintf(stderr, "Error: out of memory\n");
+        return false;
+    }
+    memcpy(sorted, outs, count * sizeof(char *));
+    qsort(sorted, count, sizeof(char *), compare_paths);
+
+    bool unique = true;
+    for (uint32_t k = 1; k < count; k++) {
+        if (strcmp(sorted[k - 1], sorted[k]) != 0 ||
+            (k > 1 && strcmp(sorted[k - 2], sorted[k]) == 0))
+            continue;
+        unique = false;
+        fprintf(stderr, "Error: several inputs render to %s:", sorted[k]);
+        for (uint32_t j = 0; j < count; j++)
+            if (strcmp(outs[j], sorted[k]) == 0)
+                fprintf(stderr, " %s", paths[j]);
+        fprintf(stderr, "\n");
+    }
+    free(sorted);
+    return unique;
+}
+
+/* Append the non-empty lines of @fp to @paths. Returns false on OOM. */
+static bool read_list(FILE *fp, char ***paths, uint32_t *count, uint32_t *cap)
+{
+    char line[4096];
+
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (*count == *cap) {
+            *cap = *cap ? *cap * 2 : 64;
+            char **grown = realloc(*paths, *cap * sizeof(char *));
+            if (!grown)
+                return false;
+            *paths = grown;
+        }
+        if (!((*paths)[*count] = strdup(line)))
+            return false;
+        (*count)++;
+    }
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-j threads] [-l list|-] [-o dir] [-v voices]"
+            " [-c cache_kb] [-q] [files...]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long voices = 8, cache_kb = 0;
+    const char *list = NULL, *out_dir = ".";
+    bool quiet = false;
+    char **paths = NULL;
+    uint32_t count = 0, cap = 0;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            list = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_kb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            quiet = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1 || voices == 0 || voices > SONG_MAX_VOICES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool ok = true;
+    for (; i < argc && ok; i++) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(paths, cap * sizeof(char *));
+            ok = grown != NULL;
+            paths = grown ? grown : paths;
+        }
+        if (ok && !(paths[count++] = strdup(argv[i])))
+            ok = false;
+    }
+    if (ok && list) {
+        FILE *fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+        if (!fp) {
+            fprintf(stderr, "Error: cannot open %s\n", list);
+            return 1;
+        }
+        ok = read_list(fp, &paths, &count, &cap);
+        if (fp != stdin)
+            fclose(fp);
+    }
+    if (ok && count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char **outs = ok ? calloc(count, sizeof(char *)) : NULL;
+    ok = outs != NULL;
+    for (uint32_t k = 0; k < count && ok; k++)
+        ok = (outs[k] = output_path(out_dir, paths[k])) != NULL;
+    if (ok && !check_outputs(paths, outs, count))
+        return 1;
+
+    farm_t farm = {
+        .paths = paths,
+        .outs = outs,
+        .results = ok ? calloc(count, sizeof(result_t)) : NULL,
+        .count = count,
+        .out_dir = out_dir,
+        .voices = (uint8_t) voices,
+        .cache_bytes = (size_t) cache_kb * 1024,
+    };
+    pthread_t *tids = calloc((size_t) threads, sizeof(pthread_t));
+    if (!ok || !farm.results || !tids) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    pthread_mutex_init(&farm.lock, NULL);
+
+    uint64_t t0 = now_ns();
+    long started = 0;
+    for (; started < threads && (uint32_t) started < count; started++)
+        if (pthread_create(&tids[started], NULL, worker, &farm) != 0)
+            break;
+    if (started == 0)
+        worker(&farm);
+    for (long t = 0; t < started; t++)
+        pthread_join(tids[t], NULL);
+    uint64_t wall = now_ns() - t0;
+
+    uint64_t samples = 0;
+    uint32_t failed = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        const result_t *r = &farm.results[k];
+        double secs = (double) r->samples / SAMPLE_RATE;
+        if (r->error) {
+            failed++;
+            fprintf(stderr, "%s: %s\n", r->path, r->error);
+            continue;
+        }
+        samples += r->samples;
+        if (!quiet)
+            printf("%-40s %8.2f s audio  parse %7.2f ms  render %8.2f ms"
+                   "  %7.1fx\n",
+                   r->path, secs, (double) r->parse_ns / 1e6,
+                   (double) r->render_ns / 1e6,
+                   r->render_ns ? secs * 1e9 / (double) r->render_ns : 0);
+    }
+
+    double audio = (double) samples / SAMPLE_RATE;
+    printf("files:     %u rendered, %u failed on %ld threads\n",
+           count - failed, failed, started ? started : 1);
+    printf("audio:     %.1f s\n", audio);
+    printf("wall:      %.1f ms (%.1fx realtime)\n", (double) wall / 1e6,
+           wall ? audio * 1e9 / (double) wall : 0);
+    printf("per core:  %.1fx realtime (busy %.1f ms)\n",
+           farm.busy_ns ? audio * 1e9 / (double) farm.busy_ns : 0,
+           (double) farm.busy_ns / 1e6);
+    if (cache_kb) {
+        uint32_t lookups = farm.cache.hits + farm.cache.misses;
+        printf("cache:     %.1f%% hits, %u evictions\n",
+               lookups ? 100.0 * farm.cache.hits / lookups : 0,
+               farm.cache.evictions);
+    }
+
+    pthread_mutex_destroy(&farm.lock);
+    for (uint32_t k = 0; k < count; k++) {
+        free(paths[k]);
+        free(outs[k]);
+    }
+    free(paths);
+    free(outs);
+    free(farm.results);
+    free(tids);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * rtbench - Measure per-block render time of the synthesizer
+ *
+ * Usage:
+ *   rtbench                  # 20000 blocks, 8 voices
+ *   rtbench -n 50000 -v 12   # Override block and voice counts
+ *
+ * Renders a workload that alternates between silence, sparse notes and
+ * full polyphony, timing every PICOSYNTH_BLOCK_SIZE-sample block with a
+ * monotonic clock. Reports min/max/mean/stddev and tail percentiles of the
+ * block time so the default kernel can be compared against a
+ * PICOSYNTH_CONSTANT_TIME=1 build. On a non-realtime host the maximum
+ * includes scheduler preemption; the percentiles show the kernel itself:
+ *
+ *   make bench
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "picosynth.h"
+
+#define NODES_PER_VOICE 6
+
+/* Two oscillators mixed into an SVF, with separate amplitude and filter
+ * envelopes. The hold stage makes the workload visit every envelope phase.
+ */
+static void setup_voice(picosynth_voice_t *v, int idx)
+{
+    picosynth_node_t *amp = picosynth_voice_get_node(v, 0);
+    picosynth_node_t *osc = picosynth_voice_get_node(v, 1);
+    picosynth_node_t *flt = picosynth_voice_get_node(v, 2);
+    picosynth_node_t *fenv = picosynth_voice_get_node(v, 3);
+    picosynth_node_t *sub = picosynth_voice_get_node(v, 4);
+    picosynth_node_t *mix = picosynth_voice_get_node(v, 5);
+
+    picosynth_init_env_ms(amp, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 5,
+                              .hold_ms = 20,
+                              .dec_ms = 150,
+                              .sus_pct = 60,
+                              .rel_ms = 120,
+                          });
+    picosynth_init_env_ms(fenv, NULL,
+                          &(picosynth_env_ms_params_t) {
+                              .atk_ms = 2,
+                              .dec_ms = 300,
+                              .sus_pct = 30,
+                              .rel_ms = 200,
+                          });
+    picosynth_init_osc(osc, &amp->out, picosynth_voice_freq_ptr(v),
+                       (idx & 1) ? picosynth_wave_saw : picosynth_wave_sine);
+    picosynth_init_osc(sub, &amp->out, picosynth_voice_freq_ptr(v),
+                       picosynth_wave_triangle);
+    picosynth_init_mix(mix, NULL, &osc->out, &sub->out, NULL);
+    picosynth_init_svf_lp(flt, &fenv->out, &mix->out, picosynth_svf_freq(1500),
+                          Q15_MAX / 2);
+    picosynth_voice_set_out(v, 2);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* Deterministic event pattern: phases of silence, sparse and dense play */
+static void schedule(picosynth_t *s, uint8_t voices, uint32_t block)
+{
+    static uint32_t rng = 0x2545F491;
+    uint32_t phase = (block / 500) % 3;
+
+    rng = rng * 1664525u + 1013904223u;
+    uint8_t voice = (uint8_t) ((rng >> 24) % voices);
+    uint8_t note = (uint8_t) (36 + (rng >> 8) % 48);
+
+    if (phase == 0) {
+        picosynth_note_off(s, voice);
+    } else if (phase == 1) {
+        if ((rng & 0xF) == 0)
+            picosynth_note_on(s, voice, note);
+        else if ((rng & 0xF) == 1)
+            picosynth_note_off(s, voice);
+    } else {
+        if ((rng & 0x3) == 0)
+            picosynth_note_on(s, voice, note);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t blocks = 20000;
+    uint8_t voices = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc) {
+            blocks = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-' && argv[i][1] == 'v' && i + 1 < argc) {
+            voices = (uint8_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [-n blocks] [-v voices]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (blocks == 0 || voices == 0) {
+        fprintf(stderr, "Error: block and voice counts must be positive\n");
+        return 1;
+    }
+
+    uint64_t *times = malloc(sizeof(uint64_t) * blocks);
+    picosynth_t *s = picosynth_create(voices, NODES_PER_VOICE);
+    if (!s || !times) {
+        fprintf(stderr, "Error: failed to create synth\n");
+        picosynth_destroy(s);
+        free(times);
+        return 1;
+    }
+    for (uint8_t i = 0; i < voices; i++)
+        setup_voice(picosynth_get_voice(s, i), i);
+
+    q15_t buf[PICOSYNTH_BLOCK_SIZE];
+    double sum = 0, sum_sq = 0;
+    uint64_t min_ns = UINT64_MAX, max_ns = 0;
+    int32_t checksum = 0;
+
+    for (uint32_t b = 0; b < blocks; b++) {
+        schedule(s, voices, b);
+        uint64_t t0 = now_ns();
+        picosynth_render(s, buf, PICOSYNTH_BLOCK_SIZE);
+        uint64_t dt = now_ns() - t0;
+
+        times[b] = dt;
+        checksum += buf[b % PICOSYNTH_BLOCK_SIZE];
+        if (dt < min_ns)
+            min_ns = dt;
+        if (dt > max_ns)
+            max_ns = dt;
+        sum += (double) dt;
+        sum_sq += (double) dt * (double) dt;
+    }
+    picosynth_destroy(s);
+
+    double mean = sum / blocks;
+    double var = sum_sq / blocks - mean * mean;
+    double stddev = var > 0 ? sqrt(var) : 0;
+    double budget_ns = 1e9 * PICOSYNTH_BLOCK_SIZE / SAMPLE_RATE;
+    qsort(times, blocks, sizeof(uint64_t), cmp_u64);
+
+    printf("mode:      %s\n",
+           PICOSYNTH_CONSTANT_TIME ? "constant-time" : "default");
+    printf("blocks:    %u x %d samples, %u voices @ %d Hz\n", blocks,
+           PICOSYNTH_BLOCK_SIZE, voices, SAMPLE_RATE);
+    printf("min:       %llu ns\n", (unsigned long long) min_ns);
+    printf("max:       %llu ns\n", (unsigned long long) max_ns);
+    printf("mean:      %.1f ns\n", mean);
+    printf("stddev:    %.1f ns (%.1f%% of mean)\n", stddev,
+           mean > 0 ? 100.0 * stddev / mean : 0);
+    printf("p50:       %llu ns\n", (unsigned long long) times[blocks / 2]);
+    printf("p99:       %llu ns\n",
+           (unsigned long long) times[(uint64_t) blocks * 99 / 100]);
+    printf("p99.9:     %llu ns\n",
+           (unsigned long long) times[(uint64_t) blocks * 999 / 1000]);
+    printf("p99/p50:   %.2f\n",
+           (double) times[(uint64_t) blocks * 99 / 100] /
+               (double) (times[blocks / 2] ? times[blocks / 2] : 1));
+    printf("load:      %.2f%% of realtime (mean), %.2f%% (max)\n",
+           100.0 * mean / budget_ns, 100.0 * (double) max_ns / budget_ns);
+    printf("checksum:  %d\n", checksum);
+    free(times);
+    return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * segrender - Render a song on several cores by splitting it into segments
+ *
+ * Usage:
+ *   segrender song.txt                 # All cores, 2 s segments -> out.wav
+ *   segrender song.mid -j 4 -s 500     # 4 threads, 500 ms segments
+ *   segrender song.mid -d --verify     # Compare against a sequential render
+ *
+ * Options:
+ *   -j N        Worker threads (default: online CPUs)
+ *   -s MS       Segment length in milliseconds (default: 2000)
+ *   -v N        Synth voices (default: 8)
+ *   -o FILE     Output WAV (default: out.wav)
+ *   -d          Deterministic noise: reseed each voice's LFSR at note-on
+ *   -c KB       Rendered-note cache per worker (implies -d)
+ *   --verify    Also render sequentially; report differences and speedup
+ *
+ * Every segment is rendered by its own instance. Since a note-on fully
+ * resets its voice, the state at a segment boundary depends only on the
+ * notes still sounding there: a worker replays the note events up to the
+ * boundary without rendering, finds the earliest note-on among the audible
+ * voices (song_player_warm_start) and renders from there, discarding the
+ * samples before the boundary. With -d the noise sequence is also a
+ * function of the note and the output is bit-identical to a sequential
+ * render; without it only the noise component differs.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "wav.h"
+
+#define CHUNK 1024
+
+/* Minimum pre-roll so the master DC blocker settles before the boundary */
+#define PREROLL PICOSYNTH_MS(50)
+
+typedef struct {
+    const song_t *song;
+    q15_t *out;
+    uint32_t total;
+    uint32_t seg_len;
+    uint32_t n_segs;
+    uint8_t voices;
+    bool per_note;
+    size_t cache_bytes; /* Per worker, 0 = no cache */
+    pthread_mutex_t lock;
+    uint32_t next_seg;
+    uint64_t warmup; /* Samples rendered and discarded, all segments */
+    song_cache_stats_t cache; /* Summed over workers */
+    bool failed;
+} job_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static picosynth_t *make_synth(const job_t *job)
+{
+    picosynth_t *s = song_patch_create(&song_patch_piano, job->voices);
+    if (s && job->per_note)
+        picosynth_set_noise_seed(s, 0, true);
+    return s;
+}
+
+/* Render [begin, end) of the song into job->out */
+static bool render_segment(job_t *job,
+                           song_cache_t *cache,
+                           uint32_t begin,
+                           uint32_t end)
+{
+    song_player_t p;
+    q15_t scratch[CHUNK];
+
+    picosynth_t *s = make_synth(job);
+    if (!s)
+        return false;
+
+    /* Find the warm start from the allocator state at the boundary */
+    song_player_init(&p, s, &song_patch_piano, job->song);
+    song_player_skip(&p, begin);
+    uint32_t start = song_player_warm_start(&p);
+    if (start > begin - (begin < PREROLL ? begin : PREROLL))
+        start = begin - (begin < PREROLL ? begin : PREROLL);
+
+    song_player_init(&p, s, &song_patch_piano, job->song);
+    song_player_set_cache(&p, cache);
+    song_player_skip(&p, start);
+    for (uint32_t pos = start; pos < begin;) {
+        uint32_t n = begin - pos < CHUNK ? begin - pos : CHUNK;
+        pos += song_player_render(&p, scratch, n);
+    }
+    for (uint32_t pos = begin; pos < end;) {
+        uint32_t n = song_player_render(&p, job->out + pos, end - pos);
+        if (n == 0)
+            break;
+        pos += n;
+    }
+    song_player_set_cache(&p, NULL);
+    picosynth_destroy(s);
+
+    pthread_mutex_lock(&job->lock);
+    job->warmup += begin - start;
+    pthread_mutex_unlock(&job->lock);
+    return true;
+}
+
+static void *worker(void *arg)
+{
+    job_t *job = arg;
+    song_cache_t *cache = NULL;
+
+    if (job->cache_bytes && !(cache = song_cache_create(job->cache_bytes))) {
+        pthread_mutex_lock(&job->lock);
+        job->failed = true;
+        pthread_mutex_unlock(&job->lock);
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t seg = job->next_seg++;
+        pthread_mutex_unlock(&job->lock);
+        if (seg >= job->n_segs)
+            break;
+
+        uint32_t begin = seg * job->seg_len;
+        uint32_t end = begin + job->seg_len;
+        if (end > job->total)
+            end = job->total;
+        if (!render_segment(job, cache, begin, end)) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = true;
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+    }
+
+    if (cache) {
+        song_cache_stats_t st;
+        song_cache_get_stats(cache, &st);
+        pthread_mutex_lock(&job->lock);
+        job->cache.hits += st.hits;
+        job->cache.misses += st.misses;
+        job->cache.evictions += st.evictions;
+        job->cache.bytes += st.bytes;
+        pthread_mutex_unlock(&job->lock);
+        song_cache_destroy(cache);
+    }
+    return NULL;
+}
+
+static bool render_sequential(const job_t *job, q15_t *out)
+{
+    song_player_t p;
+    picosynth_t *s = make_synth(job);
+    if (!s)
+        return false;
+    song_player_init(&p, s, &song_patch_piano, job->song);
+    uint32_t pos = 0, n;
+    while ((n = song_player_render(&p, out + pos, CHUNK)) > 0)
+        pos += n;
+    picosynth_destroy(s);
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-j threads] [-s segment_ms] [-v voices] [-o out.wav]"
+            " [-d] [-c cache_kb] [--verify] song.txt|song.mid\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *output = "out.wav";
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t seg_ms = 2000;
+    unsigned long voices = 8;
+    unsigned long cache_kb = 0;
+    bool per_note = false, verify = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seg_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_kb = strtoul(argv[++i], NULL, 10);
+            per_note = true;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            per_note = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (argv[i][0] != '-' && !input) {
+            input = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!input || threads < 1 || seg_ms == 0 || voices == 0 ||
+        voices > SONG_MAX_VOICES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    song_t song;
+    song_error_t err = song_load_file(&song, input);
+    if (err != SONG_OK) {
+        fprintf(stderr, "Error: cannot load %s (error %d)\n", input, err);
+        return 1;
+    }
+
+    job_t job = {
+        .song = &song,
+        .total = song.length + song_patch_piano.tail,
+        .seg_len = PICOSYNTH_MS(seg_ms),
+        .voices = (uint8_t) voices,
+        .per_note = per_note,
+        .cache_bytes = (size_t) cache_kb * 1024,
+    };
+    if (job.seg_len == 0)
+        job.seg_len = 1;
+    job.n_segs = (job.total + job.seg_len - 1) / job.seg_len;
+    job.out = calloc(job.total ? job.total : 1, sizeof(q15_t));
+    pthread_t *tids = calloc((size_t) threads, sizeof(pthread_t));
+    if (!job.out || !tids) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(job.out);
+        free(tids);
+        song_free(&song);
+        return 1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    uint64_t t0 = now_ns();
+    long started = 0;
+    for (; started < threads; started++)
+        if (pthread_create(&tids[started], NULL, worker, &job) != 0)
+            break;
+    if (started == 0)
+        worker(&job);
+    for (long i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    uint64_t t_par = now_ns() - t0;
+
+    int ret = 0;
+    if (job.failed) {
+        fprintf(stderr, "Error: failed to create synth\n");
+        ret = 1;
+        goto out;
+    }
+
+    double secs = (double) job.total / SAMPLE_RATE;
+    printf("song:      %u events, %.2f s\n", song.count, secs);
+    printf("segments:  %u x %u ms on %ld threads\n", job.n_segs, seg_ms,
+           started ? started : 1);
+    printf("warm-up:   %.1f%% extra samples rendered\n",
+           job.total ? 100.0 * (double) job.warmup / job.total : 0);
+    if (cache_kb) {
+        uint32_t lookups = job.cache.hits + job.cache.misses;
+        printf("cache:     %.1f%% hits, %u evictions, %zu KiB in use\n",
+               lookups ? 100.0 * job.cache.hits / lookups : 0,
+               job.cache.evictions, job.cache.bytes / 1024);
+    }
+    printf("parallel:  %.1f ms (%.1fx realtime)\n", (double) t_par / 1e6,
+           t_par ? secs * 1e9 / (double) t_par : 0);
+
+    if (verify) {
+        q15_t *ref = calloc(job.total ? job.total : 1, sizeof(q15_t));
+        if (!ref) {
+            fprintf(stderr, "Error: out of memory\n");
+            ret = 1;
+            goto out;
+        }
+        t0 = now_ns();
+        if (!render_sequential(&job, ref)) {
+            fprintf(stderr, "Error: failed to create synth\n");
+            free(ref);
+            ret = 1;
+            goto out;
+        }
+        uint64_t t_seq = now_ns() - t0;
+
+        uint32_t diffs = 0;
+        int max_diff = 0;
+        for (uint32_t i = 0; i < job.total; i++) {
+            int d = abs((int) ref[i] - (int) job.out[i]);
+            if (d > 0)
+                diffs++;
+            if (d > max_diff)
+                max_diff = d;
+        }
+        free(ref);
+        printf("serial:    %.1f ms (%.1fx realtime)\n", (double) t_seq / 1e6,
+               t_seq ? secs * 1e9 / (double) t_seq : 0);
+        printf("speedup:   %.2fx\n",
+               t_par ? (double) t_seq / (double) t_par : 0);
+        printf("verify:    %u of %u samples differ, max |diff| %d%s\n", diffs,
+               job.total, max_diff, per_note ? "" : " (use -d for exact)");
+    }
+
+    if (wav_write_file(output, job.out, job.total) != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", output);
+        ret = 1;
+    } else {
+        printf("output:    %s\n", output);
+    }
+
+out:
+    pthread_mutex_destroy(&job.lock);
+    free(tids);
+    free(job.out);
+    song_free(&song);
+    return ret;
+}
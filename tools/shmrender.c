@@ -0,0 +1,159 @@
+/*
+ * shmrender - Render a song into a shared-memory ring for another process
+ *
+ * Usage:
+ *   shmwav out.wav & shmrender song.mid      # Consumer first or second
+ *   shmrender song.txt -r -b 128 -k 4        # Realtime, 4 x 128 samples
+ *
+ * Options:
+ *   -n NAME     Shared memory name (default: /picosynth)
+ *   -b N        Samples per slot (default: 256)
+ *   -k N        Slots in the ring (default: 8)
+ *   -v N        Synth voices (default: 8)
+ *   -r          Publish at the realtime rate instead of as fast as possible
+ *   -t SEC      Give up if no consumer attaches in time (default: 10)
+ *
+ * The ring is described in tools/shmring.h. Blocks are rendered directly
+ * into the slot the consumer will read, so the only copy of the audio is
+ * the one synthesis writes. Without -r a full ring throttles rendering to
+ * the consumer's pace; with -r the ring holds the consumer's slack and the
+ * producer reports how often it found no free slot on time.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+#include "shmring.h"
+#include "song.h"
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t) (t / 1000000000ull),
+        .tv_nsec = (long) (t % 1000000000ull),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-n name] [-b block] [-k slots] [-v voices] [-r]"
+            " [-t seconds] <song.txt|song.mid>\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = SHMRING_DEFAULT_NAME, *input = NULL;
+    unsigned long block = 256, slots = 8, voices = 8, timeout = 10;
+    bool paced = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            block = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            slots = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            timeout = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            paced = true;
+        } else if (argv[i][0] != '-' && !input) {
+            input = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!input || block == 0 || block > 65536 || slots == 0 ||
+        slots > 1024 || voices == 0 || voices > SONG_MAX_VOICES ||
+        timeout > 3600) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    song_t song;
+    if (song_load_file(&song, input) != SONG_OK) {
+        fprintf(stderr, "Error: cannot load %s\n", input);
+        return 1;
+    }
+    picosynth_t *s = song_patch_create(&song_patch_piano, (uint8_t) voices);
+    if (!s) {
+        fprintf(stderr, "Error: out of memory\n");
+        song_free(&song);
+        return 1;
+    }
+
+    shmring_t ring;
+    if (shmring_create(&ring, name, (uint32_t) block, (uint32_t) slots) <
+        0) {
+        perror(name);
+        picosynth_destroy(s);
+        song_free(&song);
+        return 1;
+    }
+    fprintf(stderr, "shmrender: waiting for a consumer on %s\n", name);
+    if (!shmring_wait_attached(&ring, (uint32_t) timeout * 1000)) {
+        fprintf(stderr, "Error: no consumer attached\n");
+        shmring_close(&ring);
+        picosynth_destroy(s);
+        song_free(&song);
+        return 1;
+    }
+
+    song_player_t p;
+    song_player_init(&p, s, &song_patch_piano, &song);
+    uint64_t period = (uint64_t) block * 1000000000ull / SAMPLE_RATE;
+    uint64_t t0 = shmring_now_ns(), next = t0, blocks = 0, late = 0;
+    uint64_t samples = 0;
+    int ret = 0;
+    for (;;) {
+        if (paced)
+            sleep_until(next);
+        shmring_slot_t *slot = shmring_acquire(&ring);
+        if (!slot) {
+            fprintf(stderr, "Error: consumer went away\n");
+            ret = 1;
+            break;
+        }
+        if (paced) {
+            late += shmring_now_ns() > next + period;
+            next += period;
+        }
+        uint32_t n = song_player_render(&p, shmring_pcm(slot),
+                                        (uint32_t) block);
+        if (n == 0)
+            break;
+        slot->frames = n;
+        shmring_publish(&ring, slot);
+        blocks++;
+        samples += n;
+    }
+    uint64_t wall = shmring_now_ns() - t0;
+    shmring_close(&ring);
+
+    fprintf(stderr,
+            "shmrender: %llu blocks, %.2f s audio in %.2f s (%.1fx realtime)"
+            "%s",
+            (unsigned long long) blocks, (double) samples / SAMPLE_RATE,
+            (double) wall / 1e9,
+            wall ? (double) samples / SAMPLE_RATE * 1e9 / (double) wall : 0,
+            paced ? "" : "\n");
+    if (paced)
+        fprintf(stderr, ", %llu blocks waited past their slot\n",
+                (unsigned long long) late);
+
+    picosynth_destroy(s);
+    song_free(&song);
+    return ret;
+}
@@ -0,0 +1,319 @@
+/*
+ * shmring.h - Single-producer/single-consumer audio ring in shared memory
+ *
+ * A producer process renders blocks straight into slots of a POSIX shared
+ * memory object and a consumer process maps the same object and reads
+ * them in place, so PCM crosses the process boundary without a copy.
+ * Slot indices double as futex words: a side that finds the ring empty
+ * (consumer) or full (producer) sleeps in FUTEX_WAIT on the other side's
+ * index, and is woken only if it announced itself as waiting, so a busy
+ * stream makes no system calls at all.
+ *
+ *   producer                          consumer
+ *   shmring_create(&r, name, ...)     shmring_attach(&r, name)
+ *   shmring_wait_attached(&r, 0)
+ *   s = shmring_acquire(&r)           while ((s = shmring_next(&r))) {
+ *   render(shmring_pcm(s))                use(shmring_pcm(s))
+ *   shmring_publish(&r, s)                shmring_release(&r)
+ *   ...                               }
+ *   shmring_close(&r)                 shmring_detach(&r)
+ *
+ * The name is unlinked once the consumer has attached; both sides keep
+ * their mapping. Each side checks the other's pid while waiting, so a peer
+ * that dies does not leave the survivor blocked forever.
+ */
+
+#ifndef TOOLS_SHMRING_H_
+#define TOOLS_SHMRING_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+
+#define SHMRING_MAGIC 0x52485350u /* "PSHR" */
+#define SHMRING_DEFAULT_NAME "/picosynth"
+
+enum {
+    SHMRING_OPEN,
+    SHMRING_ATTACHED, /* Consumer mapped the ring */
+    SHMRING_CLOSED,   /* Producer published its last slot */
+};
+
+/* Slot header; @frames samples follow at the next cache line */
+typedef struct {
+    uint32_t frames;
+    uint32_t seq;
+    uint64_t render_ns;  /* CLOCK_MONOTONIC when rendering started */
+    uint64_t publish_ns; /* CLOCK_MONOTONIC when published */
+} shmring_slot_t;
+
+typedef struct {
+    _Atomic uint32_t magic;
+    uint32_t sample_rate;
+    uint32_t block; /* Samples per slot */
+    uint32_t n_slots;
+    uint32_t stride; /* Bytes per slot, header included */
+    int32_t producer_pid;
+    /* Free-running indices, each written by one side only */
+    _Alignas(64) _Atomic uint32_t head; /* Next slot to consume */
+    _Atomic uint32_t consumer_waiting;
+    _Atomic int32_t consumer_pid; /* 0 before attach, -1 after detach */
+    _Alignas(64) _Atomic uint32_t tail; /* Next slot to publish */
+    _Atomic uint32_t producer_waiting;
+    _Alignas(64) _Atomic uint32_t state;
+} shmring_hdr_t;
+
+typedef struct {
+    shmring_hdr_t *hdr;
+    uint8_t *slots;
+    size_t size;
+    char name[64];
+} shmring_t;
+
+static inline uint64_t shmring_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline size_t shmring_hdr_size(void)
+{
+    return (sizeof(shmring_hdr_t) + 63) & ~(size_t) 63;
+}
+
+/* Sleep while *@word == @seen, for at most 100 ms. Waiting is announced
+ * before the final check; the waker updates the word before looking at the
+ * flag, and both accesses are sequentially consistent, so a wakeup cannot
+ * fall between the check and the sleep.
+ */
+static inline void shmring_wait(_Atomic uint32_t *word,
+                                uint32_t seen,
+                                _Atomic uint32_t *waiting)
+{
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = 100000000};
+    atomic_store(waiting, 1);
+    if (atomic_load(word) == seen)
+        syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, seen, &timeout,
+                NULL, 0);
+    atomic_store(waiting, 0);
+}
+
+static inline void shmring_wake(_Atomic uint32_t *word,
+                                _Atomic uint32_t *waiting)
+{
+    if (atomic_load(waiting))
+        syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static inline bool shmring_alive(int32_t pid)
+{
+    return pid == 0 || (pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH));
+}
+
+static inline bool shmring_map(shmring_t *r, int fd, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    r->hdr = p;
+    r->slots = (uint8_t *) p + shmring_hdr_size();
+    r->size = size;
+    return true;
+}
+
+/* Producer: create @name holding @n_slots slots of @block samples.
+ * Returns 0, or -1 with errno set (EEXIST if the name is in use).
+ */
+static inline int shmring_create(shmring_t *r,
+                                 const char *name,
+                                 uint32_t block,
+                                 uint32_t n_slots)
+{
+    size_t len = strlen(name);
+    if (len >= sizeof(r->name) || block == 0 || n_slots == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(r->name, name, len + 1);
+
+    uint32_t stride = (uint32_t) ((sizeof(shmring_slot_t) + 63) & ~63u);
+    stride += (uint32_t) ((block * sizeof(q15_t) + 63) & ~(size_t) 63);
+    size_t size = shmring_hdr_size() + (size_t) stride * n_slots;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0 || !shmring_map(r, fd, size)) {
+        int err = errno;
+        shm_unlink(name);
+        errno = err;
+        return -1;
+    }
+
+    shmring_hdr_t *h = r->hdr;
+    h->sample_rate = SAMPLE_RATE;
+    h->block = block;
+    h->n_slots = n_slots;
+    h->stride = stride;
+    h->producer_pid = (int32_t) getpid();
+    atomic_store(&h->state, SHMRING_OPEN);
+    atomic_store(&h->magic, SHMRING_MAGIC);
+    return 0;
+}
+
+/* Consumer: map the ring published under @name. Returns 0 or -1. */
+static inline int shmring_attach(shmring_t *r, const char *name)
+{
+    struct stat st;
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < shmring_hdr_size()) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    if (!shmring_map(r, fd, (size_t) st.st_size))
+        return -1;
+
+    shmring_hdr_t *h = r->hdr;
+    if (atomic_load(&h->magic) != SHMRING_MAGIC ||
+        shmring_hdr_size() + (size_t) h->stride * h->n_slots > r->size ||
+        atomic_load(&h->state) != SHMRING_OPEN) {
+        munmap(r->hdr, r->size);
+        errno = EPROTO;
+        return -1;
+    }
+    r->name[0] = '\0';
+    atomic_store(&h->consumer_pid, (int32_t) getpid());
+    atomic_store(&h->state, SHMRING_ATTACHED);
+    shmring_wake(&h->state, &h->producer_waiting);
+    return 0;
+}
+
+/* Producer: wait for a consumer, then unlink the name. Returns false if
+ * @timeout_ms passes first (0 waits forever).
+ */
+static inline bool shmring_wait_attached(shmring_t *r, uint32_t timeout_ms)
+{
+    shmring_hdr_t *h = r->hdr;
+    uint64_t deadline = shmring_now_ns() + (uint64_t) timeout_ms * 1000000;
+    while (atomic_load(&h->state) == SHMRING_OPEN) {
+        if (timeout_ms && shmring_now_ns() >= deadline)
+            return false;
+        shmring_wait(&h->state, SHMRING_OPEN, &h->producer_waiting);
+    }
+    shm_unlink(r->name);
+    r->name[0] = '\0';
+    return true;
+}
+
+static inline shmring_slot_t *shmring_slot(const shmring_t *r, uint32_t i)
+{
+    uint32_t k = i % r->hdr->n_slots;
+    return (shmring_slot_t *) (r->slots + (size_t) k * r->hdr->stride);
+}
+
+static inline q15_t *shmring_pcm(shmring_slot_t *s)
+{
+    return (q15_t *) ((uint8_t *) s + ((sizeof(*s) + 63) & ~(size_t) 63));
+}
+
+/* Producer: next free slot, waiting while the ring is full. NULL if the
+ * consumer has gone away.
+ */
+static inline shmring_slot_t *shmring_acquire(shmring_t *r)
+{
+    shmring_hdr_t *h = r->hdr;
+    uint32_t tail = atomic_load_explicit(&h->tail, memory_order_relaxed);
+    for (;;) {
+        uint32_t head = atomic_load_explicit(&h->head, memory_order_acquire);
+        if (tail - head < h->n_slots)
+            break;
+        if (!shmring_alive(atomic_load(&h->consumer_pid)))
+            return NULL;
+        shmring_wait(&h->head, head, &h->producer_waiting);
+    }
+    shmring_slot_t *s = shmring_slot(r, tail);
+    s->seq = tail;
+    s->render_ns = shmring_now_ns();
+    return s;
+}
+
+/* Producer: hand the slot from shmring_acquire() to the consumer */
+static inline void shmring_publish(shmring_t *r, shmring_slot_t *s)
+{
+    shmring_hdr_t *h = r->hdr;
+    s->publish_ns = shmring_now_ns();
+    atomic_store(&h->tail, s->seq + 1);
+    shmring_wake(&h->tail, &h->consumer_waiting);
+}
+
+/* Producer: no more slots follow; unmaps the ring */
+static inline void shmring_close(shmring_t *r)
+{
+    shmring_hdr_t *h = r->hdr;
+    atomic_store(&h->state, SHMRING_CLOSED);
+    /* Sleeping consumers wait on tail */
+    if (atomic_load(&h->consumer_waiting))
+        syscall(SYS_futex, (uint32_t *) &h->tail, FUTEX_WAKE, 1, NULL, NULL,
+                0);
+    if (r->name[0])
+        shm_unlink(r->name);
+    munmap(r->hdr, r->size);
+    r->hdr = NULL;
+}
+
+/* Consumer: oldest published slot, waiting while the ring is empty. NULL
+ * once the producer has closed the ring and every slot was consumed, or
+ * if the producer died.
+ */
+static inline shmring_slot_t *shmring_next(shmring_t *r)
+{
+    shmring_hdr_t *h = r->hdr;
+    uint32_t head = atomic_load_explicit(&h->head, memory_order_relaxed);
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&h->tail, memory_order_acquire);
+        if (tail != head)
+            return shmring_slot(r, head);
+        if (atomic_load(&h->state) == SHMRING_CLOSED ||
+            !shmring_alive(h->producer_pid))
+            return NULL;
+        shmring_wait(&h->tail, tail, &h->consumer_waiting);
+    }
+}
+
+/* Consumer: hand the slot from shmring_next() back to the producer */
+static inline void shmring_release(shmring_t *r)
+{
+    shmring_hdr_t *h = r->hdr;
+    atomic_fetch_add(&h->head, 1);
+    shmring_wake(&h->head, &h->producer_waiting);
+}
+
+static inline void shmring_detach(shmring_t *r)
+{
+    atomic_store(&r->hdr->consumer_pid, -1);
+    munmap(r->hdr, r->size);
+    r->hdr = NULL;
+}
+
+#endif /* TOOLS_SHMRING_H_ */
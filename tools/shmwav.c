@@ -0,0 +1,182 @@
+/*
+ * shmwav - Reference consumer for tools/shmrender's shared-memory ring
+ *
+ * Usage:
+ *   shmwav out.wav                # Write the stream to a WAV file
+ *   shmwav                        # Consume and analyse only
+ *
+ * Options:
+ *   -n NAME     Shared memory name (default: /picosynth)
+ *   -t SEC      Wait this long for the producer to appear (default: 10)
+ *
+ * Samples are written to the file straight from the shared slots through
+ * an unbuffered stream, so the write system call is the only copy. For
+ * every block the consumer records two latencies, both on CLOCK_MONOTONIC
+ * which the processes share:
+ *   wakeup       producer published -> consumer holds the slot
+ *   end-to-end   producer started rendering -> block written and released
+ * Without realtime pacing the producer runs ahead until the ring is full,
+ * so end-to-end latency then includes the time blocks sit queued.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "picosynth.h"
+#include "shmring.h"
+#include "wav.h"
+
+typedef struct {
+    uint64_t *ns;
+    size_t n, cap;
+} lat_t;
+
+static bool lat_add(lat_t *l, uint64_t ns)
+{
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 1024;
+        uint64_t *p = realloc(l->ns, cap * sizeof(*p));
+        if (!p)
+            return false;
+        l->ns = p;
+        l->cap = cap;
+    }
+    l->ns[l->n++] = ns;
+    return true;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void lat_print(const char *name, lat_t *l)
+{
+    if (l->n == 0)
+        return;
+    qsort(l->ns, l->n, sizeof(*l->ns), cmp_u64);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < l->n; i++)
+        sum += l->ns[i];
+    printf("%-11s min %.1f  avg %.1f  p50 %.1f  p99 %.1f  max %.1f us\n",
+           name, (double) l->ns[0] / 1e3,
+           (double) sum / (double) l->n / 1e3,
+           (double) l->ns[l->n / 2] / 1e3,
+           (double) l->ns[l->n * 99 / 100] / 1e3,
+           (double) l->ns[l->n - 1] / 1e3);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n name] [-t seconds] [out.wav]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = SHMRING_DEFAULT_NAME, *output = NULL;
+    unsigned long timeout = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            timeout = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !output) {
+            output = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *f = NULL;
+    if (output) {
+        f = fopen(output, "wb");
+        if (!f) {
+            perror(output);
+            return 1;
+        }
+        setvbuf(f, NULL, _IONBF, 0);
+        wav_write_header(f, 0);
+    }
+
+    /* The producer may start after us, or be midway through creating */
+    shmring_t ring;
+    uint64_t give_up = shmring_now_ns() + (uint64_t) timeout * 1000000000ull;
+    while (shmring_attach(&ring, name) < 0) {
+        if ((errno != ENOENT && errno != EPROTO) ||
+            shmring_now_ns() >= give_up) {
+            perror(name);
+            if (f)
+                fclose(f);
+            return 1;
+        }
+        struct timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+        nanosleep(&ts, NULL);
+    }
+
+    lat_t wakeup = {0}, e2e = {0};
+    uint64_t blocks = 0, samples = 0, sum_sq = 0;
+    uint32_t peak = 0, expect = 0;
+    bool ok = true;
+    shmring_slot_t *slot;
+    while ((slot = shmring_next(&ring))) {
+        uint64_t seen = shmring_now_ns();
+        const q15_t *pcm = shmring_pcm(slot);
+        uint32_t n = slot->frames;
+        if (slot->seq != expect++ || n > ring.hdr->block) {
+            fprintf(stderr, "Error: corrupt slot %u\n", slot->seq);
+            ok = false;
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            int32_t x = pcm[i];
+            uint32_t a = (uint32_t) (x < 0 ? -x : x);
+            peak = a > peak ? a : peak;
+            sum_sq += (uint64_t) a * a;
+        }
+        if (f && fwrite(pcm, sizeof(q15_t), n, f) != n) {
+            perror(output);
+            ok = false;
+            break;
+        }
+        uint64_t render_ns = slot->render_ns;
+        ok &= lat_add(&wakeup, seen - slot->publish_ns);
+        shmring_release(&ring);
+        ok &= lat_add(&e2e, shmring_now_ns() - render_ns);
+        blocks++;
+        samples += n;
+    }
+    shmring_detach(&ring);
+
+    if (f) {
+        if (ok && (fseek(f, 0, SEEK_SET) != 0 ||
+                   wav_write_header(f, (uint32_t) samples) != 0)) {
+            perror(output);
+            ok = false;
+        }
+        if (fclose(f) != 0)
+            ok = false;
+    }
+
+    printf("blocks:     %llu, %.2f s of audio%s%s\n",
+           (unsigned long long) blocks, (double) samples / SAMPLE_RATE,
+           output ? " -> " : "", output ? output : "");
+    printf("level:      peak %.1f dBFS, rms %.1f dBFS\n",
+           peak ? 20 * log10((double) peak / 32768) : -INFINITY,
+           sum_sq ? 10 * log10((double) sum_sq / (double) samples /
+                               (32768.0 * 32768.0))
+                  : -INFINITY);
+    lat_print("wakeup:", &wakeup);
+    lat_print("end-to-end:", &e2e);
+
+    free(wakeup.ns);
+    free(e2e.ns);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+/*
+ * spsc.h - Bounded lock-free single-producer/single-consumer slot queue
+ *
+ * Slots are fixed-size and live in the queue, so producers fill a slot in
+ * place and consumers read it in place; nothing is copied or allocated per
+ * item. Exactly one thread may produce and one may consume.
+ *
+ *   void *slot = spsc_write_slot(q);   // NULL when full
+ *   fill(slot);
+ *   spsc_commit(q);
+ *   ...
+ *   const void *item = spsc_read_slot(q); // NULL when empty
+ *   use(item);
+ *   spsc_release(q);
+ */
+
+#ifndef TOOLS_SPSC_H_
+#define TOOLS_SPSC_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    /* Indices run freely and are masked on access; keep them on separate
+     * cache lines so producer and consumer do not false-share.
+     */
+    _Alignas(64) atomic_uint_fast32_t head; /* Next slot to read */
+    _Alignas(64) atomic_uint_fast32_t tail; /* Next slot to write */
+    _Alignas(64) uint32_t mask;
+    size_t slot_size;
+    uint8_t *slots;
+} spsc_t;
+
+/* @capacity must be a power of two */
+static inline bool spsc_init(spsc_t *q, uint32_t capacity, size_t slot_size)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)))
+        return false;
+    q->slots = calloc(capacity, slot_size);
+    if (!q->slots)
+        return false;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->mask = capacity - 1;
+    q->slot_size = slot_size;
+    return true;
+}
+
+static inline void spsc_free(spsc_t *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+/* Producer: free slot to fill, or NULL if the queue is full */
+static inline void *spsc_write_slot(spsc_t *q)
+{
+    uint_fast32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint_fast32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head > q->mask)
+        return NULL;
+    return q->slots + (tail & q->mask) * q->slot_size;
+}
+
+/* Producer: publish the slot returned by spsc_write_slot() */
+static inline void spsc_commit(spsc_t *q)
+{
+    uint_fast32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+/* Consumer: oldest filled slot, or NULL if the queue is empty */
+static inline void *spsc_read_slot(spsc_t *q)
+{
+    uint_fast32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint_fast32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+    return q->slots + (head & q->mask) * q->slot_size;
+}
+
+/* Consumer: hand the slot returned by spsc_read_slot() back */
+static inline void spsc_release(spsc_t *q)
+{
+    uint_fast32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+#endif /* TOOLS_SPSC_H_ */
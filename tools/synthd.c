@@ -0,0 +1,464 @@
+/*
+ * synthd - Local synthesis server over a Unix domain socket
+ *
+ * Usage:
+ *   synthd                          # Listen on /tmp/picosynth.sock
+ *   synthd -s /run/synth.sock -j 4  # Four render threads
+ *
+ * Options:
+ *   -s PATH     Socket path (default: /tmp/picosynth.sock)
+ *   -j N        Render threads (default: 2)
+ *   -v N        Voices per session (default: 8)
+ *   -q          Do not print per-session statistics
+ *
+ * Every connection is a session owning one picosynth_t wired with the
+ * piano patch, fed by the requests in tools/synthproto.h. The main thread
+ * accepts connections and hands each to the render thread with the fewest
+ * sessions; from then on that thread alone reads, renders and writes for
+ * the session through its own epoll set, so sessions need no locking.
+ * Sockets are non-blocking: a client that stops reading holds up only its
+ * own session, whose pending reply is finished when the socket drains.
+ * Statistics are printed when a session ends; SIGINT/SIGTERM shut down.
+ */
+
+#define _GNU_SOURCE /* accept4 */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "synthproto.h"
+
+#define MAX_PENDING 256 /* Queued note events per session */
+#define MAX_EVENTS 64   /* epoll_wait batch */
+
+typedef struct {
+    int fd;
+    uint32_t id;
+    picosynth_t *synth;
+    song_t song; /* Empty: events arrive over the socket */
+    song_player_t player;
+    uint32_t pos; /* Session sample clock */
+    song_event_t pending[MAX_PENDING]; /* Sorted by time */
+    uint32_t n_pending;
+    uint8_t in[64 * sizeof(synth_req_t)];
+    size_t in_len;
+    uint64_t in_ns; /* When in[] was last filled */
+    uint8_t *out; /* Reply being written */
+    size_t out_len, out_off;
+    uint64_t req_ns; /* When the RENDER being answered was read */
+    bool timing;
+    synth_stats_t stats;
+} session_t;
+
+typedef struct {
+    pthread_t tid;
+    int epfd;
+    int wake; /* eventfd: shutdown */
+    atomic_uint sessions;
+} worker_t;
+
+typedef struct {
+    uint8_t voices;
+    bool quiet;
+    pthread_mutex_t log_lock;
+    synth_stats_t total;
+    uint32_t finished;
+} server_t;
+
+static server_t server;
+static volatile sig_atomic_t stopping;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    stopping = 1;
+}
+
+static session_t *session_create(int fd, uint32_t id)
+{
+    session_t *s = calloc(1, sizeof(session_t));
+    if (!s)
+        return NULL;
+    s->out = malloc(sizeof(synth_reply_t) + SYNTH_MAX_RENDER * sizeof(q15_t));
+    s->synth = song_patch_create(&song_patch_piano, server.voices);
+    if (!s->out || !s->synth) {
+        free(s->out);
+        picosynth_destroy(s->synth);
+        free(s);
+        return NULL;
+    }
+    s->fd = fd;
+    s->id = id;
+    song_player_init(&s->player, s->synth, &song_patch_piano, &s->song);
+    return s;
+}
+
+static void session_destroy(session_t *s)
+{
+    synth_stats_t *st = &s->stats;
+    pthread_mutex_lock(&server.log_lock);
+    if (!server.quiet)
+        fprintf(stderr,
+                "session %u: %llu blocks, %llu samples, %llu events "
+                "(%llu late, %llu dropped), latency min/avg/p99/max "
+                "%.1f/%.1f/%.1f/%.1f us\n",
+                s->id, (unsigned long long) st->blocks,
+                (unsigned long long) st->samples,
+                (unsigned long long) st->events,
+                (unsigned long long) st->late,
+                (unsigned long long) st->dropped,
+                (double) st->lat_min_ns / 1e3,
+                st->blocks ? (double) st->lat_sum_ns / 1e3 / (double) st->blocks
+                           : 0,
+                (double) synth_stats_quantile(st, 0.99) / 1e3,
+                (double) st->lat_max_ns / 1e3);
+    synth_stats_t *t = &server.total;
+    if (st->blocks && (t->blocks == 0 || st->lat_min_ns < t->lat_min_ns))
+        t->lat_min_ns = st->lat_min_ns;
+    if (st->lat_max_ns > t->lat_max_ns)
+        t->lat_max_ns = st->lat_max_ns;
+    t->blocks += st->blocks;
+    t->samples += st->samples;
+    t->events += st->events;
+    t->late += st->late;
+    t->dropped += st->dropped;
+    t->lat_sum_ns += st->lat_sum_ns;
+    for (int k = 0; k < SYNTH_LAT_BUCKETS; k++)
+        t->lat_hist[k] += st->lat_hist[k];
+    server.finished++;
+    pthread_mutex_unlock(&server.log_lock);
+
+    close(s->fd);
+    picosynth_destroy(s->synth);
+    free(s->out);
+    free(s);
+}
+
+/* Insert keeping time order; equal times keep arrival order */
+static void session_queue(session_t *s, const synth_req_t *r)
+{
+    if (s->n_pending == MAX_PENDING) {
+        s->stats.dropped++;
+        return;
+    }
+    uint32_t i = s->n_pending++;
+    while (i > 0 && s->pending[i - 1].time > r->time) {
+        s->pending[i] = s->pending[i - 1];
+        i--;
+    }
+    s->pending[i] = (song_event_t) {
+        .time = r->time,
+        .type = r->type,
+        .note = r->note,
+    };
+    s->stats.events++;
+    if (r->time < s->pos)
+        s->stats.late++;
+}
+
+static void session_render(session_t *s, uint32_t n)
+{
+    synth_reply_t *hdr = (synth_reply_t *) s->out;
+    q15_t *pcm = (q15_t *) (s->out + sizeof(synth_reply_t));
+
+    if (n > SYNTH_MAX_RENDER)
+        n = SYNTH_MAX_RENDER;
+    uint32_t used = synth_render_span(&s->player, &s->pos, s->pending,
+                                      s->n_pending, pcm, n);
+    s->n_pending -= used;
+    memmove(s->pending, s->pending + used,
+            s->n_pending * sizeof(song_event_t));
+
+    hdr->type = SYNTH_REQ_RENDER;
+    hdr->count = n;
+    s->out_len = sizeof(synth_reply_t) + n * sizeof(q15_t);
+    s->out_off = 0;
+    s->stats.samples += n;
+}
+
+/* Write as much of the pending reply as the socket takes. Returns false if
+ * the connection failed.
+ */
+static bool session_flush(session_t *s)
+{
+    while (s->out_off < s->out_len) {
+        ssize_t w = send(s->fd, s->out + s->out_off, s->out_len - s->out_off,
+                         MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (w <= 0)
+            return false;
+        s->out_off += (size_t) w;
+    }
+    if (s->timing) {
+        synth_stats_add_latency(&s->stats, now_ns() - s->req_ns);
+        s->timing = false;
+    }
+    s->out_len = s->out_off = 0;
+    return true;
+}
+
+/* Handle buffered requests until one produces a reply the socket cannot
+ * take yet. Returns false if the connection failed.
+ */
+static bool session_process(session_t *s)
+{
+    size_t off = 0;
+
+    while (s->out_len == 0 && s->in_len - off >= sizeof(synth_req_t)) {
+        synth_req_t r;
+        memcpy(&r, s->in + off, sizeof(r));
+        off += sizeof(r);
+        switch (r.type) {
+        case SYNTH_REQ_NOTE_ON:
+        case SYNTH_REQ_NOTE_OFF:
+            session_queue(s, &r);
+            break;
+        case SYNTH_REQ_RENDER:
+            s->req_ns = s->in_ns;
+            s->timing = true;
+            session_render(s, r.count);
+            break;
+        case SYNTH_REQ_STATS: {
+            synth_reply_t hdr = {SYNTH_REQ_STATS, 0};
+            memcpy(s->out, &hdr, sizeof(hdr));
+            memcpy(s->out + sizeof(hdr), &s->stats, sizeof(s->stats));
+            s->out_len = sizeof(hdr) + sizeof(s->stats);
+            s->out_off = 0;
+            break;
+        }
+        default:
+            return false; /* Protocol error */
+        }
+        if (s->out_len && !session_flush(s))
+            return false;
+    }
+    s->in_len -= off;
+    memmove(s->in, s->in + off, s->in_len);
+    return true;
+}
+
+/* Readable: pull requests in. Replies are produced while the previous one
+ * is flushed, so input waits in the kernel while a reply is stuck.
+ */
+static bool session_readable(session_t *s)
+{
+    ssize_t r = read(s->fd, s->in + s->in_len, sizeof(s->in) - s->in_len);
+    if (r < 0 && (errno == EAGAIN || errno == EINTR))
+        return true;
+    if (r <= 0)
+        return false;
+    s->in_len += (size_t) r;
+    s->in_ns = now_ns();
+    return session_process(s);
+}
+
+/* Wait for output space only while a reply is incomplete */
+static void session_arm(worker_t *w, session_t *s)
+{
+    struct epoll_event ev = {
+        .events = s->out_len ? EPOLLOUT : EPOLLIN,
+        .data.ptr = s,
+    };
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL)
+                return NULL; /* Shutdown; open sessions die with us */
+            session_t *s = events[i].data.ptr;
+            bool was_blocked = s->out_len != 0;
+            bool ok = true;
+            if (events[i].events & (EPOLLERR | EPOLLHUP) &&
+                !(events[i].events & EPOLLIN))
+                ok = false;
+            if (ok && s->out_len)
+                ok = session_flush(s) && session_process(s);
+            else if (ok && events[i].events & EPOLLIN)
+                ok = session_readable(s);
+            if (!ok) {
+                epoll_ctl(w->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+                session_destroy(s);
+                atomic_fetch_sub(&w->sessions, 1);
+            } else if (was_blocked != (s->out_len != 0)) {
+                session_arm(w, s);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, 64) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s socket] [-j threads] [-v voices] [-q]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = SYNTH_DEFAULT_SOCKET;
+    unsigned long threads = 2, voices = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            server.quiet = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads == 0 || threads > 256 || voices == 0 ||
+        voices > SONG_MAX_VOICES) {
+        usage(argv[0]);
+        return 1;
+    }
+    server.voices = (uint8_t) voices;
+    pthread_mutex_init(&server.log_lock, NULL);
+
+    /* No SA_RESTART, so accept() returns on a signal */
+    struct sigaction sa = {.sa_handler = on_signal};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = listen_on(path);
+    if (lfd < 0)
+        return 1;
+
+    worker_t *workers = calloc(threads, sizeof(worker_t));
+    if (!workers) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    unsigned long started = 0;
+    for (; started < threads; started++) {
+        worker_t *w = &workers[started];
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->wake = eventfd(0, EFD_CLOEXEC);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+        if (w->epfd < 0 || w->wake < 0 ||
+            epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wake, &ev) < 0 ||
+            pthread_create(&w->tid, NULL, worker_main, w) != 0) {
+            perror("worker");
+            return 1;
+        }
+    }
+    fprintf(stderr, "synthd: listening on %s, %lu render threads\n", path,
+            threads);
+
+    uint32_t next_id = 0;
+    while (!stopping) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                perror("accept");
+            continue;
+        }
+        session_t *s = session_create(fd, next_id++);
+        if (!s) {
+            close(fd);
+            continue;
+        }
+
+        /* Least loaded worker takes the session for its lifetime */
+        worker_t *w = &workers[0];
+        for (unsigned long k = 1; k < threads; k++)
+            if (atomic_load(&workers[k].sessions) < atomic_load(&w->sessions))
+                w = &workers[k];
+        atomic_fetch_add(&w->sessions, 1);
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = s};
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            atomic_fetch_sub(&w->sessions, 1);
+            session_destroy(s);
+        }
+    }
+
+    /* Sessions still open are dropped with the process */
+    for (unsigned long k = 0; k < started; k++) {
+        uint64_t one = 1;
+        if (write(workers[k].wake, &one, sizeof(one)) != sizeof(one))
+            perror("eventfd");
+        pthread_join(workers[k].tid, NULL);
+    }
+    close(lfd);
+    unlink(path);
+
+    synth_stats_t *t = &server.total;
+    fprintf(stderr,
+            "synthd: %u sessions, %llu blocks, %llu events (%llu late), "
+            "latency avg/p99/max %.1f/%.1f/%.1f us\n",
+            server.finished, (unsigned long long) t->blocks,
+            (unsigned long long) t->events, (unsigned long long) t->late,
+            t->blocks ? (double) t->lat_sum_ns / 1e3 / (double) t->blocks : 0,
+            (double) synth_stats_quantile(t, 0.99) / 1e3,
+            (double) t->lat_max_ns / 1e3);
+    free(workers);
+    return 0;
+}
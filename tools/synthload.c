@@ -0,0 +1,334 @@
+/*
+ * synthload - Load generator and checker for tools/synthd
+ *
+ * Usage:
+ *   synthload                     # 8 clients, 5 s of audio each, realtime
+ *   synthload -c 64 -b 128 -f     # 64 clients, as fast as possible
+ *   synthload -c 4 --verify       # Compare every block to a local render
+ *
+ * Options:
+ *   -s PATH     Socket path (default: /tmp/picosynth.sock)
+ *   -c N        Concurrent sessions (default: 8)
+ *   -d SEC      Audio per session in seconds (default: 5)
+ *   -b N        Samples per RENDER request (default: 256)
+ *   -v N        Voices, must match the server for --verify (default: 8)
+ *   -f          Do not pace requests to realtime
+ *   --verify    Render the same events locally and compare sample by sample
+ *
+ * Each client plays its own pseudo-random notes, scheduled at arbitrary
+ * samples inside the block it is about to request, and measures the round
+ * trip of every RENDER. Paced clients request one block per block period,
+ * like a player keeping a single block queued; a reply slower than one
+ * period would have underrun it and is counted as a miss. At the end each
+ * client fetches its session's server-side statistics.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+#include "synthproto.h"
+
+#define MAX_BLOCK_EVENTS 4
+
+typedef struct {
+    const char *path;
+    uint32_t id;
+    uint32_t blocks, block;
+    uint8_t voices;
+    bool paced, verify;
+    /* Results */
+    const char *error;
+    synth_stats_t rtt; /* Client round trips */
+    synth_stats_t server;
+    uint64_t misses;
+    uint64_t mismatched; /* Samples differing from the local render */
+} client_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t) (t / 1000000000ull),
+        .tv_nsec = (long) (t % 1000000000ull),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+}
+
+static uint32_t rng_next(uint32_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static int connect_to(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* Up to MAX_BLOCK_EVENTS note events inside [pos, pos + n), in time order */
+static uint32_t make_events(uint32_t *rng,
+                            uint8_t *held,
+                            uint32_t pos,
+                            uint32_t n,
+                            song_event_t *ev)
+{
+    uint32_t count = 0, t = pos;
+
+    while (count < MAX_BLOCK_EVENTS) {
+        uint32_t r = rng_next(rng);
+        if ((r & 7) > 2)
+            break;
+        t += (r >> 8) % (pos + n - t);
+        if (*held && (r & 1)) {
+            ev[count++] = (song_event_t) {t, SONG_EVENT_NOTE_OFF, *held};
+            *held = 0;
+        } else {
+            uint8_t note = (uint8_t) (48 + (r >> 20) % 36);
+            ev[count++] = (song_event_t) {t, SONG_EVENT_NOTE_ON, note};
+            if (!*held)
+                *held = note;
+        }
+    }
+    return count;
+}
+
+static void *client_main(void *arg)
+{
+    client_t *c = arg;
+    q15_t *got = malloc(c->block * sizeof(q15_t));
+    q15_t *want = malloc(c->block * sizeof(q15_t));
+    picosynth_t *ref = song_patch_create(&song_patch_piano, c->voices);
+    song_t empty = {0};
+    song_player_t player;
+    int fd = connect_to(c->path);
+
+    if (fd < 0) {
+        c->error = "cannot connect";
+        goto out;
+    }
+    if (!got || !want || !ref) {
+        c->error = "out of memory";
+        goto out;
+    }
+    song_player_init(&player, ref, &song_patch_piano, &empty);
+
+    uint32_t rng = 0x9E3779B9u * (c->id + 1), pos = 0, ref_pos = 0;
+    uint8_t held = 0;
+    uint64_t period = (uint64_t) c->block * 1000000000ull / SAMPLE_RATE;
+    uint64_t next = now_ns();
+    for (uint32_t b = 0; b < c->blocks; b++) {
+        song_event_t ev[MAX_BLOCK_EVENTS];
+        synth_req_t req[MAX_BLOCK_EVENTS + 1];
+        uint32_t n_ev = make_events(&rng, &held, pos, c->block, ev);
+        for (uint32_t i = 0; i < n_ev; i++)
+            req[i] = (synth_req_t) {
+                .type = ev[i].type,
+                .note = ev[i].note,
+                .time = ev[i].time,
+            };
+        req[n_ev] = (synth_req_t) {.type = SYNTH_REQ_RENDER,
+                                   .count = c->block};
+
+        if (c->paced) {
+            sleep_until(next);
+            next += period;
+        }
+        uint64_t t0 = now_ns();
+        synth_reply_t hdr;
+        if (!synth_write_all(fd, req, (n_ev + 1) * sizeof(synth_req_t)) ||
+            !synth_read_all(fd, &hdr, sizeof(hdr)) ||
+            hdr.type != SYNTH_REQ_RENDER || hdr.count != c->block ||
+            !synth_read_all(fd, got, c->block * sizeof(q15_t))) {
+            c->error = "connection lost";
+            goto out;
+        }
+        uint64_t rtt = now_ns() - t0;
+        synth_stats_add_latency(&c->rtt, rtt);
+        c->misses += c->paced && rtt > period;
+        pos += c->block;
+
+        if (c->verify) {
+            synth_render_span(&player, &ref_pos, ev, n_ev, want, c->block);
+            for (uint32_t i = 0; i < c->block; i++)
+                c->mismatched += got[i] != want[i];
+        }
+    }
+
+    synth_req_t req = {.type = SYNTH_REQ_STATS};
+    synth_reply_t hdr;
+    if (!synth_write_all(fd, &req, sizeof(req)) ||
+        !synth_read_all(fd, &hdr, sizeof(hdr)) ||
+        hdr.type != SYNTH_REQ_STATS ||
+        !synth_read_all(fd, &c->server, sizeof(c->server)))
+        c->error = "connection lost";
+
+out:
+    if (fd >= 0)
+        close(fd);
+    picosynth_destroy(ref);
+    free(got);
+    free(want);
+    return NULL;
+}
+
+static void merge(synth_stats_t *t, const synth_stats_t *st)
+{
+    if (st->blocks && (t->blocks == 0 || st->lat_min_ns < t->lat_min_ns))
+        t->lat_min_ns = st->lat_min_ns;
+    if (st->lat_max_ns > t->lat_max_ns)
+        t->lat_max_ns = st->lat_max_ns;
+    t->blocks += st->blocks;
+    t->samples += st->samples;
+    t->events += st->events;
+    t->late += st->late;
+    t->dropped += st->dropped;
+    t->lat_sum_ns += st->lat_sum_ns;
+    for (int k = 0; k < SYNTH_LAT_BUCKETS; k++)
+        t->lat_hist[k] += st->lat_hist[k];
+}
+
+static void print_latency(const char *name, const synth_stats_t *st)
+{
+    printf("%s min %.1f  avg %.1f  p99 <%.1f  max %.1f us\n", name,
+           (double) st->lat_min_ns / 1e3,
+           st->blocks ? (double) st->lat_sum_ns / 1e3 / (double) st->blocks
+                      : 0,
+           (double) synth_stats_quantile(st, 0.99) / 1e3,
+           (double) st->lat_max_ns / 1e3);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-s socket] [-c clients] [-d seconds] [-b block]"
+            " [-v voices] [-f] [--verify]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = SYNTH_DEFAULT_SOCKET;
+    unsigned long clients = 8, block = 256, voices = 8;
+    double seconds = 5;
+    bool paced = true, verify = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            clients = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            seconds = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            block = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            paced = false;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (clients == 0 || clients > 4096 || block == 0 ||
+        block > SYNTH_MAX_RENDER || voices == 0 || voices > SONG_MAX_VOICES ||
+        !(seconds > 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint32_t blocks = (uint32_t) (seconds * SAMPLE_RATE / (double) block);
+    client_t *cl = calloc(clients, sizeof(client_t));
+    pthread_t *tids = calloc(clients, sizeof(pthread_t));
+    if (!cl || !tids) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    uint64_t t0 = now_ns();
+    unsigned long started = 0;
+    for (; started < clients; started++) {
+        cl[started] = (client_t) {
+            .path = path,
+            .id = (uint32_t) started,
+            .blocks = blocks ? blocks : 1,
+            .block = (uint32_t) block,
+            .voices = (uint8_t) voices,
+            .paced = paced,
+            .verify = verify,
+        };
+        if (pthread_create(&tids[started], NULL, client_main, &cl[started]))
+            break;
+    }
+    for (unsigned long k = 0; k < started; k++)
+        pthread_join(tids[k], NULL);
+    uint64_t wall = now_ns() - t0;
+
+    synth_stats_t rtt = {0}, server = {0};
+    uint64_t misses = 0, mismatched = 0;
+    unsigned long failed = 0;
+    for (unsigned long k = 0; k < started; k++) {
+        if (cl[k].error) {
+            if (!failed++)
+                fprintf(stderr, "client %lu: %s\n", k, cl[k].error);
+            continue;
+        }
+        merge(&rtt, &cl[k].rtt);
+        merge(&server, &cl[k].server);
+        misses += cl[k].misses;
+        mismatched += cl[k].mismatched;
+    }
+
+    double audio = (double) server.samples / SAMPLE_RATE;
+    printf("sessions:  %lu ok, %lu failed, %u-sample blocks (%.2f ms)\n",
+           started - failed, failed + (clients - started), (unsigned) block,
+           (double) block * 1e3 / SAMPLE_RATE);
+    printf("audio:     %.1f s in %.1f s wall (%.1fx realtime)\n", audio,
+           (double) wall / 1e9, wall ? audio * 1e9 / (double) wall : 0);
+    printf("events:    %llu (%llu late, %llu dropped)\n",
+           (unsigned long long) server.events,
+           (unsigned long long) server.late,
+           (unsigned long long) server.dropped);
+    print_latency("client rtt:", &rtt);
+    print_latency("server:    ", &server);
+    if (paced)
+        printf("misses:    %llu of %llu blocks over one period\n",
+               (unsigned long long) misses, (unsigned long long) rtt.blocks);
+    if (verify)
+        printf("verify:    %llu samples differ\n",
+               (unsigned long long) mismatched);
+
+    free(cl);
+    free(tids);
+    return failed || started < clients || mismatched ? 1 : 0;
+}
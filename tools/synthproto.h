@@ -0,0 +1,155 @@
+/*
+ * synthproto.h - Wire protocol shared by tools/synthd and tools/synthload
+ *
+ * One Unix stream connection is one session with its own synth instance
+ * and sample clock, starting at 0. Clients send fixed-size requests:
+ *
+ *   NOTE_ON/NOTE_OFF  schedule @note at session sample @time
+ *   RENDER            render the next @count samples (<= SYNTH_MAX_RENDER)
+ *   STATS             fetch the session's counters
+ *
+ * RENDER and STATS are answered in order with a synth_reply_t followed by
+ * @count q15 samples or one synth_stats_t. Events are applied exactly at
+ * their sample inside the block that covers them; events already in the
+ * past are applied at the start of the next block and counted as late.
+ * Everything is in host byte order, since both ends share the machine.
+ */
+
+#ifndef TOOLS_SYNTHPROTO_H_
+#define TOOLS_SYNTHPROTO_H_
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+
+#define SYNTH_DEFAULT_SOCKET "/tmp/picosynth.sock"
+#define SYNTH_MAX_RENDER 4096 /* Samples per RENDER request */
+#define SYNTH_LAT_BUCKETS 32  /* Latency histogram, bucket k < 2^k ns */
+
+typedef enum {
+    SYNTH_REQ_NOTE_OFF = SONG_EVENT_NOTE_OFF,
+    SYNTH_REQ_NOTE_ON = SONG_EVENT_NOTE_ON,
+    SYNTH_REQ_RENDER,
+    SYNTH_REQ_STATS,
+} synth_req_type_t;
+
+typedef struct {
+    uint8_t type; /* synth_req_type_t */
+    uint8_t note;
+    uint16_t reserved;
+    uint32_t time;  /* NOTE_*: session sample to apply at */
+    uint32_t count; /* RENDER: samples wanted */
+} synth_req_t;
+
+typedef struct {
+    uint32_t type;  /* SYNTH_REQ_RENDER or SYNTH_REQ_STATS */
+    uint32_t count; /* Samples following (RENDER) */
+} synth_reply_t;
+
+/* Per-session counters. Latency is server-side: from a RENDER request
+ * being read to the last byte of its reply being handed to the socket.
+ */
+typedef struct {
+    uint64_t blocks;
+    uint64_t samples;
+    uint64_t events;
+    uint64_t late;    /* Events that arrived after their time */
+    uint64_t dropped; /* Events refused because the queue was full */
+    uint64_t lat_min_ns, lat_max_ns, lat_sum_ns;
+    uint32_t lat_hist[SYNTH_LAT_BUCKETS];
+} synth_stats_t;
+
+static inline void synth_stats_add_latency(synth_stats_t *st, uint64_t ns)
+{
+    int k = 0;
+    while (k < SYNTH_LAT_BUCKETS - 1 && (ns >> k) > 0)
+        k++;
+    st->lat_hist[k]++;
+    if (st->blocks == 0 || ns < st->lat_min_ns)
+        st->lat_min_ns = ns;
+    if (ns > st->lat_max_ns)
+        st->lat_max_ns = ns;
+    st->lat_sum_ns += ns;
+    st->blocks++;
+}
+
+/* Upper bound of the bucket holding quantile @q (0..1), in ns, capped at
+ * the largest latency seen so it never reads above the maximum
+ */
+static inline uint64_t synth_stats_quantile(const synth_stats_t *st, double q)
+{
+    uint64_t total = 0, seen = 0;
+    for (int k = 0; k < SYNTH_LAT_BUCKETS; k++)
+        total += st->lat_hist[k];
+    for (int k = 0; k < SYNTH_LAT_BUCKETS; k++) {
+        seen += st->lat_hist[k];
+        if (total && (double) seen >= q * (double) total) {
+            uint64_t bound = (uint64_t) 1 << k;
+            return bound < st->lat_max_ns ? bound : st->lat_max_ns;
+        }
+    }
+    return 0;
+}
+
+/* Render @n samples from session sample *@pos, applying the sorted events
+ * @ev exactly at their time; events before *@pos are applied first. Returns
+ * the number of events consumed. Server and client reference renders both
+ * go through here, so their output matches sample for sample.
+ */
+static inline uint32_t synth_render_span(song_player_t *p,
+                                         uint32_t *pos,
+                                         const song_event_t *ev,
+                                         uint32_t n_ev,
+                                         q15_t *out,
+                                         uint32_t n)
+{
+    uint32_t used = 0, end = *pos + n;
+
+    while (*pos < end) {
+        while (used < n_ev && ev[used].time <= *pos)
+            song_player_event(p, &ev[used++]);
+        uint32_t stop = used < n_ev && ev[used].time < end ? ev[used].time
+                                                           : end;
+        picosynth_render(p->synth, out, stop - *pos);
+        out += stop - *pos;
+        *pos = stop;
+    }
+    return used;
+}
+
+/* Blocking helpers for clients */
+static inline bool synth_write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        len -= (size_t) w;
+    }
+    return true;
+}
+
+static inline bool synth_read_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        len -= (size_t) r;
+    }
+    return true;
+}
+
+#endif /* TOOLS_SYNTHPROTO_H_ */
@@ -0,0 +1,415 @@
+/*
+ * synthstream - Realtime PCM stream driven by note events on stdin
+ *
+ * Usage:
+ *   synthstream | aplay -t raw -f S16_LE -r 11025 -c 1
+ *   synthstream -o /tmp/synth.fifo -l 30     # Named pipe, 30 ms bound
+ *   printf '@0 on 60\n@500 off 60\n' | synthstream | synthstream -n
+ *
+ * Options:
+ *   -o PATH     Write PCM here instead of stdout (e.g. a named pipe)
+ *   -b N        Samples per block (default: 64)
+ *   -l MS       Bound on audio buffered ahead of the listener (default: 20)
+ *   -v N        Synth voices (default: 8)
+ *   -t SEC      Stop after this much audio (default: run until input ends)
+ *   -n          Null sink: read PCM from stdin at the realtime rate and
+ *               report underruns, instead of synthesizing
+ *
+ * Input is one event per line: "on NOTE" or "off NOTE" (MIDI note numbers)
+ * takes effect in the next block rendered; "@MS on NOTE" is scheduled MS
+ * milliseconds after the stream started. Blank lines and '#' comments are
+ * ignored. When stdin closes, the stream ends after the last scheduled
+ * event has rung out.
+ *
+ * Output is raw host-order 16-bit mono at SAMPLE_RATE. The listener is
+ * assumed to consume at exactly that rate from the first write, so the
+ * audio buffered ahead of it is what has been written minus what the
+ * monotonic clock says it has played. A block is rendered only once it
+ * fits under the bound, which keeps note latency at most the bound plus a
+ * block whatever the pipe's capacity. Falling behind the clock is an
+ * underrun: it is counted and the stream restarts from the current time.
+ */
+
+#define _GNU_SOURCE /* ppoll */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "picosynth.h"
+#include "song.h"
+
+#define MAX_BLOCK 1024
+#define MAX_PENDING 256
+
+typedef struct {
+    song_event_t ev;
+    uint64_t read_ns; /* Arrival of an immediate event, else 0 */
+} pending_t;
+
+typedef struct {
+    uint64_t n;
+    double sum, max;
+} acc_t;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t samples_to_ns(uint64_t n)
+{
+    return n * 1000000000ull / SAMPLE_RATE;
+}
+
+static uint64_t ns_to_samples(uint64_t ns)
+{
+    return ns * SAMPLE_RATE / 1000000000ull;
+}
+
+static void acc_add(acc_t *a, double x)
+{
+    a->n++;
+    a->sum += x;
+    if (x > a->max)
+        a->max = x;
+}
+
+static double acc_avg(const acc_t *a)
+{
+    return a->n ? a->sum / (double) a->n : 0;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR && !stop)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        len -= (size_t) w;
+    }
+    return true;
+}
+
+/* Stable insert keeps same-time events in arrival order */
+static bool queue_event(pending_t *q, uint32_t *n, const pending_t *e)
+{
+    if (*n == MAX_PENDING)
+        return false;
+    uint32_t i = *n;
+    while (i > 0 && q[i - 1].ev.time > e->ev.time) {
+        q[i] = q[i - 1];
+        i--;
+    }
+    q[i] = *e;
+    (*n)++;
+    return true;
+}
+
+/* Parse one input line into @e. Returns false for blank or bad lines. */
+static bool parse_line(char *line, uint64_t pos, pending_t *e, bool *bad)
+{
+    char verb[8];
+    unsigned long ms = 0, note;
+    int used = 0;
+    bool at = false;
+
+    *bad = false;
+    while (*line == ' ' || *line == '\t')
+        line++;
+    if (*line == '\0' || *line == '#')
+        return false;
+    if (*line == '@') {
+        char *end;
+        ms = strtoul(line + 1, &end, 10);
+        at = end != line + 1;
+        line = end;
+    }
+    if (sscanf(line, " %7s %lu %n", verb, &note, &used) < 2 ||
+        line[used] != '\0' || note > 127 || ms > 24 * 3600 * 1000ul ||
+        (strcmp(verb, "on") != 0 && strcmp(verb, "off") != 0)) {
+        *bad = true;
+        return false;
+    }
+    *e = (pending_t) {
+        .ev =
+            {
+                .time = (uint32_t) (at ? ms * SAMPLE_RATE / 1000 : pos),
+                .type = verb[1] == 'n' ? SONG_EVENT_NOTE_ON
+                                       : SONG_EVENT_NOTE_OFF,
+                .note = (uint8_t) note,
+            },
+        .read_ns = at ? 0 : now_ns(),
+    };
+    return true;
+}
+
+/* Consume PCM from stdin as a device would, reporting starvation */
+static int null_sink(uint32_t block)
+{
+    q15_t buf[MAX_BLOCK];
+    uint64_t t0 = 0, consumed = 0, received = 0, missing = 0;
+    uint64_t underruns = 0;
+    acc_t fill = {0};
+    bool starved = false, eof = false;
+
+    /* Start the clock at the first byte, like a device's start threshold */
+    struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR && !stop)
+        ;
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    t0 = now_ns();
+
+    while (!eof && !stop) {
+        uint64_t due = ns_to_samples(now_ns() - t0);
+        int queued = 0;
+        if (ioctl(STDIN_FILENO, FIONREAD, &queued) == 0)
+            acc_add(&fill, (double) queued / 2 * 1e3 / SAMPLE_RATE);
+
+        /* Take what the clock says has been played; missing audio is
+         * replaced by silence and the device carries on
+         */
+        while (consumed < due && !eof) {
+            uint64_t want = due - consumed;
+            size_t len = (size_t) (want < block ? want : block) * 2;
+            ssize_t r = read(STDIN_FILENO, buf, len);
+            if (r > 0) {
+                received += (uint64_t) r;
+                consumed += (uint64_t) r / 2;
+                starved = false;
+            } else if (r == 0) {
+                eof = true;
+            } else if (errno == EAGAIN) {
+                underruns += !starved;
+                starved = true;
+                missing += want;
+                consumed = due;
+            } else if (errno != EINTR) {
+                eof = true;
+            }
+        }
+        struct timespec ts = {.tv_nsec = (long) samples_to_ns(block)};
+        nanosleep(&ts, NULL);
+    }
+
+    fprintf(stderr,
+            "sink: %.2f s received, %llu underruns (%.1f ms silent), "
+            "pipe fill avg %.1f max %.1f ms\n",
+            (double) received / 2 / SAMPLE_RATE,
+            (unsigned long long) underruns,
+            (double) missing * 1e3 / SAMPLE_RATE, acc_avg(&fill), fill.max);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-o path] [-b block] [-l ms] [-v voices] [-t seconds]"
+            "\n       %s -n [-b block]\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    unsigned long block = 64, bound_ms = 20, voices = 8;
+    double seconds = 0;
+    bool sink = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            block = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            bound_ms = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) {
+            voices = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            sink = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    uint64_t bound = bound_ms * SAMPLE_RATE / 1000;
+    if (block == 0 || block > MAX_BLOCK || bound < block ||
+        bound_ms > 10000 || voices == 0 || voices > SONG_MAX_VOICES ||
+        !(seconds >= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct sigaction sa = {.sa_handler = on_signal};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    if (sink)
+        return null_sink((uint32_t) block);
+
+    int out = STDOUT_FILENO;
+    if (output && (out = open(output, O_WRONLY | O_CLOEXEC)) < 0) {
+        perror(output);
+        return 1;
+    }
+    if (isatty(out)) {
+        fprintf(stderr, "Error: refusing to write PCM to a terminal\n");
+        return 1;
+    }
+    picosynth_t *s = song_patch_create(&song_patch_piano, (uint8_t) voices);
+    if (!s) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    song_t empty = {0};
+    song_player_t p;
+    song_player_init(&p, s, &song_patch_piano, &empty);
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+    pending_t pending[MAX_PENDING];
+    uint32_t n_pending = 0;
+    char line[256];
+    size_t line_len = 0;
+    bool input_open = true;
+    uint64_t end = seconds > 0 ? (uint64_t) (seconds * SAMPLE_RATE) : 0;
+    uint64_t last_event = 0, events = 0, dropped = 0, blocks = 0;
+    uint64_t underruns = 0, lost = 0, stalls = 0;
+    acc_t buffered = {0}, note_lat = {0};
+    q15_t buf[MAX_BLOCK];
+
+    uint64_t t0 = now_ns(), written = 0;
+    while (!stop) {
+        uint64_t now = now_ns();
+        uint64_t played = ns_to_samples(now - t0);
+        if (written && played > written) {
+            /* The listener ran dry; resume from here */
+            underruns++;
+            lost += played - written;
+            t0 = now - samples_to_ns(written);
+            played = written;
+        }
+
+        if (end ? written >= end
+                : !input_open && n_pending == 0 &&
+                      written >= last_event + song_patch_piano.tail)
+            break;
+
+        if (written - played + block <= bound) {
+            uint32_t n = 0;
+            while (n < n_pending && pending[n].ev.time <= written) {
+                song_player_event(&p, &pending[n].ev);
+                if (pending[n].read_ns)
+                    acc_add(&note_lat,
+                            (double) (written - played) * 1e3 / SAMPLE_RATE +
+                                (double) (now - pending[n].read_ns) / 1e6);
+                n++;
+            }
+            n_pending -= n;
+            memmove(pending, pending + n, n_pending * sizeof(*pending));
+
+            picosynth_render(s, buf, (uint32_t) block);
+            uint64_t w0 = now_ns();
+            if (!write_all(out, buf, block * sizeof(q15_t)))
+                break;
+            /* A write that blocks for a whole block means the listener is
+             * slower than realtime or the pipe is full
+             */
+            stalls += now_ns() - w0 > samples_to_ns(block);
+            written += block;
+            blocks++;
+            acc_add(&buffered,
+                    (double) (written - played) * 1e3 / SAMPLE_RATE);
+            continue;
+        }
+
+        /* Sleep until the next block fits, or input arrives */
+        uint64_t wake = t0 + samples_to_ns(written + block - bound);
+        struct timespec ts = {0};
+        if (wake > now)
+            ts = (struct timespec) {
+                .tv_sec = (time_t) ((wake - now) / 1000000000ull),
+                .tv_nsec = (long) ((wake - now) % 1000000000ull),
+            };
+        struct pollfd pfd = {.fd = input_open ? STDIN_FILENO : -1,
+                             .events = POLLIN};
+        if (ppoll(&pfd, 1, &ts, NULL) <= 0 || !(pfd.revents & ~POLLNVAL))
+            continue;
+
+        ssize_t r = read(STDIN_FILENO, line + line_len,
+                         sizeof(line) - 1 - line_len);
+        if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+            input_open = false;
+            r = 0;
+            if (line_len)
+                line[line_len++] = '\n';
+        }
+        line_len += (size_t) (r > 0 ? r : 0);
+        char *nl, *start = line;
+        while ((nl = memchr(start, '\n', line_len - (size_t) (start - line)))) {
+            pending_t e;
+            bool bad;
+            *nl = '\0';
+            if (parse_line(start, written, &e, &bad)) {
+                events++;
+                if (queue_event(pending, &n_pending, &e)) {
+                    if (e.ev.time > last_event)
+                        last_event = e.ev.time;
+                } else {
+                    dropped++;
+                }
+            } else if (bad) {
+                fprintf(stderr, "synthstream: bad event '%s'\n", start);
+            }
+            start = nl + 1;
+        }
+        line_len -= (size_t) (start - line);
+        memmove(line, start, line_len);
+        if (line_len == sizeof(line) - 1) {
+            fprintf(stderr, "synthstream: input line too long\n");
+            line_len = 0;
+        }
+    }
+
+    fprintf(stderr,
+            "synthstream: %.2f s in %llu blocks of %lu, %llu events "
+            "(%llu dropped)\n"
+            "  buffered avg %.1f max %.1f ms (bound %lu ms), "
+            "note latency avg %.1f max %.1f ms\n"
+            "  %llu underruns (%.1f ms lost), %llu blocked writes\n",
+            (double) written / SAMPLE_RATE, (unsigned long long) blocks,
+            block, (unsigned long long) events,
+            (unsigned long long) dropped, acc_avg(&buffered), buffered.max,
+            bound_ms, acc_avg(&note_lat), note_lat.max,
+            (unsigned long long) underruns, (double) lost * 1e3 / SAMPLE_RATE,
+            (unsigned long long) stalls);
+
+    picosynth_destroy(s);
+    if (output)
+        close(out);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * wav.h - Minimal 16-bit WAV writer and reader shared by the command-line
+ * tools
+ *
+ * Header fields are written and read in host byte order, as
+ * tests/example.c does; all supported hosts are little-endian.
+ */
+
+#ifndef TOOLS_WAV_H_
+#define TOOLS_WAV_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "picosynth.h"
+
+/* Write a 44-byte header for @samples samples at the current position.
+ * Streaming writers call it once with 0 and again after seeking back.
+ */
+static inline int wav_write_header(FILE *f, uint32_t samples)
+{
+    uint32_t sample_rate = SAMPLE_RATE;
+    uint32_t file_size = samples * 2 + 36;
+    uint32_t byte_rate = SAMPLE_RATE * 2;
+    uint32_t data_size = samples * 2;
+    uint32_t fmt_size = 16;
+    uint16_t format = 1;
+    uint16_t channels = 1;
+    uint16_t block_align = 2;
+    uint16_t bits_per_sample = 16;
+
+    fwrite("RIFF", 1, 4, f);
+    fwrite(&file_size, 4, 1, f);
+    fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f);
+    fwrite(&fmt_size, 4, 1, f);
+    fwrite(&format, 2, 1, f);
+    fwrite(&channels, 2, 1, f);
+    fwrite(&sample_rate, 4, 1, f);
+    fwrite(&byte_rate, 4, 1, f);
+    fwrite(&block_align, 2, 1, f);
+    fwrite(&bits_per_sample, 2, 1, f);
+    fwrite("data", 1, 4, f);
+    return fwrite(&data_size, 4, 1, f) == 1 ? 0 : -1;
+}
+
+/* Write @samples samples from @buf to @path. Returns 0 on success. */
+static inline int wav_write_file(const char *path,
+                                 const q15_t *buf,
+                                 uint32_t samples)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return -1;
+    int ret = wav_write_header(f, samples);
+    if (ret == 0 && fwrite(buf, 2, samples, f) != samples)
+        ret = -1;
+    if (fclose(f) != 0)
+        ret = -1;
+    return ret;
+}
+
+/* Read a 16-bit PCM file from @path into a malloc'd buffer, mixing stereo
+ * down to mono. On success stores the buffer, its sample count and the
+ * file's sample rate and returns 0; other formats fail.
+ */
+static inline int wav_read_file(const char *path,
+                                q15_t **buf,
+                                uint32_t *samples,
+                                uint32_t *rate)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    char id[4];
+    uint32_t size;
+    uint16_t fmt[8] = {0}; /* Format, channels, rate, byte rate, align, bits */
+    int ret = -1;
+
+    if (fread(id, 1, 4, f) != 4 || memcmp(id, "RIFF", 4) ||
+        fread(&size, 4, 1, f) != 1 || fread(id, 1, 4, f) != 4 ||
+        memcmp(id, "WAVE", 4))
+        goto out;
+
+    /* Walk the chunks; fmt must come before data */
+    while (fread(id, 1, 4, f) == 4 && fread(&size, 4, 1, f) == 1) {
+        if (!memcmp(id, "fmt ", 4) && size >= 16) {
+            if (fread(fmt, 2, 8, f) != 8 ||
+                fseek(f, (long) (size - 16 + (size & 1)), SEEK_CUR))
+                goto out;
+        } else if (!memcmp(id, "data", 4)) {
+            uint16_t channels = fmt[1];
+            if (fmt[0] != 1 || fmt[7] != 16 || channels < 1 || channels > 2)
+                goto out;
+            uint32_t n = size / 2 / channels;
+            q15_t *pcm = malloc((size_t) n * channels * sizeof(q15_t) + 1);
+            if (!pcm)
+                goto out;
+            n = (uint32_t) fread(pcm, 2 * channels, n, f);
+            for (uint32_t i = 0; channels == 2 && i < n; i++)
+                pcm[i] = (q15_t) ((pcm[2 * i] + pcm[2 * i + 1]) / 2);
+            *buf = pcm;
+            *samples = n;
+            *rate = (uint32_t) fmt[2] | (uint32_t) fmt[3] << 16;
+            ret = 0;
+            goto out;
+        } else if (fseek(f, (long) (size + (size & 1)), SEEK_CUR)) {
+            goto out;
+        }
+    }
+out:
+    fclose(f);
+    return ret;
+}
+
+#endif /* TOOLS_WAV_H_ */